@@ -0,0 +1,38 @@
+#pragma once
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+/**
+ * Minimal helpers shared by the benchmark executables.
+ */
+class Stopwatch
+{
+public:
+    Stopwatch()
+        : m_start(std::chrono::steady_clock::now())
+    {
+        // No further initialisation
+    }
+
+    /// Seconds elapsed since construction
+    double elapsed() const
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_start).count();
+    }
+
+private:
+    std::chrono::steady_clock::time_point m_start;
+};
+
+/**
+ * Print a single benchmark result as a rate, e.g. "formulas/s".
+ */
+inline void report(const std::string & name, double count, double seconds, const std::string & unit)
+{
+    std::cout << std::left << std::setw(40) << name
+              << std::right << std::setw(14) << std::fixed << std::setprecision(0)
+              << (seconds > 0 ? count / seconds : 0) << " " << unit << "/s" << std::endl;
+}
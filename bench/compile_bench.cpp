@@ -0,0 +1,94 @@
+/*
+ * Measures FormulaCompiler throughput, in formulas per second, for a handful
+ * of typical formula shapes.
+ */
+
+#include <sstream>
+#include <string>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "bench.hpp"
+#include "formula.hpp"
+
+namespace
+{
+    typedef std::vector<std::string> Formulas;
+
+    Formulas makeFormulas(const std::string & shape, int count)
+    {
+        Formulas formulas;
+        formulas.reserve(count);
+        for (int i = 1; i <= count; i++) {
+            std::stringstream ss;
+            if (shape == "literal") {
+                ss << "'Label " << i;
+            } else if (shape == "arithmetic") {
+                ss << "=" << i << " * 2.5 + " << i << " - 1";
+            } else if (shape == "references") {
+                ss << "=A" << i << " * B" << i << " + C" << i;
+            } else if (shape == "concatenation") {
+                ss << "=\"Row \" + A" << i << " + \": \" + B" << i << " + \" of \" + C" << i;
+            } else if (shape == "function") {
+                ss << "=SUM(A" << i << ", B" << i << ", C" << i << " * 2)";
+            }
+            formulas.push_back(ss.str());
+        }
+
+        return formulas;
+    }
+
+    void compileAll(const Formulas & formulas)
+    {
+        FormulaCompiler compiler;
+        for (Formulas::const_iterator itr = formulas.begin(); itr != formulas.end(); itr++) {
+            compiler.compile(*itr);
+        }
+    }
+}
+
+int main()
+{
+    const int count = 200000;
+    const char * shapes[] = { "literal", "arithmetic", "references", "concatenation", "function" };
+
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+        const Formulas formulas = makeFormulas(shapes[i], count);
+
+        // One Formula per string, each with its own temporary compiler
+        {
+            Stopwatch stopwatch;
+            for (Formulas::const_iterator itr = formulas.begin(); itr != formulas.end(); itr++) {
+                Formula formula(*itr);
+            }
+            report(std::string(shapes[i]) + " (Formula ctor)", count, stopwatch.elapsed(), "formulas");
+        }
+
+        // A single reused compiler
+        {
+            Stopwatch stopwatch;
+            compileAll(formulas);
+            report(std::string(shapes[i]) + " (FormulaCompiler)", count, stopwatch.elapsed(), "formulas");
+        }
+
+        // One compiler per thread
+        {
+            const unsigned int numThreads = std::max(1u, std::thread::hardware_concurrency());
+            Stopwatch stopwatch;
+            std::vector<std::thread> threads;
+            for (unsigned int t = 0; t < numThreads; t++) {
+                threads.push_back(std::thread(compileAll, std::cref(formulas)));
+            }
+            for (size_t t = 0; t < threads.size(); t++) {
+                threads[t].join();
+            }
+            std::stringstream name;
+            name << shapes[i] << " (" << numThreads << " threads)";
+            report(name.str(), double(count) * numThreads, stopwatch.elapsed(), "formulas");
+        }
+    }
+
+    return 0;
+}
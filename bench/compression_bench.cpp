@@ -0,0 +1,83 @@
+/*
+ * Measures the memory used by a sheet whose cells are compressed in memory,
+ * compared with the same sheet fully decoded, along with the compression
+ * ratio of each column and the cost of reading and recalculating it.
+ */
+
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "address.hpp"
+#include "bench.hpp"
+#include "sheet.hpp"
+
+namespace
+{
+    /**
+     * Build a table with a low-cardinality label column, an increasing id
+     * column, a column of prices and a column of formulas.
+     */
+    void buildModel(Sheet & sheet, unsigned int rows)
+    {
+        const char * regions[] = {"'North", "'South", "'East", "'West"};
+        for (unsigned int row = 1; row <= rows; row++) {
+            std::stringstream id;
+            id << "=" << 100000 + row;
+            std::stringstream price;
+            price << "=" << (row * 7919) % 1000 << "." << row % 100;
+            std::stringstream formula;
+            formula << "=C" << row << " * 2";
+
+            sheet.setFormula(Address(1, row), regions[(row / 50) % 4]);
+            sheet.setFormula(Address(2, row), id.str());
+            sheet.setFormula(Address(3, row), price.str());
+            sheet.setFormula(Address(4, row), formula.str());
+        }
+    }
+
+    void run(const std::string & name, unsigned int rows, std::size_t budget)
+    {
+        Sheet sheet;
+        sheet.setCompression(budget);
+        buildModel(sheet, rows);
+        sheet.recalculate();
+
+        Stopwatch recalculation;
+        sheet.recalculate();
+        report(name + ", recalculate", 4.0 * rows, recalculation.elapsed(), "cells");
+
+        Stopwatch reads;
+        std::size_t length = 0;
+        for (unsigned int row = 1; row <= rows; row++) {
+            length += sheet.getValue(Address(1, row)).size();
+        }
+        report(name + ", getValue", rows, reads.elapsed(), "cells");
+
+        const PagingStats stats = sheet.getPagingStats();
+        std::cout << "    " << std::fixed << std::setprecision(1)
+                  << (stats.residentBytes + stats.compressedBytes) / 1048576.0 << " MB ("
+                  << stats.residentBytes / 1048576.0 << " MB decoded, "
+                  << stats.compressedBytes / 1048576.0 << " MB compressed)" << std::endl;
+
+        const std::vector<ColumnCompression> columns = sheet.getColumnCompression();
+        for (std::vector<ColumnCompression>::const_iterator itr = columns.begin(); itr != columns.end(); itr++) {
+            std::cout << "    column " << itr->column << ": ratio " << std::setprecision(1) << itr->getRatio()
+                      << " (" << itr->plainSegments << " plain, " << itr->dictionarySegments << " dictionary, "
+                      << itr->deltaSegments << " delta)" << std::endl;
+        }
+    }
+}
+
+int main()
+{
+    const unsigned int rows = 100000;
+
+    run("decoded", rows, std::size_t(-1));
+    run("compressed, 4 MB budget", rows, 4 * 1024 * 1024);
+
+    return 0;
+}
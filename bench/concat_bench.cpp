@@ -0,0 +1,50 @@
+/*
+ * Measures recalculation of a report column that builds one long string by
+ * concatenating the value of the previous cell with an item on each row.
+ */
+
+#include <cstddef>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "address.hpp"
+#include "bench.hpp"
+#include "sheet.hpp"
+
+namespace
+{
+    void run(unsigned int rows)
+    {
+        Sheet sheet;
+        sheet.setFormula(Address("A1"), "'Items:");
+        for (unsigned int row = 2; row <= rows; row++) {
+            std::stringstream formula;
+            formula << "=A" << row - 1 << " + \" \" + B" << row;
+            std::stringstream item;
+            item << "'item" << row;
+            sheet.setFormula(Address(1, row), formula.str());
+            sheet.setFormula(Address(2, row), item.str());
+        }
+
+        std::stringstream name;
+        name << rows << " rows";
+
+        Stopwatch recalculation;
+        sheet.recalculate();
+        report(name.str() + ", recalculate", rows, recalculation.elapsed(), "cells");
+
+        Stopwatch output;
+        const std::string value = sheet.getValue(Address(1, rows));
+        report(name.str() + ", getValue of last cell", value.size(), output.elapsed(), "bytes");
+    }
+}
+
+int main()
+{
+    run(5000);
+    run(20000);
+    run(80000);
+
+    return 0;
+}
@@ -0,0 +1,84 @@
+/*
+ * Measures conditional function throughput, in calls per second, for many
+ * SUMIF, COUNTIF and AVERAGEIFS calls over the same pair of 100,000 row
+ * columns. Later passes either change a cell outside of the columns, so that
+ * every result can be reused, or change a value within them, so that every
+ * call scans the columns again, using criteria compiled by the first pass.
+ */
+
+#include <sstream>
+#include <string>
+
+#include "address.hpp"
+#include "bench.hpp"
+#include "sheet.hpp"
+
+namespace
+{
+    const unsigned int ROWS = 100000;
+
+    /// Column A holds one of ten region names, and column B holds numbers
+    void buildColumns(Sheet & sheet)
+    {
+        for (unsigned int row = 1; row <= ROWS; row++) {
+            std::stringstream region;
+            region << "'region" << row % 10;
+            sheet.setFormula(Address(1, row), region.str());
+
+            std::stringstream number;
+            number << "=" << (row * 7919) % 1000;
+            sheet.setFormula(Address(2, row), number.str());
+        }
+    }
+
+    void buildCalls(Sheet & sheet, unsigned int count, const std::string & function)
+    {
+        for (unsigned int i = 0; i < count; i++) {
+            std::stringstream formula;
+            if (function == "SUMIF") {
+                formula << "=SUMIF(B1:B" << ROWS << ", \">" << i % 1000 << "\")";
+            } else if (function == "COUNTIF") {
+                formula << "=COUNTIF(A1:A" << ROWS << ", \"region" << i % 10 << "\")";
+            } else {
+                formula << "=AVERAGEIFS(B1:B" << ROWS << ", A1:A" << ROWS << ", \"region" << i % 10
+                        << "\", B1:B" << ROWS << ", \"<" << i % 1000 << "\")";
+            }
+            sheet.setFormula(Address(4, i + 1), formula.str());
+        }
+    }
+}
+
+int main()
+{
+    const unsigned int calls = 200;
+    const int passes = 5;
+
+    const char * functions[] = { "SUMIF", "COUNTIF", "AVERAGEIFS" };
+    for (int i = 0; i < 3; i++) {
+        Sheet sheet;
+        buildColumns(sheet);
+        buildCalls(sheet, calls, functions[i]);
+
+        Stopwatch first;
+        sheet.recalculate();
+        report(std::string(functions[i]) + ", first pass", calls, first.elapsed(), "calls");
+
+        Stopwatch unchanged;
+        for (int pass = 0; pass < passes; pass++) {
+            sheet.setFormula(Address(6, 1), "=1");
+            sheet.recalculate();
+        }
+        report(std::string(functions[i]) + ", columns unchanged", double(calls) * passes, unchanged.elapsed(),
+            "calls");
+
+        Stopwatch changed;
+        for (int pass = 0; pass < passes; pass++) {
+            sheet.setFormula(Address(2, ROWS - pass), "=1");
+            sheet.recalculate();
+        }
+        report(std::string(functions[i]) + ", column changed", double(calls) * passes, changed.elapsed(),
+            "calls");
+    }
+
+    return 0;
+}
@@ -0,0 +1,110 @@
+/*
+ * Measures how quickly precedents and dependents are traced on a sheet of a
+ * million cells: building the graph of references, direct and transitive
+ * queries, and queries for whether one cell depends on another. Each row
+ * holds an input, three cells derived from it, and a running total that
+ * refers to the total in the row above, so transitive queries from the top
+ * of the sheet reach most of it.
+ */
+
+#include <cstdlib>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "address.hpp"
+#include "bench.hpp"
+#include "range.hpp"
+#include "sheet.hpp"
+
+namespace
+{
+    void buildTable(Sheet & sheet, unsigned int rows)
+    {
+        for (unsigned int row = 1; row <= rows; row++) {
+            std::stringstream a, b, c, d, e;
+            a << "=" << row;
+            b << "=A" << row << " + 1";
+            c << "=B" << row << " * 2";
+            d << "=C" << row << " + B" << row;
+            e << "=D" << row;
+            if (row > 1) {
+                e << " + E" << row - 1;
+            }
+
+            sheet.setFormula(Address(1, row), a.str());
+            sheet.setFormula(Address(2, row), b.str());
+            sheet.setFormula(Address(3, row), c.str());
+            sheet.setFormula(Address(4, row), d.str());
+            sheet.setFormula(Address(5, row), e.str());
+        }
+    }
+}
+
+int main()
+{
+    const unsigned int rows = 200000;
+    const int queries = 10000;
+    const int transitiveQueries = 10;
+
+    Sheet sheet;
+    buildTable(sheet, rows);
+    sheet.recalculate();
+
+    std::srand(1);
+    std::vector<Address> addresses;
+    for (int i = 0; i < queries; i++) {
+        addresses.push_back(Address(1 + std::rand() % 5, 1 + std::rand() % rows));
+    }
+
+    std::size_t found = 0;
+    {
+        // The first query builds the graph
+        Stopwatch stopwatch;
+        found += sheet.getPrecedents(Range(Address(1, 1), Address(1, 1)), false).size();
+        report("graph build", double(rows) * 5, stopwatch.elapsed(), "cells");
+    }
+
+    {
+        Stopwatch stopwatch;
+        for (std::vector<Address>::const_iterator itr = addresses.begin(); itr != addresses.end(); itr++) {
+            found += sheet.getPrecedents(Range(*itr, *itr), false).size();
+            found += sheet.getDependents(Range(*itr, *itr), false).size();
+        }
+        report("direct precedents and dependents", queries * 2, stopwatch.elapsed(), "queries");
+    }
+
+    {
+        Stopwatch stopwatch;
+        for (int i = 0; i < transitiveQueries; i++) {
+            found += sheet.getPrecedents(Range(Address(5, rows - i), Address(5, rows - i)), true).size();
+        }
+        report("transitive precedents (1M cells)", transitiveQueries, stopwatch.elapsed(), "queries");
+    }
+
+    {
+        Stopwatch stopwatch;
+        for (int i = 0; i < transitiveQueries; i++) {
+            found += sheet.getDependents(Range(Address(1, i + 1), Address(1, i + 1)), true).size();
+        }
+        report("transitive dependents (200K cells)", transitiveQueries, stopwatch.elapsed(), "queries");
+    }
+
+    {
+        // The first query numbers the cells, so that later ones can skip
+        // cells that are too high to lead to the dependent
+        Stopwatch stopwatch;
+        found += sheet.dependsOn(Address(5, 1), Address(1, 1));
+        report("levels", double(rows) * 5, stopwatch.elapsed(), "cells");
+    }
+
+    {
+        Stopwatch stopwatch;
+        for (std::vector<Address>::const_iterator itr = addresses.begin(); itr != addresses.end(); itr++) {
+            found += sheet.dependsOn(Address(5, itr->row), *itr);
+        }
+        report("depends on", queries, stopwatch.elapsed(), "queries");
+    }
+
+    return found > 0 ? 0 : 1;
+}
@@ -0,0 +1,115 @@
+/*
+ * Measures how quickly rows are inserted into, and deleted from, a sheet of
+ * half a million cells, where every reference that crosses the edit point
+ * must be rewritten. Each row holds an input, three cells derived from it,
+ * and a running total that refers to the total in the row above. Edits near
+ * the end of the sheet only touch the rows below them, while edits at the
+ * top move every cell, and are compared with parsing every formula again.
+ */
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "address.hpp"
+#include "bench.hpp"
+#include "formula.hpp"
+#include "sheet.hpp"
+
+namespace
+{
+    void buildTable(Sheet & sheet, unsigned int rows)
+    {
+        for (unsigned int row = 1; row <= rows; row++) {
+            std::stringstream a, b, c, d, e;
+            a << "=" << row;
+            b << "=A" << row << " + 1";
+            c << "=B" << row << " * 2";
+            d << "=C" << row << " + B" << row;
+            e << "=SUM(A" << row << ":D" << row << ")";
+            if (row > 1) {
+                e << " + E" << row - 1;
+            }
+
+            sheet.setFormula(Address(1, row), a.str());
+            sheet.setFormula(Address(2, row), b.str());
+            sheet.setFormula(Address(3, row), c.str());
+            sheet.setFormula(Address(4, row), d.str());
+            sheet.setFormula(Address(5, row), e.str());
+        }
+    }
+}
+
+int main()
+{
+    const unsigned int rows = 100000;
+    const int edits = 200;
+    const int bulkEdits = 5;
+    const double cells = double(rows) * 5;
+
+    Sheet sheet;
+    buildTable(sheet, rows);
+    sheet.recalculate();
+
+    {
+        // The first edit builds the graph of references
+        Stopwatch stopwatch;
+        sheet.insertRows(rows - 10, 1);
+        sheet.deleteRows(rows - 10, 1);
+        report("first insert and delete", 2, stopwatch.elapsed(), "edits");
+    }
+
+    {
+        Stopwatch stopwatch;
+        for (int i = 0; i < edits; i++) {
+            sheet.insertRows(rows - 10, 1);
+        }
+        report("insert near the end", edits, stopwatch.elapsed(), "edits");
+    }
+
+    {
+        Stopwatch stopwatch;
+        for (int i = 0; i < edits; i++) {
+            sheet.deleteRows(rows - 10, 1);
+        }
+        report("delete near the end", edits, stopwatch.elapsed(), "edits");
+    }
+
+    {
+        Stopwatch stopwatch;
+        for (int i = 0; i < bulkEdits; i++) {
+            sheet.insertRows(1, 1);
+        }
+        report("insert at the top", double(bulkEdits) * cells, stopwatch.elapsed(), "cells");
+    }
+
+    {
+        Stopwatch stopwatch;
+        for (int i = 0; i < bulkEdits; i++) {
+            sheet.deleteRows(1, 1);
+        }
+        report("delete at the top", double(bulkEdits) * cells, stopwatch.elapsed(), "cells");
+    }
+
+    // Rewriting every formula by hand would at least parse each one again
+    const std::vector<Address> addresses = sheet.getAddresses();
+    std::vector<std::string> formulas;
+    for (std::vector<Address>::const_iterator itr = addresses.begin(); itr != addresses.end(); itr++) {
+        formulas.push_back(sheet.getFormula(*itr));
+    }
+
+    std::size_t nodes = 0;
+    {
+        FormulaCompiler compiler;
+        Stopwatch stopwatch;
+        for (int i = 0; i < bulkEdits; i++) {
+            for (std::vector<std::string>::const_iterator itr = formulas.begin(); itr != formulas.end(); itr++) {
+                nodes += compiler.compile(*itr).getReferences().size();
+            }
+        }
+        report("parse every formula", double(bulkEdits) * cells, stopwatch.elapsed(), "cells");
+    }
+
+    sheet.recalculate();
+    return nodes > 0 && sheet.getFormula(Address(5, 2)) == "=SUM(A2:D2) + E1" ? 0 : 1;
+}
@@ -0,0 +1,113 @@
+/*
+ * Measures sustained durable edits per second through a Journal, comparing a
+ * commit after every edit on one thread with concurrent editors whose
+ * commits are grouped, and with one commit per batch of edits. Also measures
+ * how quickly the journal is replayed.
+ */
+
+#include <cstdio>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "address.hpp"
+#include "bench.hpp"
+#include "journal.hpp"
+#include "sheet.hpp"
+
+namespace
+{
+    const char * const PATH = "journal_bench.log";
+
+    std::string formulaFor(int i)
+    {
+        std::stringstream formula;
+        formula << "=A" << (i % 100 + 1) << " * " << i << " + 1";
+        return formula.str();
+    }
+
+    /// Each of several threads edits its own column, then commits each edit
+    void editConcurrently(Sheet & sheet, Journal & journal, int threadCount, int editCount)
+    {
+        std::mutex sheetMutex;
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; t++) {
+            threads.push_back(std::thread([&, t]() {
+                for (int i = 0; i < editCount / threadCount; i++) {
+                    {
+                        std::lock_guard<std::mutex> lock(sheetMutex);
+                        sheet.setFormula(Address(t + 2, i % 1000 + 1), formulaFor(i));
+                    }
+                    journal.commit();
+                }
+            }));
+        }
+
+        for (std::vector<std::thread>::iterator itr = threads.begin(); itr != threads.end(); itr++) {
+            itr->join();
+        }
+    }
+}
+
+int main()
+{
+    const int editCount = 2000;
+
+    std::remove(PATH);
+    std::remove((std::string(PATH) + ".snapshot").c_str());
+
+    {
+        Journal journal(PATH);
+        Sheet sheet;
+        sheet.setJournal(&journal);
+
+        {
+            Stopwatch stopwatch;
+            for (int i = 0; i < editCount; i++) {
+                sheet.setFormula(Address(1, i % 1000 + 1), formulaFor(i));
+                journal.commit();
+            }
+            report("commit per edit, 1 thread", editCount, stopwatch.elapsed(), "edits");
+        }
+
+        for (int threadCount = 4; threadCount <= 16; threadCount *= 4) {
+            const JournalStats before = journal.getStats();
+            Stopwatch stopwatch;
+            editConcurrently(sheet, journal, threadCount, editCount);
+            const double seconds = stopwatch.elapsed();
+
+            std::stringstream name;
+            name << "group commit, " << threadCount << " threads";
+            report(name.str(), editCount, seconds, "edits");
+
+            const JournalStats after = journal.getStats();
+            std::cout << "    " << double(after.records - before.records) / double(after.syncs - before.syncs)
+                      << " edits per sync" << std::endl;
+        }
+
+        {
+            Stopwatch stopwatch;
+            for (int i = 0; i < editCount * 10; i++) {
+                sheet.setFormula(Address(20, i % 1000 + 1), formulaFor(i));
+                if (i % 100 == 99) {
+                    journal.commit();
+                }
+            }
+            report("commit per 100 edits, 1 thread", editCount * 10, stopwatch.elapsed(), "edits");
+        }
+    }
+
+    // Replay everything recorded above into an empty sheet
+    {
+        Journal journal(PATH);
+        Sheet sheet;
+        Stopwatch stopwatch;
+        const std::size_t count = journal.replay(sheet);
+        report("replay", double(count), stopwatch.elapsed(), "records");
+    }
+
+    std::remove(PATH);
+    return 0;
+}
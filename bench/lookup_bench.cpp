@@ -0,0 +1,92 @@
+/*
+ * Measures lookup throughput, in lookups per second, for many MATCH and
+ * VLOOKUP calls against the same 100,000 row key column. The first pass
+ * reads the column into a table and builds its index; later passes change
+ * one key and then recalculate, so the table is updated rather than built
+ * again. For comparison, the same number of passes over the column is made
+ * by formulas that read every cell of it, as a lookup without an index would.
+ */
+
+#include <sstream>
+#include <string>
+
+#include "address.hpp"
+#include "bench.hpp"
+#include "sheet.hpp"
+
+namespace
+{
+    const unsigned int KEYS = 100000;
+
+    /// Column A holds text keys, and column B holds numbers in ascending order
+    void buildKeys(Sheet & sheet)
+    {
+        for (unsigned int row = 1; row <= KEYS; row++) {
+            std::stringstream key;
+            key << "'key" << row;
+            sheet.setFormula(Address(1, row), key.str());
+
+            std::stringstream number;
+            number << "=" << row * 2;
+            sheet.setFormula(Address(2, row), number.str());
+        }
+    }
+
+    void buildLookups(Sheet & sheet, unsigned int count, const std::string & function)
+    {
+        for (unsigned int i = 0; i < count; i++) {
+            const unsigned int row = 1 + (i * 7919) % KEYS;
+            std::stringstream formula;
+            if (function == "MATCH") {
+                formula << "=MATCH(\"key" << row << "\", A1:A" << KEYS << ", 0)";
+            } else if (function == "VLOOKUP") {
+                formula << "=VLOOKUP(" << row * 2 + 1 << ", B1:C" << KEYS << ", 1)";
+            } else {
+                formula << "=SUM(B1:B" << KEYS << ")";
+            }
+            sheet.setFormula(Address(4, i + 1), formula.str());
+        }
+    }
+}
+
+int main()
+{
+    const unsigned int lookups = 10000;
+    const int passes = 5;
+
+    const char * functions[] = { "MATCH", "VLOOKUP" };
+    for (int i = 0; i < 2; i++) {
+        Sheet sheet;
+        buildKeys(sheet);
+        buildLookups(sheet, lookups, functions[i]);
+
+        Stopwatch first;
+        sheet.recalculate();
+        report(std::string(functions[i]) + ", first pass", lookups, first.elapsed(), "lookups");
+
+        Stopwatch later;
+        for (int pass = 0; pass < passes; pass++) {
+            sheet.setFormula(Address(1, pass + 1), "'changed");
+            sheet.setFormula(Address(2, KEYS - pass), "=1");
+            sheet.recalculate();
+        }
+        report(std::string(functions[i]) + ", after each edit", double(lookups) * passes, later.elapsed(),
+            "lookups");
+    }
+
+    // Far fewer scans are made, since each one reads the whole column
+    const unsigned int scans = 100;
+    Sheet sheet;
+    buildKeys(sheet);
+    buildLookups(sheet, scans, "SUM");
+    sheet.recalculate();
+
+    Stopwatch stopwatch;
+    for (int pass = 0; pass < passes; pass++) {
+        sheet.setFormula(Address(2, KEYS - pass), "=1");
+        sheet.recalculate();
+    }
+    report("scan of the key column", double(scans) * passes, stopwatch.elapsed(), "scans");
+
+    return 0;
+}
@@ -0,0 +1,115 @@
+/*
+ * Measures matrix multiplication throughput, in floating point operations per
+ * second, for the blocked kernel used by MMULT compared with a simple triple
+ * loop, at several sizes. Also measures a sheet in which MMULT multiplies two
+ * ranges of cells and spills the product, including the cost of reading the
+ * operands from the cells and writing every spilled value.
+ */
+
+#include <sstream>
+#include <string>
+
+#include "address.hpp"
+#include "bench.hpp"
+#include "matrix.hpp"
+#include "sheet.hpp"
+
+namespace
+{
+    Matrix makeMatrix(std::size_t size, unsigned int seed)
+    {
+        Matrix matrix(size, size);
+        for (std::size_t i = 0; i < matrix.values.size(); i++) {
+            matrix.values[i] = double((i * 7919 + seed) % 1000) / 100.0;
+        }
+
+        return matrix;
+    }
+
+    /// Multiply two matrices with the obvious loops, as a baseline
+    void multiplySimply(const Matrix & lhs, const Matrix & rhs, Matrix & product)
+    {
+        product = Matrix(lhs.rows, rhs.columns);
+        for (std::size_t i = 0; i < lhs.rows; i++) {
+            for (std::size_t j = 0; j < rhs.columns; j++) {
+                double sum = 0;
+                for (std::size_t k = 0; k < lhs.columns; k++) {
+                    sum += lhs.at(i, k) * rhs.at(k, j);
+                }
+                product.at(i, j) = sum;
+            }
+        }
+    }
+
+    /// Fill a square block of cells, with its top left corner in the given column
+    void buildBlock(Sheet & sheet, unsigned int column, unsigned int size)
+    {
+        for (unsigned int row = 1; row <= size; row++) {
+            for (unsigned int i = 0; i < size; i++) {
+                std::stringstream formula;
+                formula << "=" << (row * 7919 + i + column) % 1000;
+                sheet.setFormula(Address(column + i, row), formula.str());
+            }
+        }
+    }
+}
+
+int main()
+{
+    const std::size_t sizes[] = { 64, 256, 1024 };
+    for (int i = 0; i < 3; i++) {
+        const std::size_t size = sizes[i];
+        const double operations = 2.0 * double(size) * double(size) * double(size);
+        const Matrix lhs = makeMatrix(size, 1);
+        const Matrix rhs = makeMatrix(size, 2);
+        Matrix product;
+
+        std::stringstream name;
+        name << size << "x" << size;
+
+        const int repeats = size < 1024 ? 10 : 1;
+        Stopwatch simple;
+        for (int repeat = 0; repeat < repeats; repeat++) {
+            multiplySimply(lhs, rhs, product);
+        }
+        report(name.str() + ", simple loops", operations * repeats, simple.elapsed(), "flops");
+
+        Stopwatch blocked;
+        for (int repeat = 0; repeat < repeats; repeat++) {
+            multiplyMatrices(lhs, rhs, product);
+        }
+        report(name.str() + ", blocked kernel", operations * repeats, blocked.elapsed(), "flops");
+    }
+
+    // MMULT of two 200x200 ranges, spilling a product of 40,000 cells
+    const unsigned int size = 200;
+    Sheet sheet;
+    buildBlock(sheet, 1, size);
+    buildBlock(sheet, size + 1, size);
+    std::stringstream formula;
+    formula << "=MMULT(" << Address(1, 1).toString() << ":" << Address(size, size).toString() << ", "
+            << Address(size + 1, 1).toString() << ":" << Address(2 * size, size).toString() << ")";
+    sheet.setFormula(Address(2 * size + 2, 1), formula.str());
+    sheet.recalculate();
+
+    const int passes = 5;
+    Stopwatch recalculation;
+    for (int pass = 0; pass < passes; pass++) {
+        std::stringstream value;
+        value << "=" << pass;
+        sheet.setFormula(Address(1, 1), value.str());
+        sheet.recalculate();
+    }
+    report("MMULT 200x200 cells, recalculation", double(passes), recalculation.elapsed(), "passes");
+
+    Stopwatch reads;
+    std::size_t length = 0;
+    for (unsigned int row = 1; row <= size; row++) {
+        for (unsigned int column = 0; column < size; column++) {
+            length += sheet.getValue(Address(2 * size + 2 + column, row)).size();
+        }
+    }
+    report("MMULT 200x200 cells, spilled reads", double(size) * size, reads.elapsed(), "cells");
+
+    return length > 0 ? 0 : 1;
+}
@@ -0,0 +1,78 @@
+/*
+ * Measures recalculation of a sheet that is paged to a file, in cells per
+ * second, for a range of memory budgets, along with the cache hit rate and
+ * the number of bytes read from the file.
+ */
+
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "address.hpp"
+#include "bench.hpp"
+#include "sheet.hpp"
+
+namespace
+{
+    /**
+     * Build a column of running totals, and a second column that reads the
+     * first column in reverse, so that precedents are spread across blocks.
+     */
+    void buildModel(Sheet & sheet, unsigned int rows)
+    {
+        sheet.setFormula(Address("A1"), "=1");
+        for (unsigned int row = 2; row <= rows; row++) {
+            std::stringstream formula;
+            formula << "=A" << row - 1 << " + 1";
+            sheet.setFormula(Address(1, row), formula.str());
+        }
+
+        for (unsigned int row = 1; row <= rows; row++) {
+            std::stringstream formula;
+            formula << "=A" << rows - row + 1 << " * 2 + A" << row;
+            sheet.setFormula(Address(2, row), formula.str());
+        }
+    }
+
+    void run(const std::string & name, unsigned int rows, std::size_t budget)
+    {
+        Sheet sheet;
+        if (budget > 0) {
+            sheet.setPaging("paging_bench.dat", budget);
+        }
+
+        buildModel(sheet, rows);
+        sheet.recalculate();
+
+        // Every cell is recalculated, but no values change
+        const PagingStats before = sheet.getPagingStats();
+        Stopwatch stopwatch;
+        sheet.recalculate();
+        report(name, 2.0 * rows, stopwatch.elapsed(), "cells");
+
+        if (budget > 0) {
+            const PagingStats after = sheet.getPagingStats();
+            const std::uint64_t hits = after.hits - before.hits;
+            const std::uint64_t misses = after.misses - before.misses;
+            std::cout << "    hit rate " << std::setprecision(3)
+                      << (hits + misses > 0 ? double(hits) / double(hits + misses) : 1.0)
+                      << ", " << std::setprecision(1) << (after.bytesRead - before.bytesRead) / 1048576.0
+                      << " MB read, " << (after.bytesWritten - before.bytesWritten) / 1048576.0
+                      << " MB written" << std::endl;
+        }
+    }
+}
+
+int main()
+{
+    const unsigned int rows = 100000;
+
+    run("in memory", rows, 0);
+    run("paged, 64 MB budget", rows, 64 * 1024 * 1024);
+    run("paged, 4 MB budget", rows, 4 * 1024 * 1024);
+    run("paged, 256 KB budget", rows, 256 * 1024);
+
+    return 0;
+}
@@ -0,0 +1,78 @@
+/*
+ * Measures how quickly the formulas whose ranges contain a cell are found, in
+ * lookups per second, using a RangeIndex compared with checking every range.
+ * The ranges are running totals down a long column, as produced by filling
+ * down =SUM(A$1:A1), along with a scattering of small blocks, which is the
+ * case where a linear scan hurts most.
+ */
+
+#include <cstdlib>
+#include <vector>
+
+#include "address.hpp"
+#include "bench.hpp"
+#include "range.hpp"
+#include "range_index.hpp"
+
+int main()
+{
+    const unsigned int rows = 20000;
+    const unsigned int blocks = 20000;
+    const int lookups = 20000;
+
+    std::srand(1);
+    std::vector<std::vector<Range> > ranges;
+    for (unsigned int row = 1; row <= rows; row++) {
+        ranges.push_back(std::vector<Range>(1, Range(Address(1, 1), Address(1, row))));
+    }
+    for (unsigned int i = 0; i < blocks; i++) {
+        const Address first(2 + std::rand() % 50, 1 + std::rand() % rows);
+        ranges.push_back(std::vector<Range>(1, Range(first, Address(first.column + 3, first.row + 10))));
+    }
+
+    std::vector<Address> addresses;
+    for (int i = 0; i < lookups; i++) {
+        addresses.push_back(Address(1 + std::rand() % 60, 1 + std::rand() % rows));
+    }
+
+    RangeIndex index;
+    {
+        Stopwatch stopwatch;
+        for (std::size_t owner = 0; owner < ranges.size(); owner++) {
+            index.set(owner, ranges[owner]);
+        }
+
+        // The first lookup builds the trees
+        std::vector<RangeIndex::Owner> owners;
+        index.findCovering(Address(1, 1), owners);
+        report("index build", double(ranges.size()), stopwatch.elapsed(), "ranges");
+    }
+
+    std::size_t found = 0;
+    {
+        Stopwatch stopwatch;
+        std::vector<RangeIndex::Owner> owners;
+        for (std::vector<Address>::const_iterator itr = addresses.begin(); itr != addresses.end(); itr++) {
+            owners.clear();
+            index.findCovering(*itr, owners);
+            found += owners.size();
+        }
+        report("index lookup", lookups, stopwatch.elapsed(), "lookups");
+    }
+
+    {
+        Stopwatch stopwatch;
+        for (std::vector<Address>::const_iterator itr = addresses.begin(); itr != addresses.end(); itr++) {
+            std::vector<std::size_t> owners;
+            for (std::size_t owner = 0; owner < ranges.size(); owner++) {
+                if (ranges[owner][0].contains(*itr)) {
+                    owners.push_back(owner);
+                }
+            }
+            found -= owners.size();
+        }
+        report("scan", lookups, stopwatch.elapsed(), "lookups");
+    }
+
+    return found == 0 ? 0 : 1;
+}
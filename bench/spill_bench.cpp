@@ -0,0 +1,84 @@
+/*
+ * Measures a single array formula over two 100,000 row columns, which spills
+ * its results down the column beside them, compared with a column of 100,000
+ * formulas that have been filled down. Reports the time taken to set the
+ * formulas, recalculation throughput (cells/second) after an edit to the
+ * inputs, and how quickly the results are read back.
+ */
+
+#include <sstream>
+#include <string>
+
+#include "address.hpp"
+#include "bench.hpp"
+#include "sheet.hpp"
+
+namespace
+{
+    const unsigned int ROWS = 100000;
+
+    void buildInputs(Sheet & sheet)
+    {
+        for (unsigned int row = 1; row <= ROWS; row++) {
+            std::stringstream a;
+            std::stringstream b;
+            a << "=" << row;
+            b << "=" << row % 100 << ".5";
+            sheet.setFormula(Address(1, row), a.str());
+            sheet.setFormula(Address(2, row), b.str());
+        }
+    }
+
+    void buildResults(Sheet & sheet, bool spilled)
+    {
+        if (spilled) {
+            std::stringstream formula;
+            formula << "=A1:A" << ROWS << " * B1:B" << ROWS << " + A1:A" << ROWS << " * 2";
+            sheet.setFormula(Address(3, 1), formula.str());
+            return;
+        }
+
+        for (unsigned int row = 1; row <= ROWS; row++) {
+            std::stringstream formula;
+            formula << "=A" << row << " * B" << row << " + A" << row << " * 2";
+            sheet.setFormula(Address(3, row), formula.str());
+        }
+    }
+}
+
+int main()
+{
+    const int passes = 5;
+    for (int spilled = 1; spilled >= 0; spilled--) {
+        const std::string name = spilled ? "array formula" : "filled down";
+        Sheet sheet;
+        buildInputs(sheet);
+
+        Stopwatch building;
+        buildResults(sheet, spilled != 0);
+        sheet.recalculate();
+        report(name + ", set and first pass", ROWS, building.elapsed(), "cells");
+
+        Stopwatch recalculation;
+        for (int pass = 0; pass < passes; pass++) {
+            std::stringstream value;
+            value << "=" << pass;
+            sheet.setFormula(Address(2, ROWS / 2), value.str());
+            sheet.recalculate();
+        }
+        report(name + ", recalculation", double(ROWS) * passes, recalculation.elapsed(), "cells");
+
+        Stopwatch reads;
+        std::size_t length = 0;
+        for (unsigned int row = 1; row <= ROWS; row++) {
+            length += sheet.getValue(Address(3, row)).size();
+        }
+        report(name + ", reads", ROWS, reads.elapsed(), "cells");
+
+        if (length == 0) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
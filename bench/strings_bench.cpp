@@ -0,0 +1,61 @@
+/*
+ * Measures how much text is shared once the formulas of a sheet, and the
+ * literals and identifiers within them, are interned, along with the cost of
+ * loading and recalculating the sheet.
+ */
+
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+#include "address.hpp"
+#include "bench.hpp"
+#include "sheet.hpp"
+
+namespace
+{
+    /**
+     * Build a table with a repeated label column, a column of numbers and a
+     * column of formulas that call the same functions with the same literals
+     * on every row.
+     */
+    void buildModel(Sheet & sheet, unsigned int rows)
+    {
+        const char * statuses[] = {"'Open", "'Closed", "'Pending"};
+        for (unsigned int row = 1; row <= rows; row++) {
+            std::stringstream amount;
+            amount << "=" << (row * 7919) % 1000;
+            std::stringstream formula;
+            formula << "=IF(AND(B" << row << ">500, NOT(A" << row << "=\"Closed\")), \"Review\", \"Ok\")";
+
+            sheet.setFormula(Address(1, row), statuses[row % 3]);
+            sheet.setFormula(Address(2, row), amount.str());
+            sheet.setFormula(Address(3, row), formula.str());
+        }
+    }
+}
+
+int main()
+{
+    const unsigned int rows = 100000;
+
+    Sheet sheet;
+    Stopwatch load;
+    buildModel(sheet, rows);
+    report("load", 3.0 * rows, load.elapsed(), "cells");
+
+    Stopwatch recalculation;
+    sheet.recalculate();
+    report("recalculate", 3.0 * rows, recalculation.elapsed(), "cells");
+
+    const StringPoolStats stats = sheet.getStringStats();
+    std::cout << "    " << stats.strings << " strings, " << stats.handles << " references" << std::endl;
+    std::cout << "    " << std::fixed << std::setprecision(1)
+              << stats.referencedBytes / 1048576.0 << " MB of text stored as "
+              << stats.uniqueBytes / 1048576.0 << " MB ("
+              << stats.getBytesSaved() / 1048576.0 << " MB saved)" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,76 @@
+/*
+ * Measures a sensitivity sweep, in input values per second, comparing one
+ * full recalculation per value with a single batched Sheet::sweep().
+ */
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "address.hpp"
+#include "bench.hpp"
+#include "sheet.hpp"
+
+namespace
+{
+    /**
+     * Build a model in which a chain of cells in column B depends on the
+     * input in A1, alongside a larger block of cells that does not.
+     */
+    void buildModel(Sheet & sheet, unsigned int rows)
+    {
+        sheet.setFormula(Address("A1"), "=1");
+        sheet.setFormula(Address("B1"), "=A1 * 1.5 + 2");
+        for (unsigned int row = 2; row <= rows; row++) {
+            std::stringstream chain;
+            chain << "=B" << row - 1 << " * 0.5 + A1 - " << row;
+            sheet.setFormula(Address(2, row), chain.str());
+
+            for (unsigned int column = 3; column <= 6; column++) {
+                std::stringstream other;
+                other << "=" << row << " * " << column << " + 1";
+                sheet.setFormula(Address(column, row), other.str());
+            }
+        }
+    }
+}
+
+int main()
+{
+    const unsigned int rows = 200;
+    const int count = 2000;
+
+    Sheet sheet;
+    buildModel(sheet, rows);
+
+    std::vector<std::vector<std::string> > values;
+    for (int i = 0; i < count; i++) {
+        std::stringstream ss;
+        ss << i;
+        values.push_back(std::vector<std::string>(1, ss.str()));
+    }
+
+    const std::vector<Address> inputs(1, Address("A1"));
+    const std::vector<Address> outputs(1, Address(2, rows));
+
+    // Set the input, then recalculate the whole sheet, once per value
+    {
+        Stopwatch stopwatch;
+        for (int i = 0; i < count; i++) {
+            sheet.setFormula(inputs[0], "'" + values[i][0]);
+            sheet.recalculate();
+            sheet.getValue(outputs[0]);
+        }
+        report("recalculate per value", count, stopwatch.elapsed(), "values");
+    }
+
+    // Evaluate the affected cells for every value in one batch
+    {
+        sheet.setFormula(inputs[0], "=1");
+        Stopwatch stopwatch;
+        sheet.sweep(inputs, values, outputs);
+        report("sweep", count, stopwatch.elapsed(), "values");
+    }
+
+    return 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * Measures sorted and grouped views of a column of a million keys, in passes
+ * per second, where one key changes in each pass. A view that is kept is
+ * brought up to date from the changed cell, compared with a new view that
+ * sorts or groups every row again. Also measures a sheet in which SORT and
+ * GROUPBY read a range of cells and spill their results, including the cost
+ * of reading the range and writing every spilled value.
+ */
+
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "address.hpp"
+#include "ast.hpp"
+#include "bench.hpp"
+#include "lookup.hpp"
+#include "sheet.hpp"
+#include "views.hpp"
+
+namespace
+{
+    const unsigned int ROWS = 1000000;
+
+    /// Column of keys with many repeats, except for one changed key
+    void makeColumn(unsigned int column, unsigned int changed, int pass, std::vector<RangeCell> & cells)
+    {
+        unsigned int seed = 1;
+        for (unsigned int row = 1; row <= ROWS; row++) {
+            seed = seed * 1103515245 + 12345;
+            std::stringstream value;
+            value << (row == changed ? pass : int((seed >> 8) % 1000));
+            const RangeCell cell = {Address(column, row), Rope(value.str())};
+            cells.push_back(cell);
+        }
+    }
+
+    View * createSorted()
+    {
+        return new SortedView(0, false);
+    }
+
+    View * createGrouped()
+    {
+        return new GroupedView(GroupedView::FUNCTION_SUM);
+    }
+
+    /**
+     * Change one key in each pass, and bring a view up to date after each
+     * change, either by keeping the view or by creating a new one.
+     */
+    void measure(const std::string & name, View * (*create)(), bool keep)
+    {
+        LookupTable keys(Range(Address(1, 1), Address(1, ROWS)), false);
+        LookupTable values(Range(Address(2, 1), Address(2, ROWS)), false);
+        std::vector<RangeCell> cells;
+        makeColumn(1, 0, 0, cells);
+        keys.update(cells);
+        makeColumn(2, 0, 0, cells);
+        values.update(cells);
+
+        std::vector<const LookupTable *> tables;
+        tables.push_back(&keys);
+        tables.push_back(&values);
+        std::unique_ptr<View> pView(create());
+        Array result;
+        pView->update(tables, result);
+
+        const int passes = 10;
+        double seconds = 0;
+        for (int pass = 1; pass <= passes; pass++) {
+            makeColumn(1, (pass * 7919) % ROWS + 1, pass, cells);
+            keys.update(cells);
+
+            Stopwatch stopwatch;
+            if (!keep) {
+                pView.reset(create());
+            }
+            pView->update(tables, result);
+            seconds += stopwatch.elapsed();
+        }
+
+        report(name + (keep ? ", kept" : ", new view"), double(passes), seconds, "passes");
+    }
+}
+
+int main()
+{
+    measure("1M row sorted view", createSorted, false);
+    measure("1M row sorted view", createSorted, true);
+    measure("1M row grouped view", createGrouped, false);
+    measure("1M row grouped view", createGrouped, true);
+
+    // SORT and GROUPBY of a column of 20,000 cells
+    const unsigned int size = 20000;
+    Sheet sheet;
+    for (unsigned int row = 1; row <= size; row++) {
+        std::stringstream formula;
+        formula << "=" << (row * 7919) % 1000;
+        sheet.setFormula(Address(1, row), formula.str());
+        sheet.setFormula(Address(2, row), "=1");
+    }
+
+    std::stringstream keys;
+    std::stringstream values;
+    keys << Address(1, 1).toString() << ":" << Address(1, size).toString();
+    values << Address(2, 1).toString() << ":" << Address(2, size).toString();
+    sheet.setFormula(Address(4, 1), "=SORT(" + keys.str() + ")");
+    sheet.setFormula(Address(6, 1), "=GROUPBY(" + keys.str() + ", " + values.str() + ", \"SUM\")");
+    sheet.recalculate();
+
+    const int passes = 5;
+    Stopwatch recalculation;
+    for (int pass = 0; pass < passes; pass++) {
+        std::stringstream value;
+        value << "=" << pass;
+        sheet.setFormula(Address(1, 1), value.str());
+        sheet.recalculate();
+    }
+    report("SORT and GROUPBY 20000 cells, recalc", double(passes), recalculation.elapsed(), "passes");
+
+    return sheet.getValue(Address(4, size)).empty() ? 1 : 0;
+}
@@ -19,6 +19,13 @@ struct Address
      */
     Address(const std::string & address);
 
+    /**
+     * Format the Address as a string, e.g. "B12".
+     *
+     * @returns Address in string format
+     */
+    std::string toString() const;
+
     /// Column offset (beginning at 0)
     unsigned int column;
 
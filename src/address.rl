@@ -76,6 +76,20 @@ Address::Address(const std::string &address)
     }
 }
 
+std::string Address::toString() const
+{
+    // Inverse of the column scanner above, which gives the first letter the
+    // lowest weight
+    std::string s;
+    for (unsigned int c = column; c > 0; c = (c - 1) / 26) {
+        s.push_back(char('A' + (c - 1) % 26));
+    }
+
+    std::stringstream ss;
+    ss << s << row;
+    return ss.str();
+}
+
 bool operator<(const Address & lhs, const Address & rhs)
 {
     return (lhs.column < rhs.column) || (lhs.column == rhs.column && lhs.row < rhs.row);
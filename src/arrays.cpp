@@ -0,0 +1,384 @@
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cmath>
+#include <cstdlib>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+
+#include "arrays.hpp"
+#include "ast.hpp"
+#include "parallel.hpp"
+
+namespace
+{
+    /// Operations to hash and compare each value, which are counted towards
+    /// the work that is needed to use another thread
+    const std::size_t HASH_WORK = 16;
+
+    /// Position of a value within an array, by row (or column) and column (or row)
+    std::size_t getElement(const Array & array, bool across, std::size_t line, std::size_t position)
+    {
+        return across ? position * array.columns + line : line * array.columns + position;
+    }
+
+    /**
+     * Interpret a value as a number, only if the whole value is a finite
+     * number, so that values such as "12 apples" are sorted as text.
+     */
+    bool toNumber(const std::string & value, double & number)
+    {
+        if (value.empty() || !(std::isdigit(static_cast<unsigned char>(value[0])) ||
+                value[0] == '+' || value[0] == '-' || value[0] == '.')) {
+            return false;
+        }
+
+        // Hexadecimal numbers, infinities and NaNs are read by strtod(), but
+        // are not numbers that are produced by a formula
+        if (value.find_first_of("xXiInN") != std::string::npos) {
+            return false;
+        }
+
+        char * end = NULL;
+        errno = 0;
+        number = std::strtod(value.c_str(), &end);
+        return end == value.c_str() + value.size() && errno == 0;
+    }
+
+    /// Orders rows by their keys, leaving rows with equal keys in their places
+    struct RowLess
+    {
+        const std::vector<SortKey> & keys;
+
+        bool operator()(std::size_t lhs, std::size_t rhs) const
+        {
+            return isRowBefore(keys, lhs, rhs);
+        }
+    };
+
+    /// Sorts bands of rows, each of the given size
+    struct SortBands
+    {
+        std::vector<std::size_t> & order;
+        const RowLess & less;
+        std::size_t band;
+
+        void operator()(std::size_t begin, std::size_t end) const
+        {
+            for (std::size_t i = begin; i < end; i++) {
+                const std::size_t first = std::min(order.size(), i * band);
+                const std::size_t last = std::min(order.size(), first + band);
+                std::stable_sort(order.begin() + first, order.begin() + last, less);
+            }
+        }
+    };
+
+    /// Merges pairs of sorted runs, each of the given width, into the target
+    struct MergePairs
+    {
+        const std::vector<std::size_t> & source;
+        std::vector<std::size_t> & target;
+        const RowLess & less;
+        std::size_t width;
+
+        void operator()(std::size_t begin, std::size_t end) const
+        {
+            const std::size_t count = source.size();
+            for (std::size_t i = begin; i < end; i++) {
+                const std::size_t first = std::min(count, i * 2 * width);
+                const std::size_t middle = std::min(count, first + width);
+                const std::size_t last = std::min(count, middle + width);
+                std::merge(source.begin() + first, source.begin() + middle, source.begin() + middle,
+                    source.begin() + last, target.begin() + first, less);
+            }
+        }
+    };
+
+    /// Hashes a band of rows of an array
+    struct HashRows
+    {
+        const Array & array;
+        bool across;
+        std::size_t length;
+        std::vector<std::size_t> & hashes;
+
+        void operator()(std::size_t begin, std::size_t end) const
+        {
+            const std::hash<double> hashNumber = std::hash<double>();
+            const std::hash<std::string> hashString = std::hash<std::string>();
+            for (std::size_t line = begin; line < end; line++) {
+                std::size_t hash = 0;
+                for (std::size_t position = 0; position < length; position++) {
+                    const std::size_t i = getElement(array, across, line, position);
+                    const std::size_t value = array.values.numeric ?
+                        hashNumber(array.values.numbers[i]) : hashString(array.values.strings[i].str());
+                    hash ^= value + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+                }
+
+                hashes[line] = hash;
+            }
+        }
+    };
+
+    /// A row that has been found, and the number of times it appears
+    struct Occurrence
+    {
+        std::size_t line;
+        std::size_t count;
+    };
+
+    typedef std::vector<Occurrence> Occurrences;
+
+    /**
+     * Finds the distinct rows within shards of an array. Each shard holds the
+     * rows whose hashes have the same remainder, so equal rows are always in
+     * the same shard.
+     */
+    struct FindDistinct
+    {
+        const Array & array;
+        bool across;
+        std::size_t length;
+        const std::vector<std::size_t> & hashes;
+        std::vector<Occurrences> & shards;
+
+        bool equal(std::size_t lhs, std::size_t rhs) const
+        {
+            for (std::size_t position = 0; position < length; position++) {
+                const std::size_t i = getElement(array, across, lhs, position);
+                const std::size_t j = getElement(array, across, rhs, position);
+                if (array.values.numeric ? array.values.numbers[i] != array.values.numbers[j] :
+                        array.values.strings[i] != array.values.strings[j]) {
+                    return false;
+                }
+            }
+
+            return true;
+        }
+
+        void operator()(std::size_t begin, std::size_t end) const
+        {
+            for (std::size_t shard = begin; shard < end; shard++) {
+                // Positions within the shard of the rows found so far, by hash
+                typedef std::unordered_map<std::size_t, std::vector<std::size_t> > Buckets;
+                Buckets buckets;
+                Occurrences & occurrences = shards[shard];
+                for (std::size_t line = 0; line < hashes.size(); line++) {
+                    if (hashes[line] % shards.size() != shard) {
+                        continue;
+                    }
+
+                    std::vector<std::size_t> & bucket = buckets[hashes[line]];
+                    std::vector<std::size_t>::const_iterator itr = bucket.begin();
+                    while (itr != bucket.end() && !equal(occurrences[*itr].line, line)) {
+                        itr++;
+                    }
+
+                    if (itr != bucket.end()) {
+                        occurrences[*itr].count++;
+                    } else {
+                        bucket.push_back(occurrences.size());
+                        const Occurrence occurrence = {line, 1};
+                        occurrences.push_back(occurrence);
+                    }
+                }
+            }
+        }
+    };
+
+    /// Copies a band of the selected rows of an array
+    struct SelectBand
+    {
+        const Array & array;
+        bool across;
+        std::size_t length;
+        const std::vector<std::size_t> & lines;
+        Array & result;
+
+        void operator()(std::size_t begin, std::size_t end) const
+        {
+            for (std::size_t line = begin; line < end; line++) {
+                for (std::size_t position = 0; position < length; position++) {
+                    const std::size_t i = getElement(array, across, lines[line], position);
+                    const std::size_t j = getElement(result, across, line, position);
+                    if (array.values.numeric) {
+                        result.values.numbers[j] = array.values.numbers[i];
+                    } else {
+                        result.values.strings[j] = array.values.strings[i];
+                    }
+                }
+            }
+        }
+    };
+}
+
+SortKey::Kind readSortValue(const Rope & value, double & number, std::string & text)
+{
+    number = 0;
+    text.clear();
+    if (value.empty()) {
+        return SortKey::KIND_EMPTY;
+    }
+
+    text = value.str();
+    if (toNumber(text, number)) {
+        text.clear();
+        return SortKey::KIND_NUMBER;
+    }
+
+    number = 0;
+    return SortKey::KIND_TEXT;
+}
+
+void readSortKey(const Array & array, std::size_t index, bool across, bool descending, SortKey & key)
+{
+    const std::size_t count = across ? array.columns : array.rows;
+    key.kinds.assign(count, SortKey::KIND_NUMBER);
+    key.numbers.assign(count, 0);
+    key.texts.clear();
+    key.descending = descending;
+    for (std::size_t line = 0; line < count; line++) {
+        updateSortKey(array, index, across, line, key);
+    }
+}
+
+void updateSortKey(const Array & array, std::size_t index, bool across, std::size_t line, SortKey & key)
+{
+    const std::size_t i = getElement(array, across, line, index);
+    if (array.values.numeric) {
+        key.kinds[line] = SortKey::KIND_NUMBER;
+        key.numbers[line] = array.values.numbers[i];
+        if (!key.texts.empty()) {
+            key.texts[line].clear();
+        }
+        return;
+    }
+
+    std::string text;
+    key.kinds[line] = readSortValue(array.values.strings[i], key.numbers[line], text);
+    if (key.texts.empty() && !text.empty()) {
+        key.texts.resize(key.kinds.size());
+    }
+    if (!key.texts.empty()) {
+        key.texts[line].swap(text);
+    }
+}
+
+bool isRowBefore(const std::vector<SortKey> & keys, std::size_t lhs, std::size_t rhs)
+{
+    for (std::vector<SortKey>::const_iterator key = keys.begin(); key != keys.end(); key++) {
+        const unsigned char lhsKind = key->kinds[lhs];
+        const unsigned char rhsKind = key->kinds[rhs];
+        if (lhsKind != rhsKind) {
+            if (lhsKind == SortKey::KIND_EMPTY || rhsKind == SortKey::KIND_EMPTY) {
+                return rhsKind == SortKey::KIND_EMPTY;
+            }
+
+            return key->descending ? lhsKind > rhsKind : lhsKind < rhsKind;
+        }
+
+        if (lhsKind == SortKey::KIND_NUMBER) {
+            const double lhsNumber = key->numbers[lhs];
+            const double rhsNumber = key->numbers[rhs];
+            if (lhsNumber != rhsNumber) {
+                return key->descending ? lhsNumber > rhsNumber : lhsNumber < rhsNumber;
+            }
+        } else if (lhsKind == SortKey::KIND_TEXT) {
+            const int comparison = key->texts[lhs].compare(key->texts[rhs]);
+            if (comparison != 0) {
+                return key->descending ? comparison > 0 : comparison < 0;
+            }
+        }
+    }
+
+    return false;
+}
+
+void sortRows(const std::vector<SortKey> & keys, std::size_t count, std::size_t threads,
+    std::vector<std::size_t> & order)
+{
+    order.resize(count);
+    for (std::size_t i = 0; i < count; i++) {
+        order[i] = i;
+    }
+
+    std::size_t depth = 1;
+    while ((std::size_t(1) << depth) < count) {
+        depth++;
+    }
+
+    const RowLess less = {keys};
+    threads = countThreads(count, count * depth * keys.size(), threads);
+    if (threads == 1) {
+        std::stable_sort(order.begin(), order.end(), less);
+        return;
+    }
+
+    // Each band is sorted on its own thread, then neighbouring runs are merged
+    // until there is one run. As a merge takes values from the left run before
+    // equal values from the right, the result is the same as a single sort.
+    const std::size_t band = (count + threads - 1) / threads;
+    const SortBands sortTask = {order, less, band};
+    forEachBand(sortTask, threads, threads);
+
+    std::vector<std::size_t> buffer(count);
+    std::vector<std::size_t> * pSource = &order;
+    std::vector<std::size_t> * pTarget = &buffer;
+    for (std::size_t width = band; width < count; width *= 2) {
+        const std::size_t pairs = (count + 2 * width - 1) / (2 * width);
+        const MergePairs mergeTask = {*pSource, *pTarget, less, width};
+        forEachBand(mergeTask, pairs, std::min(threads, pairs));
+        std::swap(pSource, pTarget);
+    }
+
+    if (pSource != &order) {
+        order.swap(buffer);
+    }
+}
+
+void findUniqueRows(const Array & array, bool across, bool exactlyOnce, std::size_t threads,
+    std::vector<std::size_t> & rows)
+{
+    const std::size_t lines = across ? array.columns : array.rows;
+    const std::size_t length = across ? array.rows : array.columns;
+    threads = countThreads(lines, lines * length * HASH_WORK, threads);
+
+    std::vector<std::size_t> hashes(lines);
+    const HashRows hashTask = {array, across, length, hashes};
+    forEachBand(hashTask, lines, threads);
+
+    std::vector<Occurrences> shards(threads);
+    const FindDistinct findTask = {array, across, length, hashes, shards};
+    forEachBand(findTask, threads, threads);
+
+    // Rows are put back in order, so the shards they were found in are not seen
+    rows.clear();
+    for (std::vector<Occurrences>::const_iterator shard = shards.begin(); shard != shards.end(); shard++) {
+        for (Occurrences::const_iterator itr = shard->begin(); itr != shard->end(); itr++) {
+            if (!exactlyOnce || itr->count == 1) {
+                rows.push_back(itr->line);
+            }
+        }
+    }
+
+    std::sort(rows.begin(), rows.end());
+}
+
+void selectRows(const Array & array, bool across, const std::vector<std::size_t> & rows, Array & result)
+{
+    const std::size_t length = across ? array.rows : array.columns;
+    Array selected;
+    selected.rows = across ? array.rows : rows.size();
+    selected.columns = across ? rows.size() : array.columns;
+    selected.values.numeric = array.values.numeric;
+    if (array.values.numeric) {
+        selected.values.numbers.resize(rows.size() * length);
+    } else {
+        selected.values.strings.resize(rows.size() * length);
+    }
+
+    const SelectBand task = {array, across, length, rows, selected};
+    forEachBand(task, rows.size(), countThreads(rows.size(), rows.size() * length, 0));
+    result = std::move(selected);
+}
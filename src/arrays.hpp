@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+struct Array;
+class Rope;
+
+/**
+ * Values of one column of an array (or one row, when columns are sorted), as
+ * compared when sorting. Each value is classified once, and held in a vector
+ * for its kind, so that comparisons do not need to parse values again.
+ */
+struct SortKey
+{
+    /// Kinds of value, in the order they are sorted
+    enum Kind
+    {
+        KIND_NUMBER,
+        KIND_TEXT,
+        KIND_EMPTY
+    };
+
+    SortKey()
+        : descending(false)
+    {
+        // No further initialisation
+    }
+
+    /// Kind of each value
+    std::vector<unsigned char> kinds;
+
+    /// Value of each number, or zero
+    std::vector<double> numbers;
+
+    /// Value of each text, or empty; this is itself empty if there is no text
+    std::vector<std::string> texts;
+
+    bool descending;
+};
+
+/**
+ * Classify a value as it is sorted: as a number, if the whole value is a
+ * finite number, as empty, or else as text.
+ *
+ * @param   number  Receives the value of a number
+ * @param   text    Receives the value of text
+ *
+ * @returns kind of value
+ */
+SortKey::Kind readSortValue(const Rope & value, double & number, std::string & text);
+
+/**
+ * Read a column of an array as a sort key.
+ *
+ * @param   array       Array to read
+ * @param   index       Column to read, counted from zero, or the row if across
+ * @param   across      Read a row, to sort the columns of the array
+ * @param   descending  Sort largest values first
+ * @param   key         Receives one value per row (or column) of the array
+ */
+void readSortKey(const Array & array, std::size_t index, bool across, bool descending, SortKey & key);
+
+/**
+ * Read a single value of a sort key again, after it has changed in the array
+ * that the key was read from.
+ *
+ * @param   line  Row (or column, if across) whose value has changed
+ */
+void updateSortKey(const Array & array, std::size_t index, bool across, std::size_t line, SortKey & key);
+
+/**
+ * Check whether one row comes before another in the order found by
+ * sortRows(), not counting their positions. Neither row comes before the
+ * other if their keys are equal.
+ */
+bool isRowBefore(const std::vector<SortKey> & keys, std::size_t lhs, std::size_t rhs);
+
+/**
+ * Find the order of rows sorted by one or more keys, with later keys breaking
+ * ties between earlier ones. Numbers come before text, which is compared as
+ * case sensitive strings, and descending keys reverse both. Empty values come
+ * last, either way.
+ *
+ * The sort is stable, so rows with equal keys keep their order, and the order
+ * does not depend on the number of threads. Large inputs are divided into
+ * bands that are sorted on separate threads, then merged a pair at a time.
+ *
+ * @param   keys     Keys, each of which has a value for every row
+ * @param   count    Number of rows
+ * @param   threads  Most threads to use, or zero to choose from the work
+ * @param   order    Receives the positions of the rows, in sorted order
+ */
+void sortRows(const std::vector<SortKey> & keys, std::size_t count, std::size_t threads,
+    std::vector<std::size_t> & order);
+
+/**
+ * Find the distinct rows of an array, in the order that each first appears.
+ * Rows are distinct if any of their values differ as case sensitive strings.
+ *
+ * Every row is hashed on separate threads, then the rows are divided between
+ * threads by hash, so that all copies of a row are compared by one thread. The
+ * result does not depend on the number of threads.
+ *
+ * @param   array        Array to read
+ * @param   across       Compare columns rather than rows
+ * @param   exactlyOnce  Only find rows that appear exactly once
+ * @param   threads      Most threads to use, or zero to choose from the work
+ * @param   rows         Receives the positions of the rows, in ascending order
+ */
+void findUniqueRows(const Array & array, bool across, bool exactlyOnce, std::size_t threads,
+    std::vector<std::size_t> & rows);
+
+/**
+ * Copy rows of an array, in the given order, into another array. Large arrays
+ * are copied by several threads.
+ *
+ * @param   across  Copy columns rather than rows
+ */
+void selectRows(const Array & array, bool across, const std::vector<std::size_t> & rows, Array & result);
@@ -1,14 +1,452 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <memory>
 #include <sstream>
+#include <stdexcept>
+#include <utility>
 
 #include "ast.hpp"
 
 namespace {
+    /// Text that replaces a reference to a deleted cell or range
+    const char * const REF_ERROR = "#REF!";
+
     template<typename T>
     std::string toString(T t) {
         std::stringstream ss;
         ss << t;
         return ss.str();
     }
+
+    std::string toString(bool b) {
+        return b ? "TRUE" : "FALSE";
+    }
+
+    /// Format a number in the same way as toString(), but without a stream
+    std::string formatNumber(double value) {
+        // Equivalent to the default formatting of a stream
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%g", value);
+        return buffer;
+    }
+
+    /**
+     * Round a number to the value that it would be read back as, once
+     * formatted by toString(). Integers of up to six digits are formatted
+     * exactly, so only other values need to be formatted.
+     */
+    double toFormatted(double value) {
+        if (std::fabs(value) < 1e6 && value == std::floor(value)) {
+            return value;
+        }
+
+        return std::strtod(formatNumber(value).c_str(), NULL);
+    }
+
+    /**
+     * Parse a value that is a finite number, written in exactly the format
+     * produced by toString().
+     */
+    bool parseFormatted(const std::string & value, double & number) {
+        if (value.empty()) {
+            return false;
+        }
+
+        char * end = NULL;
+        number = std::strtod(value.c_str(), &end);
+        return end == value.c_str() + value.size() && std::isfinite(number) && formatNumber(number) == value;
+    }
+
+    bool toNumber(const std::string & value, double & number) {
+        std::stringstream ss(value);
+        ss >> number;
+        return !ss.fail();
+    }
+
+    /**
+     * Interpret a value as a number in the same way as for a string, without
+     * gathering the whole value unless its first characters are not enough.
+     */
+    bool toNumber(const Rope & value, double & number) {
+        if (value.size() <= Rope::HEAD_SIZE) {
+            return toNumber(value.str(), number);
+        }
+
+        // Parsing stops at the first character that cannot be part of the
+        // number. Unless that is beyond the head, the rest of the value makes
+        // no difference.
+        std::stringstream ss(value.head());
+        ss >> number;
+        if (ss.eof()) {
+            return toNumber(value.str(), number);
+        }
+
+        return !ss.fail();
+    }
+
+    template<typename T>
+    std::string compare(BinaryOp binaryOp, const T & lhs, const T & rhs) {
+        switch (binaryOp) {
+            case BINARY_OP_EQUAL:
+                return toString(lhs == rhs);
+            case BINARY_OP_NOT_EQUAL:
+                return toString(!(lhs == rhs));
+            case BINARY_OP_LESS:
+                return toString(lhs < rhs);
+            case BINARY_OP_LESS_EQUAL:
+                return toString(!(rhs < lhs));
+            case BINARY_OP_GREATER:
+                return toString(rhs < lhs);
+            case BINARY_OP_GREATER_EQUAL:
+                return toString(!(lhs < rhs));
+            default:
+                return "ERROR";
+        }
+    }
+
+    /// Apply a binary operator to two values, in string format
+    Rope apply(BinaryOp binaryOp, const Rope & valueLeft, const Rope & valueRight) {
+        double dLeft = 0;
+        double dRight = 0;
+        if (toNumber(valueLeft, dLeft) && toNumber(valueRight, dRight)) {
+            switch (binaryOp) {
+                case BINARY_OP_ADD:
+                    return toString(dLeft + dRight);
+                case BINARY_OP_SUBTRACT:
+                    return toString(dLeft - dRight);
+                case BINARY_OP_MULTIPLY:
+                    return toString(dLeft * dRight);
+                case BINARY_OP_DIVIDE:
+                    return toString(dLeft / dRight);
+                default:
+                    return compare(binaryOp, dLeft, dRight);
+            }
+        }
+
+        switch (binaryOp) {
+            case BINARY_OP_ADD:
+                // Neither value is copied, however long they are
+                return Rope::concat(valueLeft, valueRight);
+            case BINARY_OP_SUBTRACT:
+            case BINARY_OP_MULTIPLY:
+            case BINARY_OP_DIVIDE:
+                break;
+            default:
+                // Values that are not both numbers are compared as strings
+                return compare(binaryOp, valueLeft, valueRight);
+        }
+
+        return "ERROR";
+    }
+
+    /// Largest number of elements in an array read from a range
+    const std::size_t MAX_ARRAY_SIZE = std::size_t(1) << 24;
+
+    /**
+     * Apply a binary operator to each pair of lanes. While both operands are
+     * numbers, arithmetic is applied to every lane in a single loop.
+     */
+    void combine(BinaryOp binaryOp, std::size_t count, const Lanes & left, const Lanes & right, Lanes & result)
+    {
+        if (left.numeric && right.numeric) {
+            const double * pLeft = left.numbers.data();
+            const double * pRight = right.numbers.data();
+            std::vector<double> numbers(count);
+            double * pResult = numbers.data();
+            bool arithmetic = true;
+
+            // Simple loops over contiguous arrays, which compilers vectorise
+            switch (binaryOp) {
+                case BINARY_OP_ADD:
+                    for (std::size_t i = 0; i < count; i++) pResult[i] = pLeft[i] + pRight[i];
+                    break;
+                case BINARY_OP_SUBTRACT:
+                    for (std::size_t i = 0; i < count; i++) pResult[i] = pLeft[i] - pRight[i];
+                    break;
+                case BINARY_OP_MULTIPLY:
+                    for (std::size_t i = 0; i < count; i++) pResult[i] = pLeft[i] * pRight[i];
+                    break;
+                case BINARY_OP_DIVIDE:
+                    for (std::size_t i = 0; i < count; i++) pResult[i] = pLeft[i] / pRight[i];
+                    break;
+                default:
+                    arithmetic = false;
+                    break;
+            }
+
+            // Scalar evaluation formats every result, which rounds it to six
+            // significant digits, and turns infinities and NaN into strings
+            bool finite = true;
+            for (std::size_t i = 0; arithmetic && i < count; i++) {
+                pResult[i] = toFormatted(pResult[i]);
+                finite = finite && std::isfinite(pResult[i]);
+            }
+
+            if (arithmetic && finite) {
+                result.numeric = true;
+                result.numbers.swap(numbers);
+                result.strings.clear();
+                return;
+            } else if (arithmetic) {
+                result.numeric = false;
+                result.numbers.clear();
+                result.strings.resize(count);
+                for (std::size_t i = 0; i < count; i++) {
+                    result.strings[i] = formatNumber(pResult[i]);
+                }
+                return;
+            }
+        }
+
+        // Comparisons, and values that are not all numbers, are handled one
+        // lane at a time
+        result.numeric = false;
+        result.numbers.clear();
+        result.strings.resize(count);
+        for (std::size_t i = 0; i < count; i++) {
+            result.strings[i] = apply(binaryOp, left.getString(i), right.getString(i));
+        }
+    }
+
+    /**
+     * Spread the elements of an array over a larger number of rows and
+     * columns, as one lane per element. An array with a single row or column
+     * is repeated; otherwise elements beyond the array are errors.
+     */
+    void broadcast(Array & array, std::size_t rows, std::size_t columns, Lanes & lanes)
+    {
+        if (array.rows == rows && array.columns == columns) {
+            std::swap(lanes, array.values);
+            return;
+        }
+
+        const bool repeated = (array.rows == 1 || array.rows == rows) && (array.columns == 1 || array.columns == columns);
+        lanes.numeric = repeated && array.values.numeric;
+        lanes.numbers.clear();
+        lanes.strings.clear();
+        for (std::size_t row = 0; row < rows; row++) {
+            for (std::size_t column = 0; column < columns; column++) {
+                const std::size_t index = (array.rows == 1 ? 0 : row) * array.columns +
+                    (array.columns == 1 ? 0 : column);
+                if (lanes.numeric) {
+                    lanes.numbers.push_back(array.values.numbers[index]);
+                } else if ((array.rows == 1 || row < array.rows) && (array.columns == 1 || column < array.columns)) {
+                    lanes.strings.push_back(array.values.getString(index));
+                } else {
+                    lanes.strings.push_back("ERROR");
+                }
+            }
+        }
+    }
+
+    /// Passed to the scalar callbacks when lanes are evaluated one at a time
+    struct LaneCallbackData
+    {
+        EvalAddressLanesCallback evalAddrCb;
+        EvalRangeLanesCallback evalRangeCb;
+        void * pData;
+        std::size_t lane;
+    };
+
+    Rope evalLaneAddressCallback(const Address & address, std::size_t reference, void * pData)
+    {
+        const LaneCallbackData * pLaneData = static_cast<const LaneCallbackData *>(pData);
+        return pLaneData->evalAddrCb(address, reference, pLaneData->pData).getString(pLaneData->lane);
+    }
+
+    void evalLaneRangeCallback(const Range & range, std::size_t index, std::vector<RangeCell> & cells, void * pData)
+    {
+        const LaneCallbackData * pLaneData = static_cast<const LaneCallbackData *>(pData);
+        pLaneData->evalRangeCb(range, index, pLaneData->lane, cells, pLaneData->pData);
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+// Lanes
+//
+// ----------------------------------------------------------------------------
+
+Rope Lanes::getString(std::size_t lane) const
+{
+    return numeric ? Rope(formatNumber(numbers[lane])) : strings[lane];
+}
+
+void Lanes::setStrings(const std::vector<Rope> & values)
+{
+    numbers.resize(values.size());
+    for (std::size_t i = 0; i < values.size(); i++) {
+        // Only values that would be formatted the same way are kept as
+        // numbers, so that getString() returns each value unchanged
+        if (values[i].size() > Rope::HEAD_SIZE || !parseFormatted(values[i].str(), numbers[i])) {
+            numeric = false;
+            numbers.clear();
+            strings = values;
+            return;
+        }
+    }
+
+    numeric = true;
+    strings.clear();
+}
+
+// ----------------------------------------------------------------------------
+//
+// Node
+//
+// ----------------------------------------------------------------------------
+
+bool Node::evaluateArray(EvalAddressCallback, EvalRangeCallback, EvalFunctionCallback, EvalArrayFunctionCallback,
+        void *, Array &) const
+{
+    return false;
+}
+
+void Node::evaluateLanes(std::size_t count, EvalAddressLanesCallback evalAddrCb, EvalRangeLanesCallback evalRangeCb,
+        EvalFunctionCallback evalFuncCb, void * pData, Lanes & result) const
+{
+    LaneCallbackData laneData = {evalAddrCb, evalRangeCb, pData, 0};
+    result.numeric = false;
+    result.numbers.clear();
+    result.strings.resize(count);
+    for (; laneData.lane < count; laneData.lane++) {
+        result.strings[laneData.lane] = evaluate(evalLaneAddressCallback, evalLaneRangeCallback, evalFuncCb, &laneData);
+    }
+}
+
+// ----------------------------------------------------------------------------
+//
+// Arguments
+//
+// ----------------------------------------------------------------------------
+
+Arguments::Arguments(const std::vector<const Node *> & params, EvalAddressCallback evalAddrCb,
+        EvalRangeCallback evalRangeCb, EvalFunctionCallback evalFuncCb, EvalArrayFunctionCallback evalArrayFuncCb,
+        void * pData)
+    : m_params(params)
+    , m_evalAddrCb(evalAddrCb)
+    , m_evalRangeCb(evalRangeCb)
+    , m_evalFuncCb(evalFuncCb)
+    , m_evalArrayFuncCb(evalArrayFuncCb)
+    , m_pData(pData)
+{
+    // No further initialisation
+}
+
+std::size_t Arguments::size() const
+{
+    return m_params.size();
+}
+
+Rope Arguments::evaluate(std::size_t index) const
+{
+    return m_params.at(index)->evaluate(m_evalAddrCb, m_evalRangeCb, m_evalFuncCb, m_pData);
+}
+
+bool Arguments::isRange(std::size_t index) const
+{
+    return dynamic_cast<const RangeNode *>(m_params.at(index)) != NULL;
+}
+
+void Arguments::evaluateRange(std::size_t index, std::vector<RangeCell> & cells) const
+{
+    const RangeNode * pRangeNode = dynamic_cast<const RangeNode *>(m_params.at(index));
+    if (!pRangeNode) {
+        throw std::runtime_error("Argument is not a range.");
+    }
+
+    pRangeNode->evaluateRange(m_evalRangeCb, m_pData, cells);
+}
+
+bool Arguments::evaluateArray(std::size_t index, Array & result) const
+{
+    if (!m_evalArrayFuncCb) {
+        return false;
+    }
+
+    return m_params.at(index)->evaluateArray(m_evalAddrCb, m_evalRangeCb, m_evalFuncCb, m_evalArrayFuncCb, m_pData,
+        result);
+}
+
+const Range & Arguments::getRange(std::size_t index) const
+{
+    const RangeNode * pRangeNode = dynamic_cast<const RangeNode *>(m_params.at(index));
+    if (!pRangeNode) {
+        throw std::runtime_error("Argument is not a range.");
+    }
+
+    return pRangeNode->getRange();
+}
+
+std::string Arguments::getFunctionName(std::size_t index) const
+{
+    const FnCallNode * pCallNode = dynamic_cast<const FnCallNode *>(m_params.at(index));
+    return pCallNode ? std::string(pCallNode->getFnName()) : std::string();
+}
+
+Arguments Arguments::getFunctionArguments(std::size_t index) const
+{
+    const FnCallNode * pCallNode = dynamic_cast<const FnCallNode *>(m_params.at(index));
+    if (!pCallNode) {
+        throw std::runtime_error("Argument is not a function call.");
+    }
+
+    return Arguments(pCallNode->getParams(), m_evalAddrCb, m_evalRangeCb, m_evalFuncCb, m_evalArrayFuncCb, m_pData);
+}
+
+// ----------------------------------------------------------------------------
+//
+// Relocation
+//
+// ----------------------------------------------------------------------------
+
+Relocation::Relocation(const std::string & source, RelocateAddressCallback moveAddressCb,
+        RelocateRangeCallback moveRangeCb, void * pData)
+    : m_source(source)
+    , m_moveAddressCb(moveAddressCb)
+    , m_moveRangeCb(moveRangeCb)
+    , m_pData(pData)
+    , m_position(0)
+{
+    m_text.reserve(source.size());
+}
+
+bool Relocation::moveAddress(Address & address) const
+{
+    return m_moveAddressCb(address, m_pData);
+}
+
+bool Relocation::moveRange(Range & range) const
+{
+    return m_moveRangeCb(range, m_pData);
+}
+
+std::size_t Relocation::replace(std::size_t offset, std::size_t length, const std::string & replacement)
+{
+    if (offset < m_position || offset + length > m_source.size()) {
+        throw std::logic_error("Nodes were relocated out of order.");
+    }
+
+    m_text.append(m_source, m_position, offset - m_position);
+    const std::size_t result = m_text.size();
+    m_text.append(replacement);
+    m_position = offset + length;
+    return result;
+}
+
+std::size_t Relocation::keep(std::size_t offset, std::size_t length)
+{
+    return replace(offset, length, m_source.substr(offset, length));
+}
+
+const std::string & Relocation::finish()
+{
+    m_text.append(m_source, m_position, std::string::npos);
+    m_position = m_source.size();
+    return m_text;
 }
 
 // ----------------------------------------------------------------------------
@@ -23,13 +461,37 @@ LitDoubleNode::LitDoubleNode(double value)
     // No further initialisation
 }
 
-std::string LitDoubleNode::evaluate(EvalAddressCallback evalAddrCb, EvalFunctionCallback evalFuncCb, void * pData) const
+Rope LitDoubleNode::evaluate(EvalAddressCallback evalAddrCb, EvalRangeCallback evalRangeCb, EvalFunctionCallback evalFuncCb,
+        void * pData) const
 {
     std::ostringstream ss;
     ss << m_value;
     return ss.str();
 }
 
+void LitDoubleNode::evaluateLanes(std::size_t count, EvalAddressLanesCallback, EvalRangeLanesCallback,
+        EvalFunctionCallback, void *, Lanes & result) const
+{
+    // Scalar evaluation formats the literal, so the lanes hold the value
+    // that the formatted literal would be read back as
+    double value = 0;
+    toNumber(toString(m_value), value);
+    result.numeric = true;
+    result.numbers.assign(count, value);
+    result.strings.clear();
+}
+
+Node * LitDoubleNode::relocate(Relocation &) const
+{
+    return new LitDoubleNode(m_value);
+}
+
+void LitDoubleNode::writeShape(std::ostream & os, const Address &) const
+{
+    // Literals are written in full, so that different values never share a shape
+    os << "num{" << std::setprecision(17) << m_value << "}";
+}
+
 LitDoubleNode::operator std::string() const
 {
     std::stringstream ss;
@@ -43,15 +505,34 @@ LitDoubleNode::operator std::string() const
 //
 // ----------------------------------------------------------------------------
 
-LitStringNode::LitStringNode(const std::string & value)
+LitStringNode::LitStringNode(const InternedString & value)
     : m_value(value)
 {
     // No further initialisation
 }
 
-std::string LitStringNode::evaluate(EvalAddressCallback evalAddrCb, EvalFunctionCallback evalFuncCb, void * pData) const
+Rope LitStringNode::evaluate(EvalAddressCallback evalAddrCb, EvalRangeCallback evalRangeCb, EvalFunctionCallback evalFuncCb,
+        void * pData) const
 {
-    return m_value;
+    return Rope(m_value.str());
+}
+
+void LitStringNode::evaluateLanes(std::size_t count, EvalAddressLanesCallback, EvalRangeLanesCallback,
+        EvalFunctionCallback, void *, Lanes & result) const
+{
+    result.numeric = false;
+    result.numbers.clear();
+    result.strings.assign(count, Rope(m_value.str()));
+}
+
+Node * LitStringNode::relocate(Relocation &) const
+{
+    return new LitStringNode(m_value);
+}
+
+void LitStringNode::writeShape(std::ostream & os, const Address &) const
+{
+    os << "str" << m_value.size() << "{" << m_value << "}";
 }
 
 LitStringNode::operator std::string() const
@@ -83,41 +564,94 @@ BinaryOpNode::~BinaryOpNode()
     m_pRight = 0;
 }
 
-std::string BinaryOpNode::evaluate(EvalAddressCallback evalAddrCb, EvalFunctionCallback evalFuncCb, void * pData) const {
-    const std::string valueLeft = m_pLeft->evaluate(evalAddrCb, evalFuncCb, pData);
-    const std::string valueRight = m_pRight->evaluate(evalAddrCb, evalFuncCb, pData);
+Rope BinaryOpNode::evaluate(EvalAddressCallback evalAddrCb, EvalRangeCallback evalRangeCb, EvalFunctionCallback evalFuncCb,
+        void * pData) const {
+    const Rope valueLeft = m_pLeft->evaluate(evalAddrCb, evalRangeCb, evalFuncCb, pData);
+    const Rope valueRight = m_pRight->evaluate(evalAddrCb, evalRangeCb, evalFuncCb, pData);
+    return apply(m_binaryOp, valueLeft, valueRight);
+}
 
-    std::stringstream ss(valueLeft);
-    double dLeft = 0;
-    ss >> dLeft;
-    if (!ss.fail()) {
-        ss.str("");
-        ss.clear();
-        ss << valueRight;
-        double dRight = 0;
-        ss >> dRight;
-        if (!ss.fail()) {
-            switch (m_binaryOp) {
-                case BINARY_OP_ADD:
-                    return toString(dLeft + dRight);
-                case BINARY_OP_SUBTRACT:
-                    return toString(dLeft - dRight);
-                case BINARY_OP_MULTIPLY:
-                    return toString(dLeft * dRight);
-                case BINARY_OP_DIVIDE:
-                    return toString(dLeft / dRight);
-            }
-        }
+void BinaryOpNode::evaluateLanes(std::size_t count, EvalAddressLanesCallback evalAddrCb,
+        EvalRangeLanesCallback evalRangeCb, EvalFunctionCallback evalFuncCb, void * pData, Lanes & result) const
+{
+    Lanes left;
+    Lanes right;
+    m_pLeft->evaluateLanes(count, evalAddrCb, evalRangeCb, evalFuncCb, pData, left);
+    m_pRight->evaluateLanes(count, evalAddrCb, evalRangeCb, evalFuncCb, pData, right);
+
+    combine(m_binaryOp, count, left, right, result);
+}
+
+bool BinaryOpNode::evaluateArray(EvalAddressCallback evalAddrCb, EvalRangeCallback evalRangeCb,
+        EvalFunctionCallback evalFuncCb, EvalArrayFunctionCallback evalArrayFuncCb, void * pData, Array & result) const
+{
+    Array left;
+    Array right;
+    const bool leftArray = m_pLeft->evaluateArray(evalAddrCb, evalRangeCb, evalFuncCb, evalArrayFuncCb, pData, left);
+    const bool rightArray = m_pRight->evaluateArray(evalAddrCb, evalRangeCb, evalFuncCb, evalArrayFuncCb, pData, right);
+    if (!leftArray && !rightArray) {
+        return false;
     }
 
-    switch (m_binaryOp) {
-        case BINARY_OP_ADD:
-            return std::string(valueLeft).append(valueRight);
-        default:
-            break;
+    // An operand with a single value is an array of one element, which is
+    // repeated across the other operand
+    if (!leftArray) {
+        left.rows = left.columns = 1;
+        left.values.setStrings(std::vector<Rope>(1, m_pLeft->evaluate(evalAddrCb, evalRangeCb, evalFuncCb, pData)));
+    } else if (!rightArray) {
+        right.rows = right.columns = 1;
+        right.values.setStrings(std::vector<Rope>(1, m_pRight->evaluate(evalAddrCb, evalRangeCb, evalFuncCb, pData)));
     }
 
-    return "ERROR";
+    const std::size_t rows = std::max(left.rows, right.rows);
+    const std::size_t columns = std::max(left.columns, right.columns);
+    Lanes leftLanes;
+    Lanes rightLanes;
+    broadcast(left, rows, columns, leftLanes);
+    broadcast(right, rows, columns, rightLanes);
+
+    result.rows = rows;
+    result.columns = columns;
+    combine(m_binaryOp, rows * columns, leftLanes, rightLanes, result.values);
+    return true;
+}
+
+void BinaryOpNode::getReferences(Addresses & addresses) const
+{
+    m_pLeft->getReferences(addresses);
+    m_pRight->getReferences(addresses);
+}
+
+void BinaryOpNode::indexReferences(Addresses & addresses) const
+{
+    m_pLeft->indexReferences(addresses);
+    m_pRight->indexReferences(addresses);
+}
+
+void BinaryOpNode::indexRanges(Ranges & ranges) const
+{
+    m_pLeft->indexRanges(ranges);
+    m_pRight->indexRanges(ranges);
+}
+
+Node * BinaryOpNode::relocate(Relocation & relocation) const
+{
+    // Children are relocated in the order that they were written
+    std::unique_ptr<Node> pLeft(m_pLeft->relocate(relocation));
+    std::unique_ptr<Node> pRight(m_pRight->relocate(relocation));
+    Node * pNode = new BinaryOpNode(m_binaryOp, pLeft.get(), pRight.get());
+    pLeft.release();
+    pRight.release();
+    return pNode;
+}
+
+void BinaryOpNode::writeShape(std::ostream & os, const Address & origin) const
+{
+    os << "(";
+    m_pLeft->writeShape(os, origin);
+    os << " " << int(m_binaryOp) << " ";
+    m_pRight->writeShape(os, origin);
+    os << ")";
 }
 
 BinaryOpNode::operator std::string() const
@@ -130,6 +664,12 @@ BinaryOpNode::operator std::string() const
         case BINARY_OP_SUBTRACT: ss << " - "; break;
         case BINARY_OP_MULTIPLY: ss << " * "; break;
         case BINARY_OP_DIVIDE: ss << " / "; break;
+        case BINARY_OP_EQUAL: ss << " = "; break;
+        case BINARY_OP_NOT_EQUAL: ss << " <> "; break;
+        case BINARY_OP_LESS: ss << " < "; break;
+        case BINARY_OP_LESS_EQUAL: ss << " <= "; break;
+        case BINARY_OP_GREATER: ss << " > "; break;
+        case BINARY_OP_GREATER_EQUAL: ss << " >= "; break;
         default: ss << " ? "; break;
     }
 
@@ -143,20 +683,38 @@ BinaryOpNode::operator std::string() const
 //
 // ----------------------------------------------------------------------------
 
-VarIdentifierNode::VarIdentifierNode(const std::string & name)
+VarIdentifierNode::VarIdentifierNode(const InternedString & name, std::size_t offset)
     : m_name(name)
+    , m_offset(offset)
 {
     // No further initialisation
 }
 
-const std::string & VarIdentifierNode::getName() const
+const InternedString & VarIdentifierNode::getName() const
 {
     return m_name;
 }
 
-std::string VarIdentifierNode::evaluate(EvalAddressCallback evalAddrCb, EvalFunctionCallback evalFuncCb, void * pData) const
+std::size_t VarIdentifierNode::getOffset() const
 {
-    return m_name;
+    return m_offset;
+}
+
+Rope VarIdentifierNode::evaluate(EvalAddressCallback evalAddrCb, EvalRangeCallback evalRangeCb, EvalFunctionCallback evalFuncCb,
+        void * pData) const
+{
+    return Rope(m_name.str());
+}
+
+Node * VarIdentifierNode::relocate(Relocation & relocation) const
+{
+    // Identifiers only ever name functions, which are not moved
+    return new VarIdentifierNode(m_name, relocation.keep(m_offset, m_name.size()));
+}
+
+void VarIdentifierNode::writeShape(std::ostream & os, const Address &) const
+{
+    os << "id{" << m_name << "}";
 }
 
 VarIdentifierNode::operator std::string() const
@@ -172,10 +730,13 @@ VarIdentifierNode::operator std::string() const
 //
 // ----------------------------------------------------------------------------
 
-VarAddressNode::VarAddressNode(const Address & address)
+VarAddressNode::VarAddressNode(const Address & address, std::size_t offset, std::size_t length)
     : m_address(address)
+    , m_offset(offset)
+    , m_length(length)
+    , m_index(0)
 {
-
+    // No further initialisation
 }
 
 const Address& VarAddressNode::getAddress() const
@@ -183,9 +744,46 @@ const Address& VarAddressNode::getAddress() const
     return m_address;
 }
 
-std::string VarAddressNode::evaluate(EvalAddressCallback evalAddrCb, EvalFunctionCallback evalFuncCb, void * pData) const
+Rope VarAddressNode::evaluate(EvalAddressCallback evalAddrCb, EvalRangeCallback evalRangeCb, EvalFunctionCallback evalFuncCb,
+        void * pData) const
+{
+    return evalAddrCb(m_address, m_index, pData);
+}
+
+void VarAddressNode::evaluateLanes(std::size_t, EvalAddressLanesCallback evalAddrCb, EvalRangeLanesCallback,
+        EvalFunctionCallback, void * pData, Lanes & result) const
+{
+    result = evalAddrCb(m_address, m_index, pData);
+}
+
+void VarAddressNode::getReferences(Addresses & addresses) const
+{
+    addresses.push_back(m_address);
+}
+
+void VarAddressNode::indexReferences(Addresses & addresses) const
 {
-    return evalAddrCb(m_address, pData);
+    m_index = addresses.size();
+    addresses.push_back(m_address);
+}
+
+Node * VarAddressNode::relocate(Relocation & relocation) const
+{
+    Address address(m_address);
+    if (!relocation.moveAddress(address)) {
+        relocation.replace(m_offset, m_length, REF_ERROR);
+        return new RefErrorNode();
+    } else if (address == m_address) {
+        return new VarAddressNode(address, relocation.keep(m_offset, m_length), m_length);
+    }
+
+    const std::string text = address.toString();
+    return new VarAddressNode(address, relocation.replace(m_offset, m_length, text), text.size());
+}
+
+void VarAddressNode::writeShape(std::ostream & os, const Address & origin) const
+{
+    os << "R[" << long(m_address.row) - long(origin.row) << "]C[" << long(m_address.column) - long(origin.column) << "]";
 }
 
 VarAddressNode::operator std::string() const
@@ -195,6 +793,128 @@ VarAddressNode::operator std::string() const
     return ss.str();
 }
 
+// ----------------------------------------------------------------------------
+//
+// RefErrorNode
+//
+// ----------------------------------------------------------------------------
+
+Rope RefErrorNode::evaluate(EvalAddressCallback, EvalRangeCallback, EvalFunctionCallback, void *) const
+{
+    return "ERROR";
+}
+
+Node * RefErrorNode::relocate(Relocation &) const
+{
+    // Written as #REF!, which is copied along with the surrounding text
+    return new RefErrorNode();
+}
+
+void RefErrorNode::writeShape(std::ostream & os, const Address &) const
+{
+    os << REF_ERROR;
+}
+
+RefErrorNode::operator std::string() const
+{
+    return REF_ERROR;
+}
+
+// ----------------------------------------------------------------------------
+//
+// RangeNode
+//
+// ----------------------------------------------------------------------------
+
+RangeNode::RangeNode(const Range & range, std::size_t offset, std::size_t length)
+    : m_range(range)
+    , m_offset(offset)
+    , m_length(length)
+    , m_index(0)
+{
+    // No further initialisation
+}
+
+const Range & RangeNode::getRange() const
+{
+    return m_range;
+}
+
+Rope RangeNode::evaluate(EvalAddressCallback, EvalRangeCallback, EvalFunctionCallback, void *) const
+{
+    return "ERROR";
+}
+
+bool RangeNode::evaluateArray(EvalAddressCallback, EvalRangeCallback evalRangeCb, EvalFunctionCallback,
+        EvalArrayFunctionCallback, void * pData, Array & result) const
+{
+    const std::size_t rows = std::size_t(m_range.last.row - m_range.first.row) + 1;
+    const std::size_t columns = std::size_t(m_range.last.column - m_range.first.column) + 1;
+    if (rows > MAX_ARRAY_SIZE / columns) {
+        result.rows = result.columns = 1;
+        result.values.setStrings(std::vector<Rope>(1, Rope("ERROR")));
+        return true;
+    }
+
+    std::vector<RangeCell> cells;
+    evalRangeCb(m_range, m_index, cells, pData);
+
+    // Cells are read down each column in turn, and are placed in the array
+    // across each row in turn
+    std::vector<Rope> values(rows * columns);
+    for (std::vector<RangeCell>::iterator itr = cells.begin(); itr != cells.end(); itr++) {
+        const std::size_t row = itr->address.row - m_range.first.row;
+        const std::size_t column = itr->address.column - m_range.first.column;
+        values[row * columns + column].swap(itr->value);
+    }
+
+    result.rows = rows;
+    result.columns = columns;
+    result.values.setStrings(values);
+    return true;
+}
+
+void RangeNode::evaluateRange(EvalRangeCallback evalRangeCb, void * pData, std::vector<RangeCell> & cells) const
+{
+    cells.clear();
+    evalRangeCb(m_range, m_index, cells, pData);
+}
+
+void RangeNode::indexRanges(Ranges & ranges) const
+{
+    m_index = ranges.size();
+    ranges.push_back(m_range);
+}
+
+Node * RangeNode::relocate(Relocation & relocation) const
+{
+    Range range(m_range);
+    if (!relocation.moveRange(range)) {
+        relocation.replace(m_offset, m_length, REF_ERROR);
+        return new RefErrorNode();
+    } else if (range == m_range) {
+        return new RangeNode(range, relocation.keep(m_offset, m_length), m_length);
+    }
+
+    const std::string text = range.toString();
+    return new RangeNode(range, relocation.replace(m_offset, m_length, text), text.size());
+}
+
+void RangeNode::writeShape(std::ostream & os, const Address & origin) const
+{
+    os << "R[" << long(m_range.first.row) - long(origin.row) << "]C[" << long(m_range.first.column) - long(origin.column)
+       << "]:R[" << long(m_range.last.row) - long(origin.row) << "]C[" << long(m_range.last.column) - long(origin.column)
+       << "]";
+}
+
+RangeNode::operator std::string() const
+{
+    std::stringstream ss;
+    ss << "range{" << m_range.first.column << "," << m_range.first.row << ":"
+       << m_range.last.column << "," << m_range.last.row << "}";
+    return ss.str();
+}
+
 // ----------------------------------------------------------------------------
 //
 // FnCallNode
@@ -210,24 +930,85 @@ FnCallNode::~FnCallNode()
     m_params.clear();
 }
 
-void FnCallNode::setFnName(const std::string & name)
+void FnCallNode::setFnName(const InternedString & name)
 {
     m_fnName = name;
 }
 
+const InternedString & FnCallNode::getFnName() const
+{
+    return m_fnName;
+}
+
 void FnCallNode::pushParam(const Node * pNode)
 {
     m_params.push_back(pNode);
 }
 
-std::string FnCallNode::evaluate(EvalAddressCallback evalAddrCb, EvalFunctionCallback evalFuncCb, void * pData) const
+const FnCallNode::Params & FnCallNode::getParams() const
+{
+    return m_params;
+}
+
+Rope FnCallNode::evaluate(EvalAddressCallback evalAddrCb, EvalRangeCallback evalRangeCb, EvalFunctionCallback evalFuncCb,
+        void * pData) const
+{
+    // Parameters are evaluated lazily, by the function itself
+    const Arguments arguments(m_params, evalAddrCb, evalRangeCb, evalFuncCb, NULL, pData);
+    return evalFuncCb(m_fnName, arguments, pData);
+}
+
+bool FnCallNode::evaluateArray(EvalAddressCallback evalAddrCb, EvalRangeCallback evalRangeCb,
+        EvalFunctionCallback evalFuncCb, EvalArrayFunctionCallback evalArrayFuncCb, void * pData, Array & result) const
+{
+    const Arguments arguments(m_params, evalAddrCb, evalRangeCb, evalFuncCb, evalArrayFuncCb, pData);
+    return evalArrayFuncCb(m_fnName, arguments, pData, result);
+}
+
+void FnCallNode::getReferences(Addresses & addresses) const
 {
-    Arguments arguments;
     for (Params::const_iterator itr = m_params.begin(); itr != m_params.end(); itr++) {
-        arguments.push_back((*itr)->evaluate(evalAddrCb, evalFuncCb, pData));
+        (*itr)->getReferences(addresses);
     }
+}
 
-    return evalFuncCb(m_fnName, arguments, pData);
+void FnCallNode::indexReferences(Addresses & addresses) const
+{
+    for (Params::const_iterator itr = m_params.begin(); itr != m_params.end(); itr++) {
+        (*itr)->indexReferences(addresses);
+    }
+}
+
+void FnCallNode::indexRanges(Ranges & ranges) const
+{
+    for (Params::const_iterator itr = m_params.begin(); itr != m_params.end(); itr++) {
+        (*itr)->indexRanges(ranges);
+    }
+}
+
+Node * FnCallNode::relocate(Relocation & relocation) const
+{
+    std::unique_ptr<FnCallNode> pNode(new FnCallNode());
+    pNode->setFnName(m_fnName);
+    for (Params::const_iterator itr = m_params.begin(); itr != m_params.end(); itr++) {
+        std::unique_ptr<Node> pParam((*itr)->relocate(relocation));
+        pNode->pushParam(pParam.get());
+        pParam.release();
+    }
+
+    return pNode.release();
+}
+
+void FnCallNode::writeShape(std::ostream & os, const Address & origin) const
+{
+    os << "fn{" << m_fnName << "}(";
+    for (Params::const_iterator itr = m_params.begin(); itr != m_params.end(); itr++) {
+        if (itr != m_params.begin()) {
+            os << ",";
+        }
+        (*itr)->writeShape(os, origin);
+    }
+    os << ")";
 }
 
 FnCallNode::operator std::string() const
@@ -1,21 +1,271 @@
 #pragma once
 
+#include <cstddef>
+#include <iosfwd>
 #include <string>
 #include <vector>
 
 #include "address.hpp"
 #include "binary_op.h"
+#include "range.hpp"
+#include "rope.hpp"
+#include "strings.hpp"
 
-typedef std::vector<std::string> Arguments;
+class Arguments;
+class Node;
+class Relocation;
+struct Array;
+struct Lanes;
 
-typedef std::string (*EvalAddressCallback)(const Address &, void * pData);
-typedef std::string (*EvalFunctionCallback)(const std::string & name, const Arguments &, void * pData);
+typedef std::vector<Address> Addresses;
+
+typedef std::vector<Range> Ranges;
+
+/// Value of a cell that has been set, within a range
+struct RangeCell
+{
+    Address address;
+    Rope value;
+};
+
+typedef Rope (*EvalAddressCallback)(const Address &, std::size_t reference, void * pData);
+typedef void (*EvalRangeCallback)(const Range &, std::size_t index, std::vector<RangeCell> & cells, void * pData);
+typedef Rope (*EvalFunctionCallback)(const std::string & name, const Arguments &, void * pData);
+typedef bool (*EvalArrayFunctionCallback)(const std::string & name, const Arguments &, void * pData,
+    Array & result);
+typedef const Lanes & (*EvalAddressLanesCallback)(const Address &, std::size_t reference, void * pData);
+typedef void (*EvalRangeLanesCallback)(const Range &, std::size_t index, std::size_t lane,
+    std::vector<RangeCell> & cells, void * pData);
+typedef bool (*RelocateAddressCallback)(Address &, void * pData);
+typedef bool (*RelocateRangeCallback)(Range &, void * pData);
+
+/**
+ * Values of an expression across a batch of evaluations, one per lane.
+ *
+ * While every lane holds a number, values are kept in the numbers vector so
+ * that arithmetic can be applied to all lanes in a single tight loop. Any
+ * other values are kept as strings, and are combined one lane at a time, in
+ * the same way as scalar evaluation.
+ */
+struct Lanes
+{
+    Lanes()
+        : numeric(true)
+    {
+        // No further initialisation
+    }
+
+    /// Number of lanes
+    std::size_t size() const
+    {
+        return numeric ? numbers.size() : strings.size();
+    }
+
+    /// Value of a lane, in the same format as a scalar result
+    Rope getString(std::size_t lane) const;
+
+    /**
+     * Replace the values of all lanes. Values are stored as numbers if every
+     * value is a number that is formatted in the same way as a scalar result.
+     */
+    void setStrings(const std::vector<Rope> & values);
+
+    bool numeric;
+
+    std::vector<double> numbers;
+
+    std::vector<Rope> strings;
+};
+
+/**
+ * Values of an array, such as the result of MMULT, in row-major order. The
+ * values are held as one lane per element, so that an array of numbers is
+ * kept as numbers.
+ */
+struct Array
+{
+    Array()
+        : rows(0)
+        , columns(0)
+    {
+        // No further initialisation
+    }
+
+    std::size_t rows;
+
+    std::size_t columns;
+
+    Lanes values;
+};
+
+/**
+ * Arguments passed to a function call.
+ *
+ * Arguments are not evaluated until a function asks for them, so functions
+ * such as IF only pay for (and only depend on) the arguments they use. Each
+ * call to evaluate() evaluates the argument again.
+ *
+ * An argument may be a range of cells, such as A1:B10, rather than a single
+ * value. The cells in a range are read using evaluateRange().
+ */
+class Arguments
+{
+public:
+    /// @param  evalArrayFuncCb  Callback for arrays, which may be null if the
+    ///                          arguments are only evaluated for single values
+    Arguments(const std::vector<const Node *> & params, EvalAddressCallback, EvalRangeCallback,
+        EvalFunctionCallback, EvalArrayFunctionCallback evalArrayFuncCb, void * pData);
+
+    /// Number of arguments passed to the function
+    std::size_t size() const;
+
+    /// Evaluate an argument, where index is in the range [0, size())
+    Rope evaluate(std::size_t index) const;
+
+    /// Returns true if an argument is a range of cells
+    bool isRange(std::size_t index) const;
+
+    /**
+     * Retrieve the cells within a range argument that have been set, in
+     * address order (i.e. by column, then by row).
+     *
+     * @throws  std::runtime_error if the argument is not a range
+     */
+    void evaluateRange(std::size_t index, std::vector<RangeCell> & cells) const;
+
+    /**
+     * Retrieve the cells covered by a range argument, without reading them.
+     *
+     * @throws  std::runtime_error if the argument is not a range
+     */
+    const Range & getRange(std::size_t index) const;
+
+    /**
+     * Evaluate an argument as an array, such as A1:B2*2. Ranges are read in
+     * the same way as for evaluateRange().
+     *
+     * @returns false, having evaluated nothing, if the argument does not
+     *          evaluate to an array, or the arguments have no callback for
+     *          arrays
+     */
+    bool evaluateArray(std::size_t index, Array & result) const;
+
+    /**
+     * Retrieve the name of the function called by an argument, such as the
+     * TRANSPOSE in MMULT(TRANSPOSE(A1:B2), A1:B2), so that the call can be
+     * made by the function itself, e.g. to obtain an array.
+     *
+     * @returns name, or an empty string if the argument is not a call
+     */
+    std::string getFunctionName(std::size_t index) const;
+
+    /**
+     * Retrieve the arguments of a function called by an argument, which are
+     * evaluated in the same way as these arguments.
+     *
+     * @throws  std::runtime_error if the argument is not a call
+     */
+    Arguments getFunctionArguments(std::size_t index) const;
+
+private:
+    const std::vector<const Node *> & m_params;
+    EvalAddressCallback m_evalAddrCb;
+    EvalRangeCallback m_evalRangeCb;
+    EvalFunctionCallback m_evalFuncCb;
+    EvalArrayFunctionCallback m_evalArrayFuncCb;
+    void * m_pData;
+};
+
+/**
+ * Text of a formula whose references are being moved, as its tree is copied
+ * by Node::relocate().
+ *
+ * Each node that was written as one or more tokens reports the position of
+ * its text in the source, in the order that the nodes appear in the formula,
+ * along with the text that replaces it. Everything between those tokens,
+ * including literals and whitespace, is copied as it was written.
+ */
+class Relocation
+{
+public:
+    Relocation(const std::string & source, RelocateAddressCallback, RelocateRangeCallback, void * pData);
+
+    bool moveAddress(Address & address) const;
+
+    bool moveRange(Range & range) const;
+
+    /**
+     * Copy the source up to a node's text, then write its replacement.
+     *
+     * @returns offset of the replacement in the new text
+     */
+    std::size_t replace(std::size_t offset, std::size_t length, const std::string & replacement);
+
+    /**
+     * Copy the source up to and including a node's text, which is unchanged.
+     *
+     * @returns offset of the text in the new text
+     */
+    std::size_t keep(std::size_t offset, std::size_t length);
+
+    /// Copy the rest of the source, returning the complete new text
+    const std::string & finish();
+
+private:
+    const std::string & m_source;
+    RelocateAddressCallback m_moveAddressCb;
+    RelocateRangeCallback m_moveRangeCb;
+    void * m_pData;
+    std::string m_text;
+
+    // Position in the source up to which text has been copied
+    std::size_t m_position;
+};
 
 class Node
 {
 public:
     virtual ~Node() {};
-    virtual std::string evaluate(EvalAddressCallback, EvalFunctionCallback, void * pData) const = 0;
+    virtual Rope evaluate(EvalAddressCallback, EvalRangeCallback, EvalFunctionCallback, void * pData) const = 0;
+
+    /**
+     * Evaluate a node across a batch of lanes. References are resolved to the
+     * values of every lane at once. The default implementation evaluates each
+     * lane separately, using evaluate().
+     */
+    virtual void evaluateLanes(std::size_t count, EvalAddressLanesCallback, EvalRangeLanesCallback,
+        EvalFunctionCallback, void * pData, Lanes & result) const;
+
+    /**
+     * Evaluate a node as an array, if it is one, or if any of its operands
+     * is. Operators are applied to each element in turn, and an operand with
+     * a single row or column is repeated to match the other. The default
+     * implementation returns false, as most nodes have single values.
+     *
+     * @returns false, having evaluated nothing, if the node has a single value
+     */
+    virtual bool evaluateArray(EvalAddressCallback, EvalRangeCallback, EvalFunctionCallback,
+        EvalArrayFunctionCallback, void * pData, Array & result) const;
+
+    virtual void getReferences(Addresses &) const {};
+    virtual void indexReferences(Addresses &) const {};
+    virtual void indexRanges(Ranges &) const {};
+
+    /**
+     * Copy the node and its children, moving any references, and writing
+     * the text of the copy as it goes.
+     *
+     * @returns the copy, which the caller owns
+     */
+    virtual Node * relocate(Relocation &) const = 0;
+
+    /**
+     * Write the node in relative notation, where references are written as
+     * offsets from an origin. Formulas that were filled down or across from
+     * one another have the same shape, relative to their own cells.
+     */
+    virtual void writeShape(std::ostream &, const Address & origin) const = 0;
+
     virtual operator std::string() const = 0;
 };
 
@@ -23,7 +273,11 @@ class LitDoubleNode: public Node
 {
 public:
     LitDoubleNode(double value);
-    virtual std::string evaluate(EvalAddressCallback, EvalFunctionCallback, void * pData) const;
+    virtual Rope evaluate(EvalAddressCallback, EvalRangeCallback, EvalFunctionCallback, void * pData) const;
+    virtual void evaluateLanes(std::size_t count, EvalAddressLanesCallback, EvalRangeLanesCallback,
+        EvalFunctionCallback, void * pData, Lanes & result) const;
+    virtual Node * relocate(Relocation &) const;
+    virtual void writeShape(std::ostream &, const Address & origin) const;
     virtual operator std::string() const;
 private:
     double m_value;
@@ -32,11 +286,15 @@ private:
 class LitStringNode : public Node
 {
 public:
-    LitStringNode(const std::string & value);
-    virtual std::string evaluate(EvalAddressCallback, EvalFunctionCallback, void * pData) const;
+    LitStringNode(const InternedString & value);
+    virtual Rope evaluate(EvalAddressCallback, EvalRangeCallback, EvalFunctionCallback, void * pData) const;
+    virtual void evaluateLanes(std::size_t count, EvalAddressLanesCallback, EvalRangeLanesCallback,
+        EvalFunctionCallback, void * pData, Lanes & result) const;
+    virtual Node * relocate(Relocation &) const;
+    virtual void writeShape(std::ostream &, const Address & origin) const;
     virtual operator std::string() const;
 private:
-    std::string m_value;
+    InternedString m_value;
 };
 
 class BinaryOpNode: public Node
@@ -44,7 +302,16 @@ class BinaryOpNode: public Node
 public:
     BinaryOpNode(BinaryOp binaryOp, const Node * pLeft, const Node * pRight);
     virtual ~BinaryOpNode();
-    virtual std::string evaluate(EvalAddressCallback, EvalFunctionCallback, void * pData) const;
+    virtual Rope evaluate(EvalAddressCallback, EvalRangeCallback, EvalFunctionCallback, void * pData) const;
+    virtual void evaluateLanes(std::size_t count, EvalAddressLanesCallback, EvalRangeLanesCallback,
+        EvalFunctionCallback, void * pData, Lanes & result) const;
+    virtual bool evaluateArray(EvalAddressCallback, EvalRangeCallback, EvalFunctionCallback,
+        EvalArrayFunctionCallback, void * pData, Array & result) const;
+    virtual void getReferences(Addresses &) const;
+    virtual void indexReferences(Addresses &) const;
+    virtual void indexRanges(Ranges &) const;
+    virtual Node * relocate(Relocation &) const;
+    virtual void writeShape(std::ostream &, const Address & origin) const;
     virtual operator std::string() const;
 private:
     BinaryOp m_binaryOp;
@@ -55,35 +322,114 @@ private:
 class VarIdentifierNode: public Node
 {
 public:
-    VarIdentifierNode(const std::string & name);
-    const std::string & getName() const;
-    virtual std::string evaluate(EvalAddressCallback, EvalFunctionCallback, void * pData) const;
+    /// @param  offset  Position of the identifier in the text of the formula
+    VarIdentifierNode(const InternedString & name, std::size_t offset);
+    const InternedString & getName() const;
+    std::size_t getOffset() const;
+    virtual Rope evaluate(EvalAddressCallback, EvalRangeCallback, EvalFunctionCallback, void * pData) const;
+    virtual Node * relocate(Relocation &) const;
+    virtual void writeShape(std::ostream &, const Address & origin) const;
     virtual operator std::string() const;
 private:
-    std::string m_name;
+    InternedString m_name;
+    std::size_t m_offset;
 };
 
 class VarAddressNode: public Node
 {
 public:
-    VarAddressNode(const Address & address);
+    /// @param  offset, length  Position of the address in the text of the formula
+    VarAddressNode(const Address & address, std::size_t offset, std::size_t length);
     const Address & getAddress() const;
-    virtual std::string evaluate(EvalAddressCallback, EvalFunctionCallback, void * pData) const;
+    virtual Rope evaluate(EvalAddressCallback, EvalRangeCallback, EvalFunctionCallback, void * pData) const;
+    virtual void evaluateLanes(std::size_t count, EvalAddressLanesCallback, EvalRangeLanesCallback,
+        EvalFunctionCallback, void * pData, Lanes & result) const;
+    virtual void getReferences(Addresses &) const;
+    virtual void indexReferences(Addresses &) const;
+    virtual Node * relocate(Relocation &) const;
+    virtual void writeShape(std::ostream &, const Address & origin) const;
     virtual operator std::string() const;
 private:
     Address m_address;
+    std::size_t m_offset;
+    std::size_t m_length;
+
+    // Position of this reference within the formula, which is passed to the
+    // EvalAddressCallback. Assigned once by indexReferences(), before the
+    // tree is shared.
+    mutable std::size_t m_index;
+};
+
+/**
+ * Reference to a cell, or a range, that has been deleted. This is written as
+ * #REF!, and evaluates to ERROR.
+ */
+class RefErrorNode: public Node
+{
+public:
+    virtual Rope evaluate(EvalAddressCallback, EvalRangeCallback, EvalFunctionCallback, void * pData) const;
+    virtual Node * relocate(Relocation &) const;
+    virtual void writeShape(std::ostream &, const Address & origin) const;
+    virtual operator std::string() const;
+};
+
+/**
+ * Rectangular range of cells. A function reads the cells using
+ * evaluateRange(), and elsewhere a range is an array of their values. The
+ * cells do not count as references.
+ */
+class RangeNode: public Node
+{
+public:
+    /// @param  offset, length  Position of the range in the text of the formula, from
+    ///                         the start of its first corner to the end of its last
+    RangeNode(const Range & range, std::size_t offset, std::size_t length);
+    const Range & getRange() const;
+
+    /// A range has no single value, so this is an error
+    virtual Rope evaluate(EvalAddressCallback, EvalRangeCallback, EvalFunctionCallback, void * pData) const;
+
+    /// Read the values of every cell in the range, including those that have not been set
+    virtual bool evaluateArray(EvalAddressCallback, EvalRangeCallback, EvalFunctionCallback,
+        EvalArrayFunctionCallback, void * pData, Array & result) const;
+
+    void evaluateRange(EvalRangeCallback, void * pData, std::vector<RangeCell> & cells) const;
+    virtual void indexRanges(Ranges &) const;
+    virtual Node * relocate(Relocation &) const;
+    virtual void writeShape(std::ostream &, const Address & origin) const;
+    virtual operator std::string() const;
+private:
+    Range m_range;
+    std::size_t m_offset;
+    std::size_t m_length;
+
+    // Position of this range within the formula, which is passed to the
+    // EvalRangeCallback. Assigned once by indexRanges(), before the tree is
+    // shared.
+    mutable std::size_t m_index;
 };
 
 class FnCallNode: public Node
 {
 public:
+    typedef std::vector<const Node *> Params;
     virtual ~FnCallNode();
-    void setFnName(const std::string & fnName);
+    void setFnName(const InternedString & fnName);
+    const InternedString & getFnName() const;
     void pushParam(const Node * pNode);
-    virtual std::string evaluate(EvalAddressCallback, EvalFunctionCallback, void * pData) const;
+    const Params & getParams() const;
+    virtual Rope evaluate(EvalAddressCallback, EvalRangeCallback, EvalFunctionCallback, void * pData) const;
+
+    /// Call the function for an array, returning false if it does not return one
+    virtual bool evaluateArray(EvalAddressCallback, EvalRangeCallback, EvalFunctionCallback,
+        EvalArrayFunctionCallback, void * pData, Array & result) const;
+    virtual void getReferences(Addresses &) const;
+    virtual void indexReferences(Addresses &) const;
+    virtual void indexRanges(Ranges &) const;
+    virtual Node * relocate(Relocation &) const;
+    virtual void writeShape(std::ostream &, const Address & origin) const;
     virtual operator std::string() const;
 private:
-    typedef std::vector<const Node *> Params;
     Params m_params;
-    std::string m_fnName;
+    InternedString m_fnName;
 };
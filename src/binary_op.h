@@ -4,5 +4,11 @@ enum BinaryOp {
     BINARY_OP_ADD,
     BINARY_OP_SUBTRACT,
     BINARY_OP_MULTIPLY,
-    BINARY_OP_DIVIDE
+    BINARY_OP_DIVIDE,
+    BINARY_OP_EQUAL,
+    BINARY_OP_NOT_EQUAL,
+    BINARY_OP_LESS,
+    BINARY_OP_LESS_EQUAL,
+    BINARY_OP_GREATER,
+    BINARY_OP_GREATER_EQUAL
 };
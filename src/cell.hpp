@@ -1,30 +1,80 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
+#include <vector>
+
+#include "rope.hpp"
+#include "strings.hpp"
+
+class Formula;
+
+struct Array;
+
+/// Evaluation statistics accumulated while a Sheet is profiling
+struct CellStats
+{
+    CellStats()
+        : evaluations(0)
+        , inclusiveNanos(0)
+        , exclusiveNanos(0)
+    {
+        // No further initialisation
+    }
+
+    std::uint64_t evaluations;
+    std::uint64_t inclusiveNanos;
+    std::uint64_t exclusiveNanos;
+};
 
 struct Cell
 {
-    Cell(const std::string & formula)
+    explicit Cell(const InternedString & formula)
         : formula(formula)
+        , compiled()
+        , shape()
+        , bindings()
+        , bindingEpoch(0)
+        , precedents()
         , value()
-        , phase(0)
-        , processed(false)
+        , array()
+        , stats()
     {
         // No further initialisation
     }
 
-    // Literal cell formula
-    std::string formula;
+    // Literal cell formula, interned in the StringPool of the Cells that hold it
+    InternedString formula;
+
+    // Compiled formula; reset whenever the formula changes, and compiled again lazily
+    std::shared_ptr<Formula> compiled;
+
+    // Shape of the compiled formula, relative to this cell; cells with the same shape in
+    // consecutive rows of a column form a run, which can be evaluated as a batch
+    std::string shape;
+
+    // Slot of each cell referenced by the compiled formula, in the order returned by
+    // Formula::getReferences(), or Cells::npos for references to cells that are not set
+    std::vector<std::size_t> bindings;
+
+    // Cells epoch at which the bindings were resolved; they are resolved again when the epoch
+    // changes, i.e. after a cell has been created or erased
+    unsigned long bindingEpoch;
+
+    // Slots of the cells that were actually read by the most recent evaluation, sorted and
+    // without duplicates; references in arguments that a function did not evaluate (such as the
+    // branch of an IF that was not taken) are not included
+    std::vector<std::size_t> precedents;
 
-    // Cached value
-    std::string value;
+    // Cached value, which may share storage with the values of other cells
+    Rope value;
 
-    // This variable is used to track when this cell was last re-calculated. If the phase value is
-    // the same as that for the parent Sheet instance, then the cell has been visited by the
-    // current re-calculation pass. If it has the opposite sign, then the cell was last visited in
-    // the previous re-calculation pass.
-    int phase;
+    // Cached array, if the formula evaluates to one, such as =A1:A10*2 or =MMULT(...); the value
+    // of the cell is its first value, and the rest spill into the cells below and to the right
+    std::shared_ptr<const Array> array;
 
-    // Flag to track whether the cell has been processed in the current recalculation pass
-    bool processed;
+    // Statistics accumulated across recalculations while profiling
+    CellStats stats;
 };
@@ -0,0 +1,845 @@
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include "ast.hpp"
+#include "cells.hpp"
+
+namespace
+{
+    /// Encodings for the values in a segment of a compressed chunk
+    enum ValueEncoding
+    {
+        ENCODING_PLAIN,
+        ENCODING_DICTIONARY,
+        ENCODING_DELTA
+    };
+
+    /// How the formula of a cell in a compressed chunk relates to its value
+    enum FormulaKind
+    {
+        FORMULA_STORED,
+        FORMULA_QUOTED,     // ' followed by the value
+        FORMULA_EQUALS      // = followed by the value
+    };
+
+    FormulaKind getFormulaKind(const Cell & cell)
+    {
+        const std::string & formula = cell.formula;
+        if (formula.size() != cell.value.size() + 1 || formula.compare(1, std::string::npos, cell.value.str()) != 0) {
+            return FORMULA_STORED;
+        }
+
+        return formula[0] == '\'' ? FORMULA_QUOTED : formula[0] == '=' ? FORMULA_EQUALS : FORMULA_STORED;
+    }
+
+    /// Comparison for ordering the cells of a chunk by their addresses
+    struct AddressOrder
+    {
+        const std::vector<Address> & addresses;
+
+        bool operator()(std::size_t lhs, std::size_t rhs) const
+        {
+            return addresses[lhs] < addresses[rhs];
+        }
+    };
+
+    /**
+     * Order the cells of a chunk by column, and then by row, so that the
+     * cells in each column form a segment.
+     */
+    void orderByAddress(const std::vector<Address> & addresses, std::vector<std::size_t> & order)
+    {
+        order.resize(addresses.size());
+        for (std::size_t i = 0; i < order.size(); i++) {
+            order[i] = i;
+        }
+
+        AddressOrder compare = {addresses};
+        std::stable_sort(order.begin(), order.end(), compare);
+    }
+
+    /// Columns stop adding values to their dictionaries once they hold this many
+    const std::size_t MAX_DICTIONARY_SIZE = 1 << 16;
+
+    /// Columns stop remembering values that might be worth adding once they hold this many
+    const std::size_t MAX_CANDIDATES = 1 << 12;
+
+    void putVarint(std::string & bytes, std::uint64_t number)
+    {
+        while (number >= 0x80) {
+            bytes.push_back(char((number & 0x7f) | 0x80));
+            number >>= 7;
+        }
+
+        bytes.push_back(char(number));
+    }
+
+    void putString(std::string & bytes, const std::string & str)
+    {
+        putVarint(bytes, str.size());
+        bytes.append(str);
+    }
+
+    std::uint64_t zigzag(std::int64_t number)
+    {
+        return (std::uint64_t(number) << 1) ^ std::uint64_t(number >> 63);
+    }
+
+    std::int64_t unzigzag(std::uint64_t number)
+    {
+        return std::int64_t(number >> 1) ^ -std::int64_t(number & 1);
+    }
+
+    /**
+     * Parse an integer written in the form that std::to_string() would write
+     * it, so that it can be written back out exactly.
+     */
+    bool parseInteger(const std::string & str, std::int64_t & number)
+    {
+        const std::size_t sign = !str.empty() && str[0] == '-' ? 1 : 0;
+        const std::size_t digits = str.size() - sign;
+        if (digits == 0 || digits > 18 || (str[sign] == '0' && (digits > 1 || sign))) {
+            return false;
+        }
+
+        number = 0;
+        for (std::size_t i = sign; i < str.size(); i++) {
+            if (str[i] < '0' || str[i] > '9') {
+                return false;
+            }
+            number = number * 10 + (str[i] - '0');
+        }
+
+        if (sign) {
+            number = -number;
+        }
+
+        return true;
+    }
+
+    /// Run-length encode strings, as pairs of run length and string
+    void putPlain(std::string & bytes, const std::vector<const std::string *> & values)
+    {
+        for (std::size_t i = 0; i < values.size(); ) {
+            std::size_t run = 1;
+            while (i + run < values.size() && *values[i + run] == *values[i]) {
+                run++;
+            }
+
+            putVarint(bytes, run);
+            putString(bytes, *values[i]);
+            i += run;
+        }
+    }
+
+    /// Run-length encode the differences between integers, as pairs of run length and difference
+    bool putDelta(std::string & bytes, const std::vector<const std::string *> & values)
+    {
+        std::vector<std::int64_t> deltas(values.size());
+        std::int64_t previous = 0;
+        for (std::size_t i = 0; i < values.size(); i++) {
+            std::int64_t number;
+            if (!parseInteger(*values[i], number)) {
+                return false;
+            }
+            deltas[i] = number - previous;
+            previous = number;
+        }
+
+        for (std::size_t i = 0; i < deltas.size(); ) {
+            std::size_t run = 1;
+            while (i + run < deltas.size() && deltas[i + run] == deltas[i]) {
+                run++;
+            }
+
+            putVarint(bytes, run);
+            putVarint(bytes, zigzag(deltas[i]));
+            i += run;
+        }
+
+        return true;
+    }
+
+    /// Reads the fields of a compressed chunk in the order that they were written
+    class Reader
+    {
+    public:
+        explicit Reader(const std::string & bytes)
+            : m_pos(bytes.data())
+            , m_end(bytes.data() + bytes.size())
+        {
+            // No further initialisation
+        }
+
+        std::uint64_t getVarint()
+        {
+            std::uint64_t number = 0;
+            for (int shift = 0; ; shift += 7) {
+                check(shift < 64 && m_pos < m_end);
+                const unsigned char byte = static_cast<unsigned char>(*m_pos++);
+                number |= std::uint64_t(byte & 0x7f) << shift;
+                if (byte < 0x80) {
+                    return number;
+                }
+            }
+        }
+
+        void getString(std::string & str)
+        {
+            const std::uint64_t length = getVarint();
+            check(length <= std::uint64_t(m_end - m_pos));
+            str.assign(m_pos, std::size_t(length));
+            m_pos += length;
+        }
+
+        /// Read the length of the next run, which must fit in the cells that remain
+        std::size_t getRun(std::size_t remaining)
+        {
+            const std::uint64_t run = getVarint();
+            check(run > 0 && run <= remaining);
+            return std::size_t(run);
+        }
+
+        void check(bool valid) const
+        {
+            if (!valid) {
+                throw std::runtime_error("Compressed block is corrupt.");
+            }
+        }
+
+    private:
+        const char * m_pos;
+        const char * m_end;
+    };
+
+    /**
+     * Rough estimate of the memory used by a cell, not counting its compiled
+     * formula, which is dropped when the cell is paged out. The formula is
+     * counted in full, although it may be shared with other cells.
+     */
+    std::size_t estimateBytes(const Cell & cell)
+    {
+        return sizeof(Cell) + sizeof(Address) +
+            cell.formula.size() + cell.shape.capacity() + cell.value.size() +
+            (cell.bindings.capacity() + cell.precedents.capacity()) * sizeof(std::size_t) +
+            (cell.array ? cell.array->values.size() * sizeof(double) : 0);
+    }
+}
+
+const Cells::Slot Cells::npos = Cells::Slot(-1);
+
+const Cells::Slot Cells::CHUNK_SIZE;
+
+Cells::Cells()
+    : m_pIndex(std::make_shared<Index>())
+    , m_pStrings(std::make_shared<StringPool>())
+    , m_slotCount(0)
+    , m_epoch(0)
+    , m_paging(false)
+    , m_compressedBytes(0)
+    , m_memoryBudget(0)
+    , m_residentBytes(0)
+    , m_lastChunk(npos)
+    , m_clock(0)
+    , m_hits(0)
+    , m_misses(0)
+    , m_evictions(0)
+{
+    // No further initialisation
+}
+
+Cells::Slot Cells::find(const Address & address) const
+{
+    Index::const_iterator itr = m_pIndex->find(address);
+    if (itr == m_pIndex->end()) {
+        return npos;
+    }
+
+    return itr->second;
+}
+
+Cells::Slot Cells::insert(const Address & address, const std::string & formula)
+{
+    Slot slot;
+    if (m_free.empty()) {
+        slot = m_slotCount++;
+        if (slot % CHUNK_SIZE == 0) {
+            m_chunks.push_back(std::make_shared<Chunk>());
+            if (m_paging) {
+                m_blocks.push_back(Block());
+            }
+        }
+
+        Chunk & chunk = unshare(slot);
+        chunk.cells.push_back(Cell(m_pStrings->intern(formula)));
+        chunk.addresses.push_back(address);
+        chunk.used.push_back(true);
+        if (m_paging) {
+            m_blocks[slot / CHUNK_SIZE].bytes += estimateBytes(chunk.cells.back());
+            m_residentBytes += estimateBytes(chunk.cells.back());
+        }
+    } else {
+        slot = m_free.back();
+        m_free.pop_back();
+
+        Chunk & chunk = unshare(slot);
+        chunk.cells[slot % CHUNK_SIZE] = Cell(m_pStrings->intern(formula));
+        chunk.addresses[slot % CHUNK_SIZE] = address;
+        chunk.used[slot % CHUNK_SIZE] = true;
+    }
+
+    unshareIndex().insert(Index::value_type(address, slot));
+    m_epoch++;
+    return slot;
+}
+
+bool Cells::erase(const Address & address)
+{
+    const Slot slot = find(address);
+    if (slot == npos) {
+        return false;
+    }
+
+    unshareIndex().erase(address);
+
+    // Release the compiled formula and cached value now, rather than when
+    // the slot is reused
+    Chunk & chunk = unshare(slot);
+    chunk.cells[slot % CHUNK_SIZE] = Cell(InternedString());
+    chunk.used[slot % CHUNK_SIZE] = false;
+    m_free.push_back(slot);
+    m_epoch++;
+    return true;
+}
+
+void Cells::move(const std::vector<Slot> & slots, const std::vector<Address> & addresses)
+{
+    if (slots.size() != addresses.size()) {
+        throw std::invalid_argument("Every cell that is moved must have a new address.");
+    }
+
+    // Every cell is removed from the index before any are added back, since
+    // cells may move onto each other's addresses
+    Index & index = unshareIndex();
+    for (std::vector<Slot>::const_iterator itr = slots.begin(); itr != slots.end(); itr++) {
+        index.erase(getAddress(*itr));
+        trim();
+    }
+
+    for (std::size_t i = 0; i < slots.size(); i++) {
+        unshare(slots[i]).addresses[slots[i] % CHUNK_SIZE] = addresses[i];
+        index.insert(Index::value_type(addresses[i], slots[i]));
+        trim();
+    }
+
+    m_epoch++;
+}
+
+Cell & Cells::mutate(Slot slot)
+{
+    return unshare(slot).cells[slot % CHUNK_SIZE];
+}
+
+Cell & Cells::annotate(Slot slot)
+{
+    return unshare(slot, false).cells[slot % CHUNK_SIZE];
+}
+
+bool Cells::isShared(Slot slot) const
+{
+    getChunk(slot / CHUNK_SIZE);
+    return m_chunks[slot / CHUNK_SIZE].use_count() > 1;
+}
+
+void Cells::enablePaging(const std::string & path, std::size_t memoryBudget)
+{
+    if (m_paging) {
+        throw std::runtime_error("Paging is already enabled.");
+    }
+
+    m_pFile = std::make_shared<BlockFile>(path);
+    startPaging(memoryBudget);
+}
+
+void Cells::enableCompression(std::size_t memoryBudget)
+{
+    if (m_paging) {
+        throw std::runtime_error("Paging is already enabled.");
+    }
+
+    startPaging(memoryBudget);
+}
+
+PagingStats Cells::getPagingStats() const
+{
+    PagingStats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.evictions = m_evictions;
+    if (m_pFile) {
+        stats.bytesRead = m_pFile->getBytesRead();
+        stats.bytesWritten = m_pFile->getBytesWritten();
+    }
+
+    for (std::size_t chunk = 0; chunk < m_blocks.size(); chunk++) {
+        if (m_chunks[chunk]) {
+            stats.residentBlocks++;
+        }
+    }
+
+    stats.residentBytes = m_residentBytes;
+    stats.compressedBytes = m_compressedBytes;
+    return stats;
+}
+
+std::vector<ColumnCompression> Cells::getColumnCompression() const
+{
+    std::map<unsigned int, ColumnCompression> columns;
+    for (std::vector<Block>::const_iterator block = m_blocks.begin(); block != m_blocks.end(); block++) {
+        for (std::vector<ColumnCompression>::const_iterator segment = block->segments.begin();
+                segment != block->segments.end(); segment++) {
+            ColumnCompression & column = columns[segment->column];
+            column.column = segment->column;
+            column.cells += segment->cells;
+            column.rawBytes += segment->rawBytes;
+            column.encodedBytes += segment->encodedBytes;
+            column.plainSegments += segment->plainSegments;
+            column.dictionarySegments += segment->dictionarySegments;
+            column.deltaSegments += segment->deltaSegments;
+        }
+    }
+
+    std::vector<ColumnCompression> result;
+    for (std::map<unsigned int, ColumnCompression>::iterator itr = columns.begin(); itr != columns.end(); itr++) {
+        std::map<unsigned int, Dictionary>::const_iterator dictionary = m_dictionaries.find(itr->first);
+        if (dictionary != m_dictionaries.end()) {
+            const std::vector<std::string> & values = dictionary->second.values;
+            for (std::vector<std::string>::const_iterator value = values.begin(); value != values.end(); value++) {
+                itr->second.encodedBytes += value->size();
+            }
+        }
+        result.push_back(itr->second);
+    }
+
+    return result;
+}
+
+void Cells::startPaging(std::size_t memoryBudget)
+{
+    m_paging = true;
+    m_memoryBudget = memoryBudget;
+    m_blocks.assign(m_chunks.size(), Block());
+    m_residentBytes = 0;
+    for (std::size_t chunk = 0; chunk < m_chunks.size(); chunk++) {
+        const std::vector<Cell> & cells = m_chunks[chunk]->cells;
+        for (std::vector<Cell>::const_iterator itr = cells.begin(); itr != cells.end(); itr++) {
+            m_blocks[chunk].bytes += estimateBytes(*itr);
+        }
+        m_residentBytes += m_blocks[chunk].bytes;
+    }
+
+    trim();
+}
+
+const Cells::Chunk & Cells::pageIn(std::size_t chunk) const
+{
+    Block & block = m_blocks[chunk];
+    block.lastUsed = ++m_clock;
+    m_lastChunk = chunk;
+
+    if (m_chunks[chunk]) {
+        m_hits++;
+        return *m_chunks[chunk];
+    }
+
+    m_misses++;
+    std::shared_ptr<Chunk> pChunk;
+    if (m_pFile) {
+        std::string bytes;
+        m_pFile->read(block.offset, block.length, bytes);
+        pChunk = unpack(bytes);
+    } else {
+        pChunk = unpack(block.packed);
+    }
+
+    block.bytes = 0;
+    for (std::vector<Cell>::const_iterator itr = pChunk->cells.begin(); itr != pChunk->cells.end(); itr++) {
+        block.bytes += estimateBytes(*itr);
+    }
+
+    m_residentBytes += block.bytes;
+    m_chunks[chunk] = pChunk;
+    return *pChunk;
+}
+
+void Cells::pack(const Chunk & chunk, std::string & bytes, std::vector<ColumnCompression> & segments) const
+{
+    // Everything other than formulas and values is written first, one cell
+    // at a time; slots and addresses are written relative to their neighbours
+    const std::vector<Cell> & cells = chunk.cells;
+    putVarint(bytes, cells.size());
+    Address previous(0, 0);
+    for (std::size_t i = 0; i < cells.size(); i++) {
+        const Cell & cell = cells[i];
+        const Address & address = chunk.addresses[i];
+        putVarint(bytes, chunk.used[i] ? 1 : 0);
+        putVarint(bytes, zigzag(std::int64_t(address.column) - std::int64_t(previous.column)));
+        putVarint(bytes, zigzag(std::int64_t(address.row) - std::int64_t(previous.row)));
+        previous = address;
+
+        putVarint(bytes, cell.bindingEpoch);
+        putVarint(bytes, cell.bindings.size());
+        for (std::vector<Slot>::const_iterator itr = cell.bindings.begin(); itr != cell.bindings.end(); itr++) {
+            putVarint(bytes, *itr == npos ? 0 : *itr + 1);
+        }
+
+        Slot precedent = 0;
+        putVarint(bytes, cell.precedents.size());
+        for (std::vector<Slot>::const_iterator itr = cell.precedents.begin(); itr != cell.precedents.end(); itr++) {
+            putVarint(bytes, *itr - precedent);
+            precedent = *itr;
+        }
+
+        putVarint(bytes, cell.stats.evaluations);
+        putVarint(bytes, cell.stats.inclusiveNanos);
+        putVarint(bytes, cell.stats.exclusiveNanos);
+
+        // Arrays are rare, and are written in full
+        putVarint(bytes, cell.array ? cell.array->rows : 0);
+        if (cell.array) {
+            putVarint(bytes, cell.array->columns);
+            for (std::size_t j = 0; j < cell.array->values.size(); j++) {
+                putString(bytes, cell.array->values.getString(j).str());
+            }
+        }
+    }
+
+    // Formulas and values are then written one segment at a time, where each
+    // segment holds the cells in one column, in row order
+    std::vector<std::size_t> order;
+    orderByAddress(chunk.addresses, order);
+    std::vector<std::string> gathered;
+    std::vector<const std::string *> values;
+    std::vector<const std::string *> formulas;
+    std::string plain;
+    std::string delta;
+    std::string indexed;
+    for (std::size_t begin = 0, end = 0; begin < cells.size(); begin = end) {
+        const unsigned int column = chunk.addresses[order[begin]].column;
+        ColumnCompression segment;
+        segment.column = column;
+        for (end = begin; end < cells.size() && chunk.addresses[order[end]].column == column; end++) {
+            segment.rawBytes += cells[order[end]].formula.size() + cells[order[end]].value.size();
+        }
+        segment.cells = end - begin;
+
+        const std::size_t start = bytes.size();
+        // Values that share storage with other values are written out in full
+        gathered.resize(end - begin);
+        values.clear();
+        for (std::size_t i = begin; i < end; i++) {
+            gathered[i - begin] = cells[order[i]].value.str();
+            values.push_back(&gathered[i - begin]);
+        }
+
+        // Values that are not in the dictionary, and have not been seen in
+        // an earlier segment, count towards the size of the dictionary
+        // encoding, so that it is only used for values that recur
+        plain.clear();
+        putPlain(plain, values);
+
+        delta.clear();
+        const bool integers = putDelta(delta, values);
+
+        Dictionary & dictionary = m_dictionaries[column];
+        std::vector<std::string> added;
+        std::size_t addedBytes = 0;
+        indexed.clear();
+        for (std::size_t i = 0; i < values.size(); ) {
+            std::size_t run = 1;
+            while (i + run < values.size() && *values[i + run] == *values[i]) {
+                run++;
+            }
+
+            std::uint32_t index;
+            std::unordered_map<std::string, std::uint32_t>::const_iterator itr = dictionary.indices.find(*values[i]);
+            if (itr != dictionary.indices.end()) {
+                index = itr->second;
+            } else {
+                const std::vector<std::string>::const_iterator existing =
+                    std::find(added.begin(), added.end(), *values[i]);
+                index = std::uint32_t(dictionary.values.size() + (existing - added.begin()));
+                if (existing == added.end()) {
+                    added.push_back(*values[i]);
+                    if (dictionary.candidates.count(*values[i]) == 0) {
+                        addedBytes += values[i]->size();
+                    }
+                }
+            }
+
+            putVarint(indexed, run);
+            putVarint(indexed, index);
+            i += run;
+        }
+
+        const bool indexable = dictionary.values.size() + added.size() <= MAX_DICTIONARY_SIZE;
+        if (integers && delta.size() <= plain.size() &&
+                (!indexable || delta.size() <= indexed.size() + addedBytes)) {
+            bytes.push_back(char(ENCODING_DELTA));
+            bytes.append(delta);
+            segment.deltaSegments++;
+        } else if (indexable && indexed.size() + addedBytes < plain.size()) {
+            for (std::vector<std::string>::const_iterator itr = added.begin(); itr != added.end(); itr++) {
+                dictionary.indices[*itr] = std::uint32_t(dictionary.values.size());
+                dictionary.values.push_back(*itr);
+                dictionary.candidates.erase(*itr);
+                if (!m_pFile) {
+                    m_compressedBytes += itr->size();
+                }
+            }
+            bytes.push_back(char(ENCODING_DICTIONARY));
+            bytes.append(indexed);
+            segment.dictionarySegments++;
+        } else {
+            bytes.push_back(char(ENCODING_PLAIN));
+            bytes.append(plain);
+            segment.plainSegments++;
+            for (std::vector<std::string>::const_iterator itr = added.begin();
+                    itr != added.end() && dictionary.candidates.size() < MAX_CANDIDATES; itr++) {
+                dictionary.candidates.insert(*itr);
+            }
+        }
+
+        // Formulas that are only a prefix followed by the value are not stored
+        formulas.clear();
+        for (std::size_t i = begin; i < end; ) {
+            const FormulaKind kind = getFormulaKind(cells[order[i]]);
+            std::size_t run = 0;
+            for (; i < end && getFormulaKind(cells[order[i]]) == kind; i++, run++) {
+                if (kind == FORMULA_STORED) {
+                    formulas.push_back(&cells[order[i]].formula.str());
+                }
+            }
+
+            putVarint(bytes, run);
+            putVarint(bytes, kind);
+        }
+
+        putPlain(bytes, formulas);
+
+        segment.encodedBytes = bytes.size() - start;
+        segments.push_back(segment);
+    }
+}
+
+std::shared_ptr<Cells::Chunk> Cells::unpack(const std::string & bytes) const
+{
+    // Fields are read in the order that pack() writes them
+    std::shared_ptr<Chunk> pChunk = std::make_shared<Chunk>();
+    Reader reader(bytes);
+    const std::size_t count = std::size_t(reader.getVarint());
+    reader.check(count <= CHUNK_SIZE);
+
+    std::vector<Cell> & cells = pChunk->cells;
+    cells.reserve(count);
+    Address previous(0, 0);
+    for (std::size_t i = 0; i < count; i++) {
+        pChunk->used.push_back(reader.getVarint() != 0);
+        previous.column = static_cast<unsigned int>(previous.column + unzigzag(reader.getVarint()));
+        previous.row = static_cast<unsigned int>(previous.row + unzigzag(reader.getVarint()));
+        pChunk->addresses.push_back(previous);
+
+        cells.push_back(Cell(InternedString()));
+        Cell & cell = cells.back();
+        cell.bindingEpoch = static_cast<unsigned long>(reader.getVarint());
+        cell.bindings.resize(std::size_t(reader.getVarint()));
+        for (std::vector<Slot>::iterator itr = cell.bindings.begin(); itr != cell.bindings.end(); itr++) {
+            const std::uint64_t binding = reader.getVarint();
+            *itr = binding == 0 ? npos : Slot(binding - 1);
+        }
+
+        Slot precedent = 0;
+        cell.precedents.resize(std::size_t(reader.getVarint()));
+        for (std::vector<Slot>::iterator itr = cell.precedents.begin(); itr != cell.precedents.end(); itr++) {
+            precedent += Slot(reader.getVarint());
+            *itr = precedent;
+        }
+
+        cell.stats.evaluations = reader.getVarint();
+        cell.stats.inclusiveNanos = reader.getVarint();
+        cell.stats.exclusiveNanos = reader.getVarint();
+
+        const std::uint64_t rows = reader.getVarint();
+        if (rows > 0) {
+            const std::uint64_t columns = reader.getVarint();
+            reader.check(columns > 0 && rows <= bytes.size() / columns);
+            std::shared_ptr<Array> pArray = std::make_shared<Array>();
+            pArray->rows = std::size_t(rows);
+            pArray->columns = std::size_t(columns);
+            std::vector<Rope> values(pArray->rows * pArray->columns);
+            std::string value;
+            for (std::vector<Rope>::iterator itr = values.begin(); itr != values.end(); itr++) {
+                reader.getString(value);
+                *itr = value;
+            }
+            pArray->values.setStrings(values);
+            cell.array = pArray;
+        }
+    }
+
+    std::vector<std::size_t> order;
+    orderByAddress(pChunk->addresses, order);
+
+    std::string value;
+    for (std::size_t begin = 0, end = 0; begin < count; begin = end) {
+        const unsigned int column = pChunk->addresses[order[begin]].column;
+        for (end = begin; end < count && pChunk->addresses[order[end]].column == column; end++) {
+            // Find the end of the segment
+        }
+
+        const std::uint64_t encoding = reader.getVarint();
+        std::int64_t number = 0;
+        for (std::size_t i = begin; i < end; ) {
+            const std::size_t run = reader.getRun(end - i);
+            if (encoding == ENCODING_PLAIN) {
+                reader.getString(value);
+                for (std::size_t j = 0; j < run; j++) {
+                    cells[order[i++]].value = value;
+                }
+            } else if (encoding == ENCODING_DICTIONARY) {
+                const std::uint64_t index = reader.getVarint();
+                std::map<unsigned int, Dictionary>::const_iterator dictionary = m_dictionaries.find(column);
+                reader.check(dictionary != m_dictionaries.end() && index < dictionary->second.values.size());
+                for (std::size_t j = 0; j < run; j++) {
+                    cells[order[i++]].value = dictionary->second.values[std::size_t(index)];
+                }
+            } else {
+                reader.check(encoding == ENCODING_DELTA);
+                const std::int64_t delta = unzigzag(reader.getVarint());
+                for (std::size_t j = 0; j < run; j++) {
+                    number += delta;
+                    cells[order[i++]].value = std::to_string(static_cast<long long>(number));
+                }
+            }
+        }
+
+        std::vector<Cell *> stored;
+        for (std::size_t i = begin; i < end; ) {
+            const std::size_t run = reader.getRun(end - i);
+            const std::uint64_t kind = reader.getVarint();
+            for (std::size_t j = 0; j < run; j++, i++) {
+                if (kind == FORMULA_QUOTED) {
+                    cells[order[i]].formula = m_pStrings->intern("'" + cells[order[i]].value.str());
+                } else if (kind == FORMULA_EQUALS) {
+                    cells[order[i]].formula = m_pStrings->intern("=" + cells[order[i]].value.str());
+                } else {
+                    stored.push_back(&cells[order[i]]);
+                }
+            }
+        }
+
+        for (std::size_t i = 0; i < stored.size(); ) {
+            const std::size_t run = reader.getRun(stored.size() - i);
+            reader.getString(value);
+            const InternedString formula = m_pStrings->intern(value);
+            for (std::size_t j = 0; j < run; j++) {
+                stored[i++]->formula = formula;
+            }
+        }
+    }
+
+    return pChunk;
+}
+
+void Cells::evict() const
+{
+    // Values and formulas may have changed size since modified chunks were
+    // last measured
+    std::vector<std::pair<std::uint64_t, std::size_t> > resident;
+    for (std::size_t chunk = 0; chunk < m_chunks.size(); chunk++) {
+        if (!m_chunks[chunk]) {
+            continue;
+        }
+
+        Block & block = m_blocks[chunk];
+        if (block.modified) {
+            m_residentBytes -= block.bytes;
+            block.bytes = 0;
+            const std::vector<Cell> & cells = m_chunks[chunk]->cells;
+            for (std::vector<Cell>::const_iterator itr = cells.begin(); itr != cells.end(); itr++) {
+                block.bytes += estimateBytes(*itr);
+            }
+            m_residentBytes += block.bytes;
+        }
+
+        resident.push_back(std::make_pair(block.lastUsed, chunk));
+    }
+
+    std::sort(resident.begin(), resident.end());
+
+    const std::size_t target = m_memoryBudget - m_memoryBudget / 4;
+    std::string bytes;
+    for (std::vector<std::pair<std::uint64_t, std::size_t> >::const_iterator itr = resident.begin();
+            itr != resident.end() && m_residentBytes > target; itr++) {
+        const std::size_t chunk = itr->second;
+        Block & block = m_blocks[chunk];
+        if (block.modified) {
+            bytes.clear();
+            block.segments.clear();
+            pack(*m_chunks[chunk], bytes, block.segments);
+
+            if (!m_pFile) {
+                m_compressedBytes += bytes.size();
+                m_compressedBytes -= block.packed.size();
+                block.packed.swap(bytes);
+                block.packed.shrink_to_fit();
+            } else if (bytes.size() <= block.capacity) {
+                // Chunks are written back in place when they still fit
+                m_pFile->write(block.offset, bytes);
+            } else {
+                block.offset = m_pFile->append(bytes);
+                block.capacity = bytes.size();
+            }
+
+            block.length = bytes.size();
+            block.modified = false;
+        }
+
+        m_chunks[chunk].reset();
+        m_residentBytes -= block.bytes;
+        m_evictions++;
+    }
+
+    m_lastChunk = npos;
+}
+
+Cells::Chunk & Cells::unshare(Slot slot, bool modified)
+{
+    getChunk(slot / CHUNK_SIZE);
+    if (m_paging && modified) {
+        m_blocks[slot / CHUNK_SIZE].modified = true;
+    }
+
+    std::shared_ptr<Chunk> & pChunk = m_chunks[slot / CHUNK_SIZE];
+    if (pChunk.use_count() > 1) {
+        pChunk = std::make_shared<Chunk>(*pChunk);
+    } else {
+        // Another copy may have only just released the chunk, after reading
+        // from it on a different thread
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+
+    return *pChunk;
+}
+
+Cells::Index & Cells::unshareIndex()
+{
+    if (m_pIndex.use_count() > 1) {
+        m_pIndex = std::make_shared<Index>(*m_pIndex);
+    }
+
+    return *m_pIndex;
+}
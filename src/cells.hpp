@@ -0,0 +1,363 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "address.hpp"
+#include "cell.hpp"
+#include "paging.hpp"
+
+/**
+ * Sparse storage for the cells of a Sheet.
+ *
+ * Each Cell lives in a slot, identified by a stable index that does not change
+ * for as long as the cell exists. Compiled formulas hold slot indices for the
+ * cells they reference, so that reading a precedent does not require looking
+ * up its address. Slots freed by erase() are reused by later insertions.
+ *
+ * The epoch is incremented whenever a cell is created, erased or moved, which
+ * are the only times that slot indices held by formulas can become stale.
+ *
+ * Copies share their storage with the original. Slots are grouped into chunks
+ * of CHUNK_SIZE cells, and a chunk is only copied when a cell in it is about
+ * to be modified through mutate() while it is still shared. The address index
+ * is shared in the same way, and is copied by the first insert() or erase().
+ * A copy can be modified and read on a different thread to the original, but
+ * copying must not happen while the original is being modified.
+ *
+ * Formulas are interned in a StringPool, which copies share with the original.
+ *
+ * Chunks can also be paged out to a file, once enablePaging() has been called,
+ * or compressed in memory, once enableCompression() has been called. A chunk
+ * is then decoded whenever one of its cells is accessed, and trim() evicts
+ * the least recently used chunks, compressing them again if they were
+ * modified, until the estimated size of the decoded chunks is within the
+ * memory budget. Chunks are compressed in the same way in either case (see
+ * ColumnCompression). The address index always stays in memory. Paged
+ * storage must not be copied.
+ */
+class Cells
+{
+public:
+    typedef std::size_t Slot;
+
+    /// Cells in address order (i.e. by column, then by row)
+    typedef std::map<Address, Slot> Index;
+
+    /// Returned by find() when there is no cell at an address
+    static const Slot npos;
+
+    /// Number of slots in each chunk of storage
+    static const Slot CHUNK_SIZE = 64;
+
+    Cells();
+
+    /**
+     * Find the slot for a cell.
+     *
+     * @param   address  Address of the cell
+     *
+     * @returns slot index, or npos if the cell has not been set
+     */
+    Slot find(const Address & address) const;
+
+    /**
+     * Create a cell in an unused slot.
+     *
+     * @param   address  Address of the new cell, which must not be set already
+     * @param   formula  Formula of the new cell
+     *
+     * @returns slot index of the new cell
+     */
+    Slot insert(const Address & address, const std::string & formula);
+
+    /**
+     * Erase a cell, freeing its slot.
+     *
+     * @param   address  Address of the cell
+     *
+     * @returns true if the cell was previously set, false otherwise
+     */
+    bool erase(const Address & address);
+
+    /**
+     * Move cells to new addresses, keeping their slots.
+     *
+     * Cells may be moved onto the addresses of other cells that are moved at
+     * the same time, but not onto cells that stay where they are.
+     *
+     * @param   slots      Slots of the cells to move
+     * @param   addresses  New address of each cell, in the same order
+     */
+    void move(const std::vector<Slot> & slots, const std::vector<Address> & addresses);
+
+    /**
+     * Access a cell.
+     *
+     * If paging is enabled, the cell's chunk is read in from the file if it is
+     * not already in memory. The reference remains valid until trim() is
+     * called.
+     */
+    const Cell & operator[](Slot slot) const
+    {
+        return getChunk(slot / CHUNK_SIZE).cells[slot % CHUNK_SIZE];
+    }
+
+    /**
+     * Access a cell for modification, first copying its chunk of storage if
+     * the chunk is shared with another copy of this object.
+     *
+     * References returned by operator[] may refer to the old chunk once this
+     * has been called for any cell in the same chunk.
+     *
+     * @param   slot  Slot of the cell
+     *
+     * @returns reference to the cell, which is owned by this object alone
+     */
+    Cell & mutate(Slot slot);
+
+    /**
+     * Access a cell to update its compiled formula or shape. These are not
+     * written to the paging file, so unlike mutate(), this does not mark the
+     * cell's chunk as modified. A chunk that is read back in from the file
+     * has no compiled formulas.
+     */
+    Cell & annotate(Slot slot);
+
+    /// Returns true if the chunk holding a slot is shared with another copy
+    bool isShared(Slot slot) const;
+
+    /// Address of the cell in a slot that is in use
+    const Address & getAddress(Slot slot) const
+    {
+        return getChunk(slot / CHUNK_SIZE).addresses[slot % CHUNK_SIZE];
+    }
+
+    /// Returns true if a slot currently holds a cell
+    bool isUsed(Slot slot) const
+    {
+        return getChunk(slot / CHUNK_SIZE).used[slot % CHUNK_SIZE];
+    }
+
+    /// Number of slots, including unused ones; valid slots are [0, getSlotCount())
+    Slot getSlotCount() const
+    {
+        return m_slotCount;
+    }
+
+    /// Number of cells
+    std::size_t size() const
+    {
+        return m_pIndex->size();
+    }
+
+    unsigned long getEpoch() const
+    {
+        return m_epoch;
+    }
+
+    const Index & getIndex() const
+    {
+        return *m_pIndex;
+    }
+
+    /// Pool holding the formulas of the cells, shared with any copies
+    const std::shared_ptr<StringPool> & getStrings() const
+    {
+        return m_pStrings;
+    }
+
+    /**
+     * Keep chunks of cells in a file, so that only some of them need to be in
+     * memory at once. Every chunk is written to the file the first time that
+     * it is evicted.
+     *
+     * @param   path          Path of the file, which is created or truncated,
+     *                        and removed when this object is destroyed
+     * @param   memoryBudget  Estimated size, in bytes, that trim() keeps the
+     *                        chunks in memory within
+     *
+     * @throws  std::runtime_error if paging is already enabled, or the file
+     *          cannot be created
+     */
+    void enablePaging(const std::string & path, std::size_t memoryBudget);
+
+    /**
+     * Keep chunks of cells that have been evicted compressed in memory, rather
+     * than in a file.
+     *
+     * @param   memoryBudget  Estimated size, in bytes, that trim() keeps the
+     *                        decoded chunks within
+     *
+     * @throws  std::runtime_error if paging is already enabled
+     */
+    void enableCompression(std::size_t memoryBudget);
+
+    /// Returns true if enablePaging() or enableCompression() has been called
+    bool isPaged() const
+    {
+        return m_paging;
+    }
+
+    /**
+     * Evict chunks from memory, least recently used first, if the chunks in
+     * memory are over the memory budget. References to cells are invalidated.
+     *
+     * Chunks are evicted until they are a quarter below the budget, so that
+     * the chunks paged in afterwards do not cause an eviction every time.
+     *
+     * @throws  std::runtime_error if a modified chunk cannot be written
+     */
+    void trim() const
+    {
+        if (m_paging && m_residentBytes > m_memoryBudget) {
+            evict();
+        }
+    }
+
+    PagingStats getPagingStats() const;
+
+    /// Compression of the chunks that have been evicted, by column, in column order
+    std::vector<ColumnCompression> getColumnCompression() const;
+
+private:
+    /// Storage for CHUNK_SIZE consecutive slots; the last chunk may be partly filled
+    struct Chunk
+    {
+        std::vector<Cell> cells;
+
+        std::vector<Address> addresses;
+
+        std::vector<bool> used;
+    };
+
+    /// Values that have been stored in a column, by index
+    struct Dictionary
+    {
+        std::vector<std::string> values;
+
+        std::unordered_map<std::string, std::uint32_t> indices;
+
+        /// Values seen in segments that were not dictionary encoded, which are
+        /// added to the dictionary if they are seen again
+        std::unordered_set<std::string> candidates;
+    };
+
+    /// Location of a paged chunk in the paging file, and its state in memory
+    struct Block
+    {
+        Block()
+            : offset(0)
+            , length(0)
+            , capacity(0)
+            , bytes(0)
+            , lastUsed(0)
+            , modified(true)
+        {
+            // No further initialisation
+        }
+
+        /// Position of the most recent copy of the chunk in the file
+        std::uint64_t offset;
+
+        /// Length of that copy
+        std::size_t length;
+
+        /// Space available at the offset, for copies written later on
+        std::size_t capacity;
+
+        /// Estimated memory used by the chunk, while it is in memory
+        std::size_t bytes;
+
+        /// Time of the most recent lookup, on a clock that ticks once per lookup
+        std::uint64_t lastUsed;
+
+        /// True if the chunk has changed since it was last written to the file
+        bool modified;
+
+        /// Most recent compressed copy of the chunk, if there is no paging file
+        std::string packed;
+
+        /// Compression of each segment in the most recent compressed copy
+        std::vector<ColumnCompression> segments;
+    };
+
+    const Chunk & getChunk(std::size_t chunk) const
+    {
+        if (m_paging && chunk != m_lastChunk) {
+            return pageIn(chunk);
+        }
+
+        return *m_chunks[chunk];
+    }
+
+    /// Start tracking chunks for eviction
+    void startPaging(std::size_t memoryBudget);
+
+    /// Look up a chunk, decoding it if it is not in memory
+    const Chunk & pageIn(std::size_t chunk) const;
+
+    /// Compress a chunk, adding any new values to the column dictionaries
+    void pack(const Chunk & chunk, std::string & bytes, std::vector<ColumnCompression> & segments) const;
+
+    /// Decode a chunk that was compressed by pack()
+    std::shared_ptr<Chunk> unpack(const std::string & bytes) const;
+
+    /// Evict least recently used chunks until the chunks in memory are below the budget
+    void evict() const;
+
+    /// Copy the chunk holding a slot, if it is shared, and mark it as modified
+    Chunk & unshare(Slot slot, bool modified = true);
+
+    /// Copy the index, if it is shared
+    Index & unshareIndex();
+
+    /// Chunks that have been evicted are null until they are paged back in
+    mutable std::vector<std::shared_ptr<Chunk> > m_chunks;
+
+    std::vector<Slot> m_free;
+
+    std::shared_ptr<Index> m_pIndex;
+
+    std::shared_ptr<StringPool> m_pStrings;
+
+    Slot m_slotCount;
+
+    unsigned long m_epoch;
+
+    /// True once enablePaging() or enableCompression() has been called
+    bool m_paging;
+
+    /// Paging file, or null if chunks are not paged to a file
+    std::shared_ptr<BlockFile> m_pFile;
+
+    /// Dictionary for each column that has been compressed
+    mutable std::map<unsigned int, Dictionary> m_dictionaries;
+
+    /// Memory used by compressed chunks and dictionaries, if there is no paging file
+    mutable std::size_t m_compressedBytes;
+
+    /// State of each chunk, while paging is enabled
+    mutable std::vector<Block> m_blocks;
+
+    std::size_t m_memoryBudget;
+
+    mutable std::size_t m_residentBytes;
+
+    /// Chunk of the most recent lookup, which is always in memory
+    mutable std::size_t m_lastChunk;
+
+    mutable std::uint64_t m_clock;
+
+    mutable std::uint64_t m_hits;
+
+    mutable std::uint64_t m_misses;
+
+    mutable std::uint64_t m_evictions;
+};
@@ -14,6 +14,11 @@ main := |*
         formula = getStr(ts, te);
     };
 
+(':' any*)
+    {
+        command = getStr(ts + 1, te);
+    };
+
 (space)
     {
         // Ignore whitespace
@@ -28,18 +33,502 @@ main := |*
 
 }%%
 
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
 
 #include "address.hpp"
+#include "journal.hpp"
+#include "range.hpp"
+#include "recalculator.hpp"
 #include "sheet.hpp"
+#include "trace.hpp"
 #include "util.hpp"
 
 %% write data;
 
-bool eval(Sheet & sheet, const std::string & input)
+namespace
 {
+    /**
+     * The most recent edit, kept so that it can be undone if the
+     * recalculation that follows it fails.
+     */
+    struct LastEdit
+    {
+        std::mutex mutex;
+        std::string address;
+        std::string previousFormula;
+    };
+
+    /**
+     * Regions registered using the :view command, which are printed as soon
+     * as they have been recalculated.
+     */
+    struct Viewport
+    {
+        std::mutex mutex;
+        std::vector<Range> regions;
+    };
+
+    /**
+     * Journal opened using the :journal command, which every edit is
+     * committed to before the next prompt.
+     */
+    struct JournalFile
+    {
+        std::mutex mutex;
+        std::unique_ptr<Journal> pJournal;
+    };
+
+    void printSheet(const Sheet & sheet)
+    {
+        sheet.print();
+    }
+
+    void printViewport(Viewport & viewport, const Sheet & sheet)
+    {
+        std::lock_guard<std::mutex> lock(viewport.mutex);
+        std::cout << "Viewport:" << std::endl;
+        for (std::vector<Range>::const_iterator region = viewport.regions.begin();
+                region != viewport.regions.end(); region++) {
+            for (unsigned int column = region->first.column; column <= region->last.column; column++) {
+                for (unsigned int row = region->first.row; row <= region->last.row; row++) {
+                    const Address address(column, row);
+                    if (sheet.isSet(address)) {
+                        std::cout << "[" << column << "," << row << "]: " << sheet.getValue(address) << std::endl;
+                    }
+                }
+            }
+        }
+    }
+
+    void addPriorityRegion(Sheet & sheet, const Range & region)
+    {
+        sheet.addPriorityRegion(region);
+    }
+
+    void clearPriorityRegions(Sheet & sheet)
+    {
+        sheet.clearPriorityRegions();
+    }
+
+    void setProfiling(Sheet & sheet, bool profiling)
+    {
+        sheet.setProfiling(profiling);
+    }
+
+    void resetProfile(Sheet & sheet)
+    {
+        sheet.resetProfile();
+    }
+
+    void printHotCells(const Sheet & sheet, size_t count)
+    {
+        const std::vector<CellProfile> profiles = sheet.getHotCells(count);
+        std::cout << "cell     evals   incl(us)   excl(us)  in  out  formula" << std::endl;
+        for (std::vector<CellProfile>::const_iterator itr = profiles.begin(); itr != profiles.end(); itr++) {
+            std::cout << std::left << std::setw(6) << itr->address.toString() << std::right
+                      << std::setw(8) << itr->evaluations
+                      << std::setw(11) << itr->inclusiveNanos / 1000
+                      << std::setw(11) << itr->exclusiveNanos / 1000
+                      << std::setw(4) << itr->fanIn
+                      << std::setw(5) << itr->fanOut
+                      << "  " << itr->formula << std::endl;
+        }
+    }
+
+    void setPaging(Sheet & sheet, const std::string & path, size_t memoryBudget)
+    {
+        try {
+            sheet.setPaging(path, memoryBudget);
+            std::cout << "Paging to " << path << "." << std::endl;
+        } catch (const std::runtime_error & e) {
+            std::cout << "Error: " << e.what() << std::endl;
+        }
+    }
+
+    void setCompression(Sheet & sheet, size_t memoryBudget)
+    {
+        try {
+            sheet.setCompression(memoryBudget);
+            std::cout << "Compressing cells." << std::endl;
+        } catch (const std::runtime_error & e) {
+            std::cout << "Error: " << e.what() << std::endl;
+        }
+    }
+
+    void printColumnCompression(const Sheet & sheet)
+    {
+        const std::vector<ColumnCompression> columns = sheet.getColumnCompression();
+        std::cout << "column    cells      raw  encoded  ratio" << std::endl;
+        for (std::vector<ColumnCompression>::const_iterator itr = columns.begin(); itr != columns.end(); itr++) {
+            std::cout << std::setw(6) << itr->column
+                      << std::setw(9) << itr->cells
+                      << std::setw(9) << itr->rawBytes
+                      << std::setw(9) << itr->encodedBytes
+                      << std::setw(7) << std::fixed << std::setprecision(1) << itr->getRatio() << std::endl;
+        }
+        std::cout.unsetf(std::ios::floatfield);
+    }
+
+    void printPagingStats(const Sheet & sheet)
+    {
+        const PagingStats stats = sheet.getPagingStats();
+        std::cout << "hit rate " << std::fixed << std::setprecision(3) << stats.getHitRate()
+                  << ", " << stats.misses << " misses, " << stats.evictions << " evictions, "
+                  << stats.bytesRead << " bytes read, " << stats.bytesWritten << " bytes written, "
+                  << stats.residentBlocks << " blocks (" << stats.residentBytes << " bytes) in memory"
+                  << std::endl;
+        std::cout.unsetf(std::ios::floatfield);
+    }
+
+    void printStringStats(const Sheet & sheet)
+    {
+        const StringPoolStats stats = sheet.getStringStats();
+        std::cout << stats.strings << " strings (" << stats.uniqueBytes << " bytes), "
+                  << stats.handles << " references, " << stats.getBytesSaved() << " bytes saved"
+                  << std::endl;
+    }
+
+    void printTrace(const Sheet & sheet, const Range & cells, bool dependents, bool transitive)
+    {
+        const std::vector<Address> addresses = dependents ?
+            sheet.getDependents(cells, transitive) : sheet.getPrecedents(cells, transitive);
+        if (addresses.empty()) {
+            std::cout << "None." << std::endl;
+            return;
+        }
+
+        for (std::vector<Address>::const_iterator itr = addresses.begin(); itr != addresses.end(); itr++) {
+            std::cout << (itr == addresses.begin() ? "" : " ") << itr->toString();
+        }
+        std::cout << std::endl;
+    }
+
+    void openJournal(Sheet & sheet, JournalFile & journalFile, const std::string & path)
+    {
+        std::lock_guard<std::mutex> lock(journalFile.mutex);
+        try {
+            std::unique_ptr<Journal> pJournal(new Journal(path));
+            sheet.setJournal(nullptr);
+            const size_t count = pJournal->replay(sheet);
+            sheet.setJournal(pJournal.get());
+            journalFile.pJournal.swap(pJournal);
+            std::cout << "Replayed " << count << " edits from " << path << "." << std::endl;
+        } catch (const std::runtime_error & e) {
+            sheet.setJournal(journalFile.pJournal.get());
+            std::cout << "Error: " << e.what() << std::endl;
+        }
+    }
+
+    void compactJournal(const Sheet & sheet, JournalFile & journalFile)
+    {
+        std::lock_guard<std::mutex> lock(journalFile.mutex);
+        if (!journalFile.pJournal) {
+            std::cout << "Error: No journal is open." << std::endl;
+            return;
+        }
+
+        try {
+            journalFile.pJournal->compact(sheet);
+            std::cout << "Journal compacted." << std::endl;
+        } catch (const std::runtime_error & e) {
+            std::cout << "Error: " << e.what() << std::endl;
+        }
+    }
+
+    void commitJournal(JournalFile & journalFile)
+    {
+        std::lock_guard<std::mutex> lock(journalFile.mutex);
+        if (journalFile.pJournal) {
+            try {
+                journalFile.pJournal->commit();
+            } catch (const std::runtime_error & e) {
+                std::cout << "Error: " << e.what() << std::endl;
+            }
+        }
+    }
+
+    void applyEdit(Sheet & sheet, LastEdit & lastEdit, const std::string & address, const std::string & formula)
+    {
+        const Address parsedAddress(address);
+
+        std::lock_guard<std::mutex> lock(lastEdit.mutex);
+        lastEdit.address = address;
+        lastEdit.previousFormula = sheet.getFormula(parsedAddress);
+        sheet.setFormula(parsedAddress, formula);
+    }
+
+    void shiftCells(Sheet & sheet, LastEdit & lastEdit, bool columns, bool deleting, unsigned int position,
+            unsigned int count)
+    {
+        // The cell that was last edited may have moved, so the edit can no
+        // longer be undone
+        {
+            std::lock_guard<std::mutex> lock(lastEdit.mutex);
+            lastEdit.address.clear();
+        }
+
+        try {
+            if (columns && deleting) {
+                sheet.deleteColumns(position, count);
+            } else if (columns) {
+                sheet.insertColumns(position, count);
+            } else if (deleting) {
+                sheet.deleteRows(position, count);
+            } else {
+                sheet.insertRows(position, count);
+            }
+        } catch (const std::invalid_argument & e) {
+            std::cout << "Error: " << e.what() << std::endl;
+        }
+    }
+
+    void undoEdit(Sheet & sheet, LastEdit & lastEdit)
+    {
+        std::lock_guard<std::mutex> lock(lastEdit.mutex);
+        if (lastEdit.address.empty()) {
+            return;
+        }
+
+        // Restore the previous formula for the cell
+        const Address parsedAddress(lastEdit.address);
+        if (lastEdit.previousFormula.size() > 0) {
+            sheet.setFormula(parsedAddress, lastEdit.previousFormula);
+        } else {
+            sheet.erase(parsedAddress);
+        }
+
+        lastEdit.address.clear();
+    }
+
+    void query(const Sheet & sheet, const std::string & address)
+    {
+        // This is a query for the value/formula of an individual cell
+        const Address parsedAddress(address);
+        const std::string currentFormula = sheet.getFormula(parsedAddress);
+        if (currentFormula.size() == 0) {
+            std::cout << address << " is not defined." << std::endl;
+        } else {
+            std::cout << address << " " << currentFormula << " = " << sheet.getValue(parsedAddress) << std::endl;
+        }
+    }
+}
+
+bool runCommand(Recalculator & recalculator, LastEdit & lastEdit, Viewport & viewport, JournalFile & journalFile,
+        const std::string & command)
+{
+    using namespace std::placeholders;
+
+    std::istringstream args(command);
+    std::string name;
+    args >> name;
+
+    if (name == "trace") {
+        std::string action;
+        args >> action;
+        if (action == "start") {
+            Trace::start();
+            std::cout << "Tracing started." << std::endl;
+        } else if (action == "stop") {
+            Trace::stop();
+            std::cout << "Tracing stopped." << std::endl;
+        } else if (action == "write") {
+            std::string path;
+            args >> path;
+            std::ofstream out(path.c_str());
+            if (path.empty() || !out) {
+                std::cout << "Error: Could not open trace file." << std::endl;
+            } else {
+                // Wait for the worker, so that no spans are being recorded
+                recalculator.wait();
+                std::cout << "Wrote " << Trace::write(out) << " events to " << path << "." << std::endl;
+            }
+        } else {
+            std::cout << "Usage: :trace start|stop|write <file>" << std::endl;
+        }
+        return true;
+    }
+
+    if (name == "profile") {
+        std::string action;
+        args >> action;
+        if (action == "start") {
+            recalculator.edit(std::bind(setProfiling, _1, true));
+            std::cout << "Profiling started." << std::endl;
+        } else if (action == "stop") {
+            recalculator.edit(std::bind(setProfiling, _1, false));
+            std::cout << "Profiling stopped." << std::endl;
+        } else if (action == "reset") {
+            recalculator.edit(resetProfile);
+            std::cout << "Profile reset." << std::endl;
+        } else if (action == "top") {
+            size_t count = 10;
+            args >> count;
+            recalculator.wait();
+            recalculator.read(std::bind(printHotCells, _1, count));
+        } else {
+            std::cout << "Usage: :profile start|stop|reset|top [count]" << std::endl;
+        }
+        return true;
+    }
+
+    if (name == "journal") {
+        std::string action;
+        args >> action;
+        if (action == "open") {
+            std::string path;
+            args >> path;
+            if (path.empty()) {
+                std::cout << "Usage: :journal open <file>|compact" << std::endl;
+            } else {
+                recalculator.edit(std::bind(openJournal, _1, std::ref(journalFile), path));
+            }
+        } else if (action == "compact") {
+            recalculator.wait();
+            recalculator.read(std::bind(compactJournal, _1, std::ref(journalFile)));
+        } else {
+            std::cout << "Usage: :journal open <file>|compact" << std::endl;
+        }
+        return true;
+    }
+
+    if (name == "compress") {
+        size_t memoryBudget = 0;
+        if (args >> memoryBudget) {
+            recalculator.edit(std::bind(setCompression, _1, memoryBudget));
+        } else {
+            recalculator.wait();
+            recalculator.read(printColumnCompression);
+        }
+        return true;
+    }
+
+    if (name == "paging") {
+        std::string path;
+        size_t memoryBudget = 0;
+        args >> path;
+        if (path.empty()) {
+            recalculator.wait();
+            recalculator.read(printPagingStats);
+        } else if (args >> memoryBudget) {
+            recalculator.edit(std::bind(setPaging, _1, path, memoryBudget));
+        } else {
+            std::cout << "Usage: :paging [<file> <memory budget in bytes>]" << std::endl;
+        }
+        return true;
+    }
+
+    if (name == "strings") {
+        recalculator.wait();
+        recalculator.read(printStringStats);
+        return true;
+    }
+
+    if (name == "view") {
+        std::string action;
+        args >> action;
+        if (action == "clear") {
+            {
+                std::lock_guard<std::mutex> lock(viewport.mutex);
+                viewport.regions.clear();
+            }
+            recalculator.edit(clearPriorityRegions);
+            std::cout << "Viewport cleared." << std::endl;
+        } else if (action.size() > 0) {
+            try {
+                const Range region(action);
+                {
+                    std::lock_guard<std::mutex> lock(viewport.mutex);
+                    viewport.regions.push_back(region);
+                }
+                recalculator.edit(std::bind(addPriorityRegion, _1, region));
+                std::cout << "Prioritising " << region.toString() << "." << std::endl;
+            } catch (const std::invalid_argument &) {
+                std::cout << "Error: Invalid range." << std::endl;
+            }
+        } else {
+            std::cout << "Usage: :view <range>|clear" << std::endl;
+        }
+        return true;
+    }
+
+    if (name == "precedents" || name == "dependents") {
+        std::string target;
+        std::string scope;
+        args >> target >> scope;
+        if (target.empty() || !(scope.empty() || scope == "all")) {
+            std::cout << "Usage: :" << name << " <range> [all]" << std::endl;
+            return true;
+        }
+
+        try {
+            const Range cells(target);
+            recalculator.read(std::bind(printTrace, _1, cells, name == "dependents", scope == "all"));
+        } catch (const std::invalid_argument &) {
+            std::cout << "Error: Invalid range." << std::endl;
+        }
+        return true;
+    }
+
+    if (name == "insert" || name == "delete") {
+        std::string axis;
+        std::string position;
+        std::string count;
+        args >> axis >> position >> count;
+        const unsigned long parsedCount = count.empty() ? 1 : std::strtoul(count.c_str(), nullptr, 10);
+        if ((axis != "rows" && axis != "columns") || position.empty() || parsedCount == 0) {
+            std::cout << "Usage: :" << name << " rows|columns <row or column> [count]" << std::endl;
+            return true;
+        }
+
+        try {
+            // Rows are given as numbers, and columns as letters
+            const bool columns = axis == "columns";
+            const Address address(columns ? position + "1" : "A" + position);
+            recalculator.edit(std::bind(shiftCells, _1, std::ref(lastEdit), columns, name == "delete",
+                columns ? address.column : address.row, static_cast<unsigned int>(parsedCount)));
+            commitJournal(journalFile);
+        } catch (const std::invalid_argument &) {
+            std::cout << "Error: Invalid " << (axis == "columns" ? "column" : "row") << "." << std::endl;
+        }
+        return true;
+    }
+
+    if (name == "progress") {
+        size_t done = 0;
+        size_t total = 0;
+        recalculator.getProgress(done, total);
+        if (recalculator.isIdle()) {
+            std::cout << "Idle." << std::endl;
+        } else {
+            std::cout << "Recalculating: " << done << "/" << total << " cells." << std::endl;
+        }
+        return true;
+    }
+
+    if (name == "wait") {
+        recalculator.wait();
+        return true;
+    }
+
+    return false;
+}
+
+bool eval(Recalculator & recalculator, LastEdit & lastEdit, Viewport & viewport, JournalFile & journalFile,
+        const std::string & input)
+{
+    using namespace std::placeholders;
+
     std::string address;
     std::string formula;
+    std::string command;
 
     int cs;
     const char * ts;
@@ -55,34 +544,23 @@ bool eval(Sheet & sheet, const std::string & input)
 
     %% write exec;
 
+    if (command.size() > 0) {
+        // Commands cannot be combined with an address or formula
+        return address.empty() && formula.empty() && runCommand(recalculator, lastEdit, viewport, journalFile, command);
+    }
+
     if (address.size() > 0) {
         // An address has been defined
-        const Address parsedAddress(address);
-        const std::string currentFormula = sheet.getFormula(parsedAddress);
         if (formula.size() > 0) {
-            // A formula has also been defined; update the appropriate cell...
-            sheet.setFormula(parsedAddress, formula);
-            try {
-                // ...then attempt to re-calculate all cells in the spreadsheet
-                sheet.recalculate();
-            } catch (const std::runtime_error & e) {
-                // If something goes wrong, restore the previous formula for the cell
-                std::cout << "Error: " << e.what() << std::endl;
-                if (currentFormula.size() > 0) {
-                    sheet.setFormula(parsedAddress, currentFormula);
-                } else {
-                    sheet.erase(parsedAddress);
-                }
-
-            }
-            sheet.recalculate();
-            sheet.print();
-        } else if (currentFormula.size() == 0) {
-            // New formula has not been defined, and cell is empty, so we simply report it as being undefined
-            std::cout << address << " is not defined." << std::endl;
+            // A formula has also been defined; update the appropriate cell,
+            // then re-calculate all cells in the background. Results are
+            // printed once the recalculation completes.
+            recalculator.edit(std::bind(applyEdit, _1, std::ref(lastEdit), address, formula));
+            commitJournal(journalFile);
         } else {
-            // New formula has not been defined; so this is a query for the value/formula of an individual cell
-            std::cout << address << " " << currentFormula << " = " << sheet.getValue(parsedAddress) << std::endl;
+            // Queries wait until the values are up to date
+            recalculator.wait();
+            recalculator.read(std::bind(query, _1, address));
         }
     } else if (formula.size() > 0) {
         // Address has not been provided, but formula has; this is an error
@@ -92,19 +570,56 @@ bool eval(Sheet & sheet, const std::string & input)
     return true;
 }
 
+void onRecalculated(Recalculator & recalculator, LastEdit & lastEdit, JournalFile & journalFile,
+        const std::string & error)
+{
+    using namespace std::placeholders;
+
+    if (error.empty()) {
+        recalculator.read(printSheet);
+    } else {
+        // If something goes wrong, undo the edit; the recalculation that this
+        // triggers will print the restored sheet
+        std::cout << "Error: " << error << std::endl;
+
+        bool undoable = false;
+        {
+            std::lock_guard<std::mutex> lock(lastEdit.mutex);
+            undoable = !lastEdit.address.empty();
+        }
+
+        if (undoable) {
+            recalculator.edit(std::bind(undoEdit, _1, std::ref(lastEdit)));
+            commitJournal(journalFile);
+        }
+    }
+}
+
 int main()
 {
+    using namespace std::placeholders;
+
+    // The journal outlives the sheet that records into it
+    JournalFile journalFile;
     Sheet sheet;
+    LastEdit lastEdit;
+    Viewport viewport;
+    Recalculator recalculator(sheet);
+    recalculator.setCallback(std::bind(onRecalculated, std::ref(recalculator), std::ref(lastEdit),
+        std::ref(journalFile), _1));
+    recalculator.setPriorityCallback(std::bind(printViewport, std::ref(viewport), _1));
 
     while (std::cin) {
         std::cout << "> ";
         std::string input;
         std::getline(std::cin, input);
-        if (!eval(sheet, input)) {
+        if (!eval(recalculator, lastEdit, viewport, journalFile, input)) {
             std::cout << "Error: Invalid input." << std::endl;
         }
     }
 
+    recalculator.wait();
+
     std::cout << std::endl;
 
     return 0;
@@ -0,0 +1,84 @@
+#include <algorithm>
+
+#include "dependency_graph.hpp"
+
+DependencyGraph::DependencyGraph()
+    : m_precedentOffsets(1, 0)
+{
+    // No further initialisation
+}
+
+DependencyGraph::Node DependencyGraph::addNode(std::vector<Node> & precedents)
+{
+    std::sort(precedents.begin(), precedents.end());
+    precedents.erase(std::unique(precedents.begin(), precedents.end()), precedents.end());
+    m_precedents.insert(m_precedents.end(), precedents.begin(), precedents.end());
+    m_precedentOffsets.push_back(m_precedents.size());
+    return m_precedentOffsets.size() - 2;
+}
+
+void DependencyGraph::finish()
+{
+    const std::size_t nodes = getNodeCount();
+
+    // Drop references to nodes that were never added, compacting the edges
+    // of each node in place
+    std::size_t kept = 0;
+    for (Node node = 0; node < nodes; node++) {
+        const std::size_t begin = m_precedentOffsets[node];
+        const std::size_t end = m_precedentOffsets[node + 1];
+        m_precedentOffsets[node] = kept;
+        for (std::size_t i = begin; i < end && m_precedents[i] < nodes; i++) {
+            m_precedents[kept++] = m_precedents[i];
+        }
+    }
+    m_precedentOffsets[nodes] = kept;
+    m_precedents.resize(kept);
+    std::vector<Node>(m_precedents).swap(m_precedents);
+
+    // Count the dependents of each node, then place each edge. Visiting the
+    // nodes in order leaves the dependents of each node in ascending order.
+    m_dependentOffsets.assign(nodes + 1, 0);
+    for (std::vector<Node>::const_iterator itr = m_precedents.begin(); itr != m_precedents.end(); itr++) {
+        m_dependentOffsets[*itr + 1]++;
+    }
+    for (Node node = 0; node < nodes; node++) {
+        m_dependentOffsets[node + 1] += m_dependentOffsets[node];
+    }
+
+    std::vector<std::size_t> next(m_dependentOffsets.begin(), m_dependentOffsets.end() - 1);
+    m_dependents.resize(m_precedents.size());
+    for (Node node = 0; node < nodes; node++) {
+        for (std::size_t i = m_precedentOffsets[node]; i < m_precedentOffsets[node + 1]; i++) {
+            m_dependents[next[m_precedents[i]]++] = node;
+        }
+    }
+}
+
+DependencyGraph::Nodes DependencyGraph::getPrecedents(Node node) const
+{
+    const Nodes nodes = {
+        m_precedents.data() + m_precedentOffsets[node],
+        m_precedents.data() + m_precedentOffsets[node + 1]
+    };
+    return nodes;
+}
+
+DependencyGraph::Nodes DependencyGraph::getDependents(Node node) const
+{
+    const Nodes nodes = {
+        m_dependents.data() + m_dependentOffsets[node],
+        m_dependents.data() + m_dependentOffsets[node + 1]
+    };
+    return nodes;
+}
+
+std::size_t DependencyGraph::getNodeCount() const
+{
+    return m_precedentOffsets.size() - 1;
+}
+
+std::size_t DependencyGraph::getEdgeCount() const
+{
+    return m_precedents.size();
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Compact, read-only graph of the references between cells, for tracing
+ * precedents and dependents.
+ *
+ * Nodes are numbered from zero, e.g. by the slots of a Cells object, and are
+ * added in order along with their precedents. Both directions are stored in
+ * compressed sparse row form: one array holding every edge, grouped by node,
+ * and one array of offsets into it. Each edge costs one integer in each
+ * direction, and the precedents or dependents of a node are a contiguous
+ * block of memory, which keeps traversals of large sheets cache friendly.
+ *
+ * The graph is not modified once finish() has been called; it is rebuilt in
+ * full when the references change.
+ */
+class DependencyGraph
+{
+public:
+    typedef std::size_t Node;
+
+    /// Contiguous block of nodes, as returned by getPrecedents() and
+    /// getDependents()
+    struct Nodes
+    {
+        const Node * begin;
+        const Node * end;
+    };
+
+    DependencyGraph();
+
+    /**
+     * Add the next node.
+     *
+     * @param   precedents  Nodes that the new node refers to, which may
+     *                      include nodes that have not yet been added, in any
+     *                      order and possibly with duplicates
+     *
+     * @returns the new node
+     */
+    Node addNode(std::vector<Node> & precedents);
+
+    /**
+     * Find the dependents of every node, once all of the nodes have been
+     * added. Precedents that were never added as nodes are dropped.
+     */
+    void finish();
+
+    /// Nodes that a node refers to, in ascending order
+    Nodes getPrecedents(Node node) const;
+
+    /// Nodes that refer to a node, in ascending order; only valid once
+    /// finish() has been called
+    Nodes getDependents(Node node) const;
+
+    /// Number of nodes
+    std::size_t getNodeCount() const;
+
+    /// Number of edges, counting each reference from one node to another once
+    std::size_t getEdgeCount() const;
+
+private:
+    /// Offset in m_precedents of the first precedent of each node, followed
+    /// by the total number of precedents
+    std::vector<std::size_t> m_precedentOffsets;
+
+    std::vector<Node> m_precedents;
+
+    std::vector<std::size_t> m_dependentOffsets;
+
+    std::vector<Node> m_dependents;
+};
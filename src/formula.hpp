@@ -1,28 +1,234 @@
 #pragma once
 
+#include <cstddef>
 #include <memory>
 #include <string>
 #include <vector>
 
 #include "address.hpp"
+#include "range.hpp"
+#include "rope.hpp"
 
+class Arguments;
 class Node;
+class FormulaCompiler;
+class StringPool;
+
+struct Array;
+struct Lanes;
+struct ParserData;
+struct RangeCell;
 
 class Formula
 {
 public:
-    typedef std::vector<std::string> Arguments;
+    typedef ::Arguments Arguments;
+
+    /**
+     * Called to evaluate a reference to another cell. The reference argument
+     * is the position of the reference within the formula, i.e. an index into
+     * the vector returned by getReferences().
+     */
+    typedef Rope (*EvalAddressCallback)(const Address &, std::size_t reference, void * pData);
+
+    /**
+     * Called to read the cells within a range that is passed to a function,
+     * appending the cells that have been set in address order. The index
+     * argument is the position of the range within the formula, i.e. an
+     * index into the vector returned by getRanges().
+     */
+    typedef void (*EvalRangeCallback)(const Range &, std::size_t index, std::vector<RangeCell> & cells, void * pData);
+
+    typedef Rope (*EvalFunctionCallback)(const std::string & name, const Arguments &, void * pData);
+
+    /**
+     * Called to evaluate a call to a function as an array, returning false
+     * if the function does not return an array.
+     */
+    typedef bool (*EvalArrayFunctionCallback)(const std::string & name, const Arguments &, void * pData,
+        Array & result);
 
-    typedef std::string (*EvalAddressCallback)(const Address &, void * pData);
-    typedef std::string (*EvalFunctionCallback)(const std::string & name, const Arguments &, void * pData);
+    /**
+     * Called to evaluate a reference to another cell across a batch of lanes,
+     * returning the values of every lane. The reference argument is the same
+     * as for EvalAddressCallback.
+     */
+    typedef const Lanes & (*EvalAddressLanesCallback)(const Address &, std::size_t reference, void * pData);
 
+    /// Called to read the cells within a range, as seen by a single lane
+    typedef void (*EvalRangeLanesCallback)(const Range &, std::size_t index, std::size_t lane,
+        std::vector<RangeCell> & cells, void * pData);
+
+    /**
+     * Called to move a reference to a cell, when rows or columns are inserted
+     * or deleted, returning false if the cell has been deleted.
+     */
+    typedef bool (*RelocateAddressCallback)(Address &, void * pData);
+
+    /**
+     * Called to move a range, when rows or columns are inserted or deleted,
+     * returning false if every row or column of the range has been deleted.
+     */
+    typedef bool (*RelocateRangeCallback)(Range &, void * pData);
+
+    /**
+     * Compile a formula string.
+     *
+     * This is a convenience constructor that uses a temporary FormulaCompiler.
+     * Code that compiles many formulas should hold on to a FormulaCompiler
+     * and use that instead.
+     *
+     * @param   formula  Formula, in string format
+     */
     Formula(const std::string &);
 
-    std::string evaluate(EvalAddressCallback, EvalFunctionCallback, void * pData);
+    /**
+     * Evaluate the formula. Long values, such as the result of concatenating
+     * strings, are returned without being gathered into a single string (see
+     * Rope).
+     */
+    Rope evaluate(EvalAddressCallback, EvalRangeCallback, EvalFunctionCallback, void * pData);
+
+    /**
+     * Evaluate the formula as an array, if it has one, such as =A1:A10*2 or
+     * =MMULT(A1:B2, C1:D2). Operators are applied to each element of their
+     * operands. Functions other than those that return arrays are evaluated
+     * for a single value, even if their arguments are arrays.
+     *
+     * @param   result  Receives the array
+     *
+     * @returns false, having evaluated nothing, if the formula has a single
+     *          value
+     */
+    bool evaluateArray(EvalAddressCallback, EvalRangeCallback, EvalFunctionCallback, EvalArrayFunctionCallback,
+        void * pData, Array & result) const;
+
+    /**
+     * Evaluate the formula for a batch of lanes at once.
+     *
+     * Arithmetic on lanes that all hold numbers is applied to the whole batch
+     * at once. Anything else is evaluated one lane at a time. Either way, the
+     * value of each lane is the same as the result of evaluate().
+     *
+     * @param   count   Number of lanes
+     * @param   result  Receives the value of each lane
+     */
+    void evaluateLanes(std::size_t count, EvalAddressLanesCallback, EvalRangeLanesCallback, EvalFunctionCallback,
+        void * pData, Lanes & result) const;
+
+    /**
+     * Append the address of every cell referenced by the formula.
+     *
+     * Addresses are appended in the order that they appear in the formula,
+     * and may contain duplicates.
+     *
+     * @param   addresses  Vector to append addresses to
+     */
+    void getReferences(std::vector<Address> & addresses) const;
+
+    /**
+     * Retrieve the address of every cell referenced by the formula, in the
+     * order that they appear in the formula.
+     */
+    const std::vector<Address> & getReferences() const;
+
+    /**
+     * Retrieve every range of cells passed to a function in the formula, in
+     * the order that they appear in the formula. The cells within a range are
+     * not included in getReferences().
+     */
+    const std::vector<Range> & getRanges() const;
+
+    /**
+     * Retrieve the shape of the formula, which is the formula written with
+     * each reference as an offset from the cell that the formula belongs to.
+     * Cells that were filled down from one another have the same shape.
+     *
+     * @param   origin  Address of the cell that the formula belongs to
+     */
+    std::string getShape(const Address & origin) const;
+
+    /**
+     * Copy the formula, moving its references to cells and ranges.
+     *
+     * The text of the copy is written by replacing each reference that moved
+     * in the text that the formula was compiled from, so everything else is
+     * kept exactly as it was written, and nothing is parsed again. References
+     * to deleted cells and ranges are replaced by #REF!.
+     *
+     * @param   source  Text that the formula was compiled from
+     * @param   text    Receives the text of the copy
+     *
+     * @returns the copy
+     */
+    Formula relocate(const std::string & source, RelocateAddressCallback, RelocateRangeCallback, void * pData,
+        std::string & text) const;
 
     operator std::string() const;
 
 private:
 
+    friend class FormulaCompiler;
+
+    explicit Formula(const std::shared_ptr<Node> & pRoot);
+
     std::shared_ptr<Node> m_pRoot;
+
+    std::vector<Address> m_references;
+
+    std::vector<Range> m_ranges;
+};
+
+/**
+ * Compiles formula strings into Formula objects.
+ *
+ * A FormulaCompiler owns a single Lemon parser, which is allocated once and
+ * then reused for every call to compile(). Instances are not thread-safe,
+ * but they share no state with one another, so bulk loads can compile in
+ * parallel by using one FormulaCompiler per thread.
+ *
+ * String literals and identifiers in compiled formulas are interned in a
+ * StringPool, which may be shared by several compilers.
+ */
+class FormulaCompiler
+{
+public:
+    /// Create a compiler with a StringPool of its own
+    FormulaCompiler();
+
+    /// Create a compiler that interns strings in an existing StringPool
+    explicit FormulaCompiler(const std::shared_ptr<StringPool> & pStrings);
+
+    ~FormulaCompiler();
+
+    /**
+     * Compile a formula string.
+     *
+     * @param   formula  Formula, in string format
+     *
+     * @throws  std::runtime_error if the formula could not be parsed
+     *
+     * @returns compiled Formula
+     */
+    Formula compile(const std::string & formula);
+
+private:
+
+    /// Disabled copy constructor
+    FormulaCompiler(const FormulaCompiler &);
+
+    /// Disabled copy assignment operator
+    FormulaCompiler & operator=(const FormulaCompiler &);
+
+    /// Set up the parser callbacks, which are the same for every formula
+    void init();
+
+    /// Return the parser to its initial state after a failed compilation
+    void reset();
+
+    void * m_pParser;
+
+    std::unique_ptr<ParserData> m_pParserData;
+
+    std::shared_ptr<StringPool> m_pStrings;
 };
@@ -13,7 +13,7 @@ main := |*
     {
         // String literals appear between a pair of ' or " characters. The
         // delimiters are not passed along with the string.
-        cbToken(LITERAL, new LitStringNode(getStr(ts+1, te-1)), pData);
+        cbToken(LITERAL, new LitStringNode(getInterned(ts + 1, te - 1, pData)), pData);
     };
 
 ([A-Za-z]+[0-9]+)
@@ -21,7 +21,7 @@ main := |*
         // When an identifier looks like it could be address, it is passed to
         // parser using the ADDRESS_OR_IDENTIFIER token. The parser can
         // determine how to treat the token based on its context.
-        cbToken(ADDRESS_OR_IDENTIFIER, new VarIdentifierNode(getStr(ts, te)), pData);
+        cbToken(ADDRESS_OR_IDENTIFIER, new VarIdentifierNode(getInterned(ts, te, pData), getOffset(ts, pData)), pData);
     };
 
 ([A-Za-z][0-9a-zA-Z_]*)
@@ -30,7 +30,14 @@ main := |*
         // identifiers may contain underscores, and do not need to contain
         // numbers. Currently, identifiers may only be used for function
         // names.
-        cbToken(IDENTIFIER, new VarIdentifierNode(getStr(ts, te)), pData);
+        cbToken(IDENTIFIER, new VarIdentifierNode(getInterned(ts, te, pData), getOffset(ts, pData)), pData);
+    };
+
+'#REF!'
+    {
+        // Written in place of a reference to a cell or range that has been
+        // deleted
+        cbToken(LITERAL, new RefErrorNode(), pData);
     };
 
 ("'" any*)
@@ -38,7 +45,7 @@ main := |*
         // A formula that begins with an apostrophe should be interpreted
         // as a literal string. This is shorthand that allows numbers to
         // be entered as a text value.
-        cbToken(LITERAL, new LitStringNode(getStr(ts + 1, te)), pData);
+        cbToken(LITERAL, new LitStringNode(getInterned(ts + 1, te, pData)), pData);
     };
 
 ','
@@ -46,11 +53,41 @@ main := |*
         cbToken(COMMA, NULL, pData);
     };
 
+':'
+    {
+        cbToken(COLON, NULL, pData);
+    };
+
 '='
     {
         cbToken(EQUALS, NULL, pData);
     };
 
+'<>'
+    {
+        cbToken(NE, NULL, pData);
+    };
+
+'<'
+    {
+        cbToken(LT, NULL, pData);
+    };
+
+'<='
+    {
+        cbToken(LE, NULL, pData);
+    };
+
+'>'
+    {
+        cbToken(GT, NULL, pData);
+    };
+
+'>='
+    {
+        cbToken(GE, NULL, pData);
+    };
+
 ('+')
     {
         cbToken(PLUS, NULL, pData);
@@ -66,6 +103,11 @@ main := |*
         cbToken(TIMES, NULL, pData);
     };
 
+('/')
+    {
+        cbToken(DIVIDE, NULL, pData);
+    };
+
 "("
     {
         cbToken(LPAREN, NULL, pData);
@@ -90,6 +132,7 @@ any
 
 }%%
 
+#include <sstream>
 #include <stdexcept>
 
 #include "ast.hpp"
@@ -116,6 +159,14 @@ extern "C"
         void * pParser,                    /** The parser to be deleted */
         void (*freeProc)(void*)            /** Function used to reclaim memory */
     );
+
+    void ParseInit(
+        void * pParser                     /** The parser to be initialised */
+    );
+
+    void ParseFinalize(
+        void * pParser                     /** The parser to be finalised */
+    );
 }
 
 namespace
@@ -124,8 +175,22 @@ namespace
     {
         void * pParser;
         ParserData * pParserData;
+        StringPool * pStrings;
+
+        /// Start of the formula string, from which token offsets are measured
+        const char * pSource;
     };
 
+    InternedString getInterned(const char * beg, const char * end, CallbackData * pData)
+    {
+        return pData->pStrings->intern(beg, std::size_t(end - beg));
+    }
+
+    std::size_t getOffset(const char * p, CallbackData * pData)
+    {
+        return std::size_t(p - pData->pSource);
+    }
+
     typedef void (*CallbackToken)(int kind, Node * pNode, CallbackData * pData);
     typedef void (*CallbackEnd)(CallbackData * pData);
 
@@ -146,7 +211,8 @@ namespace
             throw std::runtime_error("Source is not an identifier node.");
         }
 
-        return new VarAddressNode(Address(pIdentifierNode->getName()));
+        const InternedString & name = pIdentifierNode->getName();
+        return new VarAddressNode(Address(name), pIdentifierNode->getOffset(), name.size());
     }
 
     Node * beginFunctionCallNode(const Node * pNode)
@@ -161,6 +227,21 @@ namespace
         return new BinaryOpNode(binaryOp, left, right);
     }
 
+    Node * createRangeNode(const Node * pFirst, const Node * pLast)
+    {
+        const VarIdentifierNode * pFirstNode = dynamic_cast<const VarIdentifierNode *>(pFirst);
+        const VarIdentifierNode * pLastNode = dynamic_cast<const VarIdentifierNode *>(pLast);
+        if (!pFirstNode || !pLastNode) {
+            throw std::runtime_error("Source is not an identifier node [createRangeNode].");
+        }
+
+        // The text of the range runs from the start of the first corner to the
+        // end of the last, including any space around the colon
+        const std::size_t offset = pFirstNode->getOffset();
+        const std::size_t length = pLastNode->getOffset() + pLastNode->getName().size() - offset;
+        return new RangeNode(Range(Address(pFirstNode->getName()), Address(pLastNode->getName())), offset, length);
+    }
+
     void deleteNode(Node * pNode)
     {
         delete pNode;
@@ -194,25 +275,125 @@ namespace
 
 Formula::Formula(const std::string & formula)
 {
-    // Initialise the Parser and ParserData structures that will be passed
-    // in to the callback functions below.
-    void * pParser = ParseAlloc(::operator new);
-
-    ParserData parserData = {
-        addressNodeFromIdentifierNode,
-        beginFunctionCallNode,
-        createBinaryOpNode,
-        deleteNode,
-        endFunctionCallNode,
-        extendFunctionCallNode,
-        nullptr,
-        false,
-        false
-    };
+    const Formula compiled = FormulaCompiler().compile(formula);
+    m_pRoot = compiled.m_pRoot;
+    m_references = compiled.m_references;
+    m_ranges = compiled.m_ranges;
+}
+
+Formula::Formula(const std::shared_ptr<Node> & pRoot)
+    : m_pRoot(pRoot)
+{
+    // Number the references, so that callers can resolve each one ahead of
+    // time rather than looking up its address on every evaluation
+    m_pRoot->indexReferences(m_references);
+    m_pRoot->indexRanges(m_ranges);
+}
+
+Rope Formula::evaluate(EvalAddressCallback evalAddrCb, EvalRangeCallback evalRangeCb, EvalFunctionCallback evalFuncCb,
+        void *pData)
+{
+    return m_pRoot->evaluate(evalAddrCb, evalRangeCb, evalFuncCb, pData);
+}
+
+bool Formula::evaluateArray(EvalAddressCallback evalAddrCb, EvalRangeCallback evalRangeCb,
+        EvalFunctionCallback evalFuncCb, EvalArrayFunctionCallback evalArrayFuncCb, void * pData, Array & result) const
+{
+    return m_pRoot->evaluateArray(evalAddrCb, evalRangeCb, evalFuncCb, evalArrayFuncCb, pData, result);
+}
+
+void Formula::evaluateLanes(std::size_t count, EvalAddressLanesCallback evalAddrCb, EvalRangeLanesCallback evalRangeCb,
+        EvalFunctionCallback evalFuncCb, void * pData, Lanes & result) const
+{
+    m_pRoot->evaluateLanes(count, evalAddrCb, evalRangeCb, evalFuncCb, pData, result);
+}
+
+std::string Formula::getShape(const Address & origin) const
+{
+    std::ostringstream ss;
+    m_pRoot->writeShape(ss, origin);
+    return ss.str();
+}
+
+void Formula::getReferences(std::vector<Address> & addresses) const
+{
+    addresses.insert(addresses.end(), m_references.begin(), m_references.end());
+}
+
+const std::vector<Address> & Formula::getReferences() const
+{
+    return m_references;
+}
+
+const std::vector<Range> & Formula::getRanges() const
+{
+    return m_ranges;
+}
+
+Formula Formula::relocate(const std::string & source, RelocateAddressCallback moveAddressCb,
+        RelocateRangeCallback moveRangeCb, void * pData, std::string & text) const
+{
+    Relocation relocation(source, moveAddressCb, moveRangeCb, pData);
+    const std::shared_ptr<Node> pRoot(m_pRoot->relocate(relocation));
+    text = relocation.finish();
+    return Formula(pRoot);
+}
+
+Formula::operator std::string() const
+{
+    return *m_pRoot;
+}
+
+FormulaCompiler::FormulaCompiler()
+    : m_pParser(ParseAlloc(::operator new))
+    , m_pParserData(new ParserData())
+    , m_pStrings(std::make_shared<StringPool>())
+{
+    init();
+}
+
+FormulaCompiler::FormulaCompiler(const std::shared_ptr<StringPool> & pStrings)
+    : m_pParser(ParseAlloc(::operator new))
+    , m_pParserData(new ParserData())
+    , m_pStrings(pStrings)
+{
+    init();
+}
+
+FormulaCompiler::~FormulaCompiler()
+{
+    ParseFree(m_pParser, ::operator delete);
+    m_pParser = nullptr;
+}
+
+void FormulaCompiler::init()
+{
+    // The callbacks are the same for every formula, so they only need to be
+    // set up once. Everything else in ParserData is reset per compilation.
+    m_pParserData->addressNodeFromIdentifierNode = addressNodeFromIdentifierNode;
+    m_pParserData->beginFunctionCallNode = beginFunctionCallNode;
+    m_pParserData->createBinaryOpNode = createBinaryOpNode;
+    m_pParserData->createRangeNode = createRangeNode;
+    m_pParserData->deleteNode = deleteNode;
+    m_pParserData->endFunctionCallNode = endFunctionCallNode;
+    m_pParserData->extendFunctionCallNode = extendFunctionCallNode;
+    m_pParserData->pRoot = nullptr;
+    m_pParserData->hadError = false;
+    m_pParserData->hadStackOverflow = false;
+}
+
+Formula FormulaCompiler::compile(const std::string & formula)
+{
+    ParserData & parserData = *m_pParserData;
+    parserData.pRoot = nullptr;
+    parserData.hadError = false;
+    parserData.hadStackOverflow = false;
 
     CallbackData data = {
-        pParser,
-        &parserData
+        m_pParser,
+        &parserData,
+        m_pStrings.get(),
+        formula.c_str()
     };
 
     CallbackData *pData = &data;
@@ -236,32 +417,39 @@ Formula::Formula(const std::string & formula)
     const char * pe = formula.c_str() + formula.size();
     const char * eof = pe;
 
-    // Embed lexical analyzer
-    %% write exec;
-
-    cbEnd(pData);
-
-    ParseFree(pParser, ::operator delete);
+    try {
+        // Embed lexical analyzer
+        %% write exec;
+
+        cbEnd(pData);
+    } catch (...) {
+        // A callback threw part way through a parse, so the parser may still
+        // be holding partially built nodes. Unwind it so that the next call
+        // to compile() starts from a clean state.
+        reset();
+        throw;
+    }
 
     if (parserData.hadStackOverflow) {
         delete parserData.pRoot;
+        reset();
         throw std::runtime_error("Stack overflow.");
     } else if (parserData.hadError || unmatched) {
         delete parserData.pRoot;
+        reset();
         throw std::runtime_error("Invalid formula.");
     } else if (parserData.pRoot) {
-        m_pRoot = std::shared_ptr<Node>(parserData.pRoot);
+        return Formula(std::shared_ptr<Node>(parserData.pRoot));
     } else {
+        reset();
         throw std::runtime_error("Internal error.");
     }
 }
 
-std::string Formula::evaluate(EvalAddressCallback evalAddrCb, EvalFunctionCallback evalFuncCb, void *pData)
-{
-    return m_pRoot->evaluate(evalAddrCb, evalFuncCb, pData);
-}
-
-Formula::operator std::string() const
+void FormulaCompiler::reset()
 {
-    return *m_pRoot;
+    // Pops (and destroys) anything left on the parser stack, then puts the
+    // parser back into its initial state without reallocating it.
+    ParseFinalize(m_pParser);
+    ParseInit(m_pParser);
 }
@@ -0,0 +1,1085 @@
+#include <cctype>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include "arrays.hpp"
+#include "ast.hpp"
+#include "functions.hpp"
+#include "lookup.hpp"
+#include "matrix.hpp"
+#include "views.hpp"
+
+namespace
+{
+    typedef Rope (*Function)(const Arguments &, LookupCache *);
+
+    typedef std::map<std::string, Function> Functions;
+
+    typedef void (*ArrayFunction)(const Arguments &, LookupCache *, Array & result);
+
+    typedef std::map<std::string, ArrayFunction> ArrayFunctions;
+
+    const std::string TRUE_STRING = "TRUE";
+    const std::string FALSE_STRING = "FALSE";
+    const std::string ERROR_STRING = "ERROR";
+
+    /// Ranges with more cells than this are not read as arrays, as they would
+    /// exhaust memory
+    const std::size_t MAX_ARRAY_CELLS = std::size_t(1) << 24;
+
+    const ArrayFunctions & getArrayFunctions();
+
+    std::string toUpper(const std::string & s)
+    {
+        std::string result(s);
+        for (std::string::iterator c = result.begin(); c != result.end(); c++) {
+            *c = char(std::toupper(static_cast<unsigned char>(*c)));
+        }
+
+        return result;
+    }
+
+    bool toNumber(const std::string & value, double & number)
+    {
+        std::stringstream ss(value);
+        ss >> number;
+        return !ss.fail();
+    }
+
+    /// Format a number in the same way as the result of an arithmetic operator
+    std::string toString(double number)
+    {
+        std::stringstream ss;
+        ss << number;
+        return ss.str();
+    }
+
+    /**
+     * Interpret a value as a boolean. TRUE and FALSE (in any case) and numbers
+     * are valid booleans, as is the empty string, which is false.
+     *
+     * @returns true if the value could be interpreted as a boolean
+     */
+    bool toBoolean(const std::string & value, bool & result)
+    {
+        double number = 0;
+        if (value.empty()) {
+            result = false;
+        } else if (toNumber(value, number)) {
+            result = number != 0;
+        } else {
+            const std::string upper = toUpper(value);
+            if (upper == TRUE_STRING) {
+                result = true;
+            } else if (upper == FALSE_STRING) {
+                result = false;
+            } else {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Read a range argument into a table for a lookup. With a cache, the cells
+     * of the range are only read the first time that it is looked up during a
+     * pass; without one, they are read into a table owned by the caller.
+     */
+    const LookupTable & readTable(const Arguments & arguments, std::size_t index, bool across,
+        LookupCache * pLookups, std::unique_ptr<LookupTable> & pOwned)
+    {
+        const Range & range = arguments.getRange(index);
+        if (pLookups) {
+            const LookupTable * pTable = pLookups->find(range, across);
+            if (pTable) {
+                return *pTable;
+            }
+        }
+
+        std::vector<RangeCell> cells;
+        arguments.evaluateRange(index, cells);
+        if (pLookups) {
+            return pLookups->update(range, across, cells);
+        }
+
+        pOwned.reset(new LookupTable(range, across));
+        pOwned->update(cells);
+        return *pOwned;
+    }
+
+    /**
+     * Check that a range is a single row or column, as searched by MATCH and
+     * XLOOKUP. A single cell counts as a row.
+     *
+     * @param   across  Set to true if the range is a row
+     */
+    bool isVector(const Range & range, bool & across)
+    {
+        across = range.first.row == range.last.row;
+        return across || range.first.column == range.last.column;
+    }
+
+    /// Total calculated by a conditional function over the cells that match
+    enum Aggregate
+    {
+        AGGREGATE_SUM,
+        AGGREGATE_COUNT,
+        AGGREGATE_AVERAGE
+    };
+
+    /// Compile a criterion, or retrieve it from the cache
+    const Criterion & readCriterion(const std::string & criterion, LookupCache * pLookups,
+        std::unique_ptr<Criterion> & pOwned)
+    {
+        if (pLookups) {
+            return pLookups->getCriterion(criterion);
+        }
+
+        pOwned.reset(new Criterion(criterion));
+        return *pOwned;
+    }
+
+    /**
+     * Rearrange values held for the cells of one range, so that they line up
+     * with the cells of another range of the same size, which may not have
+     * set the same cells. Values are matched up by the offsets of the cells
+     * within their ranges, and are zero for cells that have not been set.
+     */
+    template<typename T>
+    void align(const std::vector<std::size_t> & fromOffsets, const std::vector<T> & from,
+        const std::vector<std::size_t> & toOffsets, std::vector<T> & to)
+    {
+        to.assign(toOffsets.size(), T());
+        std::size_t f = 0;
+        for (std::size_t t = 0; t < toOffsets.size(); t++) {
+            while (f < fromOffsets.size() && fromOffsets[f] < toOffsets[t]) {
+                f++;
+            }
+            if (f < fromOffsets.size() && fromOffsets[f] == toOffsets[t]) {
+                to[t] = from[f];
+            }
+        }
+    }
+
+    /**
+     * Add the numbers whose cells match. Four running totals are kept, so
+     * that each addition does not have to wait for the one before it, and
+     * the loop has no branches, so it can be vectorized.
+     */
+    double sumMatches(const std::vector<double> & numbers, const std::vector<unsigned char> & mask)
+    {
+        double totals[4] = {0, 0, 0, 0};
+        const std::size_t count = mask.size();
+        std::size_t i = 0;
+        for (; i + 4 <= count; i += 4) {
+            totals[0] += mask[i] ? numbers[i] : 0.0;
+            totals[1] += mask[i + 1] ? numbers[i + 1] : 0.0;
+            totals[2] += mask[i + 2] ? numbers[i + 2] : 0.0;
+            totals[3] += mask[i + 3] ? numbers[i + 3] : 0.0;
+        }
+        for (; i < count; i++) {
+            totals[0] += mask[i] ? numbers[i] : 0.0;
+        }
+
+        return (totals[0] + totals[1]) + (totals[2] + totals[3]);
+    }
+
+    /// Count the cells that match, along with the cells in a second mask
+    std::size_t countMatches(const std::vector<unsigned char> & mask, const std::vector<unsigned char> & other)
+    {
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < mask.size(); i++) {
+            count += mask[i] & other[i];
+        }
+
+        return count;
+    }
+
+    /**
+     * Calculate the total of a conditional function. Each criteria range is
+     * followed by its criterion, and every range must be the same size as
+     * the first criteria range. Cells are matched up by their positions
+     * within their ranges, and a cell matches if it meets every criterion.
+     *
+     * Only cells that have been set are considered, so a criterion that
+     * matches empty values never matches cells that have not been set.
+     *
+     * @param   name      Name of the function, which identifies its result
+     * @param   values    Index of the range holding the values to add up, or
+     *                    of the first criteria range if only counting
+     * @param   first     Index of the first criteria range
+     * @param   end       Index after the last criterion
+     */
+    Rope aggregateIf(const std::string & name, Aggregate aggregate, const Arguments & arguments,
+        std::size_t values, std::size_t first, std::size_t end, LookupCache * pLookups)
+    {
+        if (first >= end || (end - first) % 2 != 0) {
+            return ERROR_STRING;
+        }
+
+        std::vector<std::size_t> ranges(1, values);
+        for (std::size_t i = first; i < end; i += 2) {
+            ranges.push_back(i);
+        }
+
+        for (std::size_t i = 0; i < ranges.size(); i++) {
+            if (!arguments.isRange(ranges[i])) {
+                return ERROR_STRING;
+            }
+            const Range & range = arguments.getRange(ranges[i]);
+            const Range & base = arguments.getRange(first);
+            if (range.last.column - range.first.column != base.last.column - base.first.column ||
+                    range.last.row - range.first.row != base.last.row - base.first.row) {
+                return ERROR_STRING;
+            }
+        }
+
+        // Criteria are evaluated before any range is read
+        std::string key = name;
+        std::vector<std::string> criteria;
+        for (std::size_t i = first + 1; i < end; i += 2) {
+            criteria.push_back(arguments.evaluate(i).str());
+        }
+
+        std::vector<std::unique_ptr<LookupTable> > owned(ranges.size());
+        std::vector<const LookupTable *> tables;
+        for (std::size_t i = 0; i < ranges.size(); i++) {
+            if (i > 0 && ranges[i] == values) {
+                tables.push_back(tables[0]);
+            } else {
+                tables.push_back(&readTable(arguments, ranges[i], false, pLookups, owned[i]));
+            }
+            key += '\0' + tables.back()->getRange().toString();
+            if (i > 0) {
+                key += '\0' + criteria[i - 1];
+            }
+        }
+
+        Rope result;
+        if (pLookups && pLookups->findResult(key, tables, result)) {
+            return result;
+        }
+
+        const std::vector<std::size_t> & offsets = tables[1]->getScan().offsets;
+        std::vector<unsigned char> mask;
+        std::vector<unsigned char> matches;
+        std::vector<unsigned char> aligned;
+        for (std::size_t i = 1; i < tables.size(); i++) {
+            std::unique_ptr<Criterion> pOwned;
+            const Criterion & criterion = readCriterion(criteria[i - 1], pLookups, pOwned);
+            criterion.match(*tables[i], i == 1 ? mask : matches);
+            if (i == 1) {
+                continue;
+            }
+
+            const std::vector<std::size_t> & other = tables[i]->getScan().offsets;
+            const std::vector<unsigned char> * pMatches = &matches;
+            if (other != offsets) {
+                align(other, matches, offsets, aligned);
+                pMatches = &aligned;
+            }
+            for (std::size_t j = 0; j < mask.size(); j++) {
+                mask[j] &= (*pMatches)[j];
+            }
+        }
+
+        if (aggregate == AGGREGATE_COUNT) {
+            result = toString(double(countMatches(mask, mask)));
+        } else {
+            const LookupTable::Scan & scan = tables[0]->getScan();
+            std::vector<double> numbers;
+            std::vector<unsigned char> numeric;
+            const std::vector<double> * pNumbers = &scan.numbers;
+            const std::vector<unsigned char> * pNumeric = &scan.numeric;
+            if (scan.offsets != offsets) {
+                align(scan.offsets, scan.numbers, offsets, numbers);
+                align(scan.offsets, scan.numeric, offsets, numeric);
+                pNumbers = &numbers;
+                pNumeric = &numeric;
+            }
+
+            const double sum = sumMatches(*pNumbers, mask);
+            if (aggregate == AGGREGATE_SUM) {
+                result = toString(sum);
+            } else {
+                const std::size_t count = countMatches(mask, *pNumeric);
+                result = count == 0 ? ERROR_STRING : toString(sum / double(count));
+            }
+        }
+
+        if (pLookups) {
+            pLookups->storeResult(key, tables, result);
+        }
+
+        return result;
+    }
+
+    /// Replace an array with a single error
+    void setError(Array & array)
+    {
+        array.rows = 1;
+        array.columns = 1;
+        array.values.setStrings(std::vector<Rope>(1, Rope(ERROR_STRING)));
+    }
+
+    /// Move the values of a matrix into an array
+    void setMatrix(Matrix & matrix, Array & array)
+    {
+        array.rows = matrix.rows;
+        array.columns = matrix.columns;
+        array.values.numeric = true;
+        array.values.numbers.swap(matrix.values);
+        array.values.strings.clear();
+    }
+
+    /// Check that a range is small enough to be read as an array
+    bool isArraySize(const Range & range)
+    {
+        const std::size_t rows = std::size_t(range.last.row - range.first.row) + 1;
+        const std::size_t columns = std::size_t(range.last.column - range.first.column) + 1;
+        return rows <= MAX_ARRAY_CELLS / columns;
+    }
+
+    /**
+     * Read an argument as an array. A range is read as the values of its
+     * cells, where cells that have not been set are empty, and an expression
+     * such as A1:B2*2, or a call to a function that returns an array, is
+     * evaluated for the whole array. Any other argument is a single value.
+     *
+     * @returns false if the argument is a range that is too large
+     */
+    bool readArray(const Arguments & arguments, std::size_t index, LookupCache * pLookups, Array & array)
+    {
+        if (arguments.isRange(index)) {
+            if (!isArraySize(arguments.getRange(index))) {
+                return false;
+            }
+
+            std::unique_ptr<LookupTable> pOwned;
+            readTable(arguments, index, false, pLookups, pOwned).getArray(array);
+            return true;
+        }
+
+        if (arguments.evaluateArray(index, array)) {
+            return true;
+        }
+
+        // Calls to array functions are made directly when the arguments have
+        // no callback for arrays, i.e. when only a single value is needed
+        const ArrayFunctions & functions = getArrayFunctions();
+        const ArrayFunctions::const_iterator itr = functions.find(toUpper(arguments.getFunctionName(index)));
+        if (itr != functions.end()) {
+            itr->second(arguments.getFunctionArguments(index), pLookups, array);
+            return true;
+        }
+
+        array.rows = 1;
+        array.columns = 1;
+        array.values.setStrings(std::vector<Rope>(1, arguments.evaluate(index)));
+        return true;
+    }
+
+    /// Read an argument as a matrix, returning false unless every value is a number
+    bool readMatrix(const Arguments & arguments, std::size_t index, LookupCache * pLookups, Matrix & matrix)
+    {
+        Array array;
+        if (!readArray(arguments, index, pLookups, array) || !array.values.numeric) {
+            return false;
+        }
+
+        matrix.rows = array.rows;
+        matrix.columns = array.columns;
+        matrix.values.swap(array.values.numbers);
+        return true;
+    }
+
+    /**
+     * Check that an array, such as the keys of SORTBY, is a column with as
+     * many rows as another array, or a row with as many columns. A single
+     * value is only a column, so it does not fit a column of several rows.
+     *
+     * @param   across  Set to true if the array is a row
+     */
+    bool fitsArray(const Array & vector, const Array & array, bool & across)
+    {
+        across = !(vector.columns == 1 && vector.rows == array.rows);
+        return !across || (vector.rows == 1 && vector.columns == array.columns && vector.columns > 1);
+    }
+
+    /**
+     * Bring a view of one or more ranges up to date, and retrieve its values.
+     * A view is created the first time that it is used, and kept in the cache
+     * from then on; without a cache, a new view is used every time.
+     *
+     * @param   key       Identifies the view, by its function and arguments
+     * @param   pCreated  View to use if there is none
+     */
+    void updateView(const std::string & key, const std::shared_ptr<View> & pCreated,
+        const std::vector<const LookupTable *> & tables, LookupCache * pLookups, Array & result)
+    {
+        View * pView = pLookups ? pLookups->findView(key) : nullptr;
+        if (!pView) {
+            pView = pLookups ? &pLookups->storeView(key, pCreated) : pCreated.get();
+        }
+
+        pView->update(tables, result);
+    }
+
+    /// Read a sort order, which is 1 to sort smallest first or -1 for largest first
+    bool readOrder(const Arguments & arguments, std::size_t index, bool & descending)
+    {
+        double order = 0;
+        if (!toNumber(arguments.evaluate(index).str(), order) || (order != 1 && order != -1)) {
+            return false;
+        }
+
+        descending = order < 0;
+        return true;
+    }
+
+    /// AND(value1, ...): stops at the first argument that is false
+    Rope fnAnd(const Arguments & arguments, LookupCache *)
+    {
+        for (std::size_t i = 0; i < arguments.size(); i++) {
+            bool b = false;
+            if (!toBoolean(arguments.evaluate(i).str(), b)) {
+                return ERROR_STRING;
+            } else if (!b) {
+                return FALSE_STRING;
+            }
+        }
+
+        return TRUE_STRING;
+    }
+
+    /**
+     * AVERAGEIF(range, criterion[, average range]): average of the numbers
+     * in the average range (or the range itself) whose cells in the range
+     * match the criterion. There is an error if no numbers match.
+     */
+    Rope fnAverageIf(const Arguments & arguments, LookupCache * pLookups)
+    {
+        if (arguments.size() < 2 || arguments.size() > 3) {
+            return ERROR_STRING;
+        }
+
+        return aggregateIf("AVERAGEIF", AGGREGATE_AVERAGE, arguments, arguments.size() == 3 ? 2 : 0, 0, 2, pLookups);
+    }
+
+    /// AVERAGEIFS(average range, range1, criterion1, ...): as for AVERAGEIF, with every criterion met
+    Rope fnAverageIfs(const Arguments & arguments, LookupCache * pLookups)
+    {
+        return aggregateIf("AVERAGEIFS", AGGREGATE_AVERAGE, arguments, 0, 1, arguments.size(), pLookups);
+    }
+
+    /// CHOOSE(index, value1, ...): evaluates only the chosen value
+    Rope fnChoose(const Arguments & arguments, LookupCache *)
+    {
+        double index = 0;
+        if (arguments.size() < 2 || !toNumber(arguments.evaluate(0).str(), index)) {
+            return ERROR_STRING;
+        }
+
+        if (index < 1 || index >= double(arguments.size())) {
+            return ERROR_STRING;
+        }
+
+        return arguments.evaluate(std::size_t(index));
+    }
+
+    /// COUNTIF(range, criterion): number of cells in the range that match the criterion
+    Rope fnCountIf(const Arguments & arguments, LookupCache * pLookups)
+    {
+        if (arguments.size() != 2) {
+            return ERROR_STRING;
+        }
+
+        return aggregateIf("COUNTIF", AGGREGATE_COUNT, arguments, 0, 0, 2, pLookups);
+    }
+
+    /// COUNTIFS(range1, criterion1, ...): number of positions at which every criterion is met
+    Rope fnCountIfs(const Arguments & arguments, LookupCache * pLookups)
+    {
+        return aggregateIf("COUNTIFS", AGGREGATE_COUNT, arguments, 0, 0, arguments.size(), pLookups);
+    }
+
+    /**
+     * FILTER(array, include[, if empty]): rows of the array for which include,
+     * a column with as many rows, is true; or columns, if include is a row
+     * with as many columns. If nothing is included, the result is the value
+     * of if empty, or an error without one.
+     */
+    void fnFilter(const Arguments & arguments, LookupCache * pLookups, Array & result)
+    {
+        Array array;
+        Array include;
+        bool across = false;
+        if (arguments.size() < 2 || arguments.size() > 3 || !readArray(arguments, 0, pLookups, array) ||
+                !readArray(arguments, 1, pLookups, include) || !fitsArray(include, array, across)) {
+            setError(result);
+            return;
+        }
+
+        std::vector<std::size_t> lines;
+        for (std::size_t i = 0; i < include.values.size(); i++) {
+            bool b = false;
+            if (include.values.numeric) {
+                b = include.values.numbers[i] != 0;
+            } else if (!toBoolean(include.values.strings[i].str(), b)) {
+                setError(result);
+                return;
+            }
+
+            if (b) {
+                lines.push_back(i);
+            }
+        }
+
+        if (lines.empty()) {
+            if (arguments.size() == 3) {
+                result.rows = 1;
+                result.columns = 1;
+                result.values.setStrings(std::vector<Rope>(1, arguments.evaluate(2)));
+            } else {
+                setError(result);
+            }
+            return;
+        }
+
+        selectRows(array, across, lines, result);
+    }
+
+    /**
+     * GROUPBY(keys, values, function): one row for each distinct key in a
+     * column, in the order that SORT would put them in, followed by the total
+     * of the values in the rows with that key. The function is "SUM", "COUNT"
+     * (of the values that are not empty), "MIN" or "MAX". Both ranges must be
+     * columns with as many rows as each other, and rows without keys are left
+     * out. The groups are kept as a view, so later passes only update the
+     * groups of the rows that have changed.
+     */
+    void fnGroupBy(const Arguments & arguments, LookupCache * pLookups, Array & result)
+    {
+        if (arguments.size() != 3 || !arguments.isRange(0) || !arguments.isRange(1)) {
+            setError(result);
+            return;
+        }
+
+        const Range & keys = arguments.getRange(0);
+        const Range & values = arguments.getRange(1);
+        if (keys.first.column != keys.last.column || values.first.column != values.last.column ||
+                keys.last.row - keys.first.row != values.last.row - values.first.row) {
+            setError(result);
+            return;
+        }
+
+        // The function is evaluated before either range is read
+        const std::string name = toUpper(arguments.evaluate(2).str());
+        GroupedView::Function function = GroupedView::FUNCTION_SUM;
+        if (name == "COUNT") {
+            function = GroupedView::FUNCTION_COUNT;
+        } else if (name == "MIN") {
+            function = GroupedView::FUNCTION_MIN;
+        } else if (name == "MAX") {
+            function = GroupedView::FUNCTION_MAX;
+        } else if (name != "SUM") {
+            setError(result);
+            return;
+        }
+
+        std::vector<std::unique_ptr<LookupTable> > owned(2);
+        std::vector<const LookupTable *> tables;
+        tables.push_back(&readTable(arguments, 0, false, pLookups, owned[0]));
+        tables.push_back(&readTable(arguments, 1, false, pLookups, owned[1]));
+        const std::string key = std::string("GROUPBY") + '\0' + keys.toString() + '\0' + values.toString() + '\0' + name;
+        updateView(key, std::make_shared<GroupedView>(function), tables, pLookups, result);
+        if (result.rows == 0) {
+            setError(result);
+        }
+    }
+
+    /// IF(condition, then[, else]): evaluates only the branch that is taken
+    Rope fnIf(const Arguments & arguments, LookupCache *)
+    {
+        bool b = false;
+        if (arguments.size() < 2 || arguments.size() > 3 || !toBoolean(arguments.evaluate(0).str(), b)) {
+            return ERROR_STRING;
+        }
+
+        if (b) {
+            return arguments.evaluate(1);
+        } else if (arguments.size() == 3) {
+            return arguments.evaluate(2);
+        }
+
+        return FALSE_STRING;
+    }
+
+    /**
+     * MATCH(value, range[, type]): position of a value within a row or
+     * column, counted from one. Type 0 finds an equal value, 1 (the default)
+     * the largest value that is less than or equal, and -1 the smallest value
+     * that is greater than or equal. Types 1 and -1 find the last of several
+     * equal values, as a binary search of sorted values would.
+     */
+    Rope fnMatch(const Arguments & arguments, LookupCache * pLookups)
+    {
+        double type = 1;
+        bool across = false;
+        if (arguments.size() < 2 || arguments.size() > 3 || !arguments.isRange(1) ||
+                !isVector(arguments.getRange(1), across)) {
+            return ERROR_STRING;
+        } else if (arguments.size() == 3 && !toNumber(arguments.evaluate(2).str(), type)) {
+            return ERROR_STRING;
+        }
+
+        const LookupTable::MatchMode mode = type > 0 ? LookupTable::MATCH_EXACT_OR_SMALLER :
+            type < 0 ? LookupTable::MATCH_EXACT_OR_LARGER : LookupTable::MATCH_EXACT;
+
+        const Rope value = arguments.evaluate(0);
+        std::unique_ptr<LookupTable> pOwned;
+        const LookupTable & table = readTable(arguments, 1, across, pLookups, pOwned);
+        const std::size_t position = table.find(value, mode, mode != LookupTable::MATCH_EXACT);
+        if (position == LookupTable::npos) {
+            return ERROR_STRING;
+        }
+
+        return toString(double(position + 1));
+    }
+
+    /**
+     * MINVERSE(array): inverse of a square matrix. Every value must be a
+     * number, and there is an error if the matrix is singular.
+     */
+    void fnMInverse(const Arguments & arguments, LookupCache * pLookups, Array & result)
+    {
+        Matrix matrix;
+        if (arguments.size() != 1 || !readMatrix(arguments, 0, pLookups, matrix) || !invertMatrix(matrix, matrix)) {
+            setError(result);
+            return;
+        }
+
+        setMatrix(matrix, result);
+    }
+
+    /**
+     * MMULT(array1, array2): matrix product of two arrays, where the first
+     * has as many columns as the second has rows. Every value must be a
+     * number.
+     */
+    void fnMMult(const Arguments & arguments, LookupCache * pLookups, Array & result)
+    {
+        Matrix lhs;
+        Matrix rhs;
+        if (arguments.size() != 2 || !readMatrix(arguments, 0, pLookups, lhs) ||
+                !readMatrix(arguments, 1, pLookups, rhs) || !multiplyMatrices(lhs, rhs, lhs)) {
+            setError(result);
+            return;
+        }
+
+        setMatrix(lhs, result);
+    }
+
+    /// NOT(value)
+    Rope fnNot(const Arguments & arguments, LookupCache *)
+    {
+        bool b = false;
+        if (arguments.size() != 1 || !toBoolean(arguments.evaluate(0).str(), b)) {
+            return ERROR_STRING;
+        }
+
+        return b ? FALSE_STRING : TRUE_STRING;
+    }
+
+    /// OR(value1, ...): stops at the first argument that is true
+    Rope fnOr(const Arguments & arguments, LookupCache *)
+    {
+        for (std::size_t i = 0; i < arguments.size(); i++) {
+            bool b = false;
+            if (!toBoolean(arguments.evaluate(i).str(), b)) {
+                return ERROR_STRING;
+            } else if (b) {
+                return TRUE_STRING;
+            }
+        }
+
+        return FALSE_STRING;
+    }
+
+    /**
+     * SORT(array[, index[, order[, by column]]]): rows of the array, sorted
+     * by the values in a column, counted from one, where an order of -1 sorts
+     * largest first. By column sorts the columns by the values in a row.
+     *
+     * The rows of a range are sorted by a view, so that later passes only
+     * sort the rows whose keys have changed.
+     */
+    void fnSort(const Arguments & arguments, LookupCache * pLookups, Array & result)
+    {
+        double index = 1;
+        bool descending = false;
+        bool byColumn = false;
+        if (arguments.size() < 1 || arguments.size() > 4 ||
+                (arguments.size() > 1 && !toNumber(arguments.evaluate(1).str(), index)) ||
+                (arguments.size() > 2 && !readOrder(arguments, 2, descending)) ||
+                (arguments.size() > 3 && !toBoolean(arguments.evaluate(3).str(), byColumn))) {
+            setError(result);
+            return;
+        }
+
+        if (arguments.isRange(0) && !byColumn) {
+            const Range & range = arguments.getRange(0);
+            if (!isArraySize(range) || index < 1 || index >= double(range.last.column - range.first.column) + 2) {
+                setError(result);
+                return;
+            }
+
+            std::unique_ptr<LookupTable> pOwned;
+            const std::vector<const LookupTable *> tables(1, &readTable(arguments, 0, false, pLookups, pOwned));
+            const std::string key = std::string("SORT") + '\0' + range.toString() + '\0' + toString(index) + '\0' +
+                (descending ? "-1" : "1");
+            updateView(key, std::make_shared<SortedView>(std::size_t(index) - 1, descending), tables, pLookups,
+                result);
+            return;
+        }
+
+        Array array;
+        if (!readArray(arguments, 0, pLookups, array) || index < 1 ||
+                index >= double(byColumn ? array.rows : array.columns) + 1) {
+            setError(result);
+            return;
+        }
+
+        std::vector<SortKey> keys(1);
+        readSortKey(array, std::size_t(index) - 1, byColumn, descending, keys.front());
+        std::vector<std::size_t> order;
+        sortRows(keys, byColumn ? array.columns : array.rows, 0, order);
+        selectRows(array, byColumn, order, result);
+    }
+
+    /**
+     * SORTBY(array, by1[, order1], ...): rows of the array, sorted by columns
+     * with as many rows, where each column breaks ties in the one before; or
+     * columns, sorted by rows with as many columns. An order of -1 sorts
+     * largest first.
+     */
+    void fnSortBy(const Arguments & arguments, LookupCache * pLookups, Array & result)
+    {
+        Array array;
+        if (arguments.size() < 2 || !readArray(arguments, 0, pLookups, array)) {
+            setError(result);
+            return;
+        }
+
+        std::vector<SortKey> keys;
+        bool across = false;
+        for (std::size_t i = 1; i < arguments.size(); i += 2) {
+            Array by;
+            bool byAcross = false;
+            bool descending = false;
+            if (!readArray(arguments, i, pLookups, by) || !fitsArray(by, array, byAcross) ||
+                    (i > 1 && byAcross != across) ||
+                    (i + 1 < arguments.size() && !readOrder(arguments, i + 1, descending))) {
+                setError(result);
+                return;
+            }
+
+            across = byAcross;
+            keys.push_back(SortKey());
+            readSortKey(by, 0, across, descending, keys.back());
+        }
+
+        std::vector<std::size_t> order;
+        sortRows(keys, across ? array.columns : array.rows, 0, order);
+        selectRows(array, across, order, result);
+    }
+
+    /**
+     * SUM(value1, ...): adds numbers, along with the numbers within ranges.
+     * Cells within a range that do not hold numbers are ignored, as are
+     * arguments that are empty.
+     */
+    Rope fnSum(const Arguments & arguments, LookupCache *)
+    {
+        double sum = 0;
+        std::vector<RangeCell> cells;
+        for (std::size_t i = 0; i < arguments.size(); i++) {
+            double number = 0;
+            if (arguments.isRange(i)) {
+                arguments.evaluateRange(i, cells);
+                for (std::vector<RangeCell>::const_iterator itr = cells.begin(); itr != cells.end(); itr++) {
+                    if (toNumber(itr->value.str(), number)) {
+                        sum += number;
+                    }
+                }
+            } else {
+                const std::string value = arguments.evaluate(i).str();
+                if (value.empty()) {
+                    continue;
+                } else if (!toNumber(value, number)) {
+                    return ERROR_STRING;
+                }
+                sum += number;
+            }
+        }
+
+        return toString(sum);
+    }
+
+    /**
+     * SUMIF(range, criterion[, sum range]): adds the numbers in the sum range
+     * (or the range itself) whose cells in the range match the criterion.
+     */
+    Rope fnSumIf(const Arguments & arguments, LookupCache * pLookups)
+    {
+        if (arguments.size() < 2 || arguments.size() > 3) {
+            return ERROR_STRING;
+        }
+
+        return aggregateIf("SUMIF", AGGREGATE_SUM, arguments, arguments.size() == 3 ? 2 : 0, 0, 2, pLookups);
+    }
+
+    /// SUMIFS(sum range, range1, criterion1, ...): as for SUMIF, with every criterion met
+    Rope fnSumIfs(const Arguments & arguments, LookupCache * pLookups)
+    {
+        return aggregateIf("SUMIFS", AGGREGATE_SUM, arguments, 0, 1, arguments.size(), pLookups);
+    }
+
+    /// TRANSPOSE(array): swaps the rows and columns of an array of any values
+    void fnTranspose(const Arguments & arguments, LookupCache * pLookups, Array & result)
+    {
+        Array array;
+        if (arguments.size() != 1 || !readArray(arguments, 0, pLookups, array)) {
+            setError(result);
+            return;
+        }
+
+        if (array.values.numeric) {
+            Matrix matrix;
+            matrix.rows = array.rows;
+            matrix.columns = array.columns;
+            matrix.values.swap(array.values.numbers);
+            transposeMatrix(matrix, matrix);
+            setMatrix(matrix, result);
+            return;
+        }
+
+        result.rows = array.columns;
+        result.columns = array.rows;
+        result.values.numeric = false;
+        result.values.numbers.clear();
+        result.values.strings.resize(array.values.strings.size());
+        for (std::size_t row = 0; row < array.rows; row++) {
+            for (std::size_t column = 0; column < array.columns; column++) {
+                result.values.strings[column * array.rows + row] = array.values.strings[row * array.columns + column];
+            }
+        }
+    }
+
+    /**
+     * UNIQUE(array[, by column[, exactly once]]): distinct rows of the array,
+     * in the order that each first appears, or distinct columns. Exactly once
+     * leaves out rows that appear more than once.
+     */
+    void fnUnique(const Arguments & arguments, LookupCache * pLookups, Array & result)
+    {
+        Array array;
+        bool byColumn = false;
+        bool exactlyOnce = false;
+        if (arguments.size() < 1 || arguments.size() > 3 || !readArray(arguments, 0, pLookups, array) ||
+                (arguments.size() > 1 && !toBoolean(arguments.evaluate(1).str(), byColumn)) ||
+                (arguments.size() > 2 && !toBoolean(arguments.evaluate(2).str(), exactlyOnce))) {
+            setError(result);
+            return;
+        }
+
+        std::vector<std::size_t> rows;
+        findUniqueRows(array, byColumn, exactlyOnce, 0, rows);
+        if (rows.empty()) {
+            setError(result);
+            return;
+        }
+
+        selectRows(array, byColumn, rows, result);
+    }
+
+    /**
+     * VLOOKUP(value, table, column[, approximate]): value in a column of the
+     * table, counted from one, from the row whose first cell matches. An
+     * approximate match (the default) finds the largest value that is less
+     * than or equal, in the same way as MATCH with type 1.
+     */
+    Rope fnVLookup(const Arguments & arguments, LookupCache * pLookups)
+    {
+        double column = 0;
+        bool approximate = true;
+        if (arguments.size() < 3 || arguments.size() > 4 || !arguments.isRange(1)) {
+            return ERROR_STRING;
+        } else if (!toNumber(arguments.evaluate(2).str(), column)) {
+            return ERROR_STRING;
+        } else if (arguments.size() == 4 && !toBoolean(arguments.evaluate(3).str(), approximate)) {
+            return ERROR_STRING;
+        }
+
+        const Range & range = arguments.getRange(1);
+        if (column < 1 || column >= double(range.last.column - range.first.column) + 2) {
+            return ERROR_STRING;
+        }
+
+        const Rope value = arguments.evaluate(0);
+        std::unique_ptr<LookupTable> pOwned;
+        const LookupTable & table = readTable(arguments, 1, false, pLookups, pOwned);
+        const std::size_t position = table.find(value,
+            approximate ? LookupTable::MATCH_EXACT_OR_SMALLER : LookupTable::MATCH_EXACT, approximate);
+        if (position == LookupTable::npos) {
+            return ERROR_STRING;
+        }
+
+        return table.getValue(position, std::size_t(column) - 1);
+    }
+
+    /**
+     * XLOOKUP(value, range, results[, not found[, match mode[, search mode]]]):
+     * value in a row or column of results, at the same position as the value
+     * within the range, which must be the same length. Match mode 0 (the
+     * default) finds an equal value, -1 an equal value or else the next
+     * smaller value, and 1 an equal value or else the next larger value.
+     * Search mode 1 (the default) finds the first match, and -1 the last;
+     * modes 2 and -2 are accepted as the same, since every search is indexed.
+     * The not found value is only evaluated if there is no match.
+     */
+    Rope fnXLookup(const Arguments & arguments, LookupCache * pLookups)
+    {
+        double matchMode = 0;
+        double searchMode = 1;
+        bool across = false;
+        bool resultsAcross = false;
+        if (arguments.size() < 3 || arguments.size() > 6 || !arguments.isRange(1) || !arguments.isRange(2) ||
+                !isVector(arguments.getRange(1), across) || !isVector(arguments.getRange(2), resultsAcross)) {
+            return ERROR_STRING;
+        } else if (arguments.size() >= 5 && !toNumber(arguments.evaluate(4).str(), matchMode)) {
+            return ERROR_STRING;
+        } else if (arguments.size() == 6 && !toNumber(arguments.evaluate(5).str(), searchMode)) {
+            return ERROR_STRING;
+        }
+
+        const Range & range = arguments.getRange(1);
+        const Range & results = arguments.getRange(2);
+        if (across != resultsAcross || (across ?
+                range.last.column - range.first.column != results.last.column - results.first.column :
+                range.last.row - range.first.row != results.last.row - results.first.row)) {
+            return ERROR_STRING;
+        }
+
+        LookupTable::MatchMode mode = LookupTable::MATCH_EXACT;
+        if (matchMode == -1) {
+            mode = LookupTable::MATCH_EXACT_OR_SMALLER;
+        } else if (matchMode == 1) {
+            mode = LookupTable::MATCH_EXACT_OR_LARGER;
+        } else if (matchMode != 0) {
+            return ERROR_STRING;
+        }
+
+        if (searchMode != 1 && searchMode != -1 && searchMode != 2 && searchMode != -2) {
+            return ERROR_STRING;
+        }
+
+        const Rope value = arguments.evaluate(0);
+        std::unique_ptr<LookupTable> pOwned;
+        const LookupTable & table = readTable(arguments, 1, across, pLookups, pOwned);
+        const std::size_t position = table.find(value, mode, searchMode < 0);
+        if (position == LookupTable::npos) {
+            return arguments.size() >= 4 ? arguments.evaluate(3) : Rope(ERROR_STRING);
+        }
+
+        std::unique_ptr<LookupTable> pOwnedResults;
+        return readTable(arguments, 2, across, pLookups, pOwnedResults).getValue(position, 0);
+    }
+
+    Functions makeFunctions()
+    {
+        Functions functions;
+        functions["AND"] = fnAnd;
+        functions["AVERAGEIF"] = fnAverageIf;
+        functions["AVERAGEIFS"] = fnAverageIfs;
+        functions["CHOOSE"] = fnChoose;
+        functions["COUNTIF"] = fnCountIf;
+        functions["COUNTIFS"] = fnCountIfs;
+        functions["IF"] = fnIf;
+        functions["MATCH"] = fnMatch;
+        functions["NOT"] = fnNot;
+        functions["OR"] = fnOr;
+        functions["SUM"] = fnSum;
+        functions["SUMIF"] = fnSumIf;
+        functions["SUMIFS"] = fnSumIfs;
+        functions["VLOOKUP"] = fnVLookup;
+        functions["XLOOKUP"] = fnXLookup;
+
+        return functions;
+    }
+
+    /**
+     * The functions are added once, by whichever thread calls first, as forks
+     * of a sheet may be recalculated on several threads at once.
+     */
+    const Functions & getFunctions()
+    {
+        static const Functions functions = makeFunctions();
+        return functions;
+    }
+
+    ArrayFunctions makeArrayFunctions()
+    {
+        ArrayFunctions functions;
+        functions["FILTER"] = fnFilter;
+        functions["GROUPBY"] = fnGroupBy;
+        functions["MINVERSE"] = fnMInverse;
+        functions["MMULT"] = fnMMult;
+        functions["SORT"] = fnSort;
+        functions["SORTBY"] = fnSortBy;
+        functions["TRANSPOSE"] = fnTranspose;
+        functions["UNIQUE"] = fnUnique;
+
+        return functions;
+    }
+
+    /// Array functions are added once in the same way
+    const ArrayFunctions & getArrayFunctions()
+    {
+        static const ArrayFunctions functions = makeArrayFunctions();
+        return functions;
+    }
+}
+
+Rope callFunction(const std::string & name, const Arguments & arguments, LookupCache * pLookups)
+{
+    const Functions & functions = getFunctions();
+    Functions::const_iterator itr = functions.find(toUpper(name));
+    if (itr != functions.end()) {
+        return itr->second(arguments, pLookups);
+    }
+
+    // Array functions called for a single value return their first value
+    Array result;
+    if (!callArrayFunction(name, arguments, pLookups, result)) {
+        throw std::runtime_error("Unknown function: " + name);
+    }
+
+    return result.values.getString(0);
+}
+
+bool callArrayFunction(const std::string & name, const Arguments & arguments, LookupCache * pLookups, Array & result)
+{
+    const ArrayFunctions & functions = getArrayFunctions();
+    ArrayFunctions::const_iterator itr = functions.find(toUpper(name));
+    if (itr == functions.end()) {
+        return false;
+    }
+
+    itr->second(arguments, pLookups, result);
+    return true;
+}
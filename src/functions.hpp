@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+
+#include "rope.hpp"
+
+class Arguments;
+class LookupCache;
+
+struct Array;
+
+/**
+ * Call one of the built-in functions.
+ *
+ * Function names are not case sensitive. Arguments are evaluated on demand,
+ * so conditional functions such as IF, AND, OR and CHOOSE only evaluate (and
+ * therefore only depend on) the arguments that they actually use.
+ *
+ * Lookup functions (MATCH, VLOOKUP and XLOOKUP) find keys using indexes
+ * over the ranges that they search. Given a cache, a range is read into its
+ * table once per recalculation pass, however many lookups are made in it.
+ * Conditional functions (SUMIF, COUNTIF, AVERAGEIF and their multiple
+ * criteria forms) compile their criteria once, and reuse their results
+ * until the ranges that they read change.
+ *
+ * Array functions (MMULT, TRANSPOSE and MINVERSE) return their first value
+ * when called by this function, or the whole array by callArrayFunction().
+ *
+ * @param   name       Name of the function
+ * @param   arguments  Unevaluated arguments to the function
+ * @param   pLookups   Tables read by lookup and conditional functions during
+ *                     the current pass, or null to read ranges on every call
+ *
+ * @throws  std::runtime_error if there is no function with the given name
+ *
+ * @returns result of the function call, in string format
+ */
+Rope callFunction(const std::string & name, const Arguments & arguments, LookupCache * pLookups);
+
+/**
+ * Call one of the built-in functions that returns an array, for the whole
+ * array. Arrays are read from ranges, and from calls to other array
+ * functions in the arguments, such as MMULT(TRANSPOSE(A1:B3), A1:B3).
+ *
+ * @param   name       Name of the function
+ * @param   arguments  Unevaluated arguments to the function
+ * @param   pLookups   Tables read during the current pass, or null
+ * @param   result     Receives the array, which is a single error if the
+ *                     arguments are not valid
+ *
+ * @returns false, having evaluated nothing, if there is no array function
+ *          with the given name
+ */
+bool callArrayFunction(const std::string & name, const Arguments & arguments, LookupCache * pLookups, Array & result);
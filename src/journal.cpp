@@ -0,0 +1,410 @@
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "address.hpp"
+#include "journal.hpp"
+#include "sheet.hpp"
+
+namespace
+{
+    const char RECORD_SET = 'S';
+    const char RECORD_ERASE = 'E';
+
+    /// First record of a snapshot, which holds the generation of the snapshot
+    const char RECORD_GENERATION = 'G';
+
+    // Records of rows or columns being inserted or deleted hold the first row
+    // or column in place of the column of an address, and the number of rows
+    // or columns in place of the row
+    const char RECORD_INSERT_ROWS = 'R';
+    const char RECORD_DELETE_ROWS = 'r';
+    const char RECORD_INSERT_COLUMNS = 'C';
+    const char RECORD_DELETE_COLUMNS = 'c';
+
+    /// Bytes before the payload of each record: its length, then its checksum
+    const std::size_t HEADER_SIZE = 8;
+
+    /// Bytes in a payload before the formula: the record type, generation,
+    /// column and row
+    const std::size_t PAYLOAD_SIZE = 13;
+
+    void putWord(std::string & bytes, std::uint32_t word)
+    {
+        for (int i = 0; i < 4; i++) {
+            bytes.push_back(char((word >> (8 * i)) & 0xff));
+        }
+    }
+
+    std::uint32_t getWord(const char * bytes)
+    {
+        std::uint32_t word = 0;
+        for (int i = 0; i < 4; i++) {
+            word |= std::uint32_t(static_cast<unsigned char>(bytes[i])) << (8 * i);
+        }
+
+        return word;
+    }
+
+    /// 32-bit FNV-1a hash, used to detect records that were only partly written
+    std::uint32_t checksum(const char * bytes, std::size_t length)
+    {
+        std::uint32_t hash = 2166136261u;
+        for (std::size_t i = 0; i < length; i++) {
+            hash ^= static_cast<unsigned char>(bytes[i]);
+            hash *= 16777619u;
+        }
+
+        return hash;
+    }
+
+    void putRecord(std::string & bytes, char type, std::uint32_t generation, const Address & address,
+        const std::string & formula)
+    {
+        std::string payload;
+        payload.reserve(PAYLOAD_SIZE + formula.size());
+        payload.push_back(type);
+        putWord(payload, generation);
+        putWord(payload, address.column);
+        putWord(payload, address.row);
+        payload.append(formula);
+
+        putWord(bytes, std::uint32_t(payload.size()));
+        putWord(bytes, checksum(payload.data(), payload.size()));
+        bytes.append(payload);
+    }
+
+    /**
+     * Apply the complete records at the start of a buffer to a Sheet.
+     *
+     * @param   oldest      Generation of the oldest records to apply; older
+     *                      records are already included in the snapshot
+     * @param   generation  Receives the generation of a snapshot, if the buffer
+     *                      holds one
+     *
+     * @returns length of the complete records
+     */
+    std::size_t applyRecords(const std::string & bytes, Sheet & sheet, std::uint32_t oldest,
+        std::uint32_t & generation, std::size_t & count)
+    {
+        std::size_t pos = 0;
+        while (bytes.size() - pos >= HEADER_SIZE) {
+            const std::size_t length = getWord(bytes.data() + pos);
+            const char * payload = bytes.data() + pos + HEADER_SIZE;
+            if (bytes.size() - pos - HEADER_SIZE < length || length < PAYLOAD_SIZE ||
+                    getWord(bytes.data() + pos + 4) != checksum(payload, length)) {
+                break;
+            }
+
+            const std::uint32_t recorded = getWord(payload + 1);
+            const Address address(getWord(payload + 5), getWord(payload + 9));
+            if (payload[0] == RECORD_GENERATION) {
+                generation = recorded;
+                pos += HEADER_SIZE + length;
+                continue;
+            } else if (recorded < oldest) {
+                pos += HEADER_SIZE + length;
+                continue;
+            } else if (payload[0] == RECORD_SET) {
+                sheet.setFormula(address, std::string(payload + PAYLOAD_SIZE, length - PAYLOAD_SIZE));
+            } else if (payload[0] == RECORD_ERASE) {
+                sheet.erase(address);
+            } else if (payload[0] == RECORD_INSERT_ROWS) {
+                sheet.insertRows(address.column, address.row);
+            } else if (payload[0] == RECORD_DELETE_ROWS) {
+                sheet.deleteRows(address.column, address.row);
+            } else if (payload[0] == RECORD_INSERT_COLUMNS) {
+                sheet.insertColumns(address.column, address.row);
+            } else if (payload[0] == RECORD_DELETE_COLUMNS) {
+                sheet.deleteColumns(address.column, address.row);
+            } else {
+                break;
+            }
+
+            pos += HEADER_SIZE + length;
+            count++;
+        }
+
+        return pos;
+    }
+
+    /**
+     * Read the generation of a snapshot from its first record, without
+     * reading the rest of the file.
+     *
+     * @returns generation, or zero if there is no snapshot
+     */
+    std::uint32_t readGeneration(const std::string & path)
+    {
+        std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+        char bytes[HEADER_SIZE + PAYLOAD_SIZE];
+        if (!in.read(bytes, sizeof(bytes)) || bytes[HEADER_SIZE] != RECORD_GENERATION) {
+            return 0;
+        }
+
+        return getWord(bytes + HEADER_SIZE + 1);
+    }
+
+    /// Returns false if the file does not exist
+    bool readFile(const std::string & path, std::string & bytes)
+    {
+        std::ifstream in(path.c_str(), std::ios::in | std::ios::binary);
+        if (!in) {
+            return false;
+        }
+
+        std::ostringstream contents;
+        contents << in.rdbuf();
+        if (in.bad()) {
+            throw std::runtime_error("Could not read " + path);
+        }
+
+        bytes = contents.str();
+        return true;
+    }
+
+    void writeAll(int fd, const std::string & bytes)
+    {
+        std::size_t written = 0;
+        while (written < bytes.size()) {
+            const ssize_t result = ::write(fd, bytes.data() + written, bytes.size() - written);
+            if (result < 0 && errno == EINTR) {
+                continue;
+            } else if (result < 0) {
+                throw std::runtime_error("Could not write to journal.");
+            }
+            written += std::size_t(result);
+        }
+    }
+
+    void sync(int fd)
+    {
+        if (::fsync(fd) != 0) {
+            throw std::runtime_error("Could not sync journal.");
+        }
+    }
+
+    /// Sync the directory holding a file, so that a rename into it is durable
+    void syncDirectory(const std::string & path)
+    {
+        const std::string::size_type slash = path.find_last_of('/');
+        const std::string directory = slash == std::string::npos ? "." : path.substr(0, slash + 1);
+        const int fd = ::open(directory.c_str(), O_RDONLY);
+        if (fd >= 0) {
+            ::fsync(fd);
+            ::close(fd);
+        }
+    }
+}
+
+Journal::Journal(const std::string & path)
+    : m_path(path)
+    , m_fd(::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644))
+    , m_generation(readGeneration(path + ".snapshot"))
+    , m_appended(0)
+    , m_durable(0)
+    , m_syncing(false)
+    , m_failed(false)
+{
+    if (m_fd < 0) {
+        throw std::runtime_error("Could not open journal: " + path);
+    }
+}
+
+Journal::~Journal()
+{
+    try {
+        commit();
+    } catch (const std::runtime_error &) {
+        // Records that could not be written are lost, as in a crash
+    }
+
+    ::close(m_fd);
+}
+
+std::size_t Journal::replay(Sheet & sheet)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::size_t count = 0;
+    std::string bytes;
+    std::uint32_t generation = 0;
+    const std::string snapshot = m_path + ".snapshot";
+    if (readFile(snapshot, bytes) && applyRecords(bytes, sheet, 0, generation, count) != bytes.size()) {
+        throw std::runtime_error("Snapshot is corrupt: " + snapshot);
+    }
+
+    // Records from before the snapshot remain if the journal was not emptied
+    // after the snapshot was written, and are skipped
+    std::uint32_t ignored = 0;
+    if (readFile(m_path, bytes)) {
+        const std::size_t length = applyRecords(bytes, sheet, generation, ignored, count);
+        if (length != bytes.size() && ::ftruncate(m_fd, off_t(length)) != 0) {
+            throw std::runtime_error("Could not truncate journal: " + m_path);
+        }
+    }
+
+    return count;
+}
+
+std::uint64_t Journal::recordSet(const Address & address, const std::string & formula)
+{
+    return append(RECORD_SET, address, formula);
+}
+
+std::uint64_t Journal::recordErase(const Address & address)
+{
+    return append(RECORD_ERASE, address, "");
+}
+
+std::uint64_t Journal::recordInsertRows(unsigned int row, unsigned int count)
+{
+    return append(RECORD_INSERT_ROWS, Address(row, count), "");
+}
+
+std::uint64_t Journal::recordDeleteRows(unsigned int row, unsigned int count)
+{
+    return append(RECORD_DELETE_ROWS, Address(row, count), "");
+}
+
+std::uint64_t Journal::recordInsertColumns(unsigned int column, unsigned int count)
+{
+    return append(RECORD_INSERT_COLUMNS, Address(column, count), "");
+}
+
+std::uint64_t Journal::recordDeleteColumns(unsigned int column, unsigned int count)
+{
+    return append(RECORD_DELETE_COLUMNS, Address(column, count), "");
+}
+
+void Journal::commit(std::uint64_t sequence)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_durable < sequence) {
+        if (m_failed) {
+            throw std::runtime_error("Journal could not be written.");
+        } else if (m_syncing) {
+            m_synced.wait(lock);
+            continue;
+        }
+
+        // Write every record appended so far, not just those up to the
+        // sequence number, so that threads that appended while the previous
+        // sync was in progress share this one
+        std::string batch;
+        batch.swap(m_buffer);
+        const std::uint64_t last = m_appended;
+        m_syncing = true;
+        lock.unlock();
+
+        bool written = false;
+        try {
+            writeAll(m_fd, batch);
+            sync(m_fd);
+            written = true;
+        } catch (const std::runtime_error &) {
+            // Reported by the loop, to this thread and every waiting thread
+        }
+
+        lock.lock();
+        m_syncing = false;
+        if (written) {
+            m_durable = last;
+            m_stats.syncs++;
+            m_stats.bytesWritten += batch.size();
+        } else {
+            m_failed = true;
+        }
+        m_synced.notify_all();
+    }
+}
+
+void Journal::commit()
+{
+    std::uint64_t sequence;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        sequence = m_appended;
+    }
+
+    commit(sequence);
+}
+
+void Journal::compact(const Sheet & sheet)
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_syncing) {
+        m_synced.wait(lock);
+    }
+
+    if (m_failed) {
+        throw std::runtime_error("Journal could not be written.");
+    }
+
+    // The snapshot includes every record of the current generation, so later
+    // records belong to the next one
+    const std::uint32_t generation = m_generation + 1;
+    std::string bytes;
+    putRecord(bytes, RECORD_GENERATION, generation, Address(0, 0), "");
+    const std::vector<Address> addresses = sheet.getAddresses();
+    for (std::vector<Address>::const_iterator itr = addresses.begin(); itr != addresses.end(); itr++) {
+        putRecord(bytes, RECORD_SET, generation, *itr, sheet.getFormula(*itr));
+    }
+
+    const std::string snapshot = m_path + ".snapshot";
+    const std::string temporary = snapshot + ".tmp";
+    const int fd = ::open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("Could not create snapshot: " + temporary);
+    }
+
+    try {
+        writeAll(fd, bytes);
+        sync(fd);
+    } catch (const std::runtime_error &) {
+        ::close(fd);
+        throw;
+    }
+
+    ::close(fd);
+    if (std::rename(temporary.c_str(), snapshot.c_str()) != 0) {
+        throw std::runtime_error("Could not replace snapshot: " + snapshot);
+    }
+
+    syncDirectory(snapshot);
+    m_generation = generation;
+
+    // The journal is only emptied once the snapshot is durable
+    if (::ftruncate(m_fd, 0) != 0) {
+        throw std::runtime_error("Could not truncate journal: " + m_path);
+    }
+
+    sync(m_fd);
+
+    // Records that had not been committed are included in the snapshot, so
+    // they are no longer needed
+    m_buffer.clear();
+    m_durable = m_appended;
+    m_stats.compactions++;
+    m_synced.notify_all();
+}
+
+JournalStats Journal::getStats() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_stats;
+}
+
+std::uint64_t Journal::append(char type, const Address & address, const std::string & formula)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    putRecord(m_buffer, type, m_generation, address, formula);
+    m_stats.records++;
+    return ++m_appended;
+}
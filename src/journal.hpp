@@ -0,0 +1,202 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+struct Address;
+
+class Sheet;
+
+/// Counters for a Journal, as reported by Journal::getStats()
+struct JournalStats
+{
+    JournalStats()
+        : records(0)
+        , syncs(0)
+        , bytesWritten(0)
+        , compactions(0)
+    {
+        // No further initialisation
+    }
+
+    /// Records appended since the journal was opened
+    std::uint64_t records;
+
+    /// Number of times the journal file has been synced to disk
+    std::uint64_t syncs;
+
+    /// Bytes written to the journal file, not counting snapshots
+    std::uint64_t bytesWritten;
+
+    /// Number of snapshots written by compact()
+    std::uint64_t compactions;
+};
+
+/**
+ * Append-only write-ahead journal of the formulas set and erased in a Sheet.
+ *
+ * A Sheet that has been given a journal using Sheet::setJournal() appends a
+ * record for each call to Sheet::setFormula() and Sheet::erase(), and for each
+ * insertion or deletion of rows or columns. Records are
+ * buffered in memory until commit() writes them out and syncs the file. An
+ * edit is durable once commit() has returned for it.
+ *
+ * Calls to commit() from different threads are grouped: one caller writes
+ * and syncs every record appended so far, while the others wait for it, so
+ * the cost of a sync is shared by every edit in the batch.
+ *
+ * compact() writes the formulas of every cell to a snapshot file alongside
+ * the journal, and then empties the journal. replay() restores a Sheet from
+ * the snapshot followed by the journal, skipping records that the snapshot
+ * already includes. Each record carries a checksum, and a record that was
+ * only partly written before a crash is discarded, along with anything after
+ * it.
+ *
+ * The journal file is opened by the constructor. Every method may be called
+ * from any thread.
+ */
+class Journal
+{
+public:
+    /**
+     * Open a journal, creating it if it does not exist.
+     *
+     * @param   path  Path of the journal file; the snapshot is stored at the
+     *                same path, followed by ".snapshot"
+     *
+     * @throws  std::runtime_error if the file cannot be opened
+     */
+    explicit Journal(const std::string & path);
+
+    /**
+     * Commits any records that are still buffered, ignoring errors.
+     */
+    ~Journal();
+
+    /**
+     * Restore a Sheet from the snapshot and journal. Cells are set in the order
+     * they were recorded, and the Sheet is not recalculated, so it should be
+     * recalculated once afterwards. The Sheet must not be recording into this
+     * journal while it is replayed.
+     *
+     * An incomplete or corrupt record at the end of the journal is truncated,
+     * so that later records follow the last complete one.
+     *
+     * @param   sheet  Sheet to apply the recorded edits to
+     *
+     * @throws  std::runtime_error if the snapshot is corrupt, or either file
+     *          cannot be read
+     *
+     * @returns number of records applied, from both files
+     */
+    std::size_t replay(Sheet & sheet);
+
+    /**
+     * Append a record of a formula being set. The record is not durable until
+     * commit() is called.
+     *
+     * @returns sequence number of the record, for commit()
+     */
+    std::uint64_t recordSet(const Address & address, const std::string & formula);
+
+    /**
+     * Append a record of a cell being erased. The record is not durable until
+     * commit() is called.
+     *
+     * @returns sequence number of the record, for commit()
+     */
+    std::uint64_t recordErase(const Address & address);
+
+    /**
+     * Append a record of rows being inserted, as by Sheet::insertRows(). The
+     * record is not durable until commit() is called.
+     *
+     * @returns sequence number of the record, for commit()
+     */
+    std::uint64_t recordInsertRows(unsigned int row, unsigned int count);
+
+    /// Append a record of rows being deleted, as by Sheet::deleteRows()
+    std::uint64_t recordDeleteRows(unsigned int row, unsigned int count);
+
+    /// Append a record of columns being inserted, as by Sheet::insertColumns()
+    std::uint64_t recordInsertColumns(unsigned int column, unsigned int count);
+
+    /// Append a record of columns being deleted, as by Sheet::deleteColumns()
+    std::uint64_t recordDeleteColumns(unsigned int column, unsigned int count);
+
+    /**
+     * Block until every record up to and including a sequence number has been
+     * written and synced to disk.
+     *
+     * @throws  std::runtime_error if the journal cannot be written
+     */
+    void commit(std::uint64_t sequence);
+
+    /**
+     * Block until every record appended so far has been written and synced.
+     *
+     * @throws  std::runtime_error if the journal cannot be written
+     */
+    void commit();
+
+    /**
+     * Replace the snapshot with the formulas of every cell in a Sheet, and
+     * empty the journal. The Sheet must already include every edit that has
+     * been recorded, and must not be modified until this returns.
+     *
+     * The new snapshot is written to a temporary file and renamed over the
+     * old one, so a crash leaves either the old snapshot and the full journal
+     * or the new snapshot. Each snapshot starts a new generation, which is
+     * written into every record that follows it, so if a crash leaves the
+     * journal in place after the new snapshot, replay() skips the records
+     * that the snapshot already includes.
+     *
+     * @throws  std::runtime_error if the snapshot cannot be written
+     */
+    void compact(const Sheet & sheet);
+
+    JournalStats getStats() const;
+
+private:
+
+    /// Disabled copy constructor
+    Journal(const Journal &);
+
+    /// Disabled copy assignment operator
+    Journal & operator=(const Journal &);
+
+    std::uint64_t append(char type, const Address & address, const std::string & formula);
+
+    std::string m_path;
+
+    int m_fd;
+
+    mutable std::mutex m_mutex;
+
+    /// Signalled when a sync finishes
+    std::condition_variable m_synced;
+
+    /// Generation of the records being appended, which is the generation of
+    /// the snapshot; the snapshot includes every record of earlier generations
+    std::uint32_t m_generation;
+
+    /// Records appended since the last sync began
+    std::string m_buffer;
+
+    /// Sequence number of the most recently appended record
+    std::uint64_t m_appended;
+
+    /// Sequence number of the most recent record known to be on disk
+    std::uint64_t m_durable;
+
+    /// True while a thread is writing and syncing a batch of records
+    bool m_syncing;
+
+    /// Set if a batch could not be written, after which nothing can be committed
+    bool m_failed;
+
+    JournalStats m_stats;
+};
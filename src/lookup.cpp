@@ -0,0 +1,809 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <functional>
+#include <sstream>
+
+#include "lookup.hpp"
+
+namespace
+{
+    /// Source of table versions, which are never reused
+    std::atomic<unsigned long> lastVersion(0);
+
+    /// Changes are only kept while there are fewer than this fraction of the
+    /// cells, as applying more would cost as much as reading every cell
+    const std::size_t MAX_CHANGES_DIVISOR = 8;
+
+    /**
+     * Interpret a value as a number in the same way as the comparison
+     * operators. Values that cannot begin with a number are rejected without
+     * parsing them, since most keys that are not numbers are labels, and
+     * values that are entirely a decimal number are read by strtod(), which
+     * is much faster than a stream.
+     */
+    bool toNumber(const std::string & value, double & number)
+    {
+        std::string::const_iterator itr = value.begin();
+        while (itr != value.end() && std::isspace(static_cast<unsigned char>(*itr))) {
+            itr++;
+        }
+
+        if (itr == value.end() || !(std::isdigit(static_cast<unsigned char>(*itr)) ||
+                *itr == '+' || *itr == '-' || *itr == '.')) {
+            return false;
+        }
+
+        // Streams do not read hexadecimal numbers, infinities or NaNs, which
+        // strtod() does, and numbers that are out of range are left to the
+        // stream to reject
+        if (value.find_first_of("xXiInN") == std::string::npos) {
+            char * end = NULL;
+            errno = 0;
+            number = std::strtod(value.c_str(), &end);
+            if (end == value.c_str() + value.size() && errno == 0) {
+                return true;
+            }
+        }
+
+        std::stringstream ss(value);
+        ss >> number;
+        return !ss.fail();
+    }
+
+    bool lessByAddress(const RangeCell & lhs, const RangeCell & rhs)
+    {
+        return lhs.address < rhs.address;
+    }
+}
+
+const std::size_t LookupTable::npos;
+
+// ----------------------------------------------------------------------------
+//
+// LookupTable
+//
+// ----------------------------------------------------------------------------
+
+bool LookupTable::Key::operator==(const Key & other) const
+{
+    if (numeric != other.numeric) {
+        return false;
+    }
+
+    return numeric ? number == other.number : text == other.text;
+}
+
+bool LookupTable::Key::operator<(const Key & other) const
+{
+    // Numbers come before strings, as they would in a sorted column
+    if (numeric != other.numeric) {
+        return numeric;
+    }
+
+    return numeric ? number < other.number : text < other.text;
+}
+
+std::size_t LookupTable::KeyHash::operator()(const Key & key) const
+{
+    if (key.numeric) {
+        // Zero and negative zero are equal, so they must hash the same
+        return std::hash<double>()(key.number == 0 ? 0 : key.number);
+    }
+
+    return std::hash<std::string>()(key.text);
+}
+
+LookupTable::LookupTable(const Range & range, bool across)
+    : m_range(range)
+    , m_across(across)
+    , m_version(++lastVersion)
+    , m_previousVersion(0)
+    , m_scanBuilt(false)
+    , m_exactBuilt(false)
+    , m_sortedBuilt(false)
+{
+    // No further initialisation
+}
+
+bool LookupTable::update(std::vector<RangeCell> & cells)
+{
+    // Patching the sorted index costs time in proportion to its size for
+    // each key that changes, so it is built again if many keys change
+    const std::size_t maxPatches = m_sorted.size() / 32 + 1;
+    std::size_t patches = 0;
+
+    // The scan arrays are patched for values that change, unless cells have
+    // been set or erased, which moves the rest of the arrays along
+    bool changed = false;
+    bool moved = false;
+
+    // Changes are kept for anything calculated from the previous version
+    const std::size_t maxChanges = std::max(m_cells.size(), cells.size()) / MAX_CHANGES_DIVISOR + 1;
+    std::vector<RangeCell> changes;
+    bool keep = true;
+
+    // Both sets of cells are in address order, so they are merged to find
+    // the keys that have changed
+    std::vector<RangeCell>::const_iterator before = m_cells.begin();
+    std::vector<RangeCell>::const_iterator after = cells.begin();
+    while (before != m_cells.end() || after != cells.end()) {
+        std::size_t position = npos;
+        if (after == cells.end() || (before != m_cells.end() && before->address < after->address)) {
+            position = getPosition(before->address);
+            if (position != npos) {
+                removeKey(position, before->value);
+                patches++;
+            }
+            if (keep) {
+                const RangeCell change = {before->address, Rope()};
+                changes.push_back(change);
+            }
+            changed = true;
+            moved = true;
+            before++;
+        } else if (before == m_cells.end() || after->address < before->address) {
+            position = getPosition(after->address);
+            if (position != npos) {
+                addKey(position, after->value);
+                patches++;
+            }
+            if (keep) {
+                changes.push_back(*after);
+            }
+            changed = true;
+            moved = true;
+            after++;
+        } else {
+            if (before->value != after->value) {
+                position = getPosition(after->address);
+                if (position != npos) {
+                    removeKey(position, before->value);
+                    addKey(position, after->value);
+                    patches++;
+                }
+
+                const std::size_t index = std::size_t(after - cells.begin());
+                if (m_scanBuilt && !moved) {
+                    toScan(after->value, m_scan.numbers[index], m_scan.numeric[index]);
+                }
+                if (keep) {
+                    changes.push_back(*after);
+                }
+                changed = true;
+            }
+            before++;
+            after++;
+        }
+
+        if (keep && changes.size() > maxChanges) {
+            keep = false;
+            std::vector<RangeCell>().swap(changes);
+        }
+
+        if (m_sortedBuilt && patches > maxPatches) {
+            m_sortedBuilt = false;
+            std::vector<SortedEntry>().swap(m_sorted);
+        }
+    }
+
+    if (moved && m_scanBuilt) {
+        m_scanBuilt = false;
+        m_scan = Scan();
+    }
+
+    if (changed) {
+        m_previousVersion = keep ? m_version : 0;
+        m_changes.swap(changes);
+        m_version = ++lastVersion;
+    }
+
+    m_cells.swap(cells);
+    cells.clear();
+    return changed;
+}
+
+const Range & LookupTable::getRange() const
+{
+    return m_range;
+}
+
+unsigned long LookupTable::getVersion() const
+{
+    return m_version;
+}
+
+unsigned long LookupTable::getPreviousVersion() const
+{
+    return m_previousVersion;
+}
+
+const std::vector<RangeCell> & LookupTable::getChanges() const
+{
+    return m_changes;
+}
+
+const std::vector<RangeCell> & LookupTable::getCells() const
+{
+    return m_cells;
+}
+
+void LookupTable::getArray(Array & array) const
+{
+    const std::size_t rows = std::size_t(m_range.last.row - m_range.first.row) + 1;
+    const std::size_t columns = std::size_t(m_range.last.column - m_range.first.column) + 1;
+    const std::size_t size = rows * columns;
+    const Scan & scan = getScan();
+    bool numeric = scan.offsets.size() == size;
+    for (std::size_t i = 0; numeric && i < size; i++) {
+        numeric = scan.numeric[i] != 0;
+    }
+
+    // Cells are scanned down each column in turn, and are placed in the array
+    // across each row in turn
+    array.rows = rows;
+    array.columns = columns;
+    array.values.numeric = numeric;
+    if (numeric) {
+        array.values.numbers.resize(size);
+        array.values.strings.clear();
+        for (std::size_t i = 0; i < size; i++) {
+            const std::size_t offset = scan.offsets[i];
+            array.values.numbers[(offset % rows) * columns + offset / rows] = scan.numbers[i];
+        }
+    } else {
+        array.values.numbers.clear();
+        array.values.strings.assign(size, Rope());
+        for (std::size_t i = 0; i < m_cells.size(); i++) {
+            const std::size_t offset = scan.offsets[i];
+            array.values.strings[(offset % rows) * columns + offset / rows] = m_cells[i].value;
+        }
+    }
+}
+
+const LookupTable::Scan & LookupTable::getScan() const
+{
+    if (m_scanBuilt) {
+        return m_scan;
+    }
+
+    const std::size_t rows = m_range.last.row - m_range.first.row + 1;
+    m_scan.offsets.resize(m_cells.size());
+    m_scan.numbers.resize(m_cells.size());
+    m_scan.numeric.resize(m_cells.size());
+    for (std::size_t i = 0; i < m_cells.size(); i++) {
+        const Address & address = m_cells[i].address;
+        m_scan.offsets[i] = (address.column - m_range.first.column) * rows + (address.row - m_range.first.row);
+        toScan(m_cells[i].value, m_scan.numbers[i], m_scan.numeric[i]);
+    }
+
+    m_scanBuilt = true;
+    return m_scan;
+}
+
+bool LookupTable::isAcross() const
+{
+    return m_across;
+}
+
+std::size_t LookupTable::size() const
+{
+    if (m_across) {
+        return m_range.last.column - m_range.first.column + 1;
+    }
+
+    return m_range.last.row - m_range.first.row + 1;
+}
+
+std::size_t LookupTable::find(const Rope & value, MatchMode mode, bool last) const
+{
+    Key key;
+    if (!toKey(value, key)) {
+        return npos;
+    }
+
+    if (mode == MATCH_EXACT) {
+        buildExact();
+        std::unordered_map<Key, std::vector<std::size_t>, KeyHash>::const_iterator itr = m_exact.find(key);
+        if (itr == m_exact.end()) {
+            return npos;
+        }
+
+        return last ? itr->second.back() : itr->second.front();
+    }
+
+    buildSorted();
+
+    // Find any entry for the key that matched, then the first or last entry
+    // for that key
+    std::vector<SortedEntry>::const_iterator itr;
+    if (mode == MATCH_EXACT_OR_SMALLER) {
+        itr = std::upper_bound(m_sorted.begin(), m_sorted.end(), SortedEntry(key, npos));
+        if (itr == m_sorted.begin()) {
+            return npos;
+        }
+        itr--;
+    } else {
+        itr = std::lower_bound(m_sorted.begin(), m_sorted.end(), SortedEntry(key, 0));
+        if (itr == m_sorted.end()) {
+            return npos;
+        }
+    }
+
+    if (itr->first.numeric != key.numeric) {
+        return npos;
+    }
+
+    if (last) {
+        return (std::upper_bound(m_sorted.begin(), m_sorted.end(), SortedEntry(itr->first, npos)) - 1)->second;
+    }
+
+    return std::lower_bound(m_sorted.begin(), m_sorted.end(), SortedEntry(itr->first, 0))->second;
+}
+
+Rope LookupTable::getValue(std::size_t position, std::size_t offset) const
+{
+    if (position >= size()) {
+        return Rope();
+    }
+
+    const Address address(
+        m_range.first.column + unsigned(m_across ? position : offset),
+        m_range.first.row + unsigned(m_across ? offset : position));
+    if (!m_range.contains(address)) {
+        return Rope();
+    }
+
+    const RangeCell cell = {address, Rope()};
+    std::vector<RangeCell>::const_iterator itr = std::lower_bound(m_cells.begin(), m_cells.end(), cell, lessByAddress);
+    if (itr == m_cells.end() || !(itr->address == address)) {
+        return Rope();
+    }
+
+    return itr->value;
+}
+
+bool LookupTable::toKey(const Rope & value, Key & key)
+{
+    if (value.empty()) {
+        return false;
+    }
+
+    key.text = value.str();
+    key.numeric = toNumber(key.text, key.number);
+    if (key.numeric) {
+        key.text.clear();
+    } else {
+        key.number = 0;
+    }
+
+    return true;
+}
+
+void LookupTable::toScan(const Rope & value, double & number, unsigned char & numeric)
+{
+    numeric = !value.empty() && toNumber(value.str(), number);
+    if (!numeric) {
+        number = 0;
+    }
+}
+
+std::size_t LookupTable::getPosition(const Address & address) const
+{
+    if (m_across) {
+        return address.row == m_range.first.row ? address.column - m_range.first.column : npos;
+    }
+
+    return address.column == m_range.first.column ? address.row - m_range.first.row : npos;
+}
+
+void LookupTable::addKey(std::size_t position, const Rope & value)
+{
+    Key key;
+    if (!toKey(value, key)) {
+        return;
+    }
+
+    if (m_exactBuilt) {
+        std::vector<std::size_t> & positions = m_exact[key];
+        positions.insert(std::lower_bound(positions.begin(), positions.end(), position), position);
+    }
+
+    if (m_sortedBuilt) {
+        const SortedEntry entry(key, position);
+        m_sorted.insert(std::lower_bound(m_sorted.begin(), m_sorted.end(), entry), entry);
+    }
+}
+
+void LookupTable::removeKey(std::size_t position, const Rope & value)
+{
+    Key key;
+    if (!toKey(value, key)) {
+        return;
+    }
+
+    if (m_exactBuilt) {
+        std::unordered_map<Key, std::vector<std::size_t>, KeyHash>::iterator itr = m_exact.find(key);
+        if (itr != m_exact.end()) {
+            std::vector<std::size_t> & positions = itr->second;
+            positions.erase(std::lower_bound(positions.begin(), positions.end(), position));
+            if (positions.empty()) {
+                m_exact.erase(itr);
+            }
+        }
+    }
+
+    if (m_sortedBuilt) {
+        m_sorted.erase(std::lower_bound(m_sorted.begin(), m_sorted.end(), SortedEntry(key, position)));
+    }
+}
+
+void LookupTable::buildExact() const
+{
+    if (m_exactBuilt) {
+        return;
+    }
+
+    // Cells are in address order, so the positions of each key are appended
+    // in ascending order
+    Key key;
+    for (std::vector<RangeCell>::const_iterator itr = m_cells.begin(); itr != m_cells.end(); itr++) {
+        const std::size_t position = getPosition(itr->address);
+        if (position != npos && toKey(itr->value, key)) {
+            m_exact[key].push_back(position);
+        }
+    }
+
+    m_exactBuilt = true;
+}
+
+void LookupTable::buildSorted() const
+{
+    if (m_sortedBuilt) {
+        return;
+    }
+
+    Key key;
+    for (std::vector<RangeCell>::const_iterator itr = m_cells.begin(); itr != m_cells.end(); itr++) {
+        const std::size_t position = getPosition(itr->address);
+        if (position != npos && toKey(itr->value, key)) {
+            m_sorted.push_back(SortedEntry(key, position));
+        }
+    }
+
+    std::sort(m_sorted.begin(), m_sorted.end());
+    m_sortedBuilt = true;
+}
+
+// ----------------------------------------------------------------------------
+//
+// Criterion
+//
+// ----------------------------------------------------------------------------
+
+namespace
+{
+    /**
+     * Compare every number in a scan with a value. Cells that do not hold
+     * numbers are zero in the scan, and are masked out afterwards, so the
+     * loop has no branches.
+     */
+    template<typename Compare>
+    void matchNumbers(const LookupTable::Scan & scan, double value, unsigned char * mask)
+    {
+        const Compare compare = Compare();
+        const std::size_t count = scan.numbers.size();
+        const double * numbers = scan.numbers.data();
+        const unsigned char * numeric = scan.numeric.data();
+        for (std::size_t i = 0; i < count; i++) {
+            mask[i] = numeric[i] & static_cast<unsigned char>(compare(numbers[i], value));
+        }
+    }
+}
+
+Criterion::Criterion(const std::string & criterion)
+    : m_operator(OPERATOR_EQUAL)
+    , m_kind(KIND_EMPTY)
+    , m_number(0)
+{
+    // Two character operators are checked first
+    std::size_t length = 0;
+    if (criterion.compare(0, 2, "<>") == 0) {
+        m_operator = OPERATOR_NOT_EQUAL;
+        length = 2;
+    } else if (criterion.compare(0, 2, "<=") == 0) {
+        m_operator = OPERATOR_LESS_EQUAL;
+        length = 2;
+    } else if (criterion.compare(0, 2, ">=") == 0) {
+        m_operator = OPERATOR_GREATER_EQUAL;
+        length = 2;
+    } else if (criterion.compare(0, 1, "<") == 0) {
+        m_operator = OPERATOR_LESS;
+        length = 1;
+    } else if (criterion.compare(0, 1, ">") == 0) {
+        m_operator = OPERATOR_GREATER;
+        length = 1;
+    } else if (criterion.compare(0, 1, "=") == 0) {
+        length = 1;
+    }
+
+    const std::string value = criterion.substr(length);
+    const bool equality = m_operator == OPERATOR_EQUAL || m_operator == OPERATOR_NOT_EQUAL;
+    if (value.empty() && equality) {
+        m_kind = KIND_EMPTY;
+    } else if (toNumber(value, m_number)) {
+        m_kind = KIND_NUMBER;
+    } else if (equality && value.find_first_of("*?~") != std::string::npos) {
+        m_kind = KIND_PATTERN;
+        for (std::size_t i = 0; i < value.size(); i++) {
+            if (value[i] == '~' && i + 1 < value.size()) {
+                m_pattern += value[++i];
+                m_wildcards.push_back(false);
+            } else {
+                m_pattern += value[i];
+                m_wildcards.push_back(value[i] == '*' || value[i] == '?');
+            }
+        }
+    } else {
+        m_kind = KIND_TEXT;
+        m_text = value;
+    }
+}
+
+void Criterion::match(const LookupTable & table, std::vector<unsigned char> & mask) const
+{
+    const std::vector<RangeCell> & cells = table.getCells();
+    mask.assign(cells.size(), 0);
+    if (cells.empty()) {
+        return;
+    }
+
+    if (m_kind == KIND_NUMBER) {
+        const LookupTable::Scan & scan = table.getScan();
+        switch (m_operator) {
+            case OPERATOR_EQUAL:
+            case OPERATOR_NOT_EQUAL:
+                matchNumbers<std::equal_to<double> >(scan, m_number, mask.data());
+                break;
+            case OPERATOR_LESS:
+                matchNumbers<std::less<double> >(scan, m_number, mask.data());
+                break;
+            case OPERATOR_LESS_EQUAL:
+                matchNumbers<std::less_equal<double> >(scan, m_number, mask.data());
+                break;
+            case OPERATOR_GREATER:
+                matchNumbers<std::greater<double> >(scan, m_number, mask.data());
+                break;
+            case OPERATOR_GREATER_EQUAL:
+                matchNumbers<std::greater_equal<double> >(scan, m_number, mask.data());
+                break;
+        }
+    } else if (m_kind == KIND_EMPTY) {
+        for (std::size_t i = 0; i < cells.size(); i++) {
+            mask[i] = cells[i].value.empty();
+        }
+    } else {
+        // Text is only compared with cells that hold text
+        const LookupTable::Scan & scan = table.getScan();
+        for (std::size_t i = 0; i < cells.size(); i++) {
+            const Rope & value = cells[i].value;
+            if (scan.numeric[i] || value.empty()) {
+                continue;
+            }
+
+            switch (m_operator) {
+                case OPERATOR_EQUAL:
+                case OPERATOR_NOT_EQUAL:
+                    mask[i] = m_kind == KIND_PATTERN ? matchPattern(value.str()) : value == m_text;
+                    break;
+                case OPERATOR_LESS:
+                    mask[i] = value < m_text;
+                    break;
+                case OPERATOR_LESS_EQUAL:
+                    mask[i] = !(m_text < value);
+                    break;
+                case OPERATOR_GREATER:
+                    mask[i] = m_text < value;
+                    break;
+                case OPERATOR_GREATER_EQUAL:
+                    mask[i] = !(value < m_text);
+                    break;
+            }
+        }
+    }
+
+    if (m_operator == OPERATOR_NOT_EQUAL) {
+        for (std::size_t i = 0; i < mask.size(); i++) {
+            mask[i] ^= 1;
+        }
+    }
+}
+
+bool Criterion::matchPattern(const std::string & text) const
+{
+    // Each * is tried against as few characters as possible, and extended
+    // one character at a time if the rest of the pattern does not match
+    std::size_t t = 0;
+    std::size_t p = 0;
+    std::size_t star = std::string::npos;
+    std::size_t resume = 0;
+    while (t < text.size()) {
+        if (p < m_pattern.size() && m_wildcards[p] && m_pattern[p] == '*') {
+            star = p++;
+            resume = t;
+        } else if (p < m_pattern.size() && ((m_wildcards[p] && m_pattern[p] == '?') || m_pattern[p] == text[t])) {
+            p++;
+            t++;
+        } else if (star != std::string::npos) {
+            p = star + 1;
+            t = ++resume;
+        } else {
+            return false;
+        }
+    }
+
+    while (p < m_pattern.size() && m_wildcards[p] && m_pattern[p] == '*') {
+        p++;
+    }
+
+    return p == m_pattern.size();
+}
+
+// ----------------------------------------------------------------------------
+//
+// LookupCache
+//
+// ----------------------------------------------------------------------------
+
+bool LookupCache::TableOrder::operator()(const TableKey & lhs, const TableKey & rhs) const
+{
+    if (!(lhs.first.first == rhs.first.first)) {
+        return lhs.first.first < rhs.first.first;
+    } else if (!(lhs.first.last == rhs.first.last)) {
+        return lhs.first.last < rhs.first.last;
+    }
+
+    return lhs.second < rhs.second;
+}
+
+LookupCache::LookupCache()
+    : m_pass(0)
+{
+    // No further initialisation
+}
+
+void LookupCache::beginPass()
+{
+    m_pass++;
+
+    std::map<TableKey, Entry, TableOrder>::iterator itr = m_entries.begin();
+    while (itr != m_entries.end()) {
+        if (itr->second.pass + 1 < m_pass) {
+            m_entries.erase(itr++);
+        } else {
+            itr++;
+        }
+    }
+
+    std::map<std::string, CriterionEntry>::iterator criterion = m_criteria.begin();
+    while (criterion != m_criteria.end()) {
+        if (criterion->second.pass + 1 < m_pass) {
+            m_criteria.erase(criterion++);
+        } else {
+            criterion++;
+        }
+    }
+
+    std::map<std::string, ResultEntry>::iterator result = m_results.begin();
+    while (result != m_results.end()) {
+        if (result->second.pass + 1 < m_pass) {
+            m_results.erase(result++);
+        } else {
+            result++;
+        }
+    }
+
+    std::map<std::string, ViewEntry>::iterator view = m_views.begin();
+    while (view != m_views.end()) {
+        if (view->second.pass + 1 < m_pass) {
+            m_views.erase(view++);
+        } else {
+            view++;
+        }
+    }
+}
+
+const LookupTable * LookupCache::find(const Range & range, bool across) const
+{
+    std::map<TableKey, Entry, TableOrder>::const_iterator itr = m_entries.find(TableKey(range, across));
+    if (itr == m_entries.end() || itr->second.pass != m_pass) {
+        return nullptr;
+    }
+
+    return itr->second.pTable.get();
+}
+
+const LookupTable & LookupCache::update(const Range & range, bool across, std::vector<RangeCell> & cells)
+{
+    const TableKey key(range, across);
+    std::map<TableKey, Entry, TableOrder>::iterator itr = m_entries.find(key);
+    if (itr == m_entries.end()) {
+        Entry entry;
+        entry.pTable.reset(new LookupTable(range, across));
+        entry.pass = m_pass;
+        itr = m_entries.insert(std::make_pair(key, std::move(entry))).first;
+    }
+
+    itr->second.pTable->update(cells);
+    itr->second.pass = m_pass;
+    return *itr->second.pTable;
+}
+
+const Criterion & LookupCache::getCriterion(const std::string & criterion)
+{
+    std::map<std::string, CriterionEntry>::iterator itr = m_criteria.find(criterion);
+    if (itr == m_criteria.end()) {
+        CriterionEntry entry = {std::make_shared<const Criterion>(criterion), m_pass};
+        itr = m_criteria.insert(std::make_pair(criterion, entry)).first;
+    }
+
+    itr->second.pass = m_pass;
+    return *itr->second.pCriterion;
+}
+
+bool LookupCache::findResult(const std::string & key, const std::vector<const LookupTable *> & tables, Rope & result)
+{
+    std::map<std::string, ResultEntry>::iterator itr = m_results.find(key);
+    if (itr == m_results.end() || itr->second.versions.size() != tables.size()) {
+        return false;
+    }
+
+    for (std::size_t i = 0; i < tables.size(); i++) {
+        if (itr->second.versions[i] != tables[i]->getVersion()) {
+            return false;
+        }
+    }
+
+    itr->second.pass = m_pass;
+    result = itr->second.result;
+    return true;
+}
+
+void LookupCache::storeResult(const std::string & key, const std::vector<const LookupTable *> & tables,
+    const Rope & result)
+{
+    ResultEntry & entry = m_results[key];
+    entry.versions.resize(tables.size());
+    for (std::size_t i = 0; i < tables.size(); i++) {
+        entry.versions[i] = tables[i]->getVersion();
+    }
+
+    entry.result = result;
+    entry.pass = m_pass;
+}
+
+View * LookupCache::findView(const std::string & key)
+{
+    std::map<std::string, ViewEntry>::iterator itr = m_views.find(key);
+    if (itr == m_views.end()) {
+        return nullptr;
+    }
+
+    itr->second.pass = m_pass;
+    return itr->second.pView.get();
+}
+
+View & LookupCache::storeView(const std::string & key, const std::shared_ptr<View> & pView)
+{
+    ViewEntry & entry = m_views[key];
+    entry.pView = pView;
+    entry.pass = m_pass;
+    return *pView;
+}
+
+std::size_t LookupCache::size() const
+{
+    return m_entries.size();
+}
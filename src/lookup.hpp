@@ -0,0 +1,430 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "ast.hpp"
+#include "range.hpp"
+#include "rope.hpp"
+
+class View;
+
+/**
+ * Values of the cells in a range, as read by a lookup or conditional
+ * function, with indexes for finding the position of a key.
+ *
+ * The keys of a table are the values down its first column, or across its
+ * first row. Keys are found by position, which is counted from zero at the
+ * first row (or column) of the range.
+ *
+ * Keys are matched in the same way that values are compared by the = and <
+ * operators: values that are both numbers are compared numerically, and any
+ * other values are compared as case sensitive strings. Cells that have not
+ * been set, or whose values are empty, never match.
+ *
+ * An index is only built when a key is first found in a way that needs it:
+ * a hash index for exact matches, or a sorted index for approximate ones.
+ * When the values are replaced, indexes that have been built are updated
+ * for the keys that changed, rather than being built again.
+ */
+class LookupTable
+{
+public:
+    static const std::size_t npos = static_cast<std::size_t>(-1);
+
+    /**
+     * Values of every cell that has been set, as arrays in the same order as
+     * getCells(), so that the whole range can be scanned in tight loops.
+     */
+    struct Scan
+    {
+        /// Position of each cell within the range, counted in address order
+        /// (i.e. down each column in turn) from zero at the first cell
+        std::vector<std::size_t> offsets;
+
+        /// Value of each cell as a number, or zero if it is not a number
+        std::vector<double> numbers;
+
+        /// Whether each cell holds a number, as 1 or 0
+        std::vector<unsigned char> numeric;
+    };
+
+    /// How a key is matched
+    enum MatchMode
+    {
+        /// Only a key that equals the value
+        MATCH_EXACT,
+
+        /// An equal key, or else the largest key that is smaller
+        MATCH_EXACT_OR_SMALLER,
+
+        /// An equal key, or else the smallest key that is larger
+        MATCH_EXACT_OR_LARGER
+    };
+
+    /**
+     * @param   range   Range that the table holds the values of
+     * @param   across  Whether the keys run across the first row, rather than
+     *                  down the first column
+     */
+    LookupTable(const Range & range, bool across);
+
+    /**
+     * Replace the values of the table.
+     *
+     * @param   cells  Cells within the range that have been set, in address
+     *                 order, as read by Arguments::evaluateRange(); the
+     *                 vector is left empty
+     *
+     * @returns true if any value changed, or any cell was set or erased
+     */
+    bool update(std::vector<RangeCell> & cells);
+
+    const Range & getRange() const;
+
+    /**
+     * Version of the values, which changes whenever update() changes them.
+     * No two versions are the same, even for different tables, so results
+     * calculated from a table can be checked against its version later.
+     */
+    unsigned long getVersion() const;
+
+    /**
+     * Version of the values before the most recent update() that changed
+     * them. Anything calculated from that version can be brought up to date
+     * from getChanges(), rather than being calculated again.
+     *
+     * @returns version, or zero if so many cells changed that the changes
+     *          were not kept
+     */
+    unsigned long getPreviousVersion() const;
+
+    /**
+     * Retrieve the cells that were set, erased or changed by the most recent
+     * update() that changed any, in address order, with their new values.
+     * Cells that were erased have empty values.
+     */
+    const std::vector<RangeCell> & getChanges() const;
+
+    /// Cells within the range that have been set, in address order
+    const std::vector<RangeCell> & getCells() const;
+
+    /**
+     * Copy the values of the range into an array, in row-major order, where
+     * cells that have not been set are empty. The array holds numbers if
+     * every cell holds a number.
+     */
+    void getArray(Array & array) const;
+
+    /**
+     * Retrieve the values of the cells as arrays. These are built when first
+     * needed, and updated in place when values change without cells being
+     * set or erased.
+     */
+    const Scan & getScan() const;
+
+    /// Whether the keys run across the first row
+    bool isAcross() const;
+
+    /// Number of positions, i.e. rows, or columns if the keys run across
+    std::size_t size() const;
+
+    /**
+     * Find a key. Numbers are only matched approximately by numbers, and
+     * strings by strings.
+     *
+     * @param   value  Value to find
+     * @param   mode   How the key is matched
+     * @param   last   Whether to return the last position at which the key
+     *                 that matched appears, rather than the first
+     *
+     * @returns position of the key, or npos if no key matched
+     */
+    std::size_t find(const Rope & value, MatchMode mode, bool last) const;
+
+    /**
+     * Retrieve a value from the table.
+     *
+     * @param   position  Position of the key, as returned by find()
+     * @param   offset    Column of the value, counted from zero at the first
+     *                    column (or row, if the keys run across)
+     *
+     * @returns value, which is empty if the cell has not been set or is
+     *          outside of the range
+     */
+    Rope getValue(std::size_t position, std::size_t offset) const;
+
+private:
+
+    /// Value of a key, as it is compared
+    struct Key
+    {
+        bool numeric;
+        double number;
+        std::string text;
+
+        bool operator==(const Key & other) const;
+        bool operator<(const Key & other) const;
+    };
+
+    struct KeyHash
+    {
+        std::size_t operator()(const Key & key) const;
+    };
+
+    typedef std::pair<Key, std::size_t> SortedEntry;
+
+    /// Convert a value to a key, returning false if it is empty
+    static bool toKey(const Rope & value, Key & key);
+
+    /// Interpret the value of a cell as a number, for the scan arrays
+    static void toScan(const Rope & value, double & number, unsigned char & numeric);
+
+    /// Position of a cell in the range, or npos if it does not hold a key
+    std::size_t getPosition(const Address & address) const;
+
+    void addKey(std::size_t position, const Rope & value);
+
+    void removeKey(std::size_t position, const Rope & value);
+
+    void buildExact() const;
+
+    void buildSorted() const;
+
+    Range m_range;
+
+    bool m_across;
+
+    unsigned long m_version;
+
+    unsigned long m_previousVersion;
+
+    /// Cells changed by the most recent update that changed any
+    std::vector<RangeCell> m_changes;
+
+    /// Cells that have been set, in address order
+    std::vector<RangeCell> m_cells;
+
+    mutable bool m_scanBuilt;
+
+    mutable Scan m_scan;
+
+    mutable bool m_exactBuilt;
+
+    /// Positions of each key, in ascending order
+    mutable std::unordered_map<Key, std::vector<std::size_t>, KeyHash> m_exact;
+
+    mutable bool m_sortedBuilt;
+
+    /// Keys and their positions, ordered by key, then position
+    mutable std::vector<SortedEntry> m_sorted;
+};
+
+/**
+ * Condition on the values of cells, as passed to SUMIF and the other
+ * conditional functions, e.g. ">=10", "<>done" or "app*".
+ *
+ * A criterion is a comparison operator (=, <>, <, <=, > or >=, or = if there
+ * is none) followed by a value. A number is compared numerically with cells
+ * that hold numbers, and any other value is compared with cells that hold
+ * text, as a case sensitive string. When testing for equality, * and ? in
+ * the text match any characters and any single character, unless preceded
+ * by ~. An empty value matches cells whose values are empty, and <> matches
+ * every cell that = does not.
+ *
+ * Criteria are compiled once, then tested against every cell of a table at a
+ * time. Numbers are compared in a single loop over the scan arrays of the
+ * table, without branches, which compilers turn into vector instructions.
+ */
+class Criterion
+{
+public:
+    explicit Criterion(const std::string & criterion);
+
+    /**
+     * Test every cell of a table.
+     *
+     * @param   mask  Receives 1 for each cell that matches and 0 for each cell
+     *                that does not, in the same order as getCells()
+     */
+    void match(const LookupTable & table, std::vector<unsigned char> & mask) const;
+
+private:
+
+    enum Operator
+    {
+        OPERATOR_EQUAL,
+        OPERATOR_NOT_EQUAL,
+        OPERATOR_LESS,
+        OPERATOR_LESS_EQUAL,
+        OPERATOR_GREATER,
+        OPERATOR_GREATER_EQUAL
+    };
+
+    /// How cells are compared with the value
+    enum Kind
+    {
+        KIND_EMPTY,
+        KIND_NUMBER,
+        KIND_TEXT,
+        KIND_PATTERN
+    };
+
+    /// Test a string against the pattern, which has wildcards
+    bool matchPattern(const std::string & text) const;
+
+    Operator m_operator;
+
+    Kind m_kind;
+
+    double m_number;
+
+    Rope m_text;
+
+    /// Pattern, with escapes removed, and whether each character is a wildcard
+    std::string m_pattern;
+    std::vector<bool> m_wildcards;
+};
+
+/**
+ * Tables read by lookup and conditional functions during recalculation, kept
+ * from one pass to the next, along with the criteria and results of the
+ * conditional functions.
+ *
+ * A function that reads a range for a lookup first checks the cache. The
+ * first time a range is read during a pass, its cells are read (and so
+ * recalculated) as usual, and the table for the range is updated with their
+ * values. Every later lookup in the same range during that pass uses the
+ * table as it is, since its cells cannot change again until the next pass.
+ *
+ * Results are stored along with the versions of the tables that they were
+ * calculated from, so a call with the same arguments can reuse its result
+ * for as long as those tables are unchanged, whether later in the same pass
+ * or in a later one. Functions such as SORT keep views (see View) instead,
+ * which are brought up to date from the cells that changed in their tables.
+ *
+ * Anything that was not used during the previous pass is discarded, so
+ * ranges that are no longer read do not hold on to memory.
+ */
+class LookupCache
+{
+public:
+    LookupCache();
+
+    /// Start a recalculation pass
+    void beginPass();
+
+    /**
+     * Retrieve the table for a range, if it has been read during this pass.
+     *
+     * @param   across  Whether the keys run across the first row, as for
+     *                  LookupTable
+     *
+     * @returns table, or null if the range must be read
+     */
+    const LookupTable * find(const Range & range, bool across) const;
+
+    /**
+     * Update the table for a range with the cells read during this pass.
+     *
+     * @param   cells  Cells within the range that have been set, in address
+     *                 order; the vector is left empty
+     *
+     * @returns table, which remains valid until the next pass begins
+     */
+    const LookupTable & update(const Range & range, bool across, std::vector<RangeCell> & cells);
+
+    /// Compile a criterion, unless it has already been compiled
+    const Criterion & getCriterion(const std::string & criterion);
+
+    /**
+     * Retrieve a result stored by storeResult(), if none of the tables that
+     * it was calculated from have changed since.
+     *
+     * @param   key     Identifies the call, e.g. by its name and arguments
+     * @param   tables  Tables read by the call, in the same order as when the
+     *                  result was stored
+     *
+     * @returns true if the result was found
+     */
+    bool findResult(const std::string & key, const std::vector<const LookupTable *> & tables, Rope & result);
+
+    /// Store the result of a call, along with the tables it was calculated from
+    void storeResult(const std::string & key, const std::vector<const LookupTable *> & tables, const Rope & result);
+
+    /**
+     * Retrieve a view stored by storeView(). Views are kept from one pass to
+     * the next, so that they can be maintained from the cells that change.
+     *
+     * @param   key  Identifies the call, e.g. by its name and arguments
+     *
+     * @returns view, or null if there is none
+     */
+    View * findView(const std::string & key);
+
+    /// Store a view, which is kept for as long as it is found in each pass
+    View & storeView(const std::string & key, const std::shared_ptr<View> & pView);
+
+    /// Number of tables in the cache
+    std::size_t size() const;
+
+private:
+
+    /// Disabled copy constructor
+    LookupCache(const LookupCache &);
+
+    /// Disabled copy assignment operator
+    LookupCache & operator=(const LookupCache &);
+
+    /// Range of a table, and whether its keys run across
+    typedef std::pair<Range, bool> TableKey;
+
+    /// Orders tables by the corners of their ranges, then their direction
+    struct TableOrder
+    {
+        bool operator()(const TableKey & lhs, const TableKey & rhs) const;
+    };
+
+    struct Entry
+    {
+        std::unique_ptr<LookupTable> pTable;
+
+        /// Pass in which the table was last updated
+        unsigned long pass;
+    };
+
+    struct CriterionEntry
+    {
+        std::shared_ptr<const Criterion> pCriterion;
+        unsigned long pass;
+    };
+
+    struct ResultEntry
+    {
+        /// Versions of the tables that the result was calculated from
+        std::vector<unsigned long> versions;
+        Rope result;
+        unsigned long pass;
+    };
+
+    std::map<TableKey, Entry, TableOrder> m_entries;
+
+    std::map<std::string, CriterionEntry> m_criteria;
+
+    struct ViewEntry
+    {
+        std::shared_ptr<View> pView;
+        unsigned long pass;
+    };
+
+    std::map<std::string, ResultEntry> m_results;
+
+    std::map<std::string, ViewEntry> m_views;
+
+    unsigned long m_pass;
+};
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "matrix.hpp"
+#include "parallel.hpp"
+
+namespace
+{
+    /// Rows and columns in each block of a product, or tile of a transpose
+    const std::size_t BLOCK_SIZE = 64;
+
+    /// Columns of the product in each block, which are contiguous in memory
+    const std::size_t COLUMN_BLOCK_SIZE = 256;
+
+    /// Calculates a band of rows of a product
+    struct MultiplyBand
+    {
+        const Matrix & lhs;
+        const Matrix & rhs;
+        Matrix & product;
+
+        void operator()(std::size_t begin, std::size_t end) const
+        {
+            const std::size_t inner = lhs.columns;
+            const std::size_t columns = rhs.columns;
+            for (std::size_t kk = 0; kk < inner; kk += BLOCK_SIZE) {
+                const std::size_t kEnd = std::min(inner, kk + BLOCK_SIZE);
+                for (std::size_t jj = 0; jj < columns; jj += COLUMN_BLOCK_SIZE) {
+                    const std::size_t jEnd = std::min(columns, jj + COLUMN_BLOCK_SIZE);
+                    for (std::size_t i = begin; i < end; i++) {
+                        const double * a = lhs.values.data() + i * inner;
+                        double * c = product.values.data() + i * columns;
+                        for (std::size_t k = kk; k < kEnd; k++) {
+                            const double aik = a[k];
+                            const double * b = rhs.values.data() + k * columns;
+                            for (std::size_t j = jj; j < jEnd; j++) {
+                                c[j] += aik * b[j];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    /// Transposes a band of rows of a matrix
+    struct TransposeBand
+    {
+        const Matrix & matrix;
+        Matrix & result;
+
+        void operator()(std::size_t begin, std::size_t end) const
+        {
+            const std::size_t rows = matrix.rows;
+            const std::size_t columns = matrix.columns;
+            for (std::size_t ii = begin; ii < end; ii += BLOCK_SIZE) {
+                const std::size_t iEnd = std::min(end, ii + BLOCK_SIZE);
+                for (std::size_t jj = 0; jj < columns; jj += BLOCK_SIZE) {
+                    const std::size_t jEnd = std::min(columns, jj + BLOCK_SIZE);
+                    for (std::size_t i = ii; i < iEnd; i++) {
+                        for (std::size_t j = jj; j < jEnd; j++) {
+                            result.values[j * rows + i] = matrix.values[i * columns + j];
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    /// Eliminates the pivot column from a band of rows, other than the pivot row
+    struct EliminateBand
+    {
+        Matrix & work;
+        Matrix & inverse;
+        std::size_t pivot;
+
+        void operator()(std::size_t begin, std::size_t end) const
+        {
+            const std::size_t n = work.columns;
+            const double * workPivot = work.values.data() + pivot * n;
+            const double * inversePivot = inverse.values.data() + pivot * n;
+            for (std::size_t row = begin; row < end; row++) {
+                const double factor = work.at(row, pivot);
+                if (row == pivot || factor == 0) {
+                    continue;
+                }
+
+                // Columns before the pivot are already zero in both rows
+                double * workRow = work.values.data() + row * n;
+                for (std::size_t j = pivot; j < n; j++) {
+                    workRow[j] -= factor * workPivot[j];
+                }
+
+                double * inverseRow = inverse.values.data() + row * n;
+                for (std::size_t j = 0; j < n; j++) {
+                    inverseRow[j] -= factor * inversePivot[j];
+                }
+            }
+        }
+    };
+}
+
+bool multiplyMatrices(const Matrix & lhs, const Matrix & rhs, Matrix & result)
+{
+    if (lhs.columns != rhs.rows) {
+        return false;
+    }
+
+    // The product is built separately, in case the result is also an operand
+    Matrix product(lhs.rows, rhs.columns);
+    const MultiplyBand task = {lhs, rhs, product};
+    forEachBand(task, lhs.rows, countThreads(lhs.rows, lhs.rows * lhs.columns * rhs.columns, 0));
+    result = std::move(product);
+    return true;
+}
+
+void transposeMatrix(const Matrix & matrix, Matrix & result)
+{
+    Matrix transposed(matrix.columns, matrix.rows);
+    const TransposeBand task = {matrix, transposed};
+    forEachBand(task, matrix.rows, countThreads(matrix.rows, matrix.rows * matrix.columns, 0));
+    result = std::move(transposed);
+}
+
+bool invertMatrix(const Matrix & matrix, Matrix & result)
+{
+    if (matrix.rows != matrix.columns) {
+        return false;
+    }
+
+    const std::size_t n = matrix.rows;
+    Matrix work(matrix);
+    Matrix inverse(n, n);
+    double scale = 0;
+    for (std::size_t i = 0; i < n; i++) {
+        inverse.at(i, i) = 1;
+        for (std::size_t j = 0; j < n; j++) {
+            scale = std::max(scale, std::fabs(matrix.at(i, j)));
+        }
+    }
+
+    // Pivots that are this small, relative to the values of the matrix, are
+    // treated as zero
+    const double tolerance = scale * double(n) * std::numeric_limits<double>::epsilon();
+
+    for (std::size_t pivot = 0; pivot < n; pivot++) {
+        // The largest value in the column is chosen as the pivot, which
+        // limits the growth of rounding errors
+        std::size_t best = pivot;
+        for (std::size_t row = pivot + 1; row < n; row++) {
+            if (std::fabs(work.at(row, pivot)) > std::fabs(work.at(best, pivot))) {
+                best = row;
+            }
+        }
+
+        if (!(std::fabs(work.at(best, pivot)) > tolerance)) {
+            return false;
+        }
+
+        if (best != pivot) {
+            std::swap_ranges(work.values.begin() + best * n, work.values.begin() + (best + 1) * n,
+                work.values.begin() + pivot * n);
+            std::swap_ranges(inverse.values.begin() + best * n, inverse.values.begin() + (best + 1) * n,
+                inverse.values.begin() + pivot * n);
+        }
+
+        const double reciprocal = 1 / work.at(pivot, pivot);
+        for (std::size_t j = pivot; j < n; j++) {
+            work.at(pivot, j) *= reciprocal;
+        }
+        for (std::size_t j = 0; j < n; j++) {
+            inverse.at(pivot, j) *= reciprocal;
+        }
+
+        const EliminateBand task = {work, inverse, pivot};
+        forEachBand(task, n, countThreads(n, n * (2 * n - pivot), 0));
+    }
+
+    result = std::move(inverse);
+    return true;
+}
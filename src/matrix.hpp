@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * Dense matrix of numbers, held in row-major order in a single buffer, as
+ * read from a range of cells by the matrix functions.
+ */
+struct Matrix
+{
+    Matrix()
+        : rows(0)
+        , columns(0)
+    {
+        // No further initialisation
+    }
+
+    Matrix(std::size_t rows, std::size_t columns)
+        : rows(rows)
+        , columns(columns)
+        , values(rows * columns, 0.0)
+    {
+        // No further initialisation
+    }
+
+    double & at(std::size_t row, std::size_t column)
+    {
+        return values[row * columns + column];
+    }
+
+    double at(std::size_t row, std::size_t column) const
+    {
+        return values[row * columns + column];
+    }
+
+    std::size_t rows;
+
+    std::size_t columns;
+
+    std::vector<double> values;
+};
+
+/**
+ * Multiply two matrices.
+ *
+ * The product is calculated in blocks of rows and columns that stay in cache
+ * while they are used, with an innermost loop that runs along contiguous
+ * rows of both the right-hand matrix and the product, so that it can be
+ * vectorized. Large products are divided by rows between several threads.
+ *
+ * @param   lhs     Left-hand matrix, which must have as many columns as the
+ *                  right-hand matrix has rows
+ * @param   rhs     Right-hand matrix
+ * @param   result  Receives the product
+ *
+ * @returns false, leaving the result unchanged, if the matrices do not fit
+ */
+bool multiplyMatrices(const Matrix & lhs, const Matrix & rhs, Matrix & result);
+
+/**
+ * Swap the rows and columns of a matrix. The matrix is copied in square
+ * tiles, so that both reads and writes stay within a few cache lines.
+ */
+void transposeMatrix(const Matrix & matrix, Matrix & result);
+
+/**
+ * Invert a square matrix, by Gauss-Jordan elimination with partial pivoting.
+ * For large matrices, the rows eliminated by each pivot are divided between
+ * several threads.
+ *
+ * @returns false, leaving the result unchanged, if the matrix is not square
+ *          or is singular
+ */
+bool invertMatrix(const Matrix & matrix, Matrix & result);
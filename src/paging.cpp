@@ -0,0 +1,53 @@
+#include <cstdio>
+#include <stdexcept>
+
+#include "paging.hpp"
+
+BlockFile::BlockFile(const std::string & path)
+    : m_path(path)
+    , m_stream(path.c_str(), std::ios::in | std::ios::out | std::ios::trunc | std::ios::binary)
+    , m_size(0)
+    , m_bytesRead(0)
+    , m_bytesWritten(0)
+{
+    if (!m_stream) {
+        throw std::runtime_error("Could not create paging file: " + path);
+    }
+}
+
+BlockFile::~BlockFile()
+{
+    m_stream.close();
+    std::remove(m_path.c_str());
+}
+
+std::uint64_t BlockFile::append(const std::string & bytes)
+{
+    const std::uint64_t offset = m_size;
+    write(offset, bytes);
+    m_size += bytes.size();
+    return offset;
+}
+
+void BlockFile::write(std::uint64_t offset, const std::string & bytes)
+{
+    m_stream.seekp(std::streamoff(offset));
+    m_stream.write(bytes.data(), std::streamsize(bytes.size()));
+    if (!m_stream) {
+        throw std::runtime_error("Could not write to paging file.");
+    }
+
+    m_bytesWritten += bytes.size();
+}
+
+void BlockFile::read(std::uint64_t offset, std::size_t length, std::string & bytes)
+{
+    bytes.resize(length);
+    m_stream.seekg(std::streamoff(offset));
+    m_stream.read(&bytes[0], std::streamsize(length));
+    if (!m_stream) {
+        throw std::runtime_error("Could not read from paging file.");
+    }
+
+    m_bytesRead += length;
+}
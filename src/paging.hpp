@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+/**
+ * Counters for a Sheet whose cells are kept in a file, as reported by
+ * Sheet::getPagingStats().
+ *
+ * A lookup is counted each time a cell is read or written in a different
+ * block to the previous access, so a pass over the cells of one block counts
+ * as a single lookup.
+ */
+struct PagingStats
+{
+    PagingStats()
+        : hits(0)
+        , misses(0)
+        , evictions(0)
+        , bytesRead(0)
+        , bytesWritten(0)
+        , residentBlocks(0)
+        , residentBytes(0)
+        , compressedBytes(0)
+    {
+        // No further initialisation
+    }
+
+    /// Fraction of lookups that found the block already in memory
+    double getHitRate() const
+    {
+        return hits + misses > 0 ? double(hits) / double(hits + misses) : 1.0;
+    }
+
+    /// Lookups that found the block in memory
+    std::uint64_t hits;
+
+    /// Lookups that read the block from the file
+    std::uint64_t misses;
+
+    /// Blocks dropped from memory to stay within the memory budget
+    std::uint64_t evictions;
+
+    /// Bytes read from the file
+    std::uint64_t bytesRead;
+
+    /// Bytes written to the file, when modified blocks were evicted
+    std::uint64_t bytesWritten;
+
+    /// Blocks currently in memory
+    std::size_t residentBlocks;
+
+    /// Estimated memory used by the blocks that are in memory
+    std::size_t residentBytes;
+
+    /// Memory used by evicted blocks that are kept compressed in memory rather
+    /// than in a file, including the dictionaries that they refer to
+    std::size_t compressedBytes;
+};
+
+/**
+ * Compression of the formulas and values in one column of a Sheet, as
+ * reported by Sheet::getColumnCompression().
+ *
+ * Blocks are compressed when they are evicted, one segment at a time, where
+ * a segment holds the cells of a block that share a column, in row order.
+ * Values in each segment are run-length encoded, and then stored as plain
+ * strings, as indices into a dictionary that is shared by the whole column,
+ * or as differences between consecutive integers, whichever is smallest.
+ * Formulas that can be derived from their values, such as 'label or =42, are
+ * not stored at all.
+ */
+struct ColumnCompression
+{
+    ColumnCompression()
+        : column(0)
+        , cells(0)
+        , rawBytes(0)
+        , encodedBytes(0)
+        , plainSegments(0)
+        , dictionarySegments(0)
+        , deltaSegments(0)
+    {
+        // No further initialisation
+    }
+
+    /// Ratio of the size of the formulas and values to their encoded size
+    double getRatio() const
+    {
+        return encodedBytes > 0 ? double(rawBytes) / double(encodedBytes) : 1.0;
+    }
+
+    /// Column number (beginning at 1)
+    unsigned int column;
+
+    /// Cells in blocks that have been compressed
+    std::size_t cells;
+
+    /// Length of the formulas and values of those cells
+    std::size_t rawBytes;
+
+    /// Length of their encoded form, including the column's dictionary
+    std::size_t encodedBytes;
+
+    /// Number of segments stored using each encoding
+    std::size_t plainSegments;
+    std::size_t dictionarySegments;
+    std::size_t deltaSegments;
+};
+
+/**
+ * A scratch file holding serialised blocks of cells.
+ *
+ * Records are written at offsets chosen by the caller, or appended to the end
+ * of the file. The file is created (or truncated) when the object is
+ * constructed, and removed when it is destroyed.
+ */
+class BlockFile
+{
+public:
+    /**
+     * @throws  std::runtime_error if the file cannot be created
+     */
+    explicit BlockFile(const std::string & path);
+
+    ~BlockFile();
+
+    /**
+     * Write a record to the end of the file.
+     *
+     * @returns offset of the record
+     *
+     * @throws  std::runtime_error if the record cannot be written
+     */
+    std::uint64_t append(const std::string & bytes);
+
+    /**
+     * Overwrite part of the file with a record that fits in the space that an
+     * earlier record occupied.
+     *
+     * @throws  std::runtime_error if the record cannot be written
+     */
+    void write(std::uint64_t offset, const std::string & bytes);
+
+    /**
+     * Read a record.
+     *
+     * @throws  std::runtime_error if the record cannot be read
+     */
+    void read(std::uint64_t offset, std::size_t length, std::string & bytes);
+
+    std::uint64_t getBytesRead() const
+    {
+        return m_bytesRead;
+    }
+
+    std::uint64_t getBytesWritten() const
+    {
+        return m_bytesWritten;
+    }
+
+private:
+
+    /// Disabled copy constructor
+    BlockFile(const BlockFile &);
+
+    /// Disabled copy assignment operator
+    BlockFile & operator=(const BlockFile &);
+
+    std::string m_path;
+
+    std::fstream m_stream;
+
+    std::uint64_t m_size;
+
+    std::uint64_t m_bytesRead;
+
+    std::uint64_t m_bytesWritten;
+};
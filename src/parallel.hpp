@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+/// Number of operations below which work stays on the calling thread, as
+/// starting threads would take longer than the work itself
+const std::size_t PARALLEL_WORK = std::size_t(1) << 21;
+
+/**
+ * Choose the number of threads to divide work between.
+ *
+ * @param   count    Number of items, such as rows, that the work divides into
+ * @param   work     Number of operations needed for every item
+ * @param   threads  Most threads to use, or zero to use one per core, but
+ *                   only as many as there is enough work for
+ *
+ * @returns number of threads, which is at least one and at most count
+ */
+inline std::size_t countThreads(std::size_t count, std::size_t work, std::size_t threads)
+{
+    if (threads == 0) {
+        threads = std::min<std::size_t>(std::thread::hardware_concurrency(), work / PARALLEL_WORK);
+    }
+
+    return std::max<std::size_t>(1, std::min(threads, count));
+}
+
+/**
+ * Divide the items [0, count) into one contiguous band per thread, of equal
+ * size apart from the last, and call task(begin, end) for each band, taking
+ * the first band on this thread. Bands are never written by more than one
+ * thread. If a thread cannot be started, its band is done on this thread.
+ *
+ * @param   threads  Number of threads, as returned by countThreads()
+ */
+template<typename Task>
+void forEachBand(const Task & task, std::size_t count, std::size_t threads)
+{
+    if (threads <= 1 || count <= 1) {
+        task(0, count);
+        return;
+    }
+
+    const std::size_t band = (count + threads - 1) / threads;
+    std::vector<std::thread> workers;
+    for (std::size_t begin = band; begin < count; begin += band) {
+        const std::size_t end = std::min(count, begin + band);
+        try {
+            workers.push_back(std::thread(std::cref(task), begin, end));
+        } catch (const std::system_error &) {
+            task(begin, end);
+        }
+    }
+
+    task(0, std::min(count, band));
+    for (std::vector<std::thread>::iterator itr = workers.begin(); itr != workers.end(); itr++) {
+        itr->join();
+    }
+}
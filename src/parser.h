@@ -4,25 +4,34 @@
 
 #include "binary_op.h"
 
-#define PLUS                            1
-#define MINUS                           2
-#define TIMES                           3
-#define DIVIDE                          4
-#define EXP                             5
-#define NOT                             6
-#define LITERAL                         7
-#define EQUALS                          8
-#define LPAREN                          9
-#define RPAREN                         10
-#define ADDRESS_OR_IDENTIFIER          11
-#define IDENTIFIER                     12
-#define COMMA                          13
+// Token codes are assigned by lemon in order of first appearance in parser.y,
+// so these must be kept in sync with the precedence declarations there
+#define EQUALS                          1
+#define NE                              2
+#define LT                              3
+#define LE                              4
+#define GT                              5
+#define GE                              6
+#define PLUS                            7
+#define MINUS                           8
+#define TIMES                           9
+#define DIVIDE                         10
+#define EXP                            11
+#define NOT                            12
+#define LITERAL                        13
+#define LPAREN                         14
+#define RPAREN                         15
+#define ADDRESS_OR_IDENTIFIER          16
+#define IDENTIFIER                     17
+#define COMMA                          18
+#define COLON                          19
 
 struct Node;
 
 typedef struct Node * (*AddressNodeFromIdentifierNode)(const struct Node *);
 typedef struct Node * (*BeginFunctionCallNode)(const struct Node *);
 typedef struct Node * (*CreateBinaryOpNode)(enum BinaryOp, const struct Node *, const struct Node *);
+typedef struct Node * (*CreateRangeNode)(const struct Node *, const struct Node *);
 typedef void (*DeleteNode)(struct Node *);
 typedef void (*EndFunctionCallNode)(struct Node *, const struct Node *);
 typedef void (*ExtendFunctionCallNode)(struct Node *, const struct Node *);
@@ -32,6 +41,7 @@ struct ParserData
     AddressNodeFromIdentifierNode addressNodeFromIdentifierNode;
     BeginFunctionCallNode beginFunctionCallNode;
     CreateBinaryOpNode createBinaryOpNode;
+    CreateRangeNode createRangeNode;
     DeleteNode deleteNode;
     EndFunctionCallNode endFunctionCallNode;
     ExtendFunctionCallNode extendFunctionCallNode;
@@ -3,6 +3,7 @@
 #include "parser.h"
 }
 
+%nonassoc EQUALS NE LT LE GT GE.
 %left PLUS MINUS.
 %left TIMES DIVIDE.
 %right EXP NOT.
@@ -41,6 +42,36 @@ expr(A) ::= expr(B) DIVIDE expr(C).
         A = pData->createBinaryOpNode(BINARY_OP_DIVIDE, B, C);
     }
 
+expr(A) ::= expr(B) EQUALS expr(C).
+    {
+        A = pData->createBinaryOpNode(BINARY_OP_EQUAL, B, C);
+    }
+
+expr(A) ::= expr(B) NE expr(C).
+    {
+        A = pData->createBinaryOpNode(BINARY_OP_NOT_EQUAL, B, C);
+    }
+
+expr(A) ::= expr(B) LT expr(C).
+    {
+        A = pData->createBinaryOpNode(BINARY_OP_LESS, B, C);
+    }
+
+expr(A) ::= expr(B) LE expr(C).
+    {
+        A = pData->createBinaryOpNode(BINARY_OP_LESS_EQUAL, B, C);
+    }
+
+expr(A) ::= expr(B) GT expr(C).
+    {
+        A = pData->createBinaryOpNode(BINARY_OP_GREATER, B, C);
+    }
+
+expr(A) ::= expr(B) GE expr(C).
+    {
+        A = pData->createBinaryOpNode(BINARY_OP_GREATER_EQUAL, B, C);
+    }
+
 expr(A) ::= LPAREN expr(B) RPAREN.
     {
         A = B;
@@ -90,6 +121,20 @@ params(A) ::= expr(B).
         A = pData->beginFunctionCallNode(B);
     }
 
+expr(A) ::= range(B).
+    {
+        // Functions read the cells within a range that is passed to them;
+        // elsewhere, a range is an array of the values of its cells
+        A = B;
+    }
+
+range(A) ::= ADDRESS_OR_IDENTIFIER(B) COLON ADDRESS_OR_IDENTIFIER(C).
+    {
+        A = pData->createRangeNode(B, C);
+        pData->deleteNode(B);
+        pData->deleteNode(C);
+    }
+
 expr(A) ::= ADDRESS_OR_IDENTIFIER(B).
     {
         // Since we know that this identifier is also a valid address we can convert it to an address
@@ -108,6 +153,11 @@ expr(A) ::= ADDRESS_OR_IDENTIFIER(B).
         pData->deleteNode($$);
     }
 
+%destructor range
+    {
+        pData->deleteNode($$);
+    }
+
 %parse_accept
     {
         // Do nothing
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "address.hpp"
+
+/**
+ * Profiling results for a single cell, as reported by Sheet::getHotCells().
+ */
+struct CellProfile
+{
+    /// Address of the cell
+    Address address;
+
+    /// Formula of the cell, as returned by Sheet::getFormula()
+    std::string formula;
+
+    /// Number of times the cell has been evaluated while profiling
+    std::uint64_t evaluations;
+
+    /// Total time spent recalculating the cell, including its precedents
+    std::uint64_t inclusiveNanos;
+
+    /// Total time spent recalculating the cell, excluding its precedents
+    std::uint64_t exclusiveNanos;
+
+    /// Number of distinct cells read by the most recent evaluation of the cell
+    std::size_t fanIn;
+
+    /// Number of cells whose most recent evaluation read this cell
+    std::size_t fanOut;
+};
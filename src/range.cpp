@@ -0,0 +1,56 @@
+#include <algorithm>
+#include <stdexcept>
+
+#include "range.hpp"
+
+namespace
+{
+    Address parseFirst(const std::string & range)
+    {
+        return Address(range.substr(0, range.find(':')));
+    }
+
+    Address parseLast(const std::string & range)
+    {
+        const std::string::size_type colon = range.find(':');
+        if (colon == std::string::npos) {
+            return Address(range);
+        }
+
+        if (range.find(':', colon + 1) != std::string::npos) {
+            throw std::invalid_argument("Invalid range string.");
+        }
+
+        return Address(range.substr(colon + 1));
+    }
+}
+
+Range::Range(const Address & a, const Address & b)
+    : first(std::min(a.column, b.column), std::min(a.row, b.row))
+    , last(std::max(a.column, b.column), std::max(a.row, b.row))
+{
+    // No further initialisation
+}
+
+Range::Range(const std::string & range)
+    : first(0, 0)
+    , last(0, 0)
+{
+    *this = Range(parseFirst(range), parseLast(range));
+}
+
+bool Range::contains(const Address & address) const
+{
+    return address.column >= first.column && address.column <= last.column &&
+        address.row >= first.row && address.row <= last.row;
+}
+
+std::string Range::toString() const
+{
+    return first.toString() + ":" + last.toString();
+}
+
+bool operator==(const Range & lhs, const Range & rhs)
+{
+    return lhs.first == rhs.first && lhs.last == rhs.last;
+}
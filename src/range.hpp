@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+
+#include "address.hpp"
+
+struct Range
+{
+    /**
+     * Construct a Range from two corner Addresses. The corners may be given
+     * in any order; they are normalised so that first is the top-left corner
+     * and last is the bottom-right corner.
+     *
+     * @param   a  One corner of the range
+     * @param   b  The opposite corner of the range
+     */
+    Range(const Address & a, const Address & b);
+
+    /**
+     * Construct a Range using a range in string format, e.g. "A1:C10". A
+     * single address, e.g. "B2", is treated as a range containing one cell.
+     *
+     * @param   range  Range in string format
+     */
+    Range(const std::string & range);
+
+    /**
+     * Query whether an Address falls within the Range.
+     *
+     * @param   address  Address to test
+     *
+     * @returns true if the Address is inside the Range, false otherwise
+     */
+    bool contains(const Address & address) const;
+
+    /**
+     * Format the Range as a string, e.g. "A1:C10".
+     *
+     * @returns Range in string format
+     */
+    std::string toString() const;
+
+    /// Top-left corner
+    Address first;
+
+    /// Bottom-right corner
+    Address last;
+};
+
+bool operator==(const Range & lhs, const Range & rhs);
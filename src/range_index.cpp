@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <utility>
+
+#include "range_index.hpp"
+
+namespace
+{
+    const std::vector<Range> NO_RANGES;
+
+    typedef std::pair<unsigned int, std::size_t> RowEntry;
+
+    bool moreRows(const RowEntry & lhs, const RowEntry & rhs)
+    {
+        return lhs.first > rhs.first;
+    }
+}
+
+RangeIndex::RangeIndex()
+    : m_size(0)
+    , m_built(true)
+    , m_leaves(0)
+{
+    // No further initialisation
+}
+
+void RangeIndex::set(Owner owner, const std::vector<Range> & ranges)
+{
+    std::map<Owner, std::vector<Range> >::iterator itr = m_ranges.find(owner);
+    if (itr == m_ranges.end()) {
+        if (ranges.empty()) {
+            return;
+        }
+        itr = m_ranges.insert(std::make_pair(owner, std::vector<Range>())).first;
+    } else if (itr->second == ranges) {
+        // Formulas are compiled again after being paged out, which must not
+        // cause the trees to be rebuilt
+        return;
+    }
+
+    m_size -= itr->second.size();
+    m_size += ranges.size();
+    if (ranges.empty()) {
+        m_ranges.erase(itr);
+    } else {
+        itr->second = ranges;
+    }
+
+    m_built = false;
+}
+
+bool RangeIndex::erase(Owner owner)
+{
+    std::map<Owner, std::vector<Range> >::iterator itr = m_ranges.find(owner);
+    if (itr == m_ranges.end()) {
+        return false;
+    }
+
+    m_size -= itr->second.size();
+    m_ranges.erase(itr);
+    m_built = false;
+    return true;
+}
+
+const std::vector<Range> & RangeIndex::get(Owner owner) const
+{
+    std::map<Owner, std::vector<Range> >::const_iterator itr = m_ranges.find(owner);
+    return itr == m_ranges.end() ? NO_RANGES : itr->second;
+}
+
+void RangeIndex::findCovering(const Address & address, std::vector<Owner> & owners) const
+{
+    build();
+    if (m_entries.empty()) {
+        return;
+    }
+
+    // Find the span of columns that contains the cell
+    const std::vector<unsigned int>::const_iterator itr =
+        std::upper_bound(m_boundaries.begin(), m_boundaries.end(), address.column);
+    if (itr == m_boundaries.begin() || itr == m_boundaries.end()) {
+        return;
+    }
+
+    // Every node on the path from the leaf to the root holds ranges that span
+    // the column, so only their rows need to be checked
+    const std::size_t begin = owners.size();
+    for (std::size_t node = m_leaves + std::size_t(itr - m_boundaries.begin()) - 1; node > 0; node /= 2) {
+        findInRows(m_columnNodes[node], address.row, owners);
+    }
+
+    std::sort(owners.begin() + begin, owners.end());
+    owners.erase(std::unique(owners.begin() + begin, owners.end()), owners.end());
+}
+
+void RangeIndex::findIntersecting(const Range & area, std::vector<Owner> & owners) const
+{
+    for (std::map<Owner, std::vector<Range> >::const_iterator itr = m_ranges.begin(); itr != m_ranges.end(); itr++) {
+        for (std::vector<Range>::const_iterator range = itr->second.begin(); range != itr->second.end(); range++) {
+            if (range->first.column <= area.last.column && range->last.column >= area.first.column &&
+                    range->first.row <= area.last.row && range->last.row >= area.first.row) {
+                owners.push_back(itr->first);
+                break;
+            }
+        }
+    }
+}
+
+std::size_t RangeIndex::size() const
+{
+    return m_size;
+}
+
+void RangeIndex::build() const
+{
+    if (m_built) {
+        return;
+    }
+
+    m_entries.clear();
+    m_boundaries.clear();
+    m_columnNodes.clear();
+    m_rowNodes.clear();
+    m_byFirstRow.clear();
+    m_byLastRow.clear();
+
+    m_entries.reserve(m_size);
+    for (std::map<Owner, std::vector<Range> >::const_iterator itr = m_ranges.begin(); itr != m_ranges.end(); itr++) {
+        for (std::vector<Range>::const_iterator range = itr->second.begin(); range != itr->second.end(); range++) {
+            const Entry entry = {*range, itr->first};
+            m_entries.push_back(entry);
+            m_boundaries.push_back(range->first.column);
+            m_boundaries.push_back(range->last.column + 1);
+        }
+    }
+
+    std::sort(m_boundaries.begin(), m_boundaries.end());
+    m_boundaries.erase(std::unique(m_boundaries.begin(), m_boundaries.end()), m_boundaries.end());
+
+    m_leaves = 1;
+    while (m_leaves + 1 < m_boundaries.size()) {
+        m_leaves *= 2;
+    }
+
+    // Each range is held by the O(log n) nodes whose spans of columns make up
+    // its own span of columns, as in any segment tree
+    std::vector<std::vector<std::size_t> > held(m_leaves * 2);
+    for (std::size_t i = 0; i < m_entries.size(); i++) {
+        const Range & range = m_entries[i].range;
+        std::size_t lo = m_leaves + std::size_t(
+            std::lower_bound(m_boundaries.begin(), m_boundaries.end(), range.first.column) - m_boundaries.begin());
+        std::size_t hi = m_leaves + std::size_t(
+            std::lower_bound(m_boundaries.begin(), m_boundaries.end(), range.last.column + 1) - m_boundaries.begin());
+        for (; lo < hi; lo /= 2, hi /= 2) {
+            if (lo & 1) {
+                held[lo++].push_back(i);
+            }
+            if (hi & 1) {
+                held[--hi].push_back(i);
+            }
+        }
+    }
+
+    m_columnNodes.resize(held.size());
+    for (std::size_t node = 1; node < held.size(); node++) {
+        m_columnNodes[node] = buildRows(held[node]);
+    }
+
+    m_built = true;
+}
+
+long RangeIndex::buildRows(std::vector<std::size_t> & entries) const
+{
+    if (entries.empty()) {
+        return -1;
+    }
+
+    // The centre is the median of the first and last rows, so that at most
+    // half of the ranges lie entirely above or below it
+    std::vector<unsigned int> rows;
+    rows.reserve(entries.size() * 2);
+    for (std::vector<std::size_t>::const_iterator itr = entries.begin(); itr != entries.end(); itr++) {
+        rows.push_back(m_entries[*itr].range.first.row);
+        rows.push_back(m_entries[*itr].range.last.row);
+    }
+
+    std::nth_element(rows.begin(), rows.begin() + rows.size() / 2, rows.end());
+    const unsigned int center = rows[rows.size() / 2];
+
+    std::vector<std::size_t> above;
+    std::vector<std::size_t> below;
+    std::vector<std::size_t> here;
+    for (std::vector<std::size_t>::const_iterator itr = entries.begin(); itr != entries.end(); itr++) {
+        const Range & range = m_entries[*itr].range;
+        if (range.last.row < center) {
+            above.push_back(*itr);
+        } else if (range.first.row > center) {
+            below.push_back(*itr);
+        } else {
+            here.push_back(*itr);
+        }
+    }
+
+    std::vector<RowEntry> byFirstRow;
+    std::vector<RowEntry> byLastRow;
+    for (std::vector<std::size_t>::const_iterator itr = here.begin(); itr != here.end(); itr++) {
+        byFirstRow.push_back(RowEntry(m_entries[*itr].range.first.row, *itr));
+        byLastRow.push_back(RowEntry(m_entries[*itr].range.last.row, *itr));
+    }
+
+    std::sort(byFirstRow.begin(), byFirstRow.end());
+    std::sort(byLastRow.begin(), byLastRow.end(), moreRows);
+
+    RowNode node;
+    node.center = center;
+    node.begin = m_byFirstRow.size();
+    for (std::size_t i = 0; i < here.size(); i++) {
+        m_byFirstRow.push_back(byFirstRow[i].second);
+        m_byLastRow.push_back(byLastRow[i].second);
+    }
+    node.end = m_byFirstRow.size();
+
+    // Release the memory held by this level before building the next
+    std::vector<std::size_t>().swap(entries);
+
+    node.above = buildRows(above);
+    node.below = buildRows(below);
+    m_rowNodes.push_back(node);
+    return long(m_rowNodes.size()) - 1;
+}
+
+void RangeIndex::findInRows(long node, unsigned int row, std::vector<Owner> & owners) const
+{
+    while (node >= 0) {
+        const RowNode & rowNode = m_rowNodes[std::size_t(node)];
+        if (row < rowNode.center) {
+            // Every range held by the node ends at or below the centre, so
+            // only their first rows need to be checked
+            for (std::size_t i = rowNode.begin; i < rowNode.end; i++) {
+                const Entry & entry = m_entries[m_byFirstRow[i]];
+                if (entry.range.first.row > row) {
+                    break;
+                }
+                owners.push_back(entry.owner);
+            }
+            node = rowNode.above;
+        } else if (row > rowNode.center) {
+            for (std::size_t i = rowNode.begin; i < rowNode.end; i++) {
+                const Entry & entry = m_entries[m_byLastRow[i]];
+                if (entry.range.last.row < row) {
+                    break;
+                }
+                owners.push_back(entry.owner);
+            }
+            node = rowNode.below;
+        } else {
+            for (std::size_t i = rowNode.begin; i < rowNode.end; i++) {
+                owners.push_back(m_entries[m_byFirstRow[i]].owner);
+            }
+            return;
+        }
+    }
+}
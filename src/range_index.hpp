@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <vector>
+
+#include "address.hpp"
+#include "range.hpp"
+
+/**
+ * Index of the ranges read by formulas, for finding the formulas that read a
+ * particular cell.
+ *
+ * Each formula is identified by an owner, such as the slot of its cell, and
+ * may read any number of ranges. A range is stored once, as a rectangle,
+ * however many cells it covers, so the memory used is proportional to the
+ * number of ranges rather than the number of cells within them.
+ *
+ * Queries use a segment tree over columns, in which each node holds the
+ * ranges that span all of its columns in an interval tree over rows. Finding
+ * the ranges that contain a cell takes O(log^2 n + k) time, for n ranges, k
+ * of which contain the cell. The trees are built on the first query after
+ * the ranges have changed, in O(n log^2 n) time, so changes are cheap to
+ * make in bulk.
+ *
+ * Queries may build the trees, so an index must not be queried from several
+ * threads at once.
+ */
+class RangeIndex
+{
+public:
+    typedef std::size_t Owner;
+
+    RangeIndex();
+
+    /**
+     * Replace the ranges read by an owner.
+     *
+     * @param   owner   Owner of the ranges
+     * @param   ranges  Ranges read by the owner, which may be empty to remove
+     *                  the owner from the index
+     */
+    void set(Owner owner, const std::vector<Range> & ranges);
+
+    /**
+     * Remove an owner, along with its ranges.
+     *
+     * @returns true if the owner had any ranges, false otherwise
+     */
+    bool erase(Owner owner);
+
+    /**
+     * Retrieve the ranges read by an owner.
+     *
+     * @returns ranges in the order they were set, or an empty vector
+     */
+    const std::vector<Range> & get(Owner owner) const;
+
+    /**
+     * Find the owners of the ranges that contain a cell.
+     *
+     * @param   address  Address of the cell
+     * @param   owners   Vector to append owners to, in ascending order and
+     *                   without duplicates
+     */
+    void findCovering(const Address & address, std::vector<Owner> & owners) const;
+
+    /**
+     * Find the owners of the ranges that share at least one cell with an
+     * area. This checks every range, without building the trees, so it is
+     * meant for occasional bulk edits rather than recalculation.
+     *
+     * @param   area    Area to check
+     * @param   owners  Vector to append owners to, in ascending order and
+     *                  without duplicates
+     */
+    void findIntersecting(const Range & area, std::vector<Owner> & owners) const;
+
+    /// Number of ranges in the index
+    std::size_t size() const;
+
+private:
+
+    struct Entry
+    {
+        Range range;
+        Owner owner;
+    };
+
+    /// Node of an interval tree over rows, holding the ranges that contain
+    /// its centre row
+    struct RowNode
+    {
+        unsigned int center;
+
+        // Positions in m_byFirstRow and m_byLastRow of the ranges held by
+        // this node
+        std::size_t begin;
+        std::size_t end;
+
+        // Nodes for ranges entirely above and below the centre row, or -1
+        long above;
+        long below;
+    };
+
+    /// Build the trees, if the ranges have changed since they were last built
+    void build() const;
+
+    long buildRows(std::vector<std::size_t> & entries) const;
+
+    void findInRows(long node, unsigned int row, std::vector<Owner> & owners) const;
+
+    std::map<Owner, std::vector<Range> > m_ranges;
+
+    std::size_t m_size;
+
+    mutable bool m_built;
+
+    mutable std::vector<Entry> m_entries;
+
+    /// Boundaries between columns at which ranges begin or end, in ascending
+    /// order; the leaves of the segment tree are the spans between them
+    mutable std::vector<unsigned int> m_boundaries;
+
+    /// Number of leaves in the segment tree, which is a power of two
+    mutable std::size_t m_leaves;
+
+    /// Root of the interval tree held by each node of the segment tree, or -1
+    mutable std::vector<long> m_columnNodes;
+
+    mutable std::vector<RowNode> m_rowNodes;
+
+    /// Entries held by each RowNode, ordered by first row, ascending
+    mutable std::vector<std::size_t> m_byFirstRow;
+
+    /// Entries held by each RowNode, ordered by last row, descending
+    mutable std::vector<std::size_t> m_byLastRow;
+};
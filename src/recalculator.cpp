@@ -0,0 +1,170 @@
+#include <stdexcept>
+#include <string>
+
+#include "recalculator.hpp"
+
+Recalculator::Recalculator(Sheet & sheet)
+    : m_sheet(sheet)
+    , m_requested(0)
+    , m_started(0)
+    , m_pendingEdits(0)
+    , m_running(false)
+    , m_stopping(false)
+{
+    // The worker is started last, once every other member is initialised
+    m_thread = std::thread(&Recalculator::run, this);
+}
+
+Recalculator::~Recalculator()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stopping = true;
+        m_progress.cancelled.store(true);
+    }
+
+    m_workCondition.notify_all();
+    m_thread.join();
+}
+
+void Recalculator::edit(const EditFunction & fn)
+{
+    {
+        // Ask the current pass, if any, to give up the Sheet as soon as
+        // possible, and hold off starting another until the edit is applied
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pendingEdits++;
+        if (m_running) {
+            m_progress.cancelled.store(true);
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_sheetMutex);
+        try {
+            fn(m_sheet);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_pendingEdits--;
+            m_requested++;
+            m_workCondition.notify_all();
+            throw;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_pendingEdits--;
+        m_requested++;
+    }
+
+    m_workCondition.notify_all();
+}
+
+void Recalculator::read(const ReadFunction & fn) const
+{
+    std::lock_guard<std::mutex> lock(m_sheetMutex);
+    fn(m_sheet);
+}
+
+void Recalculator::restart()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_requested++;
+        if (m_running) {
+            m_progress.cancelled.store(true);
+        }
+    }
+
+    m_workCondition.notify_all();
+}
+
+bool Recalculator::isIdle() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return !m_running && m_started == m_requested;
+}
+
+void Recalculator::getProgress(std::size_t & done, std::size_t & total) const
+{
+    done = m_progress.done.load();
+    total = m_progress.total.load();
+}
+
+void Recalculator::setCallback(const CompletionCallback & callback)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_callback = callback;
+}
+
+void Recalculator::setPriorityCallback(const PriorityCallback & callback)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_priorityCallback = callback;
+}
+
+std::string Recalculator::wait()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (m_running || m_started != m_requested) {
+        m_idleCondition.wait(lock);
+    }
+
+    return m_lastError;
+}
+
+void Recalculator::run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        while (!m_stopping && (m_started == m_requested || m_pendingEdits > 0)) {
+            m_workCondition.wait(lock);
+        }
+
+        if (m_stopping) {
+            break;
+        }
+
+        // Cancellation requests made before this point applied to an earlier
+        // pass, so the flag is only cleared while holding the lock
+        const unsigned long number = m_requested;
+        m_started = number;
+        m_running = true;
+        m_progress.cancelled.store(false);
+        m_progress.onPrioritised = nullptr;
+        if (m_priorityCallback) {
+            const PriorityCallback callback = m_priorityCallback;
+            const Sheet & sheet = m_sheet;
+            m_progress.onPrioritised = [callback, &sheet]() { callback(sheet); };
+        }
+        lock.unlock();
+
+        bool completed = false;
+        std::string error;
+        {
+            std::lock_guard<std::mutex> sheetLock(m_sheetMutex);
+            try {
+                completed = m_sheet.recalculate(m_progress);
+            } catch (const std::runtime_error & e) {
+                error = e.what();
+            }
+        }
+
+        lock.lock();
+        m_running = false;
+
+        // Only report passes that have not been superseded by a newer request
+        if ((completed || !error.empty()) && m_requested == number) {
+            m_lastError = error;
+            CompletionCallback callback = m_callback;
+            if (callback) {
+                lock.unlock();
+                callback(error);
+                lock.lock();
+            }
+        }
+
+        m_idleCondition.notify_all();
+    }
+}
@@ -0,0 +1,151 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "sheet.hpp"
+
+/**
+ * Recalculates a Sheet on a background thread.
+ *
+ * All access to the Sheet must go through edit() and read() while the
+ * Recalculator exists. Each call to edit() cancels any recalculation that is
+ * in progress, applies the edit, and then starts a new recalculation, so a
+ * stream of edits never waits for a full pass to finish.
+ */
+class Recalculator
+{
+public:
+    /**
+     * Called on the worker thread after each recalculation that ran to
+     * completion or failed. Passes that were cancelled or superseded by a
+     * newer edit are not reported. The error message is empty on success.
+     */
+    typedef std::function<void(const std::string & error)> CompletionCallback;
+
+    /**
+     * Called on the worker thread, part way through a pass, once the Sheet's
+     * priority regions are up to date. The worker holds the Sheet while the
+     * callback runs, so the callback must read from the Sheet it is given
+     * rather than calling read() or edit().
+     */
+    typedef std::function<void(const Sheet &)> PriorityCallback;
+
+    typedef std::function<void(Sheet &)> EditFunction;
+
+    typedef std::function<void(const Sheet &)> ReadFunction;
+
+    explicit Recalculator(Sheet & sheet);
+
+    /**
+     * Cancels any recalculation in progress and stops the worker thread.
+     */
+    ~Recalculator();
+
+    /**
+     * Apply an edit to the Sheet, then schedule a recalculation.
+     *
+     * May be called from the completion callback.
+     *
+     * @param   fn  Function that modifies the Sheet
+     */
+    void edit(const EditFunction & fn);
+
+    /**
+     * Read from the Sheet. Blocks while a recalculation pass holds the Sheet,
+     * so callers that must not block should check isIdle() first.
+     *
+     * @param   fn  Function that reads from the Sheet
+     */
+    void read(const ReadFunction & fn) const;
+
+    /**
+     * Schedule a recalculation without editing the Sheet.
+     */
+    void restart();
+
+    /**
+     * Returns true if no recalculation is running or scheduled.
+     */
+    bool isIdle() const;
+
+    /**
+     * Retrieve progress of the current (or most recent) recalculation.
+     *
+     * @param   done   Set to the number of cells recalculated so far
+     * @param   total  Set to the number of cells in the pass, which grows
+     *                 if the pass is repeated for spilled arrays
+     */
+    void getProgress(std::size_t & done, std::size_t & total) const;
+
+    /**
+     * Set the function to be called after each recalculation.
+     *
+     * @param   callback  Completion callback
+     */
+    void setCallback(const CompletionCallback & callback);
+
+    /**
+     * Set the function to be called once priority regions are up to date.
+     *
+     * @param   callback  Priority callback
+     */
+    void setPriorityCallback(const PriorityCallback & callback);
+
+    /**
+     * Block until no recalculation is running or scheduled.
+     *
+     * @returns error message from the most recent recalculation, or an empty
+     *          string if it succeeded
+     */
+    std::string wait();
+
+private:
+
+    /// Disabled copy constructor
+    Recalculator(const Recalculator &);
+
+    /// Disabled copy assignment operator
+    Recalculator & operator=(const Recalculator &);
+
+    void run();
+
+    Sheet & m_sheet;
+
+    /// Held by the worker for the duration of a pass, and by edit() and read()
+    mutable std::mutex m_sheetMutex;
+
+    /// Guards the remaining members
+    mutable std::mutex m_mutex;
+
+    std::condition_variable m_workCondition;
+
+    std::condition_variable m_idleCondition;
+
+    RecalcProgress m_progress;
+
+    CompletionCallback m_callback;
+
+    PriorityCallback m_priorityCallback;
+
+    /// Number of recalculations requested so far
+    unsigned long m_requested;
+
+    /// Number of the recalculation most recently started by the worker
+    unsigned long m_started;
+
+    /// Number of calls to edit() that are waiting for, or holding, the Sheet
+    unsigned int m_pendingEdits;
+
+    bool m_running;
+
+    bool m_stopping;
+
+    std::string m_lastError;
+
+    std::thread m_thread;
+};
@@ -0,0 +1,247 @@
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "rope.hpp"
+
+const std::size_t Rope::SMALL_SIZE;
+
+const std::size_t Rope::HEAD_SIZE;
+
+/**
+ * Shared storage for a long value: either a single string, or the
+ * concatenation of two values, at least one of which is long.
+ */
+struct Rope::Piece
+{
+    explicit Piece(std::string && value)
+        : length(value.size())
+        , text(std::move(value))
+        , headLength(0)
+    {
+        // No further initialisation
+    }
+
+    Piece(const Rope & lhs, const Rope & rhs)
+        : length(lhs.size() + rhs.size())
+        , left(lhs)
+        , right(rhs)
+        , headLength(0)
+    {
+        const std::string leftHead = lhs.head();
+        const std::string rightHead = rhs.head();
+        headLength = std::min(HEAD_SIZE, leftHead.size() + rightHead.size());
+        const std::size_t fromLeft = std::min(headLength, leftHead.size());
+        std::memcpy(head, leftHead.data(), fromLeft);
+        std::memcpy(head + fromLeft, rightHead.data(), headLength - fromLeft);
+    }
+
+    ~Piece();
+
+    bool isConcatenation() const
+    {
+        return text.empty();
+    }
+
+    std::size_t length;
+
+    /// Characters of a single string
+    std::string text;
+
+    /// Parts of a concatenation
+    Rope left;
+    Rope right;
+
+    /// Characters at the start of a concatenation
+    char head[HEAD_SIZE];
+    std::size_t headLength;
+};
+
+Rope::Piece::~Piece()
+{
+    // Chains of concatenations can be much deeper than the stack, so pieces
+    // that are only referred to by this one are released iteratively rather
+    // than by their own destructors
+    if (!left.m_pPiece && !right.m_pPiece) {
+        return;
+    }
+
+    std::vector<std::shared_ptr<const Piece> > pending;
+    pending.push_back(std::move(left.m_pPiece));
+    pending.push_back(std::move(right.m_pPiece));
+    while (!pending.empty()) {
+        std::shared_ptr<const Piece> pPiece = std::move(pending.back());
+        pending.pop_back();
+        if (pPiece && pPiece.use_count() == 1) {
+            Piece & piece = const_cast<Piece &>(*pPiece);
+            pending.push_back(std::move(piece.left.m_pPiece));
+            pending.push_back(std::move(piece.right.m_pPiece));
+        }
+    }
+}
+
+Rope::Rope(const char * s)
+    : m_small(s)
+{
+    if (m_small.size() > SMALL_SIZE) {
+        m_pPiece = std::make_shared<Piece>(std::move(m_small));
+        m_small.clear();
+    }
+}
+
+Rope::Rope(const std::string & s)
+{
+    if (s.size() > SMALL_SIZE) {
+        m_pPiece = std::make_shared<Piece>(std::string(s));
+    } else {
+        m_small = s;
+    }
+}
+
+Rope::Rope(std::string && s)
+{
+    if (s.size() > SMALL_SIZE) {
+        m_pPiece = std::make_shared<Piece>(std::move(s));
+    } else {
+        m_small = std::move(s);
+    }
+}
+
+Rope::Rope(const std::shared_ptr<const Piece> & pPiece)
+    : m_pPiece(pPiece)
+{
+    // No further initialisation
+}
+
+Rope Rope::concat(const Rope & left, const Rope & right)
+{
+    if (left.empty()) {
+        return right;
+    } else if (right.empty()) {
+        return left;
+    }
+
+    const std::size_t length = left.size() + right.size();
+    if (length <= SMALL_SIZE) {
+        return Rope(left.m_small + right.m_small);
+    }
+
+    // Appending a short value to a concatenation that ends with a short value
+    // (or prepending one to a concatenation that begins with a short value)
+    // combines the two short values, which keeps chains of small additions
+    // from creating a piece per addition
+    if (!right.m_pPiece && left.m_pPiece && left.m_pPiece->isConcatenation() &&
+            !left.m_pPiece->right.m_pPiece && left.m_pPiece->right.size() + right.size() <= SMALL_SIZE) {
+        return Rope(std::make_shared<Piece>(left.m_pPiece->left,
+            Rope(left.m_pPiece->right.m_small + right.m_small)));
+    } else if (!left.m_pPiece && right.m_pPiece && right.m_pPiece->isConcatenation() &&
+            !right.m_pPiece->left.m_pPiece && left.size() + right.m_pPiece->left.size() <= SMALL_SIZE) {
+        return Rope(std::make_shared<Piece>(Rope(left.m_small + right.m_pPiece->left.m_small),
+            right.m_pPiece->right));
+    }
+
+    return Rope(std::make_shared<Piece>(left, right));
+}
+
+std::size_t Rope::size() const
+{
+    return m_pPiece ? m_pPiece->length : m_small.size();
+}
+
+std::string Rope::head() const
+{
+    if (!m_pPiece) {
+        return m_small.substr(0, HEAD_SIZE);
+    } else if (m_pPiece->isConcatenation()) {
+        return std::string(m_pPiece->head, m_pPiece->headLength);
+    }
+
+    return m_pPiece->text.substr(0, HEAD_SIZE);
+}
+
+std::string Rope::str() const
+{
+    if (!m_pPiece) {
+        return m_small;
+    } else if (!m_pPiece->isConcatenation()) {
+        return m_pPiece->text;
+    }
+
+    std::string s;
+    appendTo(s);
+    return s;
+}
+
+void Rope::appendTo(std::string & s) const
+{
+    s.reserve(s.size() + size());
+
+    // Parts are visited left to right, using a stack rather than recursion
+    std::vector<const Rope *> pending(1, this);
+    while (!pending.empty()) {
+        const Rope * pRope = pending.back();
+        pending.pop_back();
+        if (!pRope->m_pPiece) {
+            s.append(pRope->m_small);
+        } else if (!pRope->m_pPiece->isConcatenation()) {
+            s.append(pRope->m_pPiece->text);
+        } else {
+            pending.push_back(&pRope->m_pPiece->right);
+            pending.push_back(&pRope->m_pPiece->left);
+        }
+    }
+}
+
+void Rope::swap(Rope & other)
+{
+    m_small.swap(other.m_small);
+    m_pPiece.swap(other.m_pPiece);
+}
+
+bool Rope::operator==(const Rope & other) const
+{
+    // Pairs of parts that have the same length, and remain to be compared
+    std::vector<std::pair<const Rope *, const Rope *> > pending;
+    pending.push_back(std::make_pair(this, &other));
+    while (!pending.empty()) {
+        const Rope & lhs = *pending.back().first;
+        const Rope & rhs = *pending.back().second;
+        pending.pop_back();
+        if (lhs.size() != rhs.size()) {
+            return false;
+        } else if (!lhs.m_pPiece && !rhs.m_pPiece) {
+            if (lhs.m_small != rhs.m_small) {
+                return false;
+            }
+        } else if (lhs.m_pPiece == rhs.m_pPiece) {
+            continue;
+        } else if (lhs.head() != rhs.head()) {
+            return false;
+        } else if (lhs.m_pPiece && rhs.m_pPiece && lhs.m_pPiece->isConcatenation() &&
+                rhs.m_pPiece->isConcatenation() && lhs.m_pPiece->left.size() == rhs.m_pPiece->left.size()) {
+            pending.push_back(std::make_pair(&lhs.m_pPiece->right, &rhs.m_pPiece->right));
+            pending.push_back(std::make_pair(&lhs.m_pPiece->left, &rhs.m_pPiece->left));
+        } else if (lhs.str() != rhs.str()) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Rope::operator<(const Rope & other) const
+{
+    // Most values differ within the first few characters
+    const std::string lhsHead = head();
+    const std::string rhsHead = other.head();
+    const std::size_t common = std::min(lhsHead.size(), rhsHead.size());
+    const int result = lhsHead.compare(0, common, rhsHead, 0, common);
+    if (result != 0) {
+        return result < 0;
+    } else if (lhsHead.size() == size() && rhsHead.size() == other.size()) {
+        return size() < other.size();
+    }
+
+    return str() < other.str();
+}
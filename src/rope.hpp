@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+/**
+ * Immutable string value, as produced by evaluating a formula.
+ *
+ * Short values are stored inline, like a std::string. Longer values are kept
+ * in a buffer that is shared by every copy, so values can be passed from cell
+ * to cell without being copied. Concatenating two long values creates a node
+ * that refers to both of them, rather than copying either one, so a chain of
+ * concatenations across many cells takes linear time and space overall.
+ *
+ * The characters of a value are only gathered into a single std::string when
+ * str() is called, which is normally left until the value is displayed. The
+ * first HEAD_SIZE characters are always available without doing so, which is
+ * enough to tell whether most values are numbers.
+ *
+ * Copies may be read and destroyed on different threads.
+ */
+class Rope
+{
+public:
+    /// Values up to this length are stored inline, and concatenated by copying
+    static const std::size_t SMALL_SIZE = 64;
+
+    /// Number of characters available from head() without gathering the value
+    static const std::size_t HEAD_SIZE = 32;
+
+    Rope()
+    {
+        // No further initialisation
+    }
+
+    Rope(const char * s);
+
+    Rope(const std::string & s);
+
+    Rope(std::string && s);
+
+    /// Concatenate two values, without copying either of them if they are long
+    static Rope concat(const Rope & left, const Rope & right);
+
+    std::size_t size() const;
+
+    bool empty() const
+    {
+        return size() == 0;
+    }
+
+    /// Up to the first HEAD_SIZE characters of the value
+    std::string head() const;
+
+    /// Gather the value into a single string
+    std::string str() const;
+
+    /// Append the value to a string
+    void appendTo(std::string & s) const;
+
+    void swap(Rope & other);
+
+    /**
+     * Compare two values. Values that share storage are compared without
+     * reading it, so a value that was concatenated from the same parts as
+     * another is found to be equal in time proportional to the parts that
+     * differ.
+     */
+    bool operator==(const Rope & other) const;
+
+    bool operator!=(const Rope & other) const
+    {
+        return !(*this == other);
+    }
+
+    bool operator<(const Rope & other) const;
+
+private:
+    struct Piece;
+
+    explicit Rope(const std::shared_ptr<const Piece> & pPiece);
+
+    /// Value, if it is no longer than SMALL_SIZE
+    std::string m_small;
+
+    /// Shared storage for longer values
+    std::shared_ptr<const Piece> m_pPiece;
+};
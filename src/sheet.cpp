@@ -1,72 +1,1236 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "address.hpp"
+#include "ast.hpp"
 #include "cell.hpp"
+#include "cells.hpp"
+#include "dependency_graph.hpp"
 #include "formula.hpp"
+#include "functions.hpp"
+#include "journal.hpp"
+#include "lookup.hpp"
+#include "range_index.hpp"
 #include "sheet.hpp"
+#include "trace.hpp"
+
+/**
+ * Order in which the cells of a sheet were recalculated by a complete pass.
+ *
+ * Each step is either a single cell, or the first cell of a run that was
+ * evaluated as a batch, in which case it is followed by the other cells of
+ * the run. The plan is only valid while the slots of the sheet stay the same,
+ * i.e. until a cell is created or erased.
+ */
+struct EvaluationPlan
+{
+    struct Step
+    {
+        Cells::Slot slot;
+
+        // Number of cells in the run that begins with this step; one for a
+        // single cell, and zero for the remaining cells of a run
+        std::size_t count;
+    };
+
+    explicit EvaluationPlan(const Cells & cells)
+        : epoch(cells.getEpoch())
+        , edited(cells.getSlotCount(), false)
+    {
+        steps.reserve(cells.size());
+    }
+
+    /// Epoch of the cells when the plan was recorded
+    unsigned long epoch;
+
+    std::vector<Step> steps;
+
+    /// Slots whose formulas have been changed since the plan was recorded,
+    /// which may no longer have the same shape as the rest of their run
+    std::vector<bool> edited;
+};
+
+/**
+ * References between the cells of a sheet, as written in their formulas, for
+ * tracing precedents and dependents. Ranges are not expanded into individual
+ * references; cells within them are found through the sheet's RangeIndex.
+ * The graph is only valid while the slots of the sheet stay the same.
+ */
+struct TraceIndex
+{
+    explicit TraceIndex(unsigned long epoch)
+        : epoch(epoch)
+        , levelsFound(false)
+    {
+        // No further initialisation
+    }
+
+    /// Epoch of the cells when the graph was built
+    unsigned long epoch;
+
+    /// Direct references, by slot
+    DependencyGraph graph;
+
+    /// Slots whose formulas have been changed since the graph was built,
+    /// which may now refer to different cells
+    std::vector<Cells::Slot> edited;
+
+    /// Slots whose formulas refer to cells that have not been set, which are
+    /// missing from the graph; may include slots that have since been edited
+    std::vector<Cells::Slot> unresolved;
+
+    /// Length of the longest chain of precedents beneath each slot, counting
+    /// ranges; empty if the cells form a cycle
+    std::vector<unsigned int> levels;
+
+    /// Whether levels have been found for the current graph
+    bool levelsFound;
+};
 
 namespace
 {
+    /// Progress of each cell through a single recalculation pass
+    enum VisitState
+    {
+        VISIT_NONE = 0,
+        VISIT_STARTED,
+        VISIT_FINISHED
+    };
+
+    /// State shared by every cell visited during a single recalculation pass
+    struct RecalcContext
+    {
+        Cells & cells;
+        FormulaCompiler & compiler;
+        RecalcProgress & progress;
+
+        // Ranges read by each compiled formula, which are updated whenever a
+        // formula is compiled
+        RangeIndex & ranges;
+
+        // Tables read by lookup functions during this pass
+        LookupCache & lookups;
+
+        // Cells that the array of each cell spills into, which are updated
+        // whenever an array is stored
+        RangeIndex & spills;
+
+        // Visit state for each slot. This is kept outside of the cells, so that
+        // cells shared with another Sheet are only written when they change
+        std::vector<unsigned char> & visits;
+
+        // Order in which cells are recalculated by this pass
+        EvaluationPlan & recording;
+
+        bool profiling;
+
+        // Whether the area that any array spills into has changed during this
+        // pass, in which case cells read before the change may be out of date
+        bool spillsChanged;
+    };
+
+    /// Thrown to unwind a recalculation pass once it has been cancelled
+    struct RecalcCancelled
+    {
+    };
+
+    /// Passed to the evaluation callbacks for an individual cell
     struct SheetCallbackData
     {
-        Cells & cells;
-        int phase;
-    };
+        RecalcContext & context;
+
+        // Slot of the cell being evaluated, whose bindings resolve its
+        // references. The cell is looked up again whenever it is needed,
+        // because recalculating a precedent may copy its chunk of storage.
+        Cells::Slot slot;
+
+        // Slots of the cells read so far
+        std::vector<Cells::Slot> precedents;
+
+        // Inclusive time spent recalculating precedents of the cell; only
+        // maintained while profiling
+        std::uint64_t childNanos;
+    };
+
+    std::uint64_t recalculateDepthFirst(RecalcContext & context, Cells::Slot slot);
+
+    /// Value spilled from the array held by a cell into a cell within its area
+    Rope getSpilledValue(const Cells & cells, Cells::Slot slot, const Address & address)
+    {
+        const Address anchor = cells.getAddress(slot);
+        const Array & array = *cells[slot].array;
+        return array.values.getString(
+            std::size_t(address.row - anchor.row) * array.columns + (address.column - anchor.column));
+    }
+
+    /**
+     * Read a cell that has not been set, which may hold a value spilled from
+     * an array. The cell that holds the array is recalculated first, and is
+     * recorded as a precedent.
+     */
+    Rope readSpilled(SheetCallbackData * pCbData, const Address & address)
+    {
+        RecalcContext & context = pCbData->context;
+        if (context.spills.size() == 0) {
+            return "";
+        }
+
+        std::vector<RangeIndex::Owner> owners;
+        context.spills.findCovering(address, owners);
+        for (std::vector<RangeIndex::Owner>::const_iterator owner = owners.begin(); owner != owners.end(); owner++) {
+            pCbData->precedents.push_back(*owner);
+            pCbData->childNanos += recalculateDepthFirst(context, *owner);
+        }
+
+        // Recalculating an array may have changed the area it spills into
+        owners.clear();
+        context.spills.findCovering(address, owners);
+        return owners.empty() ? Rope() : getSpilledValue(context.cells, owners.front(), address);
+    }
+
+    /// Orders the cells of a range by address
+    bool addressOrder(const RangeCell & lhs, const RangeCell & rhs)
+    {
+        return lhs.address < rhs.address;
+    }
+
+    /**
+     * Append the values spilled into a range by arrays, other than those of
+     * the cells that hold them, which are read like any other cell. The cells
+     * that hold the arrays are recalculated first, and are recorded as
+     * precedents, as they may lie outside of the range.
+     */
+    void readSpilledRange(SheetCallbackData * pCbData, const Range & range, std::vector<RangeCell> & cells)
+    {
+        RecalcContext & context = pCbData->context;
+        std::vector<RangeIndex::Owner> owners;
+        context.spills.findIntersecting(range, owners);
+        if (owners.empty()) {
+            return;
+        }
+
+        for (std::vector<RangeIndex::Owner>::const_iterator owner = owners.begin(); owner != owners.end(); owner++) {
+            pCbData->precedents.push_back(*owner);
+            pCbData->childNanos += recalculateDepthFirst(context, *owner);
+        }
+
+        owners.clear();
+        context.spills.findIntersecting(range, owners);
+        for (std::vector<RangeIndex::Owner>::const_iterator owner = owners.begin(); owner != owners.end(); owner++) {
+            const Address anchor = context.cells.getAddress(*owner);
+            const Range & area = context.spills.get(*owner).front();
+            const unsigned int lastColumn = std::min(area.last.column, range.last.column);
+            const unsigned int lastRow = std::min(area.last.row, range.last.row);
+            for (unsigned int column = std::max(area.first.column, range.first.column); column <= lastColumn; column++) {
+                for (unsigned int row = std::max(area.first.row, range.first.row); row <= lastRow; row++) {
+                    const Address address(column, row);
+                    if (!(address == anchor)) {
+                        const RangeCell cell = {address, getSpilledValue(context.cells, *owner, address)};
+                        cells.push_back(cell);
+                    }
+                }
+            }
+        }
+    }
+
+    std::uint64_t nowNanos()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    Rope evalAddressCallback(const Address & address, std::size_t reference, void * pData)
+    {
+        SheetCallbackData *pCbData = static_cast<SheetCallbackData*>(pData);
+        const Cells::Slot slot = pCbData->context.cells[pCbData->slot].bindings[reference];
+        if (slot == Cells::npos) {
+            return readSpilled(pCbData, address);
+        }
+
+        pCbData->precedents.push_back(slot);
+        pCbData->childNanos += recalculateDepthFirst(pCbData->context, slot);
+        return pCbData->context.cells[slot].value;
+    }
+
+    /**
+     * Read the cells within a range, recalculating each one first. The cells
+     * are not recorded as precedents, so that a range over many cells costs
+     * no more to keep track of than a single reference; the range itself is
+     * held by the RangeIndex instead. Values spilled into the range by arrays
+     * are read as well.
+     */
+    void evalRangeCallback(const Range & range, std::size_t, std::vector<RangeCell> & cells, void * pData)
+    {
+        SheetCallbackData *pCbData = static_cast<SheetCallbackData*>(pData);
+        RecalcContext & context = pCbData->context;
+        const std::size_t begin = cells.size();
+
+        // Cells are indexed by column and then row, so each column of a range
+        // is a contiguous run of cells
+        const Cells::Index & index = context.cells.getIndex();
+        for (unsigned int column = range.first.column; column <= range.last.column; column++) {
+            Cells::Index::const_iterator itr = index.lower_bound(Address(column, range.first.row));
+            const Cells::Index::const_iterator end = index.upper_bound(Address(column, range.last.row));
+            for (; itr != end; itr++) {
+                pCbData->childNanos += recalculateDepthFirst(context, itr->second);
+                const RangeCell cell = {itr->first, context.cells[itr->second].value};
+                cells.push_back(cell);
+            }
+        }
+
+        const std::size_t set = cells.size();
+        if (context.spills.size() > 0) {
+            readSpilledRange(pCbData, range, cells);
+        }
+
+        if (cells.size() > set) {
+            std::sort(cells.begin() + begin, cells.end(), addressOrder);
+        }
+    }
+
+    /**
+     * Resolve the slot of every cell referenced by a compiled formula.
+     */
+    void resolveBindings(const Cells & cells, const Formula & formula, std::vector<Cells::Slot> & bindings)
+    {
+        const std::vector<Address> & references = formula.getReferences();
+        bindings.resize(references.size());
+        for (size_t i = 0; i < references.size(); i++) {
+            bindings[i] = cells.find(references[i]);
+        }
+    }
+
+    /// Call a function without a cache of lookup tables, as when evaluating a
+    /// batch or a sweep, whose ranges are not read through a RecalcContext
+    Rope evalFunctionCallback(const std::string & name, const Formula::Arguments & arguments, void *)
+    {
+        return callFunction(name, arguments, nullptr);
+    }
+
+    /// Call a function on behalf of an individual cell, whose lookups can use
+    /// the tables read earlier in the same pass
+    Rope evalCellFunctionCallback(const std::string & name, const Formula::Arguments & arguments, void * pData)
+    {
+        SheetCallbackData *pCbData = static_cast<SheetCallbackData*>(pData);
+        return callFunction(name, arguments, &pCbData->context.lookups);
+    }
+
+    /// Call a function for an array on behalf of an individual cell
+    bool evalCellArrayFunctionCallback(const std::string & name, const Formula::Arguments & arguments, void * pData,
+        Array & result)
+    {
+        SheetCallbackData *pCbData = static_cast<SheetCallbackData*>(pData);
+        return callArrayFunction(name, arguments, &pCbData->context.lookups, result);
+    }
+
+    /**
+     * Compile the formula of a cell, if it has not been compiled since it was
+     * set, and resolve its references if cells have been created or erased.
+     */
+    void prepare(RecalcContext & context, Cells::Slot slot)
+    {
+        Cells & cells = context.cells;
+
+        // Formulas are only compiled the first time they are needed after
+        // being set, rather than on every recalculation pass
+        if (!cells[slot].compiled) {
+            const Address address = cells.getAddress(slot);
+            TraceSpan span("parse", address);
+            Cell & cell = cells.annotate(slot);
+            cell.compiled = std::make_shared<Formula>(context.compiler.compile(cell.formula));
+            cell.shape = cell.compiled->getShape(address);
+            context.ranges.set(slot, cell.compiled->getRanges());
+        } else if (cells[slot].shape.empty()) {
+            // Shapes of formulas that have moved are left until they are
+            // needed, so that a series of insertions only works them out once
+            cells.annotate(slot).shape = cells[slot].compiled->getShape(cells.getAddress(slot));
+        }
+
+        // References only need to be resolved again once cells have been
+        // created or erased. Bindings in shared storage are left alone if
+        // they are still correct, at the cost of checking them on each pass.
+        if (cells[slot].bindingEpoch != cells.getEpoch()) {
+            std::vector<Cells::Slot> bindings;
+            resolveBindings(cells, *cells[slot].compiled, bindings);
+            if (!cells.isShared(slot) || bindings != cells[slot].bindings) {
+                Cell & cell = cells.mutate(slot);
+                cell.bindings.swap(bindings);
+                cell.bindingEpoch = cells.getEpoch();
+            }
+        }
+    }
+
+    /**
+     * Store the result of evaluating a cell. The cell is only modified if its
+     * value or precedents have changed.
+     *
+     * @param   precedents  Slots of the cells that were read, in any order
+     */
+    void store(Cells & cells, Cells::Slot slot, Rope & value, std::vector<Cells::Slot> & precedents)
+    {
+        std::sort(precedents.begin(), precedents.end());
+        precedents.erase(std::unique(precedents.begin(), precedents.end()), precedents.end());
+        if (precedents != cells[slot].precedents) {
+            cells.mutate(slot).precedents.swap(precedents);
+        }
+
+        if (value != cells[slot].value) {
+            cells.mutate(slot).value.swap(value);
+        }
+    }
+
+    /// Returns true if two arrays, either of which may be null, hold the same values
+    bool sameArray(const Array * pLhs, const Array * pRhs)
+    {
+        if (!pLhs || !pRhs) {
+            return pLhs == pRhs;
+        } else if (pLhs->rows != pRhs->rows || pLhs->columns != pRhs->columns) {
+            return false;
+        } else if (pLhs->values.numeric && pRhs->values.numeric) {
+            return pLhs->values.numbers == pRhs->values.numbers;
+        }
+
+        for (std::size_t i = 0; i < pLhs->values.size(); i++) {
+            if (pLhs->values.getString(i) != pRhs->values.getString(i)) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    /**
+     * Find the cells that an array spills into, which are the cells below and
+     * to the right of the cell that holds it, up to the size of the array.
+     *
+     * @returns false if the array does not fit on the sheet
+     */
+    bool getSpillArea(const Address & anchor, const Array & array, Range & area)
+    {
+        const unsigned int last = std::numeric_limits<unsigned int>::max();
+        if (array.columns - 1 > last - anchor.column || array.rows - 1 > last - anchor.row) {
+            return false;
+        }
+
+        area = Range(anchor, Address(anchor.column + static_cast<unsigned int>(array.columns - 1),
+            anchor.row + static_cast<unsigned int>(array.rows - 1)));
+        return true;
+    }
+
+    /**
+     * Check whether an array can spill from the cell that holds it. An array
+     * cannot overwrite cells that have been set, or the area of another array
+     * that spilled first.
+     *
+     * Another array can only have spilled into the area since the last pass
+     * if the area has changed, as that array would have found this one, so
+     * arrays whose areas are unchanged are not checked against the others.
+     */
+    bool canSpill(RecalcContext & context, Cells::Slot slot, const Array & array, Range & area)
+    {
+        const Cells & cells = context.cells;
+        if (!getSpillArea(cells.getAddress(slot), array, area)) {
+            return false;
+        }
+
+        const Cells::Index & index = cells.getIndex();
+        for (unsigned int column = area.first.column; column <= area.last.column; column++) {
+            Cells::Index::const_iterator itr = index.lower_bound(Address(column, area.first.row));
+            const Cells::Index::const_iterator end = index.upper_bound(Address(column, area.last.row));
+            for (; itr != end; itr++) {
+                if (itr->second != slot) {
+                    return false;
+                }
+            }
+        }
+
+        const std::vector<Range> & previous = context.spills.get(slot);
+        if (previous.size() == 1 && previous.front() == area) {
+            return true;
+        }
+
+        std::vector<RangeIndex::Owner> owners;
+        context.spills.findIntersecting(area, owners);
+        return owners.empty() || (owners.size() == 1 && owners.front() == slot);
+    }
+
+    /**
+     * Store the array that a cell evaluated to, or null if it did not. The
+     * cell is only modified if its array has changed.
+     *
+     * @param   area  Cells that the array spills into
+     */
+    void storeArray(RecalcContext & context, Cells::Slot slot, const std::shared_ptr<const Array> & pArray,
+        const Range & area)
+    {
+        Cells & cells = context.cells;
+        if (!sameArray(cells[slot].array.get(), pArray.get())) {
+            cells.mutate(slot).array = pArray;
+        }
+
+        // Arrays of a single value spill into no other cells, so are not indexed
+        std::vector<Range> ranges;
+        if (pArray && pArray->values.size() > 1) {
+            ranges.push_back(area);
+        }
+
+        if (ranges != context.spills.get(slot)) {
+            context.spills.set(slot, ranges);
+            context.spillsChanged = true;
+        }
+    }
+
+    /**
+     * Recalculate a cell, after recursively recalculating its precedents.
+     *
+     * A cell is only modified (and its storage copied, if it is shared with
+     * another Sheet) when its formula must be compiled, its bindings or
+     * precedents change, or its value changes.
+     *
+     * @returns inclusive time spent, in nanoseconds, if profiling is enabled
+     *          and the cell was recalculated by this call; zero otherwise
+     */
+    std::uint64_t recalculateDepthFirst(RecalcContext & context, Cells::Slot slot)
+    {
+        // Check if cell has been discovered in this recalculation pass
+        if (context.visits[slot] != VISIT_NONE) {
+            // If it has been discovered, and has also been processed, we're done
+            if (context.visits[slot] == VISIT_FINISHED) {
+                // Forward edge (= already recalculated in this pass)
+                return 0;
+            }
+            // Otherwise, it must be a back edge (= cycle)
+            throw std::runtime_error("Cycle detected.");
+        }
+
+        if (context.progress.cancelled.load(std::memory_order_relaxed)) {
+            throw RecalcCancelled();
+        }
+
+        const std::uint64_t start = context.profiling ? nowNanos() : 0;
+
+        Cells & cells = context.cells;
+        context.visits[slot] = VISIT_STARTED;
+        prepare(context, slot);
+
+        // Evaluate the value of the cell, recursively recalculating the values
+        // of other cells whose values it depends on. The formula is held here,
+        // in case the storage that it was found in is copied.
+        const std::shared_ptr<Formula> compiled = cells[slot].compiled;
+        SheetCallbackData cbData = {context, slot, std::vector<Cells::Slot>(), 0};
+        Rope value;
+        std::shared_ptr<Array> pArray;
+        Range area(cells.getAddress(slot), cells.getAddress(slot));
+        {
+            TraceSpan span("eval", cells.getAddress(slot));
+            Array array;
+            if (compiled->evaluateArray(
+                    evalAddressCallback,
+                    evalRangeCallback,
+                    evalCellFunctionCallback,
+                    evalCellArrayFunctionCallback,
+                    &cbData,
+                    array)) {
+                pArray = std::make_shared<Array>(std::move(array));
+                if (canSpill(context, slot, *pArray, area)) {
+                    value = pArray->values.getString(0);
+                } else {
+                    // Arrays that would overwrite other cells are errors
+                    value = "ERROR";
+                    pArray.reset();
+                }
+            } else {
+                value = compiled->evaluate(
+                    evalAddressCallback,
+                    evalRangeCallback,
+                    evalCellFunctionCallback,
+                    &cbData);
+            }
+        }
+
+        store(cells, slot, value, cbData.precedents);
+        storeArray(context, slot, pArray, area);
+
+        context.visits[slot] = VISIT_FINISHED;
+        context.progress.done.fetch_add(1, std::memory_order_relaxed);
+
+        const EvaluationPlan::Step step = {slot, 1};
+        context.recording.steps.push_back(step);
+
+        if (!context.profiling) {
+            return 0;
+        }
+
+        const std::uint64_t inclusive = nowNanos() - start;
+        CellStats & stats = cells.mutate(slot).stats;
+        stats.evaluations++;
+        stats.inclusiveNanos += inclusive;
+        stats.exclusiveNanos += inclusive - std::min(inclusive, cbData.childNanos);
+        return inclusive;
+    }
+
+    /// Runs shorter than this are recalculated one cell at a time
+    const std::size_t MIN_RUN_LENGTH = 8;
+
+    /// Longer runs are split into batches of this many cells
+    const std::size_t MAX_RUN_LENGTH = 4096;
+
+    /// Most passes made by a single recalculation, while the areas of arrays
+    /// keep changing
+    const int MAX_SPILL_PASSES = 4;
+
+    /// Passed to the lane evaluation callback for a run of cells
+    struct RunCallbackData
+    {
+        const Cells & cells;
+
+        // Slots of the cells in the run, one per lane
+        const std::vector<Cells::Slot> & run;
+
+        // Values of each reference across the run, filled in on demand
+        std::vector<Lanes> & references;
+
+        std::vector<bool> & ready;
+    };
+
+    /**
+     * Gather the values referenced by every cell in a run into lanes, which
+     * hold the values as numbers wherever possible.
+     */
+    const Lanes & evalRunAddressCallback(const Address &, std::size_t reference, void * pData)
+    {
+        RunCallbackData *pCbData = static_cast<RunCallbackData*>(pData);
+        if (!pCbData->ready[reference]) {
+            const Cells & cells = pCbData->cells;
+            std::vector<Rope> values(pCbData->run.size());
+            for (std::size_t lane = 0; lane < values.size(); lane++) {
+                const Cells::Slot slot = cells[pCbData->run[lane]].bindings[reference];
+                if (slot != Cells::npos) {
+                    values[lane] = cells[slot].value;
+                }
+            }
+
+            pCbData->references[reference].setStrings(values);
+            pCbData->ready[reference] = true;
+        }
+
+        return pCbData->references[reference];
+    }
+
+    void evalRunRangeCallback(const Range &, std::size_t, std::size_t, std::vector<RangeCell> &, void *)
+    {
+        throw std::logic_error("Formulas that read ranges are not evaluated in batches.");
+    }
+
+    /**
+     * Recalculate a run of prepared cells that have the same shape. The cells
+     * are evaluated together, one lane per cell, once all of their precedents
+     * have been recalculated. Runs that are short, whose cells refer to one
+     * another or call functions, or that are recalculated while profiling,
+     * are instead recalculated one cell at a time.
+     */
+    void recalculateBatch(RecalcContext & context, const std::vector<Cells::Slot> & run)
+    {
+        Cells & cells = context.cells;
+
+        // Functions may not evaluate all of their arguments, and ranges are
+        // evaluated as arrays, both of which are only handled by recalculating
+        // each cell separately. Cells that refer to other cells in the run, or
+        // to cells that may hold values spilled from arrays, must also be
+        // recalculated in order.
+        const std::string & shape = cells[run.front()].shape;
+        bool batch = !context.profiling && run.size() >= MIN_RUN_LENGTH && shape.find("fn{") == std::string::npos &&
+            shape.find("]:R[") == std::string::npos;
+        std::vector<Cells::Slot> sorted(run);
+        std::sort(sorted.begin(), sorted.end());
+        for (std::size_t lane = 0; batch && lane < run.size(); lane++) {
+            const std::vector<Cells::Slot> & bindings = cells[run[lane]].bindings;
+            for (std::vector<Cells::Slot>::const_iterator binding = bindings.begin(); binding != bindings.end(); binding++) {
+                if (std::binary_search(sorted.begin(), sorted.end(), *binding) ||
+                        (*binding == Cells::npos && context.spills.size() > 0)) {
+                    batch = false;
+                    break;
+                }
+            }
+        }
+
+        // Recalculate precedents first. If that reaches any cell in the run,
+        // the remaining cells are recalculated one at a time.
+        for (std::size_t lane = 0; batch && lane < run.size(); lane++) {
+            const std::vector<Cells::Slot> bindings = cells[run[lane]].bindings;
+            for (std::vector<Cells::Slot>::const_iterator binding = bindings.begin(); binding != bindings.end(); binding++) {
+                if (*binding != Cells::npos) {
+                    recalculateDepthFirst(context, *binding);
+                }
+            }
+        }
+
+        for (std::size_t lane = 0; batch && lane < run.size(); lane++) {
+            batch = context.visits[run[lane]] == VISIT_NONE;
+        }
+
+        if (!batch) {
+            for (std::size_t lane = 0; lane < run.size(); lane++) {
+                recalculateDepthFirst(context, run[lane]);
+            }
+            return;
+        }
+
+        if (context.progress.cancelled.load(std::memory_order_relaxed)) {
+            throw RecalcCancelled();
+        }
+
+        // Every cell in the run has the same shape, so the formula of the
+        // first cell is evaluated with the references of each cell in turn
+        const std::shared_ptr<Formula> compiled = cells[run.front()].compiled;
+        const std::size_t referenceCount = compiled->getReferences().size();
+        std::vector<Lanes> references(referenceCount);
+        std::vector<bool> ready(referenceCount, false);
+        RunCallbackData cbData = {cells, run, references, ready};
+        Lanes lanes;
+        {
+            TraceSpan span("eval", cells.getAddress(run.front()));
+            compiled->evaluateLanes(
+                run.size(),
+                evalRunAddressCallback,
+                evalRunRangeCallback,
+                evalFunctionCallback,
+                &cbData,
+                lanes);
+        }
+
+        for (std::size_t lane = 0; lane < run.size(); lane++) {
+            const Cells::Slot slot = run[lane];
+            Rope value = lanes.getString(lane);
+            std::vector<Cells::Slot> precedents(cells[slot].bindings);
+            precedents.erase(std::remove(precedents.begin(), precedents.end(), Cells::npos), precedents.end());
+            store(cells, slot, value, precedents);
+            context.visits[slot] = VISIT_FINISHED;
+
+            const EvaluationPlan::Step step = {slot, lane == 0 ? run.size() : 0};
+            context.recording.steps.push_back(step);
+        }
+
+        context.progress.done.fetch_add(run.size(), std::memory_order_relaxed);
+    }
+
+    /**
+     * Recalculate every cell in the order recorded by an earlier pass, with
+     * the same runs. Cells whose precedents have changed since then are
+     * still recalculated after their precedents, since those are reached
+     * depth-first if they have not yet been recalculated.
+     */
+    void recalculatePlanned(RecalcContext & context, const EvaluationPlan & plan)
+    {
+        Cells & cells = context.cells;
+        std::vector<Cells::Slot> run;
+        for (std::size_t position = 0; position < plan.steps.size(); ) {
+            const EvaluationPlan::Step & step = plan.steps[position];
+            if (step.count <= 1) {
+                recalculateDepthFirst(context, step.slot);
+                position++;
+                cells.trim();
+                continue;
+            }
+
+            // Cells in the run must be prepared, as their formulas may have
+            // been changed or paged out. A run that no longer has the same
+            // shape throughout is recalculated one cell at a time.
+            run.clear();
+            bool edited = false;
+            for (std::size_t lane = 0; lane < step.count; lane++) {
+                const Cells::Slot slot = plan.steps[position + lane].slot;
+                prepare(context, slot);
+                edited = edited || plan.edited[slot];
+                run.push_back(slot);
+            }
+
+            bool same = true;
+            for (std::size_t lane = 1; edited && same && lane < run.size(); lane++) {
+                same = cells[run[lane]].shape == cells[run.front()].shape;
+            }
+
+            if (same) {
+                recalculateBatch(context, run);
+            } else {
+                for (std::size_t lane = 0; lane < run.size(); lane++) {
+                    recalculateDepthFirst(context, run[lane]);
+                }
+            }
+
+            position += step.count;
+            cells.trim();
+        }
+    }
+
+    /**
+     * Recalculate the cells at a position in the order of a pass. Cells that
+     * have the same shape in consecutive rows of a column (e.g. a formula that
+     * has been filled down) and are next to each other in the order are
+     * recalculated together, using recalculateBatch().
+     *
+     * @returns number of cells in the order that were visited
+     */
+    std::size_t recalculateRun(RecalcContext & context, const std::vector<Cells::Slot> & order,
+            std::size_t position)
+    {
+        Cells & cells = context.cells;
+        if (context.profiling || context.visits[order[position]] != VISIT_NONE) {
+            recalculateDepthFirst(context, order[position]);
+            return 1;
+        }
+
+        std::vector<Cells::Slot> run;
+        Address previous = cells.getAddress(order[position]);
+        for (; position < order.size() && run.size() < MAX_RUN_LENGTH; position++) {
+            const Cells::Slot slot = order[position];
+            const Address address = cells.getAddress(slot);
+            if (!run.empty() && (address.column != previous.column || address.row != previous.row + 1)) {
+                break;
+            } else if (context.visits[slot] != VISIT_NONE) {
+                break;
+            }
+
+            prepare(context, slot);
+            if (!run.empty() && cells[slot].shape != cells[run.front()].shape) {
+                break;
+            }
+
+            run.push_back(slot);
+            previous = address;
+        }
+
+        recalculateBatch(context, run);
+        return run.size();
+    }
+
+    /// State shared by every cell evaluated during a sweep
+    struct SweepContext
+    {
+        const Cells & cells;
+
+        // Number of lanes
+        std::size_t count;
+
+        // Values of each cell across all lanes, once it is ready
+        std::vector<Lanes> & lanes;
+
+        std::vector<bool> & ready;
+
+        // Lanes for references to cells that are not set
+        const Lanes & blank;
+    };
+
+    /// Passed to the lane evaluation callback for an individual cell
+    struct SweepCallbackData
+    {
+        SweepContext & context;
+        Cells::Slot slot;
+    };
+
+    /**
+     * Retrieve the lanes of a referenced cell. Cells that do not depend on the
+     * inputs have the same value in every lane, and are filled in on demand.
+     */
+    const Lanes & evalAddressLanesCallback(const Address &, std::size_t reference, void * pData)
+    {
+        SweepCallbackData *pCbData = static_cast<SweepCallbackData*>(pData);
+        SweepContext & context = pCbData->context;
+        const Cells::Slot slot = context.cells[pCbData->slot].bindings[reference];
+        if (slot == Cells::npos) {
+            return context.blank;
+        }
+
+        if (!context.ready[slot]) {
+            context.lanes[slot].setStrings(std::vector<Rope>(context.count, context.cells[slot].value));
+            context.ready[slot] = true;
+        }
+
+        return context.lanes[slot];
+    }
+
+    /**
+     * Read the cells within a range, as seen by a single lane. Cells that
+     * depend on the inputs have already been evaluated for every lane.
+     */
+    void evalRangeLanesCallback(const Range & range, std::size_t, std::size_t lane, std::vector<RangeCell> & cells,
+            void * pData)
+    {
+        SweepCallbackData *pCbData = static_cast<SweepCallbackData*>(pData);
+        SweepContext & context = pCbData->context;
+        const Cells::Index & index = context.cells.getIndex();
+        for (unsigned int column = range.first.column; column <= range.last.column; column++) {
+            Cells::Index::const_iterator itr = index.lower_bound(Address(column, range.first.row));
+            const Cells::Index::const_iterator end = index.upper_bound(Address(column, range.last.row));
+            for (; itr != end; itr++) {
+                const RangeCell cell = {itr->first, context.ready[itr->second] ?
+                    context.lanes[itr->second].getString(lane) : context.cells[itr->second].value};
+                cells.push_back(cell);
+            }
+        }
+    }
+
+    /**
+     * Append the cells needed to evaluate a cell to a sweep plan, followed by
+     * the cell itself. Only cells that depend on the inputs are included.
+     */
+    void planSweep(const Cells & cells, const RangeIndex & ranges, const std::vector<bool> & affected,
+            Cells::Slot slot, std::vector<unsigned char> & visits, std::vector<Cells::Slot> & plan)
+    {
+        if (visits[slot] == VISIT_FINISHED) {
+            return;
+        } else if (visits[slot] == VISIT_STARTED) {
+            throw std::runtime_error("Cycle detected.");
+        }
+
+        visits[slot] = VISIT_STARTED;
+        const std::vector<Cells::Slot> & bindings = cells[slot].bindings;
+        for (std::vector<Cells::Slot>::const_iterator itr = bindings.begin(); itr != bindings.end(); itr++) {
+            if (*itr != Cells::npos && affected[*itr]) {
+                planSweep(cells, ranges, affected, *itr, visits, plan);
+            }
+        }
+
+        const std::vector<Range> & read = ranges.get(slot);
+        const Cells::Index & index = cells.getIndex();
+        for (std::vector<Range>::const_iterator range = read.begin(); range != read.end(); range++) {
+            for (unsigned int column = range->first.column; column <= range->last.column; column++) {
+                Cells::Index::const_iterator itr = index.lower_bound(Address(column, range->first.row));
+                const Cells::Index::const_iterator end = index.upper_bound(Address(column, range->last.row));
+                for (; itr != end; itr++) {
+                    if (affected[itr->second]) {
+                        planSweep(cells, ranges, affected, itr->second, visits, plan);
+                    }
+                }
+            }
+        }
+
+        visits[slot] = VISIT_FINISHED;
+        plan.push_back(slot);
+    }
+
+    /**
+     * Append the slots of the cells that have been set within a range, in
+     * address order.
+     */
+    void findCellsInRange(const Cells & cells, const Range & range, std::vector<Cells::Slot> & slots)
+    {
+        const Cells::Index & index = cells.getIndex();
+        for (unsigned int column = range.first.column; column <= range.last.column; column++) {
+            Cells::Index::const_iterator itr = index.lower_bound(Address(column, range.first.row));
+            const Cells::Index::const_iterator end = index.upper_bound(Address(column, range.last.row));
+            for (; itr != end; itr++) {
+                slots.push_back(itr->second);
+            }
+        }
+    }
+
+    /**
+     * Find the slots of the cells that the formula of a cell refers to, and
+     * index the ranges that it reads. Bindings are used if they are current,
+     * and formulas that have not been compiled are compiled without being
+     * stored. A formula that cannot be compiled refers to no cells.
+     *
+     * @returns true if the formula also refers to cells that have not been set
+     */
+    bool findReferences(const Cells & cells, FormulaCompiler & compiler, RangeIndex & ranges, Cells::Slot slot,
+            std::vector<Cells::Slot> & references)
+    {
+        references.clear();
+
+        std::shared_ptr<Formula> compiled = cells[slot].compiled;
+        if (compiled && cells[slot].bindingEpoch == cells.getEpoch()) {
+            references = cells[slot].bindings;
+        } else {
+            try {
+                if (!compiled) {
+                    compiled = std::make_shared<Formula>(compiler.compile(cells[slot].formula));
+                }
+            } catch (const std::runtime_error &) {
+                ranges.erase(slot);
+                return false;
+            }
+
+            resolveBindings(cells, *compiled, references);
+        }
+
+        ranges.set(slot, compiled->getRanges());
+        const std::size_t count = references.size();
+        references.erase(std::remove(references.begin(), references.end(), Cells::npos), references.end());
+        return references.size() != count;
+    }
+
+    /// Appends the neighbours of a cell in one direction of a TraceIndex
+    typedef void (*TraceNeighbours)(const Cells &, const RangeIndex &, const DependencyGraph &, Cells::Slot,
+        std::vector<Cells::Slot> &);
+
+    /**
+     * Append the slots of the cells that a cell refers to, including the
+     * cells within the ranges that it reads.
+     */
+    void tracePrecedents(const Cells & cells, const RangeIndex & ranges, const DependencyGraph & graph,
+            Cells::Slot slot, std::vector<Cells::Slot> & slots)
+    {
+        const DependencyGraph::Nodes precedents = graph.getPrecedents(slot);
+        slots.insert(slots.end(), precedents.begin, precedents.end);
+
+        const std::vector<Range> & read = ranges.get(slot);
+        for (std::vector<Range>::const_iterator itr = read.begin(); itr != read.end(); itr++) {
+            findCellsInRange(cells, *itr, slots);
+        }
+    }
+
+    /**
+     * Append the slots of the cells that refer to a cell, including the cells
+     * that read a range containing it.
+     */
+    void traceDependents(const Cells & cells, const RangeIndex & ranges, const DependencyGraph & graph,
+            Cells::Slot slot, std::vector<Cells::Slot> & slots)
+    {
+        const DependencyGraph::Nodes dependents = graph.getDependents(slot);
+        slots.insert(slots.end(), dependents.begin, dependents.end);
+        ranges.findCovering(cells.getAddress(slot), slots);
+    }
+
+    /**
+     * Find the cells reached from the cells within a range, in one direction.
+     *
+     * @returns addresses of the cells reached, in address order
+     */
+    std::vector<Address> trace(const Cells & cells, const RangeIndex & ranges, const DependencyGraph & graph,
+            const Range & range, bool transitive, TraceNeighbours neighbours)
+    {
+        std::vector<Cells::Slot> pending;
+        findCellsInRange(cells, range, pending);
+
+        std::vector<Cells::Slot> slots;
+        std::vector<Cells::Slot> found;
+        if (!transitive) {
+            // Direct queries are small, and are answered without marking
+            // cells across the whole sheet
+            for (std::vector<Cells::Slot>::const_iterator itr = pending.begin(); itr != pending.end(); itr++) {
+                neighbours(cells, ranges, graph, *itr, slots);
+            }
+
+            std::sort(slots.begin(), slots.end());
+            slots.erase(std::unique(slots.begin(), slots.end()), slots.end());
+            pending.clear();
+        }
+
+        std::vector<bool> reached(pending.empty() ? 0 : cells.getSlotCount(), false);
+        while (!pending.empty()) {
+            const Cells::Slot slot = pending.back();
+            pending.pop_back();
+
+            found.clear();
+            neighbours(cells, ranges, graph, slot, found);
+            for (std::vector<Cells::Slot>::const_iterator itr = found.begin(); itr != found.end(); itr++) {
+                if (!reached[*itr]) {
+                    reached[*itr] = true;
+                    slots.push_back(*itr);
+                    pending.push_back(*itr);
+                }
+            }
+        }
+
+        // Addresses are sorted as integers, which keeps the comparisons
+        // inline when a query reaches most of a large sheet
+        std::vector<std::uint64_t> keys;
+        keys.reserve(slots.size());
+        for (std::vector<Cells::Slot>::const_iterator itr = slots.begin(); itr != slots.end(); itr++) {
+            const Address & address = cells.getAddress(*itr);
+            keys.push_back(std::uint64_t(address.column) << 32 | address.row);
+        }
+
+        std::sort(keys.begin(), keys.end());
+
+        std::vector<Address> addresses;
+        addresses.reserve(keys.size());
+        for (std::vector<std::uint64_t>::const_iterator itr = keys.begin(); itr != keys.end(); itr++) {
+            addresses.push_back(Address(static_cast<unsigned int>(*itr >> 32), static_cast<unsigned int>(*itr)));
+        }
+
+        return addresses;
+    }
+
+    /**
+     * Number each cell by the length of the longest chain of precedents
+     * beneath it, so that every cell is numbered higher than the cells it
+     * depends on. Cells are numbered in topological order, starting from the
+     * cells that have no precedents.
+     *
+     * @returns false, leaving levels empty, if the cells form a cycle
+     */
+    bool findLevels(const Cells & cells, const RangeIndex & ranges, const DependencyGraph & graph,
+            std::vector<unsigned int> & levels)
+    {
+        const Cells::Slot slotCount = cells.getSlotCount();
+
+        // Count the precedents of each cell, the same way that they will be
+        // found again below: once per reference, and once per cell that reads
+        // a range containing it
+        std::vector<std::size_t> remaining(slotCount, 0);
+        std::vector<Cells::Slot> within;
+        for (Cells::Slot slot = 0; slot < slotCount; slot++) {
+            const DependencyGraph::Nodes precedents = graph.getPrecedents(slot);
+            remaining[slot] = std::size_t(precedents.end - precedents.begin);
+
+            const std::vector<Range> & read = ranges.get(slot);
+            if (!read.empty()) {
+                within.clear();
+                for (std::vector<Range>::const_iterator itr = read.begin(); itr != read.end(); itr++) {
+                    findCellsInRange(cells, *itr, within);
+                }
+                std::sort(within.begin(), within.end());
+                remaining[slot] += std::size_t(std::unique(within.begin(), within.end()) - within.begin());
+            }
+        }
+
+        levels.assign(slotCount, 0);
+        std::vector<Cells::Slot> ready;
+        for (Cells::Slot slot = 0; slot < slotCount; slot++) {
+            if (cells.isUsed(slot) && remaining[slot] == 0) {
+                ready.push_back(slot);
+            }
+        }
+
+        std::size_t numbered = 0;
+        std::vector<Cells::Slot> dependents;
+        while (!ready.empty()) {
+            const Cells::Slot slot = ready.back();
+            ready.pop_back();
+            numbered++;
+
+            dependents.clear();
+            traceDependents(cells, ranges, graph, slot, dependents);
+            for (std::vector<Cells::Slot>::const_iterator itr = dependents.begin(); itr != dependents.end(); itr++) {
+                levels[*itr] = std::max(levels[*itr], levels[slot] + 1);
+                if (--remaining[*itr] == 0) {
+                    ready.push_back(*itr);
+                }
+            }
+        }
+
+        if (numbered != cells.size()) {
+            levels.clear();
+            return false;
+        }
+
+        return true;
+    }
+
+    /// Rows or columns that are being inserted or deleted
+    struct Shift
+    {
+        /// True for columns, false for rows
+        bool columns;
+
+        /// First row or column inserted or deleted
+        unsigned int position;
 
-    void recalculateDepthFirst(int phase, Cells & cells, Cell & cell);
+        unsigned int count;
 
-    std::string evalAddressCallback(const Address &address, void * pData)
+        bool deleting;
+    };
+
+    /**
+     * Move a row or column number past the rows or columns that are inserted,
+     * or back over those that are deleted.
+     *
+     * @returns false if the row or column is deleted, or would be moved past
+     *          the last one
+     */
+    bool shiftCoordinate(const Shift & shift, unsigned int & coordinate)
     {
-        SheetCallbackData *pCbData = static_cast<SheetCallbackData*>(pData);
-        Cells::iterator itr = pCbData->cells.find(address);
-        if (itr == pCbData->cells.end()) {
-            return "";
+        if (coordinate < shift.position) {
+            return true;
+        } else if (!shift.deleting) {
+            if (coordinate > std::numeric_limits<unsigned int>::max() - shift.count) {
+                return false;
+            }
+            coordinate += shift.count;
+            return true;
+        } else if (coordinate - shift.position < shift.count) {
+            return false;
         }
 
-        recalculateDepthFirst(pCbData->phase, pCbData->cells, itr->second);
-        return itr->second.value;
+        coordinate -= shift.count;
+        return true;
     }
 
-    std::string evalFunctionCallback(const std::string & name, const Formula::Arguments &, void * pData)
+    bool shiftAddress(Address & address, void * pData)
     {
-        SheetCallbackData *pCbData = static_cast<SheetCallbackData*>(pData);
-        throw std::runtime_error("Function calls are not implemented.");
+        const Shift & shift = *static_cast<const Shift *>(pData);
+        return shiftCoordinate(shift, shift.columns ? address.column : address.row);
     }
 
-    void recalculateDepthFirst(int phase, Cells & cells, Cell & cell)
+    /**
+     * Move a range. Ranges grow when rows or columns are inserted within
+     * them, and shrink when rows or columns are deleted from them.
+     */
+    bool shiftRange(Range & range, void * pData)
     {
-        // Check if cell has been discovered in this recalculation phase
-        if (cell.phase == phase) {
-            // If it has been discovered, and has also been processed, we're done
-            if (cell.processed) {
-                // Forward edge (= already recalculated in this phase)
-                return;
-            }
-            // Otherwise, it must be a back edge (= cycle)
-            throw std::runtime_error("Cycle detected.");
+        const Shift & shift = *static_cast<const Shift *>(pData);
+        unsigned int & first = shift.columns ? range.first.column : range.first.row;
+        unsigned int & last = shift.columns ? range.last.column : range.last.row;
+        const bool firstKept = shiftCoordinate(shift, first);
+        const bool lastKept = shiftCoordinate(shift, last);
+        if (!shift.deleting) {
+            return firstKept && lastKept;
         }
 
-        SheetCallbackData cbData = {cells, phase};
-
-        cell.phase = phase;
-        cell.processed = false;
+        // Corners that were deleted move to the nearest rows or columns that
+        // remain within the range
+        if (!firstKept) {
+            first = shift.position;
+        }
+        if (!lastKept) {
+            if (shift.position == 0) {
+                return false;
+            }
+            last = shift.position - 1;
+        }
 
-        // Evaluate the value of the cell, recursively recalculating the values
-        // of other cells whose values it depends on.
-        cell.value = Formula(cell.formula).evaluate(
-            evalAddressCallback,
-            evalFunctionCallback,
-            &cbData);
+        return first <= last;
+    }
 
-        cell.processed = true;
+    bool moreExpensive(const CellProfile & lhs, const CellProfile & rhs)
+    {
+        return lhs.exclusiveNanos > rhs.exclusiveNanos ||
+            (lhs.exclusiveNanos == rhs.exclusiveNanos && lhs.address < rhs.address);
     }
 }
 
 Sheet::Sheet()
     : m_pCells(new Cells())
-    , m_phase(1)
+    , m_pCompiler(new FormulaCompiler(m_pCells->getStrings()))
+    , m_pRanges(new RangeIndex())
+    , m_pLookups(new LookupCache())
+    , m_pSpills(new RangeIndex())
+    , m_pJournal(nullptr)
+    , m_profiling(false)
+{
+
+}
+
+Sheet::Sheet(const Sheet & parent)
+    : m_pCells(new Cells(*parent.m_pCells))
+    , m_pCompiler(new FormulaCompiler(m_pCells->getStrings()))
+    , m_pRanges(new RangeIndex(*parent.m_pRanges))
+    , m_pLookups(new LookupCache())
+    , m_pSpills(new RangeIndex(*parent.m_pSpills))
+    , m_pJournal(nullptr)
+    , m_priorityRegions(parent.m_priorityRegions)
+    , m_profiling(parent.m_profiling)
 {
 
 }
@@ -76,57 +1240,752 @@ Sheet::~Sheet()
 
 }
 
+void Sheet::addPriorityRegion(const Range & region)
+{
+    m_priorityRegions.push_back(region);
+}
+
+void Sheet::clearPriorityRegions()
+{
+    m_priorityRegions.clear();
+}
+
+bool Sheet::dependsOn(const Address & dependent, const Address & precedent) const
+{
+    const Cells::Slot target = m_pCells->find(dependent);
+    const Cells::Slot source = m_pCells->find(precedent);
+    if (target == Cells::npos || source == Cells::npos) {
+        return false;
+    }
+
+    const TraceIndex & trace = getTraceIndex();
+    if (!trace.levelsFound) {
+        m_pTrace->levelsFound = true;
+        findLevels(*m_pCells, *m_pRanges, trace.graph, m_pTrace->levels);
+    }
+
+    // Search forwards from the precedent, skipping cells that are too high
+    // to lead to the dependent. Without levels, every cell is searched.
+    const std::vector<unsigned int> & levels = trace.levels;
+    std::vector<bool> reached(m_pCells->getSlotCount(), false);
+    std::vector<Cells::Slot> pending(1, source);
+    std::vector<Cells::Slot> found;
+    while (!pending.empty()) {
+        const Cells::Slot slot = pending.back();
+        pending.pop_back();
+
+        found.clear();
+        traceDependents(*m_pCells, *m_pRanges, trace.graph, slot, found);
+        for (std::vector<Cells::Slot>::const_iterator itr = found.begin(); itr != found.end(); itr++) {
+            if (*itr == target) {
+                return true;
+            } else if (!reached[*itr] && (levels.empty() || levels[*itr] < levels[target])) {
+                reached[*itr] = true;
+                pending.push_back(*itr);
+            }
+        }
+    }
+
+    return false;
+}
+
+void Sheet::deleteColumns(unsigned int column, unsigned int count)
+{
+    shiftCells(true, column, count, true);
+}
+
+void Sheet::deleteRows(unsigned int row, unsigned int count)
+{
+    shiftCells(false, row, count, true);
+}
+
 bool Sheet::erase(const Address & address)
 {
-    return m_pCells->erase(address) == 1;
+    if (m_pJournal && isSet(address)) {
+        m_pJournal->recordErase(address);
+    }
+
+    // The slot may be reused by another cell
+    const Cells::Slot slot = m_pCells->find(address);
+    if (slot != Cells::npos) {
+        m_pRanges->erase(slot);
+        m_pSpills->erase(slot);
+    }
+
+    const bool erased = m_pCells->erase(address);
+    m_pCells->trim();
+    return erased;
+}
+
+std::unique_ptr<Sheet> Sheet::fork() const
+{
+    if (m_pCells->isPaged()) {
+        throw std::runtime_error("Sheets that are paged or compressed cannot be forked.");
+    }
+
+    return std::unique_ptr<Sheet>(new Sheet(*this));
+}
+
+std::vector<Address> Sheet::getAddresses() const
+{
+    std::vector<Address> addresses;
+    const Cells::Index & index = m_pCells->getIndex();
+    addresses.reserve(index.size());
+    for (Cells::Index::const_iterator itr = index.begin(); itr != index.end(); itr++) {
+        addresses.push_back(itr->first);
+    }
+
+    return addresses;
+}
+
+std::vector<ColumnCompression> Sheet::getColumnCompression() const
+{
+    return m_pCells->getColumnCompression();
+}
+
+std::vector<Address> Sheet::getDependents(const Range & cells, bool transitive) const
+{
+    return trace(*m_pCells, *m_pRanges, getTraceIndex().graph, cells, transitive, traceDependents);
 }
 
 std::string Sheet::getFormula(const Address & address) const
 {
-    Cells::const_iterator itr = m_pCells->find(address);
-    if (itr != m_pCells->end()) {
-        const Cell & cell = itr->second;
-        return cell.formula;
+    const Cells::Slot slot = m_pCells->find(address);
+    if (slot != Cells::npos) {
+        const std::string formula = (*m_pCells)[slot].formula;
+        m_pCells->trim();
+        return formula;
     }
 
     return "";
 }
 
+std::vector<CellProfile> Sheet::getHotCells(size_t count) const
+{
+    std::vector<CellProfile> profiles;
+
+    // Fan-out is counted from the precedents recorded by the most recent
+    // evaluation of each cell, so it only includes references that were read
+    std::vector<size_t> fanOut(m_pCells->getSlotCount(), 0);
+    for (Cells::Slot slot = 0; slot < m_pCells->getSlotCount(); slot++) {
+        m_pCells->trim();
+        if (!m_pCells->isUsed(slot)) {
+            continue;
+        }
+
+        const Cell & cell = (*m_pCells)[slot];
+        for (std::vector<size_t>::const_iterator precedent = cell.precedents.begin();
+                precedent != cell.precedents.end(); precedent++) {
+            fanOut[*precedent]++;
+        }
+
+        if (cell.stats.evaluations > 0) {
+            CellProfile profile = {
+                m_pCells->getAddress(slot),
+                cell.formula,
+                cell.stats.evaluations,
+                cell.stats.inclusiveNanos,
+                cell.stats.exclusiveNanos,
+                cell.precedents.size(),
+                0
+            };
+            profiles.push_back(profile);
+        }
+    }
+
+    count = std::min(count, profiles.size());
+    std::partial_sort(profiles.begin(), profiles.begin() + count, profiles.end(), moreExpensive);
+    profiles.erase(profiles.begin() + count, profiles.end());
+
+    for (std::vector<CellProfile>::iterator itr = profiles.begin(); itr != profiles.end(); itr++) {
+        itr->fanOut = fanOut[m_pCells->find(itr->address)];
+    }
+
+    return profiles;
+}
+
+PagingStats Sheet::getPagingStats() const
+{
+    return m_pCells->getPagingStats();
+}
+
+StringPoolStats Sheet::getStringStats() const
+{
+    return m_pCells->getStrings()->getStats();
+}
+
+std::vector<Address> Sheet::getPrecedents(const Range & cells, bool transitive) const
+{
+    return trace(*m_pCells, *m_pRanges, getTraceIndex().graph, cells, transitive, tracePrecedents);
+}
+
+const TraceIndex & Sheet::getTraceIndex() const
+{
+    std::vector<Cells::Slot> references;
+    if (m_pTrace && m_pTrace->epoch == m_pCells->getEpoch()) {
+        // Most edits change values rather than references, so the graph is
+        // kept unless an edited cell now refers to different cells. Levels
+        // remain valid if references are removed, but not if ranges that
+        // may contain cells with higher levels are added.
+        bool changed = false;
+        std::vector<Cells::Slot> & edited = m_pTrace->edited;
+        std::sort(edited.begin(), edited.end());
+        edited.erase(std::unique(edited.begin(), edited.end()), edited.end());
+        for (std::vector<Cells::Slot>::const_iterator itr = edited.begin(); itr != edited.end() && !changed; itr++) {
+            if (findReferences(*m_pCells, *m_pCompiler, *m_pRanges, *itr, references)) {
+                m_pTrace->unresolved.push_back(*itr);
+            }
+            m_pCells->trim();
+            std::sort(references.begin(), references.end());
+            references.erase(std::unique(references.begin(), references.end()), references.end());
+            const DependencyGraph::Nodes precedents = m_pTrace->graph.getPrecedents(*itr);
+            changed = references.size() != std::size_t(precedents.end - precedents.begin) ||
+                !std::equal(references.begin(), references.end(), precedents.begin);
+            if (!m_pRanges->get(*itr).empty()) {
+                m_pTrace->levels.clear();
+                m_pTrace->levelsFound = false;
+            }
+        }
+
+        edited.clear();
+        if (!changed) {
+            return *m_pTrace;
+        }
+    }
+
+    TraceSpan span("trace");
+
+    std::unique_ptr<TraceIndex> pTrace(new TraceIndex(m_pCells->getEpoch()));
+    for (Cells::Slot slot = 0; slot < m_pCells->getSlotCount(); slot++) {
+        references.clear();
+        if (m_pCells->isUsed(slot)) {
+            if (findReferences(*m_pCells, *m_pCompiler, *m_pRanges, slot, references)) {
+                pTrace->unresolved.push_back(slot);
+            }
+            m_pCells->trim();
+        }
+        pTrace->graph.addNode(references);
+    }
+
+    pTrace->graph.finish();
+    m_pTrace.swap(pTrace);
+    return *m_pTrace;
+}
+
 std::string Sheet::getValue(const Address & address) const
 {
-    Cells::const_iterator itr = m_pCells->find(address);
-    if (itr != m_pCells->end()) {
-        const Cell & cell = itr->second;
-        return cell.value;
+    const Cells::Slot slot = m_pCells->find(address);
+    if (slot != Cells::npos) {
+        const std::string value = (*m_pCells)[slot].value.str();
+        m_pCells->trim();
+        return value;
+    }
+
+    // Cells that have not been set may hold a value spilled from an array,
+    // which is read from the array itself
+    std::vector<RangeIndex::Owner> owners;
+    m_pSpills->findCovering(address, owners);
+    if (!owners.empty()) {
+        const std::string value = getSpilledValue(*m_pCells, owners.front(), address).str();
+        m_pCells->trim();
+        return value;
     }
 
     return "";
 }
 
+void Sheet::insertColumns(unsigned int column, unsigned int count)
+{
+    shiftCells(true, column, count, false);
+}
+
+void Sheet::insertRows(unsigned int row, unsigned int count)
+{
+    shiftCells(false, row, count, false);
+}
+
+bool Sheet::isSet(const Address & address) const
+{
+    return m_pCells->find(address) != Cells::npos;
+}
+
+bool Sheet::isProfiling() const
+{
+    return m_profiling;
+}
+
 void Sheet::print() const
 {
-    for (Cells::const_iterator itr = m_pCells->begin(); itr != m_pCells->end(); itr++) {
-      std::cout << "[" << itr->first.column << "," << itr->first.row << "]: " << itr->second.value << std::endl;
+    const Cells::Index & index = m_pCells->getIndex();
+    for (Cells::Index::const_iterator itr = index.begin(); itr != index.end(); itr++) {
+      std::cout << "[" << itr->first.column << "," << itr->first.row << "]: " << (*m_pCells)[itr->second].value.str() << std::endl;
+      m_pCells->trim();
     }
 }
 
 void Sheet::recalculate()
 {
-    m_phase *= -1;
+    RecalcProgress progress;
+    recalculate(progress);
+}
+
+bool Sheet::recalculate(RecalcProgress & progress)
+{
+    TraceSpan span("recalculate");
+
+    // Every pass starts with no cells visited, so cells left part way through
+    // a cancelled or failed pass are never mistaken for cells visited by the
+    // current one
+    std::vector<unsigned char> visits(m_pCells->getSlotCount(), VISIT_NONE);
+
+    progress.done.store(0);
+    progress.total.store(m_pCells->size());
+
+    // The plan of the previous pass is followed if cells have not been
+    // created or erased since, while the order of this pass is recorded to
+    // replace it
+    const bool planned = m_pPlan && m_pPlan->epoch == m_pCells->getEpoch();
+    progress.planned.store(planned);
+
+    std::unique_ptr<EvaluationPlan> pRecording(new EvaluationPlan(*m_pCells));
+
+    m_pLookups->beginPass();
+
+    RecalcContext context = {*m_pCells, *m_pCompiler, progress, *m_pRanges, *m_pLookups, *m_pSpills, visits,
+        *pRecording, m_profiling, false};
+
+    try {
+        for (int pass = 1; ; pass++) {
+            if (!m_priorityRegions.empty()) {
+                // Cells are indexed by column and then row, so each column of a
+                // region is a contiguous run of cells
+                const Cells::Index & index = m_pCells->getIndex();
+                for (std::vector<Range>::const_iterator region = m_priorityRegions.begin();
+                        region != m_priorityRegions.end(); region++) {
+                    for (unsigned int column = region->first.column; column <= region->last.column; column++) {
+                        Cells::Index::const_iterator itr = index.lower_bound(Address(column, region->first.row));
+                        const Cells::Index::const_iterator end = index.upper_bound(Address(column, region->last.row));
+                        for (; itr != end; itr++) {
+                            recalculateDepthFirst(context, itr->second);
+                            m_pCells->trim();
+                        }
+                    }
+                }
+
+                if (progress.onPrioritised) {
+                    progress.onPrioritised();
+                }
+            }
+
+            if (planned) {
+                recalculatePlanned(context, *m_pPlan);
+            } else {
+                // Iterate over every cell in the sheet, in address order, so that
+                // runs of cells that were filled down a column are visited
+                // together; cells that were recalculated above are skipped. When
+                // cells are paged or compressed, they are visited in slot order
+                // instead, so that each chunk is paged in once by this loop, and
+                // runs are only found among cells that were created one after
+                // another.
+                const Cells::Index & index = m_pCells->getIndex();
+                std::vector<Cells::Slot> order;
+                order.reserve(index.size());
+                for (Cells::Index::const_iterator itr = index.begin(); itr != index.end(); itr++) {
+                    order.push_back(itr->second);
+                }
+
+                if (m_pCells->isPaged()) {
+                    std::sort(order.begin(), order.end());
+                }
+
+                // Chunks can only be evicted between cells, while no references
+                // to cells are held
+                for (std::size_t position = 0; position < order.size(); ) {
+                    position += recalculateRun(context, order, position);
+                    m_pCells->trim();
+                }
+            }
+
+            // A cell that read the area of an array before the array changed
+            // its area has read the wrong value, so such passes are repeated.
+            // Arrays whose areas depend on one another may never settle, so
+            // the number of passes is limited.
+            if (!context.spillsChanged || pass == MAX_SPILL_PASSES) {
+                break;
+            }
 
-    // Iterate over every cell in the sheet
-    for (Cells::iterator itr = m_pCells->begin(); itr != m_pCells->end(); itr++) {
-        recalculateDepthFirst(m_phase, *m_pCells, itr->second);
+            context.spillsChanged = false;
+            std::fill(visits.begin(), visits.end(), static_cast<unsigned char>(VISIT_NONE));
+            pRecording->steps.clear();
+            progress.total.fetch_add(m_pCells->size());
+            m_pLookups->beginPass();
+        }
+    } catch (const RecalcCancelled &) {
+        return false;
+    }
+
+    m_pPlan.swap(pRecording);
+    return true;
+}
+
+void Sheet::resetProfile()
+{
+    for (Cells::Slot slot = 0; slot < m_pCells->getSlotCount(); slot++) {
+        if ((*m_pCells)[slot].stats.evaluations > 0) {
+            m_pCells->mutate(slot).stats = CellStats();
+        }
+        m_pCells->trim();
     }
 }
 
 bool Sheet::setFormula(const Address & address, const std::string & formula)
 {
-    Cells::iterator itr = m_pCells->find(address);
-    if (itr == m_pCells->end()) {
-        return m_pCells->insert(Cells::value_type(address, Cell(formula))).second;
+    if (m_pJournal) {
+        m_pJournal->recordSet(address, formula);
     }
 
-    itr->second.formula = formula;
+    const Cells::Slot slot = m_pCells->find(address);
+    if (slot == Cells::npos) {
+        m_pCells->insert(address, formula);
+        m_pCells->trim();
+        return true;
+    }
+
+    // The plan remains valid, but the run that the cell belongs to (if any)
+    // must be checked before it is next evaluated as a batch
+    if (m_pPlan && slot < m_pPlan->edited.size()) {
+        m_pPlan->edited[slot] = true;
+    }
+
+    // Ranges are indexed again once the new formula has been compiled, and
+    // the area of an array once it has been evaluated. Until then, the cell
+    // may read cells that its old array spilled into, without depending on
+    // itself.
+    m_pRanges->erase(slot);
+    m_pSpills->erase(slot);
+
+    // The cell may now refer to different cells
+    if (m_pTrace) {
+        m_pTrace->edited.push_back(slot);
+    }
+
+    Cell & cell = m_pCells->mutate(slot);
+    cell.formula = m_pCells->getStrings()->intern(formula);
+    cell.compiled.reset();
+    cell.bindingEpoch = 0;
+    cell.stats = CellStats();
+    m_pCells->trim();
     return true;
 }
+
+void Sheet::shiftCells(bool columns, unsigned int position, unsigned int count, bool deleting)
+{
+    if (count == 0) {
+        return;
+    }
+
+    Shift shift = {columns, position, count, deleting};
+
+    // Find the cells after the edit point, which either move or are deleted.
+    // Cells are indexed by column first, so the cells before an inserted or
+    // deleted row are skipped a column at a time.
+    std::vector<Cells::Slot> moved;
+    std::vector<Address> addresses;
+    std::vector<Cells::Slot> deleted;
+    const Cells::Index & index = m_pCells->getIndex();
+    Cells::Index::const_iterator itr = index.lower_bound(columns ? Address(position, 0) : Address(0, position));
+    while (itr != index.end()) {
+        Address address(itr->first);
+        if (!columns && address.row < position) {
+            itr = index.lower_bound(Address(address.column, position));
+            continue;
+        }
+
+        if (shiftAddress(address, &shift)) {
+            moved.push_back(itr->second);
+            addresses.push_back(address);
+        } else if (deleting) {
+            deleted.push_back(itr->second);
+        } else {
+            throw std::invalid_argument("Cells cannot be moved past the last row or column.");
+        }
+        itr++;
+    }
+
+    if (m_pJournal) {
+        if (columns && deleting) {
+            m_pJournal->recordDeleteColumns(position, count);
+        } else if (columns) {
+            m_pJournal->recordInsertColumns(position, count);
+        } else if (deleting) {
+            m_pJournal->recordDeleteRows(position, count);
+        } else {
+            m_pJournal->recordInsertRows(position, count);
+        }
+    }
+
+    TraceSpan span(deleting ? "delete" : "insert");
+
+    // Only formulas that refer to a cell or range beyond the edit point need
+    // to be rewritten. References to cells that have been set are found in
+    // the graph, and ranges in the range index; references to cells that
+    // have not been set are checked separately.
+    const TraceIndex & trace = getTraceIndex();
+    std::vector<Cells::Slot> candidates(trace.unresolved);
+    for (int pass = 0; pass < 2; pass++) {
+        const std::vector<Cells::Slot> & slots = pass == 0 ? moved : deleted;
+        for (std::vector<Cells::Slot>::const_iterator slot = slots.begin(); slot != slots.end(); slot++) {
+            const DependencyGraph::Nodes dependents = trace.graph.getDependents(*slot);
+            candidates.insert(candidates.end(), dependents.begin, dependents.end);
+        }
+    }
+
+    const unsigned int last = std::numeric_limits<unsigned int>::max();
+    m_pRanges->findIntersecting(columns ? Range(Address(position, 0), Address(last, last)) :
+        Range(Address(0, position), Address(last, last)), candidates);
+
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    std::sort(deleted.begin(), deleted.end());
+
+    // Rewrite each formula by replacing the text of the references that move,
+    // and copying its compiled tree, rather than parsing the new text
+    std::vector<Cells::Slot> rewritten;
+    std::string text;
+    for (std::vector<Cells::Slot>::const_iterator slot = candidates.begin(); slot != candidates.end(); slot++) {
+        if (!m_pCells->isUsed(*slot) || std::binary_search(deleted.begin(), deleted.end(), *slot)) {
+            continue;
+        }
+
+        const std::string source = (*m_pCells)[*slot].formula;
+        std::shared_ptr<Formula> compiled = (*m_pCells)[*slot].compiled;
+        try {
+            if (!compiled) {
+                compiled = std::make_shared<Formula>(m_pCompiler->compile(source));
+            }
+        } catch (const std::runtime_error &) {
+            // Formulas that cannot be compiled are left as they are
+            continue;
+        }
+
+        const std::shared_ptr<Formula> relocated =
+            std::make_shared<Formula>(compiled->relocate(source, shiftAddress, shiftRange, &shift, text));
+        if (text == source) {
+            continue;
+        }
+
+        Cell & cell = m_pCells->mutate(*slot);
+        cell.formula = m_pCells->getStrings()->intern(text);
+        cell.compiled = relocated;
+        cell.bindingEpoch = 0;
+        m_pRanges->set(*slot, relocated->getRanges());
+        rewritten.push_back(*slot);
+        m_pCells->trim();
+    }
+
+    for (std::vector<Cells::Slot>::const_iterator slot = deleted.begin(); slot != deleted.end(); slot++) {
+        m_pRanges->erase(*slot);
+        m_pSpills->erase(*slot);
+        m_pCells->erase(m_pCells->getAddress(*slot));
+        m_pCells->trim();
+    }
+
+    m_pCells->move(moved, addresses);
+
+    // Arrays spill from the cells that hold them, wherever they are now
+    for (std::size_t i = 0; i < moved.size(); i++) {
+        Range area(addresses[i], addresses[i]);
+        const std::shared_ptr<const Array> pArray = (*m_pCells)[moved[i]].array;
+        if (pArray && pArray->values.size() > 1 && getSpillArea(addresses[i], *pArray, area)) {
+            m_pSpills->set(moved[i], std::vector<Range>(1, area));
+        } else {
+            m_pSpills->erase(moved[i]);
+        }
+        m_pCells->trim();
+    }
+
+    // Shapes are relative to the cell that a formula belongs to, so they
+    // change when either the cell or the cells it refers to have moved. They
+    // are cleared here, and worked out again when next prepared.
+    rewritten.insert(rewritten.end(), moved.begin(), moved.end());
+    for (std::vector<Cells::Slot>::const_iterator slot = rewritten.begin(); slot != rewritten.end(); slot++) {
+        if (!(*m_pCells)[*slot].shape.empty()) {
+            m_pCells->annotate(*slot).shape.clear();
+        }
+        m_pCells->trim();
+    }
+
+    // Cells keep their slots, and rewritten formulas refer to the same slots
+    // as before, apart from those of deleted cells, so the graph is kept
+    // rather than built again from every formula. Removing references keeps
+    // the levels valid.
+    if (!deleted.empty()) {
+        std::vector<bool> removed(m_pCells->getSlotCount(), false);
+        for (std::vector<Cells::Slot>::const_iterator slot = deleted.begin(); slot != deleted.end(); slot++) {
+            removed[*slot] = true;
+        }
+
+        DependencyGraph graph;
+        std::vector<Cells::Slot> precedents;
+        for (Cells::Slot slot = 0; slot < m_pTrace->graph.getNodeCount(); slot++) {
+            precedents.clear();
+            const DependencyGraph::Nodes nodes = m_pTrace->graph.getPrecedents(slot);
+            for (const Cells::Slot * node = nodes.begin; node != nodes.end && !removed[slot]; node++) {
+                if (!removed[*node]) {
+                    precedents.push_back(*node);
+                }
+            }
+            graph.addNode(precedents);
+        }
+
+        graph.finish();
+        m_pTrace->graph = std::move(graph);
+    }
+
+    m_pTrace->epoch = m_pCells->getEpoch();
+}
+
+std::vector<std::vector<std::string> > Sheet::sweep(const std::vector<Address> & inputs,
+        const std::vector<std::vector<std::string> > & values, const std::vector<Address> & outputs)
+{
+    const Cells & cells = *m_pCells;
+
+    std::vector<Cells::Slot> inputSlots;
+    for (std::vector<Address>::const_iterator itr = inputs.begin(); itr != inputs.end(); itr++) {
+        const Cells::Slot slot = cells.find(*itr);
+        if (slot == Cells::npos) {
+            throw std::invalid_argument("Sweep input is not set.");
+        }
+        inputSlots.push_back(slot);
+    }
+
+    for (std::vector<std::vector<std::string> >::const_iterator itr = values.begin(); itr != values.end(); itr++) {
+        if (itr->size() != inputs.size()) {
+            throw std::invalid_argument("Sweep values do not match inputs.");
+        }
+    }
+
+    // Every cell must be compiled and bound, and cells that do not depend on
+    // the inputs must be up to date
+    recalculate();
+
+    TraceSpan span("sweep");
+
+    // Find the cells that depend on the inputs, by following every reference
+    // in every formula backwards, including references that the most recent
+    // recalculation did not read. Cells that read a range are found through
+    // the RangeIndex, rather than by listing every cell within the range.
+    const Cells::Slot slotCount = cells.getSlotCount();
+    std::vector<std::vector<Cells::Slot> > dependents(slotCount);
+    for (Cells::Slot slot = 0; slot < slotCount; slot++) {
+        if (!cells.isUsed(slot)) {
+            continue;
+        }
+
+        const std::vector<Cells::Slot> & bindings = cells[slot].bindings;
+        for (std::vector<Cells::Slot>::const_iterator itr = bindings.begin(); itr != bindings.end(); itr++) {
+            if (*itr != Cells::npos) {
+                dependents[*itr].push_back(slot);
+            }
+        }
+    }
+
+    std::vector<bool> affected(slotCount, false);
+    std::vector<Cells::Slot> pending(inputSlots);
+    std::vector<RangeIndex::Owner> covering;
+    while (!pending.empty()) {
+        const Cells::Slot slot = pending.back();
+        pending.pop_back();
+
+        covering.clear();
+        m_pRanges->findCovering(cells.getAddress(slot), covering);
+        covering.insert(covering.end(), dependents[slot].begin(), dependents[slot].end());
+        for (std::vector<Cells::Slot>::const_iterator itr = covering.begin(); itr != covering.end(); itr++) {
+            if (!affected[*itr]) {
+                affected[*itr] = true;
+                pending.push_back(*itr);
+            }
+        }
+    }
+
+    // Inputs are not evaluated, even if they also depend on other inputs
+    for (std::vector<Cells::Slot>::const_iterator itr = inputSlots.begin(); itr != inputSlots.end(); itr++) {
+        affected[*itr] = false;
+    }
+
+    // Order the affected cells that the outputs depend on, so that each cell
+    // is evaluated after its precedents
+    std::vector<Cells::Slot> plan;
+    std::vector<unsigned char> visits(slotCount, VISIT_NONE);
+    for (std::vector<Address>::const_iterator itr = outputs.begin(); itr != outputs.end(); itr++) {
+        const Cells::Slot slot = cells.find(*itr);
+        if (slot != Cells::npos && affected[slot]) {
+            planSweep(cells, *m_pRanges, affected, slot, visits, plan);
+        }
+    }
+
+    const std::size_t count = values.size();
+    Lanes blank;
+    blank.setStrings(std::vector<Rope>(count));
+    std::vector<Lanes> lanes(slotCount);
+    std::vector<bool> ready(slotCount, false);
+    SweepContext context = {cells, count, lanes, ready, blank};
+
+    std::vector<Rope> column(count);
+    for (std::size_t input = 0; input < inputSlots.size(); input++) {
+        for (std::size_t lane = 0; lane < count; lane++) {
+            column[lane] = values[lane][input];
+        }
+        lanes[inputSlots[input]].setStrings(column);
+        ready[inputSlots[input]] = true;
+    }
+
+    for (std::vector<Cells::Slot>::const_iterator itr = plan.begin(); itr != plan.end(); itr++) {
+        // Cells that were paged out since they were recalculated have lost
+        // their compiled formulas
+        std::shared_ptr<Formula> compiled = cells[*itr].compiled;
+        if (!compiled) {
+            compiled = std::make_shared<Formula>(m_pCompiler->compile(cells[*itr].formula));
+        }
+
+        SweepCallbackData cbData = {context, *itr};
+        compiled->evaluateLanes(
+            count,
+            evalAddressLanesCallback,
+            evalRangeLanesCallback,
+            evalFunctionCallback,
+            &cbData,
+            lanes[*itr]);
+        ready[*itr] = true;
+    }
+
+    std::vector<std::vector<std::string> > results(count, std::vector<std::string>(outputs.size()));
+    for (std::size_t output = 0; output < outputs.size(); output++) {
+        const Cells::Slot slot = cells.find(outputs[output]);
+        for (std::size_t lane = 0; slot != Cells::npos && lane < count; lane++) {
+            results[lane][output] = ready[slot] ? lanes[slot].getString(lane).str() : cells[slot].value.str();
+        }
+    }
+
+    return results;
+}
+
+void Sheet::setCompression(std::size_t memoryBudget)
+{
+    m_pCells->enableCompression(memoryBudget);
+}
+
+void Sheet::setJournal(Journal * pJournal)
+{
+    m_pJournal = pJournal;
+}
+
+void Sheet::setPaging(const std::string & path, std::size_t memoryBudget)
+{
+    m_pCells->enablePaging(path, memoryBudget);
+}
+
+void Sheet::setProfiling(bool profiling)
+{
+    m_profiling = profiling;
+}
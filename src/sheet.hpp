@@ -1,13 +1,65 @@
 #pragma once
 
+#include <atomic>
+#include <cstddef>
+#include <functional>
 #include <map>
 #include <memory>
 #include <string>
+#include <vector>
+
+#include "paging.hpp"
+#include "profile.hpp"
+#include "range.hpp"
+#include "strings.hpp"
 
 struct Address;
-struct Cell;
 
-typedef std::map<Address, Cell> Cells;
+class Cells;
+class FormulaCompiler;
+class Journal;
+class LookupCache;
+class RangeIndex;
+
+struct EvaluationPlan;
+struct TraceIndex;
+
+/**
+ * Progress of a recalculation pass, which may be running on another thread.
+ *
+ * Setting the cancelled flag causes the pass to stop at the next cell it
+ * visits. Cells that were not reached keep their previous values.
+ */
+struct RecalcProgress
+{
+    RecalcProgress()
+        : done(0)
+        , total(0)
+        , cancelled(false)
+        , planned(false)
+    {
+        // No further initialisation
+    }
+
+    /// Number of cells recalculated so far
+    std::atomic<std::size_t> done;
+
+    /// Number of cells in the sheet when the pass began. A pass that is
+    /// repeated, because spilled arrays changed their areas, adds the number
+    /// of cells again, so the total may grow part way through.
+    std::atomic<std::size_t> total;
+
+    /// Set to request that the pass be abandoned
+    std::atomic<bool> cancelled;
+
+    /// Set once the pass has begun, if it follows the evaluation plan that
+    /// was recorded by an earlier pass
+    std::atomic<bool> planned;
+
+    /// Called part way through a pass, once every cell in the Sheet's
+    /// priority regions (and their precedents) has been recalculated
+    std::function<void()> onPrioritised;
+};
 
 class Sheet
 {
@@ -16,6 +68,64 @@ public:
 
     ~Sheet();
 
+    /**
+     * Register a priority region.
+     *
+     * Each recalculation pass begins with the cells in the priority regions,
+     * and the precedents of those cells, before moving on to the rest of the
+     * sheet. This is intended for the rows and columns that a user is looking
+     * at, so that they can be shown up to date values as soon as possible.
+     *
+     * @param   region  Range of cells to prioritise
+     */
+    void addPriorityRegion(const Range & region);
+
+    /**
+     * Remove all priority regions.
+     */
+    void clearPriorityRegions();
+
+    /**
+     * Query whether one cell depends on another, directly or through any
+     * number of other cells.
+     *
+     * The first query after references have changed numbers the cells by
+     * the length of the longest chain of precedents beneath them. A cell can
+     * only depend on cells with lower numbers, so the search skips any cell
+     * whose number is too high to lead to the dependent.
+     *
+     * @param   dependent  Address of the cell that may depend on the other
+     * @param   precedent  Address of the cell that may be depended upon
+     *
+     * @returns true if both cells are set, and the dependent refers to the
+     *          precedent through a chain of one or more references or ranges
+     */
+    bool dependsOn(const Address & dependent, const Address & precedent) const;
+
+    /**
+     * Delete columns, moving the cells to their right to the left.
+     *
+     * References to cells that move are rewritten to follow them, and those
+     * to deleted cells are replaced by #REF!. Ranges that lose some of their
+     * columns shrink, and ranges that lose all of them are replaced by #REF!.
+     *
+     * @param   column  First column to delete
+     * @param   count   Number of columns to delete
+     *
+     * @see insertRows()
+     */
+    void deleteColumns(unsigned int column, unsigned int count);
+
+    /**
+     * Delete rows, moving the cells below them up.
+     *
+     * @param   row    First row to delete
+     * @param   count  Number of rows to delete
+     *
+     * @see deleteColumns()
+     */
+    void deleteRows(unsigned int row, unsigned int count);
+
     /**
      * Erase the formula for a Cell, identified by an address string.
      *
@@ -25,6 +135,64 @@ public:
      */
     bool erase(const Address &);
 
+    /**
+     * Create a copy of the sheet, for exploring a what-if scenario.
+     *
+     * The fork shares cell storage, compiled formulas and cached values with
+     * this sheet. Storage is copied in small chunks, and only once a cell in a
+     * chunk is changed by either sheet, so the memory used by a fork is
+     * proportional to the cells that it overrides and the values that change
+     * as a result. Creating or erasing a cell in a fork also copies the index
+     * of cell addresses.
+     *
+     * Forks are independent of each other and of this sheet, and may be
+     * edited and recalculated on different threads at the same time. This
+     * sheet must not be modified or recalculated while it is being forked.
+     *
+     * @throws  std::runtime_error if the sheet is paged to a file or
+     *          compressed
+     *
+     * @returns the new sheet
+     */
+    std::unique_ptr<Sheet> fork() const;
+
+    /**
+     * Retrieve the addresses of every cell that has been set.
+     *
+     * @returns addresses in address order, i.e. by column, then by row
+     */
+    std::vector<Address> getAddresses() const;
+
+    /**
+     * Retrieve the compression achieved for each column of a sheet that is
+     * compressed or paged to a file, counting the blocks that have been
+     * evicted at least once.
+     *
+     * @returns one entry per column, in column order
+     */
+    std::vector<ColumnCompression> getColumnCompression() const;
+
+    /**
+     * Find the cells that depend on any of the cells within a range.
+     *
+     * Dependencies are taken from the formulas of the cells, rather than from
+     * the most recent recalculation, so they include references that were
+     * not read, such as those in the branch of an IF that was not taken.
+     * Cells that read a range depend on every cell within it.
+     *
+     * The references between cells are held in a compact graph, which is
+     * built by the first query after cells are created or erased, or after a
+     * formula is changed to refer to different cells; other changes keep it.
+     *
+     * @param   cells       Range of cells to start from
+     * @param   transitive  true to include the dependents of dependents, and
+     *                      so on, false for direct dependents only
+     *
+     * @returns addresses of the dependents in address order, which include
+     *          cells within the range if they depend on other cells within it
+     */
+    std::vector<Address> getDependents(const Range & cells, bool transitive) const;
+
     /**
      * Retrieve the formula for a Cell identified by an address string, in
      * string format.
@@ -38,12 +206,54 @@ public:
      */
     std::string getFormula(const Address &) const;
 
+    /**
+     * Retrieve the most expensive cells recorded while profiling.
+     *
+     * Cells are ranked by exclusive time, i.e. time spent evaluating their own
+     * formulas, not counting the time spent recalculating their precedents.
+     *
+     * @param   count  Maximum number of cells to return
+     *
+     * @returns up to count profiles, most expensive first
+     */
+    std::vector<CellProfile> getHotCells(std::size_t count) const;
+
+    /**
+     * Retrieve the cache and I/O counters for a sheet that is paged to a
+     * file. All counters are zero if paging has not been enabled.
+     */
+    PagingStats getPagingStats() const;
+
+    /**
+     * Find the cells that any of the cells within a range depend on, i.e.
+     * the cells that their formulas refer to, and the cells within the ranges
+     * that their formulas read. Only cells that have been set are included.
+     *
+     * @param   cells       Range of cells to start from
+     * @param   transitive  true to include the precedents of precedents, and
+     *                      so on, false for direct precedents only
+     *
+     * @returns addresses of the precedents in address order
+     *
+     * @see getDependents()
+     */
+    std::vector<Address> getPrecedents(const Range & cells, bool transitive) const;
+
+    /**
+     * Retrieve the counters for the pool in which formulas, and the string
+     * literals and identifiers within them, are interned. The pool is shared
+     * with any forks of the sheet, so the counters include their cells too.
+     */
+    StringPoolStats getStringStats() const;
+
     /**
      * Retrieve the value of a Cell, identified by an address string, in string
      * format.
      *
      * If the Cell has not been set, then this function will return an empty
-     * string.
+     * string, unless the cell is covered by an array that spills from a cell
+     * above or to the left of it, such as the result of =A1:B2*2, in which
+     * case it returns the value of the array at that position.
      *
      * @param   address  Address of the cell to query
      *
@@ -51,6 +261,43 @@ public:
      */
     std::string getValue(const Address &) const;
 
+    /**
+     * Insert empty columns, moving the cells in and to the right of a column
+     * further to the right.
+     *
+     * @param   column  Column at which to insert, which becomes the first of
+     *                  the new columns
+     * @param   count   Number of columns to insert
+     *
+     * @throws  std::invalid_argument if a cell would be moved past the last
+     *          column
+     *
+     * @see insertRows()
+     */
+    void insertColumns(unsigned int column, unsigned int count);
+
+    /**
+     * Insert empty rows, moving the cells in and below a row further down.
+     *
+     * References to cells that move are rewritten to follow them, and ranges
+     * that span the new rows grow to include them. Only the formulas that
+     * refer to a cell or range beyond the edit point are rewritten, and their
+     * text is rewritten in place, by replacing the references that moved, so
+     * nothing is parsed again. Formulas that cannot be compiled are left as
+     * they are.
+     *
+     * Cells keep their compiled formulas and cached values, but the sheet
+     * should be recalculated afterwards, as the evaluation plan is discarded.
+     *
+     * @param   row    Row at which to insert, which becomes the first of the
+     *                 new rows
+     * @param   count  Number of rows to insert
+     *
+     * @throws  std::invalid_argument if a cell would be moved past the last
+     *          row
+     */
+    void insertRows(unsigned int row, unsigned int count);
+
     /**
      * Query a Cell, identified by an Address object, to see if it has been set.
      *
@@ -60,6 +307,11 @@ public:
      */
     bool isSet(const Address & address) const;
 
+    /**
+     * Returns true if per-cell statistics are being recorded.
+     */
+    bool isProfiling() const;
+
     /**
      * Print values of all cells
      */
@@ -70,9 +322,45 @@ public:
      *
      * Values for cells are cached in a sparse array of Cell objects, but these
      * values are not updated until this method is invoked on the Sheet.
+     *
+     * Each pass that completes records the order in which it recalculated
+     * cells, including the runs of cells that it evaluated together, as an
+     * evaluation plan. Later passes follow the plan in a single loop, rather
+     * than searching the sheet for dependencies and runs again. Changing the
+     * formula of a cell keeps the plan; creating or erasing a cell discards
+     * it. Cells that come to depend on a cell that is later in the plan are
+     * still recalculated after it, and the plan is updated to match.
+     *
+     * A formula that evaluates to an array, such as =A1:A10*2, spills the
+     * rest of the array into the cells below and to the right of its own,
+     * which formulas can read like any other cells. The array is held once,
+     * by the cell whose formula it is. If any of those cells have been set,
+     * or another array already spills into them, the formula's value is
+     * ERROR instead. Cells are not known to be spilled into until the array
+     * has been evaluated, so when the area of an array changes, the pass is
+     * repeated for any cells that read it too early.
      */
     void recalculate();
 
+    /**
+     * Recalculate all values in the sheet, reporting progress as cells are
+     * recalculated, and stopping early if the pass is cancelled.
+     *
+     * If any priority regions have been registered, the onPrioritised
+     * callback of the progress object is invoked once those regions are up
+     * to date, before the remaining cells are recalculated.
+     *
+     * @param   progress  Progress counters, and cancellation flag
+     *
+     * @returns true if the pass completed, false if it was cancelled
+     */
+    bool recalculate(RecalcProgress & progress);
+
+    /**
+     * Discard all per-cell statistics recorded while profiling.
+     */
+    void resetProfile();
+
     /**
      * Set the formula for a cell identified by an Address object.
      *
@@ -83,15 +371,144 @@ public:
      */
     bool setFormula(const Address & address, const std::string & formula);
 
+    /**
+     * Evaluate the cells that depend on one or more input cells, for many sets
+     * of input values at once, as in a data table or sensitivity analysis.
+     *
+     * The sheet is recalculated first. The cells that lie between the inputs
+     * and the outputs are then found once, and evaluated in dependency order
+     * for every set of input values in a single batch, with one lane per set
+     * of values. Other cells keep their current values, and the sheet itself
+     * is not modified.
+     *
+     * @param   inputs   Cells to override, which must be set
+     * @param   values   Values of the inputs for each lane, with one value per
+     *                   input, in the same order as the inputs
+     * @param   outputs  Cells whose values are returned
+     *
+     * @throws  std::invalid_argument if an input is not set, or the number of
+     *          values for a lane does not match the number of inputs
+     * @throws  std::runtime_error if the cells between the inputs and outputs
+     *          form a cycle, or a formula cannot be evaluated
+     *
+     * @returns values of the outputs for each lane, indexed by lane and then
+     *          by output
+     */
+    std::vector<std::vector<std::string> > sweep(const std::vector<Address> & inputs,
+        const std::vector<std::vector<std::string> > & values, const std::vector<Address> & outputs);
+
+    /**
+     * Keep the cells of the sheet compressed in memory, with only the most
+     * recently used blocks decoded.
+     *
+     * This works in the same way as setPaging(), except that blocks that are
+     * evicted are kept in memory in compressed form (see ColumnCompression)
+     * rather than written to a file. Columns that hold a few distinct labels,
+     * or sequences of integers, compress well. Values are decoded whenever
+     * their block is accessed, so getValue() and recalculation are unchanged.
+     *
+     * @param   memoryBudget  Estimated number of bytes of decoded cells to
+     *                        keep in memory
+     *
+     * @throws  std::runtime_error if compression or paging is already enabled
+     */
+    void setCompression(std::size_t memoryBudget);
+
+    /**
+     * Record every subsequent call to setFormula() and erase(), and every
+     * insertion or deletion of rows or columns, in a journal, so that the
+     * edits can be recovered after a crash using Journal::replay(). Records
+     * are appended before each edit is applied, but are only durable once
+     * Journal::commit() has been called.
+     *
+     * Forks do not record into their parent's journal.
+     *
+     * @param   pJournal  Journal to record into, which must outlive the
+     *                    sheet or be replaced first; null to stop recording
+     */
+    void setJournal(Journal * pJournal);
+
+    /**
+     * Keep the cells of the sheet in a file, for sheets that are too large to
+     * fit in memory.
+     *
+     * Cells are stored in blocks of Cells::CHUNK_SIZE consecutive slots, which
+     * are compressed before being written. A block is read in from the file
+     * when one of its cells is accessed, and
+     * the least recently used blocks are dropped from memory between cells
+     * whenever the blocks in memory exceed the memory budget. Blocks that
+     * have been modified are written back when they are dropped. Compiled
+     * formulas are not written to the file, and are compiled again after
+     * their block is read back in. The index of cell addresses always stays
+     * in memory.
+     *
+     * Recalculation visits cells in block order, rather than address order,
+     * so that each block is read in at most once by the pass itself; blocks
+     * may still be read again while recalculating precedents.
+     *
+     * @param   path          Path of the file, which is created or truncated,
+     *                        and removed when the sheet is destroyed
+     * @param   memoryBudget  Estimated number of bytes of cells to keep in
+     *                        memory; a single cell whose precedents span many
+     *                        blocks may exceed this while it is recalculated
+     *
+     * @throws  std::runtime_error if paging or compression is already
+     *          enabled, or the file cannot be created
+     */
+    void setPaging(const std::string & path, std::size_t memoryBudget);
+
+    /**
+     * Enable or disable profiling.
+     *
+     * While profiling, each recalculation accumulates per-cell evaluation
+     * counts and timings, which can be queried using getHotCells(). Changing
+     * the formula of a cell discards its statistics.
+     *
+     * @param   profiling  true to enable profiling, false to disable it
+     */
+    void setProfiling(bool profiling);
+
 private:
 
-    /// Disabled copy constructor
+    /// Copy constructor, used by fork()
     Sheet(const Sheet &);
 
     /// Disabled copy assignment operator
     Sheet & operator=(const Sheet &);
 
+    /// Bring the graph used for tracing up to date, if necessary
+    const TraceIndex & getTraceIndex() const;
+
+    /// Insert or delete rows or columns, for the public methods above
+    void shiftCells(bool columns, unsigned int position, unsigned int count, bool deleting);
+
     std::unique_ptr<Cells> m_pCells;
 
-    int m_phase;
+    std::unique_ptr<FormulaCompiler> m_pCompiler;
+
+    /// Ranges read by each compiled formula, by slot
+    std::unique_ptr<RangeIndex> m_pRanges;
+
+    /// Tables read by lookup functions, kept from one pass to the next; not
+    /// shared with forks
+    std::unique_ptr<LookupCache> m_pLookups;
+
+    /// Cells that the array of each cell spills into, by slot, for reading
+    /// the values of cells that have not been set
+    std::unique_ptr<RangeIndex> m_pSpills;
+
+    /// Journal that edits are recorded into, if any
+    Journal * m_pJournal;
+
+    /// Order of the most recent complete pass, if cells have not since been
+    /// created or erased; not shared with forks
+    std::unique_ptr<EvaluationPlan> m_pPlan;
+
+    /// References between cells, built by the first tracing query after they
+    /// change; not shared with forks
+    mutable std::unique_ptr<TraceIndex> m_pTrace;
+
+    std::vector<Range> m_priorityRegions;
+
+    bool m_profiling;
 };
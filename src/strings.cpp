@@ -0,0 +1,200 @@
+#include <cstdint>
+#include <cstring>
+
+#include "strings.hpp"
+
+namespace
+{
+    const std::string EMPTY_STRING;
+
+    /// Characters of a string in the pool, or of a string being looked up
+    struct Key
+    {
+        const char * data;
+        std::size_t length;
+
+        bool operator==(const Key & other) const
+        {
+            return length == other.length && std::memcmp(data, other.data, length) == 0;
+        }
+    };
+
+    /// 64-bit FNV-1a hash
+    struct KeyHash
+    {
+        std::size_t operator()(const Key & key) const
+        {
+            std::uint64_t hash = 14695981039346656037ull;
+            for (std::size_t i = 0; i < key.length; i++) {
+                hash ^= static_cast<unsigned char>(key.data[i]);
+                hash *= 1099511628211ull;
+            }
+
+            return std::size_t(hash);
+        }
+    };
+}
+
+struct StringPool::Table
+{
+    /// Guards the entries, and every change of a reference count to or from zero
+    std::mutex mutex;
+
+    /// Entries by their text; each key refers to the text of its own entry
+    std::unordered_map<Key, InternedString::Entry *, KeyHash> entries;
+};
+
+struct InternedString::Entry
+{
+    Entry(const char * data, std::size_t length, const std::shared_ptr<StringPool::Table> & pTable)
+        : text(data, length)
+        , references(1)
+        , pTable(pTable)
+    {
+        // No further initialisation
+    }
+
+    const std::string text;
+
+    std::atomic<std::size_t> references;
+
+    std::shared_ptr<StringPool::Table> pTable;
+};
+
+// ----------------------------------------------------------------------------
+//
+// InternedString
+//
+// ----------------------------------------------------------------------------
+
+InternedString::InternedString(const InternedString & other)
+    : m_pEntry(other.m_pEntry)
+{
+    if (m_pEntry) {
+        // The other handle keeps the count above zero, so the entry cannot be
+        // removed while it is being copied
+        m_pEntry->references.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+InternedString::~InternedString()
+{
+    if (m_pEntry) {
+        release(m_pEntry);
+    }
+}
+
+InternedString & InternedString::operator=(const InternedString & other)
+{
+    if (other.m_pEntry) {
+        other.m_pEntry->references.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (m_pEntry) {
+        release(m_pEntry);
+    }
+
+    m_pEntry = other.m_pEntry;
+    return *this;
+}
+
+InternedString & InternedString::operator=(InternedString && other)
+{
+    if (this != &other) {
+        if (m_pEntry) {
+            release(m_pEntry);
+        }
+
+        m_pEntry = other.m_pEntry;
+        other.m_pEntry = nullptr;
+    }
+
+    return *this;
+}
+
+const std::string & InternedString::str() const
+{
+    return m_pEntry ? m_pEntry->text : EMPTY_STRING;
+}
+
+void InternedString::release(Entry * pEntry)
+{
+    // Other handles remain, so the entry can be released without a lock
+    std::size_t references = pEntry->references.load(std::memory_order_relaxed);
+    while (references > 1) {
+        if (pEntry->references.compare_exchange_weak(references, references - 1, std::memory_order_acq_rel)) {
+            return;
+        }
+    }
+
+    // This may be the last handle. The count only reaches zero while the table
+    // is locked, so intern() cannot hand out the entry as it is removed. The
+    // entry is deleted after unlocking, since it may hold the last reference
+    // to the table.
+    const std::shared_ptr<StringPool::Table> pTable = pEntry->pTable;
+    Entry * pRemoved = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(pTable->mutex);
+        if (pEntry->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            const Key key = {pEntry->text.data(), pEntry->text.size()};
+            pTable->entries.erase(key);
+            pRemoved = pEntry;
+        }
+    }
+
+    delete pRemoved;
+}
+
+// ----------------------------------------------------------------------------
+//
+// StringPool
+//
+// ----------------------------------------------------------------------------
+
+StringPool::StringPool()
+    : m_pTable(std::make_shared<Table>())
+{
+    // No further initialisation
+}
+
+StringPool::~StringPool()
+{
+    // Entries that are still referenced keep the table alive until they are
+    // released
+}
+
+InternedString StringPool::intern(const char * data, std::size_t length)
+{
+    if (length == 0) {
+        return InternedString();
+    }
+
+    std::lock_guard<std::mutex> lock(m_pTable->mutex);
+    const Key key = {data, length};
+    std::unordered_map<Key, InternedString::Entry *, KeyHash>::const_iterator itr = m_pTable->entries.find(key);
+    if (itr != m_pTable->entries.end()) {
+        itr->second->references.fetch_add(1, std::memory_order_relaxed);
+        return InternedString(itr->second);
+    }
+
+    InternedString::Entry * pEntry = new InternedString::Entry(data, length, m_pTable);
+    const Key stored = {pEntry->text.data(), pEntry->text.size()};
+    m_pTable->entries.insert(std::make_pair(stored, pEntry));
+    return InternedString(pEntry);
+}
+
+StringPoolStats StringPool::getStats() const
+{
+    StringPoolStats stats;
+    std::lock_guard<std::mutex> lock(m_pTable->mutex);
+    for (std::unordered_map<Key, InternedString::Entry *, KeyHash>::const_iterator itr = m_pTable->entries.begin();
+            itr != m_pTable->entries.end(); itr++) {
+        const std::size_t references = itr->second->references.load(std::memory_order_relaxed);
+        stats.strings++;
+        stats.handles += references;
+        stats.uniqueBytes += itr->first.length;
+        stats.referencedBytes += references * itr->first.length;
+    }
+
+    return stats;
+}
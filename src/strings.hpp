@@ -0,0 +1,174 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+
+/// Counters for a StringPool, as reported by Sheet::getStringStats()
+struct StringPoolStats
+{
+    StringPoolStats()
+        : strings(0)
+        , handles(0)
+        , uniqueBytes(0)
+        , referencedBytes(0)
+    {
+        // No further initialisation
+    }
+
+    /// Bytes that would be needed to give every handle its own copy of its
+    /// string, less the bytes actually stored
+    std::size_t getBytesSaved() const
+    {
+        return referencedBytes - uniqueBytes;
+    }
+
+    /// Distinct strings in the pool
+    std::size_t strings;
+
+    /// Handles that refer to those strings
+    std::size_t handles;
+
+    /// Length of the distinct strings
+    std::size_t uniqueBytes;
+
+    /// Combined length of the strings referred to by every handle
+    std::size_t referencedBytes;
+};
+
+class StringPool;
+
+/**
+ * Handle to a string stored in a StringPool.
+ *
+ * A handle is the size of a pointer, and refers to a single copy of its
+ * string that is shared with every other handle for the same text. Handles
+ * from the same pool are equal if and only if their strings are equal, so
+ * comparing them only compares pointers. Handles from different pools should
+ * be compared by their strings instead.
+ *
+ * Handles count references to their strings, and a string is removed from
+ * its pool when the last handle to it is destroyed. Handles may outlive the
+ * pool that created them, and may be copied and destroyed on any thread.
+ */
+class InternedString
+{
+public:
+    /// Handle to the empty string, which is not stored in any pool
+    InternedString()
+        : m_pEntry(nullptr)
+    {
+        // No further initialisation
+    }
+
+    InternedString(const InternedString & other);
+
+    InternedString(InternedString && other)
+        : m_pEntry(other.m_pEntry)
+    {
+        other.m_pEntry = nullptr;
+    }
+
+    ~InternedString();
+
+    InternedString & operator=(const InternedString & other);
+
+    InternedString & operator=(InternedString && other);
+
+    const std::string & str() const;
+
+    operator const std::string &() const
+    {
+        return str();
+    }
+
+    std::size_t size() const
+    {
+        return str().size();
+    }
+
+    bool empty() const
+    {
+        return m_pEntry == nullptr;
+    }
+
+    bool operator==(const InternedString & other) const
+    {
+        return m_pEntry == other.m_pEntry;
+    }
+
+    bool operator!=(const InternedString & other) const
+    {
+        return m_pEntry != other.m_pEntry;
+    }
+
+private:
+    friend class StringPool;
+
+    struct Entry;
+
+    explicit InternedString(Entry * pEntry)
+        : m_pEntry(pEntry)
+    {
+        // No further initialisation
+    }
+
+    /// Drop a reference to an entry, removing it from its pool if it was the last
+    static void release(Entry * pEntry);
+
+    Entry * m_pEntry;
+};
+
+inline std::ostream & operator<<(std::ostream & os, const InternedString & s)
+{
+    return os << s.str();
+}
+
+/**
+ * Deduplicated store of strings, such as the formulas of a Sheet and the
+ * literals and identifiers within them.
+ *
+ * intern() returns a handle to the copy of a string that is already in the
+ * pool, adding one if there is none. Each distinct string is stored once,
+ * however many cells and formulas refer to it, and is removed once nothing
+ * refers to it, so a pool only holds strings that are still in use.
+ *
+ * Every method may be called from any thread.
+ */
+class StringPool
+{
+public:
+    StringPool();
+
+    ~StringPool();
+
+    InternedString intern(const std::string & s)
+    {
+        return intern(s.data(), s.size());
+    }
+
+    /// Intern a string without first copying it into a std::string
+    InternedString intern(const char * data, std::size_t length);
+
+    /// Count the strings in the pool, and the handles that refer to them
+    StringPoolStats getStats() const;
+
+private:
+
+    /// Disabled copy constructor
+    StringPool(const StringPool &);
+
+    /// Disabled copy assignment operator
+    StringPool & operator=(const StringPool &);
+
+    friend class InternedString;
+
+    struct Table;
+
+    /// Shared with every entry, so that handles can outlive the pool
+    std::shared_ptr<Table> m_pTable;
+};
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+#include "trace.hpp"
+
+namespace
+{
+    /**
+     * Fixed-size ring of events. Only the owning thread writes to a ring, so
+     * publishing an event is a plain store followed by a release store of the
+     * head counter.
+     */
+    struct TraceRing
+    {
+        TraceRing(std::size_t capacity, unsigned int tid)
+            : events(capacity)
+            , head(0)
+            , tid(tid)
+        {
+            // No further initialisation
+        }
+
+        std::vector<TraceEvent> events;
+
+        /// Total number of events ever written to this ring
+        std::atomic<std::uint64_t> head;
+
+        /// Thread identifier reported in the trace
+        unsigned int tid;
+    };
+
+    typedef std::vector<std::shared_ptr<TraceRing> > TraceRings;
+
+    std::mutex g_mutex;
+    TraceRings g_rings;
+    std::size_t g_capacity = 0;
+
+    /// Incremented by each call to Trace::start(), so that threads know to discard stale rings
+    std::atomic<unsigned int> g_generation(0);
+
+    /// Time at which tracing was last started, in steady_clock nanoseconds
+    std::atomic<std::int64_t> g_epoch(0);
+
+    std::atomic<unsigned int> g_nextTid(1);
+
+    /// Ring that the thread writes to, which is shared so that it outlives
+    /// a call to Trace::start() that discards it while an event is written
+    thread_local std::shared_ptr<TraceRing> t_pRing;
+    thread_local unsigned int t_generation = 0;
+    thread_local unsigned int t_tid = 0;
+    thread_local unsigned int t_depth = 0;
+
+    std::int64_t steadyNanos()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    TraceRing & currentRing()
+    {
+        const unsigned int generation = g_generation.load(std::memory_order_acquire);
+        if (t_pRing == nullptr || t_generation != generation) {
+            if (t_tid == 0) {
+                t_tid = g_nextTid.fetch_add(1);
+            }
+
+            // Registration takes the lock, but only happens once per thread
+            // per call to Trace::start()
+            std::lock_guard<std::mutex> lock(g_mutex);
+            t_pRing = std::make_shared<TraceRing>(g_capacity, t_tid);
+            g_rings.push_back(t_pRing);
+            t_generation = generation;
+        }
+
+        return *t_pRing;
+    }
+
+    /**
+     * Write a time in microseconds, with three decimal places, so that times
+     * far into a long trace keep their nanoseconds and are never written in
+     * scientific notation.
+     */
+    void writeMicros(std::ostream & out, std::uint64_t nanos)
+    {
+        const unsigned int fraction = unsigned(nanos % 1000);
+        out << nanos / 1000 << "." << fraction / 100 << fraction / 10 % 10 << fraction % 10;
+    }
+}
+
+void Trace::writeEvent(std::ostream & out, const TraceEvent & event, unsigned int tid)
+{
+    out << "{\"name\":\"" << event.category;
+    if (event.column != 0) {
+        out << " " << Address(event.column, event.row).toString();
+    }
+
+    out << "\",\"cat\":\"" << event.category << "\""
+        << ",\"ph\":\"X\""
+        << ",\"ts\":";
+    writeMicros(out, event.start);
+    out << ",\"dur\":";
+    writeMicros(out, event.duration);
+    out << ",\"pid\":1"
+        << ",\"tid\":" << tid
+        << ",\"args\":{";
+
+    if (event.column != 0) {
+        out << "\"cell\":\"" << Address(event.column, event.row).toString() << "\",";
+    }
+
+    out << "\"depth\":" << event.depth << "}}";
+}
+
+std::atomic<bool> Trace::s_enabled(false);
+
+void Trace::start(std::size_t capacity)
+{
+    // Threads may still be writing to the old rings, which they hold until
+    // they next record an event
+    std::lock_guard<std::mutex> lock(g_mutex);
+    g_rings.clear();
+    g_capacity = std::max<std::size_t>(capacity, 1);
+    g_epoch.store(steadyNanos());
+    g_generation.fetch_add(1, std::memory_order_release);
+    s_enabled.store(true);
+}
+
+void Trace::stop()
+{
+    s_enabled.store(false);
+}
+
+std::size_t Trace::write(std::ostream & out)
+{
+    std::lock_guard<std::mutex> lock(g_mutex);
+
+    std::size_t count = 0;
+    out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for (TraceRings::const_iterator itr = g_rings.begin(); itr != g_rings.end(); itr++) {
+        const TraceRing & ring = **itr;
+        const std::uint64_t head = ring.head.load(std::memory_order_acquire);
+        const std::uint64_t size = std::min<std::uint64_t>(head, ring.events.size());
+        for (std::uint64_t i = head - size; i < head; i++) {
+            if (count > 0) {
+                out << ",";
+            }
+            writeEvent(out, ring.events[i % ring.events.size()], ring.tid);
+            count++;
+        }
+    }
+    out << "]}" << std::endl;
+
+    return count;
+}
+
+std::uint64_t Trace::now()
+{
+    return std::uint64_t(steadyNanos() - g_epoch.load(std::memory_order_relaxed));
+}
+
+void Trace::record(const TraceEvent & event)
+{
+    TraceRing & ring = currentRing();
+    const std::uint64_t head = ring.head.load(std::memory_order_relaxed);
+    ring.events[head % ring.events.size()] = event;
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+void TraceSpan::begin(const char * category, unsigned int column, unsigned int row)
+{
+    m_event.category = category;
+    m_event.column = column;
+    m_event.row = row;
+    m_event.depth = t_depth++;
+    m_event.start = Trace::now();
+    m_event.duration = 0;
+}
+
+void TraceSpan::end()
+{
+    m_event.duration = Trace::now() - m_event.start;
+    t_depth--;
+
+    // Tracing may have been stopped while this span was open; it is still
+    // recorded, so that the trace contains a complete picture of the work
+    // that was in flight.
+    Trace::record(m_event);
+}
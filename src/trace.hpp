@@ -0,0 +1,144 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+#include "address.hpp"
+
+/**
+ * A single completed span, as recorded by TraceSpan.
+ */
+struct TraceEvent
+{
+    /// Span category, e.g. "parse" or "eval"; must point to static storage
+    const char * category;
+
+    /// Cell the span relates to; both are zero when not tied to a cell
+    unsigned int column;
+    unsigned int row;
+
+    /// Start time and duration, in nanoseconds since tracing was started
+    std::uint64_t start;
+    std::uint64_t duration;
+
+    /// Number of spans that were open on the same thread when this one began
+    unsigned int depth;
+};
+
+/**
+ * Optional recalculation tracing.
+ *
+ * While tracing is enabled, each thread that records a span writes it into a
+ * ring buffer that only that thread writes to, so recording never takes a
+ * lock. When a ring fills up, the oldest events are overwritten.
+ *
+ * The recorded events can be written out in Chrome trace format, which can be
+ * loaded into chrome://tracing or the Perfetto UI.
+ */
+class Trace
+{
+public:
+    /**
+     * Begin recording spans, discarding any previously recorded events.
+     *
+     * @param   capacity  Maximum number of events retained per thread
+     */
+    static void start(std::size_t capacity = 1 << 16);
+
+    /**
+     * Stop recording spans. Events recorded so far are kept until the next
+     * call to start().
+     */
+    static void stop();
+
+    /**
+     * Returns true if spans are currently being recorded.
+     */
+    static bool isEnabled()
+    {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * Write all retained events as Chrome trace JSON.
+     *
+     * This should only be called once the threads being traced are idle, as
+     * events that are written concurrently may be skipped or torn.
+     *
+     * @param   out  Stream to write to
+     *
+     * @returns number of events written
+     */
+    static std::size_t write(std::ostream & out);
+
+    /**
+     * Write a single event as a Chrome trace JSON object, as write() does for
+     * each retained event. Times are written in microseconds.
+     *
+     * @param   out    Stream to write to
+     * @param   event  Event to write
+     * @param   tid    Thread identifier to report for the event
+     */
+    static void writeEvent(std::ostream & out, const TraceEvent & event, unsigned int tid);
+
+private:
+
+    friend class TraceSpan;
+
+    static std::uint64_t now();
+
+    static void record(const TraceEvent & event);
+
+    static std::atomic<bool> s_enabled;
+};
+
+/**
+ * RAII helper that records a span covering its own lifetime.
+ *
+ * When tracing is disabled, constructing and destroying a TraceSpan costs a
+ * single test of a flag that rarely changes.
+ */
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char * category)
+        : m_active(Trace::isEnabled())
+    {
+        if (m_active) {
+            begin(category, 0, 0);
+        }
+    }
+
+    TraceSpan(const char * category, const Address & address)
+        : m_active(Trace::isEnabled())
+    {
+        if (m_active) {
+            begin(category, address.column, address.row);
+        }
+    }
+
+    ~TraceSpan()
+    {
+        if (m_active) {
+            end();
+        }
+    }
+
+private:
+
+    /// Disabled copy constructor
+    TraceSpan(const TraceSpan &);
+
+    /// Disabled copy assignment operator
+    TraceSpan & operator=(const TraceSpan &);
+
+    void begin(const char * category, unsigned int column, unsigned int row);
+
+    void end();
+
+    bool m_active;
+
+    TraceEvent m_event;
+};
@@ -4,5 +4,5 @@
 
 inline std::string getStr(const char * beg, const char * end)
 {
-    return std::string(beg).substr(0, end-beg);
+    return std::string(beg, end);
 }
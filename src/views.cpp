@@ -0,0 +1,352 @@
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+
+#include "ast.hpp"
+#include "lookup.hpp"
+#include "views.hpp"
+
+namespace
+{
+    /// Format a number in the same way as the result of an arithmetic operator
+    std::string toString(double number)
+    {
+        std::stringstream ss;
+        ss << number;
+        return ss.str();
+    }
+
+    /**
+     * Add a number to a sum that is held exactly, as partial sums whose bits
+     * do not overlap, using Shewchuk's algorithm. Subtracting a number by
+     * adding its negation gives exactly the sum of the remaining numbers.
+     */
+    void addExactly(std::vector<double> & partials, double number)
+    {
+        std::size_t count = 0;
+        for (std::size_t i = 0; i < partials.size(); i++) {
+            double partial = partials[i];
+            if (std::fabs(number) < std::fabs(partial)) {
+                std::swap(number, partial);
+            }
+
+            const double high = number + partial;
+            const double low = partial - (high - number);
+            if (low != 0) {
+                partials[count++] = low;
+            }
+            number = high;
+        }
+
+        partials.resize(count);
+        partials.push_back(number);
+    }
+
+    /**
+     * Round a sum that is held exactly to the nearest number, so that the
+     * result does not depend on the order that numbers were added in.
+     */
+    double roundExactly(const std::vector<double> & partials)
+    {
+        if (partials.empty()) {
+            return 0;
+        }
+
+        std::size_t i = partials.size() - 1;
+        double high = partials[i];
+        double low = 0;
+        while (i > 0) {
+            const double number = high;
+            const double partial = partials[--i];
+            high = number + partial;
+            low = partial - (high - number);
+            if (low != 0) {
+                break;
+            }
+        }
+
+        // A sum that lies halfway between two numbers is rounded towards the
+        // partial sums that remain, which decide which way it should go
+        if (i > 0 && ((low < 0 && partials[i - 1] < 0) || (low > 0 && partials[i - 1] > 0))) {
+            const double twice = low * 2;
+            const double rounded = high + twice;
+            if (twice == rounded - high) {
+                high = rounded;
+            }
+        }
+
+        return high;
+    }
+
+    /// Orders rows by their keys, and rows with equal keys by their positions
+    struct RowOrder
+    {
+        const std::vector<SortKey> & keys;
+
+        bool operator()(std::size_t lhs, std::size_t rhs) const
+        {
+            if (isRowBefore(keys, lhs, rhs)) {
+                return true;
+            } else if (isRowBefore(keys, rhs, lhs)) {
+                return false;
+            }
+
+            return lhs < rhs;
+        }
+    };
+}
+
+// ----------------------------------------------------------------------------
+//
+// View
+//
+// ----------------------------------------------------------------------------
+
+View::View()
+{
+    // No further initialisation
+}
+
+void View::update(const std::vector<const LookupTable *> & tables, Array & result)
+{
+    // The changes to a table only lead from the version before it
+    bool rebuilding = m_versions.size() != tables.size();
+    for (std::size_t i = 0; i < tables.size() && !rebuilding; i++) {
+        rebuilding = m_versions[i] != tables[i]->getVersion() && m_versions[i] != tables[i]->getPreviousVersion();
+    }
+
+    if (rebuilding) {
+        rebuild(tables);
+    } else {
+        for (std::size_t i = 0; i < tables.size(); i++) {
+            if (m_versions[i] == tables[i]->getVersion()) {
+                continue;
+            }
+
+            const Range & range = tables[i]->getRange();
+            const std::vector<RangeCell> & changes = tables[i]->getChanges();
+            for (std::vector<RangeCell>::const_iterator itr = changes.begin(); itr != changes.end(); itr++) {
+                setCell(i, itr->address.row - range.first.row, itr->address.column - range.first.column,
+                    itr->value);
+            }
+        }
+    }
+
+    m_versions.resize(tables.size());
+    for (std::size_t i = 0; i < tables.size(); i++) {
+        m_versions[i] = tables[i]->getVersion();
+    }
+
+    getArray(tables, result);
+}
+
+// ----------------------------------------------------------------------------
+//
+// SortedView
+//
+// ----------------------------------------------------------------------------
+
+SortedView::SortedView(std::size_t index, bool descending)
+    : m_index(index)
+    , m_descending(descending)
+    , m_sorted(false)
+    , m_numeric(false)
+    , m_keys(1)
+{
+    // No further initialisation
+}
+
+void SortedView::rebuild(const std::vector<const LookupTable *> &)
+{
+    // The keys are read from the range when the view's values are retrieved
+    m_sorted = false;
+    m_changed.clear();
+}
+
+void SortedView::setCell(std::size_t, std::size_t row, std::size_t column, const Rope &)
+{
+    if (m_sorted && column == m_index) {
+        m_changed.push_back(row);
+    }
+}
+
+void SortedView::getArray(const std::vector<const LookupTable *> & tables, Array & result)
+{
+    Array array;
+    tables.front()->getArray(array);
+
+    // A range whose cells all become numbers, or stop being numbers, has its
+    // values read differently, so its keys are read again
+    if (!m_sorted || array.values.numeric != m_numeric || m_order.size() != array.rows) {
+        readSortKey(array, m_index, false, m_descending, m_keys.front());
+        sortRows(m_keys, array.rows, 0, m_order);
+        m_sorted = true;
+        m_numeric = array.values.numeric;
+    } else if (!m_changed.empty()) {
+        std::sort(m_changed.begin(), m_changed.end());
+        m_changed.erase(std::unique(m_changed.begin(), m_changed.end()), m_changed.end());
+
+        // Rows whose keys have changed are taken out of the order, which
+        // leaves the rest in order, and merged back in once they are sorted
+        // by their new keys. Rows are ordered by their positions as well as
+        // their keys, so this gives the same order as sorting every row.
+        std::vector<unsigned char> changed(m_order.size(), 0);
+        for (std::vector<std::size_t>::const_iterator itr = m_changed.begin(); itr != m_changed.end(); itr++) {
+            changed[*itr] = 1;
+            updateSortKey(array, m_index, false, *itr, m_keys.front());
+        }
+
+        std::vector<std::size_t> kept;
+        kept.reserve(m_order.size() - m_changed.size());
+        for (std::vector<std::size_t>::const_iterator itr = m_order.begin(); itr != m_order.end(); itr++) {
+            if (!changed[*itr]) {
+                kept.push_back(*itr);
+            }
+        }
+
+        const RowOrder order = {m_keys};
+        std::sort(m_changed.begin(), m_changed.end(), order);
+        std::merge(kept.begin(), kept.end(), m_changed.begin(), m_changed.end(), m_order.begin(), order);
+    }
+
+    m_changed.clear();
+    selectRows(array, false, m_order, result);
+}
+
+// ----------------------------------------------------------------------------
+//
+// GroupedView
+//
+// ----------------------------------------------------------------------------
+
+bool GroupedView::GroupKey::operator<(const GroupKey & other) const
+{
+    if (kind != other.kind) {
+        return kind < other.kind;
+    } else if (kind == SortKey::KIND_NUMBER) {
+        return number < other.number;
+    }
+
+    return text < other.text;
+}
+
+GroupedView::GroupedView(Function function)
+    : m_function(function)
+{
+    // No further initialisation
+}
+
+void GroupedView::rebuild(const std::vector<const LookupTable *> & tables)
+{
+    const Range & range = tables.front()->getRange();
+    const std::size_t rows = std::size_t(range.last.row - range.first.row) + 1;
+    m_keys.assign(rows, Rope());
+    m_values.assign(rows, Rope());
+    m_groups.clear();
+    for (std::size_t i = 0; i < tables.size(); i++) {
+        std::vector<Rope> & values = i == 0 ? m_keys : m_values;
+        const Range & cellRange = tables[i]->getRange();
+        const std::vector<RangeCell> & cells = tables[i]->getCells();
+        for (std::vector<RangeCell>::const_iterator itr = cells.begin(); itr != cells.end(); itr++) {
+            const std::size_t row = itr->address.row - cellRange.first.row;
+            if (row < rows) {
+                values[row] = itr->value;
+            }
+        }
+    }
+
+    for (std::size_t row = 0; row < rows; row++) {
+        addRow(row, true);
+    }
+}
+
+void GroupedView::setCell(std::size_t range, std::size_t row, std::size_t, const Rope & value)
+{
+    if (row >= m_keys.size()) {
+        return;
+    }
+
+    addRow(row, false);
+    (range == 0 ? m_keys : m_values)[row] = value;
+    addRow(row, true);
+}
+
+void GroupedView::getArray(const std::vector<const LookupTable *> &, Array & result)
+{
+    std::vector<Rope> values;
+    values.reserve(m_groups.size() * 2);
+    for (std::map<GroupKey, Group>::const_iterator itr = m_groups.begin(); itr != m_groups.end(); itr++) {
+        const GroupKey & key = itr->first;
+        const Group & group = itr->second;
+        values.push_back(key.kind == SortKey::KIND_NUMBER ? Rope(toString(key.number)) : Rope(key.text));
+
+        double total = 0;
+        switch (m_function) {
+            case FUNCTION_SUM:
+                total = roundExactly(group.sum);
+                break;
+            case FUNCTION_COUNT:
+                total = double(group.values);
+                break;
+            case FUNCTION_MIN:
+                total = group.ordered.empty() ? 0 : *group.ordered.begin();
+                break;
+            case FUNCTION_MAX:
+                total = group.ordered.empty() ? 0 : *group.ordered.rbegin();
+                break;
+        }
+        values.push_back(toString(total));
+    }
+
+    result.rows = m_groups.size();
+    result.columns = 2;
+    result.values.setStrings(values);
+}
+
+void GroupedView::addRow(std::size_t row, bool adding)
+{
+    // Rows without keys are not in any group
+    GroupKey key;
+    key.kind = readSortValue(m_keys[row], key.number, key.text);
+    if (key.kind == SortKey::KIND_EMPTY) {
+        return;
+    }
+
+    double number = 0;
+    std::string text;
+    const SortKey::Kind kind = readSortValue(m_values[row], number, text);
+    const bool ordered = m_function == FUNCTION_MIN || m_function == FUNCTION_MAX;
+    if (adding) {
+        Group & group = m_groups[key];
+        group.rows++;
+        if (kind != SortKey::KIND_EMPTY) {
+            group.values++;
+        }
+        if (kind == SortKey::KIND_NUMBER) {
+            group.numbers++;
+            addExactly(group.sum, number);
+            if (ordered) {
+                group.ordered.insert(number);
+            }
+        }
+        return;
+    }
+
+    std::map<GroupKey, Group>::iterator itr = m_groups.find(key);
+    Group & group = itr->second;
+    group.rows--;
+    if (kind != SortKey::KIND_EMPTY) {
+        group.values--;
+    }
+    if (kind == SortKey::KIND_NUMBER) {
+        group.numbers--;
+        addExactly(group.sum, -number);
+        if (ordered) {
+            group.ordered.erase(group.ordered.find(number));
+        }
+    }
+
+    if (group.rows == 0) {
+        m_groups.erase(itr);
+    }
+}
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "arrays.hpp"
+#include "rope.hpp"
+
+struct Array;
+
+class LookupTable;
+
+/**
+ * Result of a function over one or more ranges, such as the sorted rows of
+ * SORT or the groups of GROUPBY, that is kept from one recalculation pass to
+ * the next and maintained from the cells that change, rather than being
+ * calculated again from every cell.
+ *
+ * A view remembers the versions of the tables of its ranges. If a table has
+ * only been updated once since then, and its changes were kept, only those
+ * changes are applied to the view; otherwise every cell is read again.
+ */
+class View
+{
+public:
+    View();
+
+    virtual ~View() {}
+
+    /**
+     * Bring the view up to date with the tables of its ranges, and retrieve
+     * its values.
+     *
+     * @param   tables  Tables of the ranges, which are always passed in the
+     *                  same order
+     * @param   result  Receives the values of the view, which has no rows if
+     *                  the view is empty
+     */
+    void update(const std::vector<const LookupTable *> & tables, Array & result);
+
+protected:
+
+    /// Read every cell of the ranges again
+    virtual void rebuild(const std::vector<const LookupTable *> & tables) = 0;
+
+    /**
+     * Change the value of a cell.
+     *
+     * @param   range   Index of the range that holds the cell
+     * @param   row     Row of the cell, counted from zero within its range
+     * @param   column  Column of the cell, counted from zero within its range
+     * @param   value   New value, which is empty if the cell was erased
+     */
+    virtual void setCell(std::size_t range, std::size_t row, std::size_t column, const Rope & value) = 0;
+
+    /// Retrieve the values of the view, once every change has been made
+    virtual void getArray(const std::vector<const LookupTable *> & tables, Array & result) = 0;
+
+private:
+
+    /// Disabled copy constructor
+    View(const View &);
+
+    /// Disabled copy assignment operator
+    View & operator=(const View &);
+
+    /// Versions of the tables when the view was last updated
+    std::vector<unsigned long> m_versions;
+};
+
+/**
+ * Rows of a range, sorted by the values in one of its columns, as for SORT.
+ *
+ * The order of the rows is kept from one update to the next. Rows whose keys
+ * have changed are taken out of the order, sorted, and merged back in, so an
+ * update that changes a few keys costs no more than reading the range.
+ */
+class SortedView : public View
+{
+public:
+    /**
+     * @param   index       Column of the range to sort by, counted from zero
+     * @param   descending  Sort largest values first
+     */
+    SortedView(std::size_t index, bool descending);
+
+protected:
+    virtual void rebuild(const std::vector<const LookupTable *> & tables);
+
+    virtual void setCell(std::size_t range, std::size_t row, std::size_t column, const Rope & value);
+
+    virtual void getArray(const std::vector<const LookupTable *> & tables, Array & result);
+
+private:
+    std::size_t m_index;
+
+    bool m_descending;
+
+    /// Whether the order has been found since the range was last read again
+    bool m_sorted;
+
+    /// Whether the keys were read from an array of numbers, which reads
+    /// some values differently to an array of strings
+    bool m_numeric;
+
+    /// Key of every row, as read from the range
+    std::vector<SortKey> m_keys;
+
+    /// Positions of the rows, in sorted order
+    std::vector<std::size_t> m_order;
+
+    /// Rows whose keys have changed since the last update
+    std::vector<std::size_t> m_changed;
+};
+
+/**
+ * Totals of the values in one range, grouped by the keys in another, as for
+ * GROUPBY. Groups are ordered by key, in the same way as SORT.
+ *
+ * Each group holds running totals, so a changed cell only updates the group
+ * that it leaves and the one it joins. Sums are held exactly, so taking a
+ * value away leaves the same sum as adding up the remaining values afresh,
+ * in any order.
+ */
+class GroupedView : public View
+{
+public:
+    /// Total calculated for each group
+    enum Function
+    {
+        /// Sum of the numbers
+        FUNCTION_SUM,
+
+        /// Number of values that are not empty
+        FUNCTION_COUNT,
+
+        /// Smallest number, or zero if there are none
+        FUNCTION_MIN,
+
+        /// Largest number, or zero if there are none
+        FUNCTION_MAX
+    };
+
+    explicit GroupedView(Function function);
+
+protected:
+    virtual void rebuild(const std::vector<const LookupTable *> & tables);
+
+    virtual void setCell(std::size_t range, std::size_t row, std::size_t column, const Rope & value);
+
+    virtual void getArray(const std::vector<const LookupTable *> & tables, Array & result);
+
+private:
+
+    /// Key of a group, ordered as SORT orders values
+    struct GroupKey
+    {
+        SortKey::Kind kind;
+        double number;
+        std::string text;
+
+        bool operator<(const GroupKey & other) const;
+    };
+
+    struct Group
+    {
+        Group()
+            : rows(0)
+            , values(0)
+            , numbers(0)
+        {
+            // No further initialisation
+        }
+
+        /// Rows with the key
+        std::size_t rows;
+
+        /// Values that are not empty
+        std::size_t values;
+
+        /// Values that are numbers
+        std::size_t numbers;
+
+        /// Sum of the numbers, held exactly as numbers that do not overlap,
+        /// which add up to the sum
+        std::vector<double> sum;
+
+        /// Every number, for the smallest and largest; only kept for MIN and MAX
+        std::multiset<double> ordered;
+    };
+
+    /// Add the value of a row to the total of its group, or take it away
+    void addRow(std::size_t row, bool adding);
+
+    Function m_function;
+
+    /// Key and value of every row, as read from the ranges
+    std::vector<Rope> m_keys;
+    std::vector<Rope> m_values;
+
+    std::map<GroupKey, Group> m_groups;
+};
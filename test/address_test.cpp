@@ -84,3 +84,16 @@ TEST_F(AddressTest, constructionFromString)
     EXPECT_THROW(Address("11"), std::invalid_argument);
     EXPECT_THROW(Address(""), std::invalid_argument);
 }
+
+TEST_F(AddressTest, toString)
+{
+    EXPECT_EQ("A1", Address(1, 1).toString());
+    EXPECT_EQ("B2", Address(2, 2).toString());
+    EXPECT_EQ("Z9", Address(26, 9).toString());
+
+    // Formatting must round-trip through the string constructor
+    const char * addresses[] = { "A1", "AA11", "AB3", "ZZ100", "ABC42" };
+    for (size_t i = 0; i < sizeof(addresses) / sizeof(addresses[0]); i++) {
+        EXPECT_EQ(addresses[i], Address(addresses[i]).toString());
+    }
+}
@@ -0,0 +1,206 @@
+/*
+ * test/arrays_test.cpp
+ *
+ * Copyright (c) 2012 Tristan Penman
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * This file is part of Inspect.
+ *
+ * Inspect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "arrays.hpp"
+#include "ast.hpp"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+class ArraysTest : public testing::Test
+{
+protected:
+    static Array makeArray(size_t rows, size_t columns, const char * const values[])
+    {
+        Array array;
+        array.rows = rows;
+        array.columns = columns;
+        array.values.setStrings(vector<Rope>(values, values + rows * columns));
+        return array;
+    }
+
+    /// Array with many repeated values, which are numbers unless prefixed
+    static Array makeRandomArray(size_t rows, size_t columns, unsigned seed, const string & prefix)
+    {
+        vector<Rope> values;
+        for (size_t i = 0; i < rows * columns; i++) {
+            seed = seed * 1103515245 + 12345;
+            values.push_back(Rope(prefix + to_string((seed >> 16) % 50)));
+        }
+
+        Array array;
+        array.rows = rows;
+        array.columns = columns;
+        array.values.setStrings(values);
+        return array;
+    }
+
+    static vector<string> getColumn(const Array & array, size_t column)
+    {
+        vector<string> values;
+        for (size_t row = 0; row < array.rows; row++) {
+            values.push_back(array.values.getString(row * array.columns + column).str());
+        }
+
+        return values;
+    }
+
+    /// Orders rows by a key of numbers, as a reference for sortRows()
+    struct NumberLess
+    {
+        const SortKey & key;
+
+        bool operator()(size_t lhs, size_t rhs) const
+        {
+            return key.numbers[lhs] < key.numbers[rhs];
+        }
+    };
+};
+
+TEST_F(ArraysTest, sorts_numbers_before_text_and_empty_values_last)
+{
+    const char * const values[] = {"b", "10", "", "9", "a", "B", "-1.5"};
+    const Array array = makeArray(7, 1, values);
+    vector<SortKey> keys(1);
+    vector<size_t> order;
+    Array sorted;
+
+    readSortKey(array, 0, false, false, keys[0]);
+    sortRows(keys, array.rows, 1, order);
+    selectRows(array, false, order, sorted);
+    const char * const ascending[] = {"-1.5", "9", "10", "B", "a", "b", ""};
+    EXPECT_EQ(vector<string>(ascending, ascending + 7), getColumn(sorted, 0));
+
+    readSortKey(array, 0, false, true, keys[0]);
+    sortRows(keys, array.rows, 1, order);
+    selectRows(array, false, order, sorted);
+    const char * const descending[] = {"b", "a", "B", "10", "9", "-1.5", ""};
+    EXPECT_EQ(vector<string>(descending, descending + 7), getColumn(sorted, 0));
+}
+
+TEST_F(ArraysTest, sorts_stably_by_several_keys)
+{
+    const char * const values[] = {
+        "2", "x", "first",
+        "1", "y", "second",
+        "2", "x", "third",
+        "1", "x", "fourth",
+        "2", "w", "fifth"
+    };
+    const Array array = makeArray(5, 3, values);
+    vector<SortKey> keys(2);
+    readSortKey(array, 0, false, true, keys[0]);
+    readSortKey(array, 1, false, false, keys[1]);
+    vector<size_t> order;
+    sortRows(keys, array.rows, 1, order);
+
+    Array sorted;
+    selectRows(array, false, order, sorted);
+    const char * const expected[] = {"fifth", "first", "third", "fourth", "second"};
+    EXPECT_EQ(vector<string>(expected, expected + 5), getColumn(sorted, 2));
+}
+
+TEST_F(ArraysTest, sorts_in_the_same_order_with_any_number_of_threads)
+{
+    const Array array = makeRandomArray(100000, 2, 1, "");
+    vector<SortKey> keys(1);
+    readSortKey(array, 0, false, false, keys[0]);
+
+    // Ties are left in their original order, as they would be by one sort
+    vector<size_t> expected(array.rows);
+    for (size_t i = 0; i < expected.size(); i++) {
+        expected[i] = i;
+    }
+    const NumberLess less = {keys[0]};
+    stable_sort(expected.begin(), expected.end(), less);
+
+    const size_t threads[] = {1, 2, 3, 8};
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+        vector<size_t> order;
+        sortRows(keys, array.rows, threads[i], order);
+        EXPECT_EQ(expected, order) << threads[i] << " threads";
+    }
+}
+
+TEST_F(ArraysTest, finds_unique_rows_with_any_number_of_threads)
+{
+    const Array array = makeRandomArray(20000, 2, 2, "k");
+    map<vector<string>, size_t> counts;
+    vector<size_t> firsts;
+    vector<vector<string> > rows;
+    for (size_t row = 0; row < array.rows; row++) {
+        vector<string> values;
+        values.push_back(array.values.getString(row * 2).str());
+        values.push_back(array.values.getString(row * 2 + 1).str());
+        if (counts[values]++ == 0) {
+            firsts.push_back(row);
+        }
+        rows.push_back(values);
+    }
+
+    vector<size_t> once;
+    for (vector<size_t>::const_iterator itr = firsts.begin(); itr != firsts.end(); itr++) {
+        if (counts[rows[*itr]] == 1) {
+            once.push_back(*itr);
+        }
+    }
+    ASSERT_LT(firsts.size(), array.rows);
+    ASSERT_FALSE(once.empty());
+
+    const size_t threads[] = {1, 2, 3, 8};
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); i++) {
+        vector<size_t> unique;
+        findUniqueRows(array, false, false, threads[i], unique);
+        EXPECT_EQ(firsts, unique) << threads[i] << " threads";
+        findUniqueRows(array, false, true, threads[i], unique);
+        EXPECT_EQ(once, unique) << threads[i] << " threads";
+    }
+}
+
+TEST_F(ArraysTest, selects_and_compares_columns_across)
+{
+    const char * const values[] = {
+        "a", "b", "a", "c",
+        "1", "2", "1", "3"
+    };
+    const Array array = makeArray(2, 4, values);
+    vector<size_t> columns;
+    findUniqueRows(array, true, false, 0, columns);
+    ASSERT_EQ(3u, columns.size());
+
+    vector<size_t> reversed(columns.rbegin(), columns.rend());
+    Array selected;
+    selectRows(array, true, reversed, selected);
+    ASSERT_EQ(2u, selected.rows);
+    ASSERT_EQ(3u, selected.columns);
+    EXPECT_EQ("c", selected.values.getString(0).str());
+    EXPECT_EQ("a", selected.values.getString(2).str());
+    EXPECT_EQ("3", selected.values.getString(3).str());
+    EXPECT_EQ("1", selected.values.getString(5).str());
+}
@@ -0,0 +1,86 @@
+/*
+ * test/dependency_graph_test.cpp
+ *
+ * Copyright (c) 2012 Tristan Penman
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * This file is part of Inspect.
+ *
+ * Inspect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+
+#include "dependency_graph.hpp"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+class DependencyGraphTest : public testing::Test
+{
+protected:
+    static vector<DependencyGraph::Node> toVector(const DependencyGraph::Nodes & nodes)
+    {
+        return vector<DependencyGraph::Node>(nodes.begin, nodes.end);
+    }
+};
+
+TEST_F(DependencyGraphTest, stores_edges_in_both_directions)
+{
+    DependencyGraph graph;
+
+    // Node 0 refers to node 3, which is added later, and node 2 refers to a
+    // node that is never added
+    vector<DependencyGraph::Node> precedents;
+    precedents.push_back(3);
+    EXPECT_EQ(0, graph.addNode(precedents));
+
+    precedents.clear();
+    EXPECT_EQ(1, graph.addNode(precedents));
+
+    precedents.push_back(3);
+    precedents.push_back(0);
+    precedents.push_back(9);
+    precedents.push_back(0);
+    EXPECT_EQ(2, graph.addNode(precedents));
+
+    precedents.assign(1, 1);
+    EXPECT_EQ(3, graph.addNode(precedents));
+    graph.finish();
+
+    EXPECT_EQ(4, graph.getNodeCount());
+    EXPECT_EQ(4, graph.getEdgeCount());
+
+    // Duplicates are removed, and edges are kept in ascending order
+    const DependencyGraph::Node node2[] = {0, 3};
+    EXPECT_EQ(vector<DependencyGraph::Node>(node2, node2 + 2), toVector(graph.getPrecedents(2)));
+    EXPECT_TRUE(toVector(graph.getPrecedents(1)).empty());
+    EXPECT_EQ(vector<DependencyGraph::Node>(1, 3), toVector(graph.getPrecedents(0)));
+
+    EXPECT_EQ(vector<DependencyGraph::Node>(1, 2), toVector(graph.getDependents(0)));
+    EXPECT_EQ(vector<DependencyGraph::Node>(1, 3), toVector(graph.getDependents(1)));
+    EXPECT_TRUE(toVector(graph.getDependents(2)).empty());
+    const DependencyGraph::Node node3[] = {0, 2};
+    EXPECT_EQ(vector<DependencyGraph::Node>(node3, node3 + 2), toVector(graph.getDependents(3)));
+}
+
+TEST_F(DependencyGraphTest, empty_graph)
+{
+    DependencyGraph graph;
+    graph.finish();
+    EXPECT_EQ(0, graph.getNodeCount());
+    EXPECT_EQ(0, graph.getEdgeCount());
+}
@@ -0,0 +1,186 @@
+/*
+ * test/formula_test.cpp
+ *
+ * Copyright (c) 2012 Tristan Penman
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * This file is part of Inspect.
+ *
+ * Inspect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "formula.hpp"
+
+using namespace std;
+
+namespace
+{
+    /// Rows are inserted before row 3, then row 6 (after moving) is deleted
+    bool moveAddress(Address & address, void *)
+    {
+        if (address.row >= 3) {
+            address.row++;
+        }
+
+        return address.row != 6;
+    }
+
+    bool moveRange(Range & range, void *)
+    {
+        if (range.first.row >= 3) {
+            range.first.row++;
+        }
+        if (range.last.row >= 3) {
+            range.last.row++;
+        }
+
+        return !(range.first.row == 6 && range.last.row == 6);
+    }
+}
+
+class FormulaTest : public testing::Test
+{
+
+};
+
+TEST_F(FormulaTest, compiler_reused_for_many_formulas)
+{
+    FormulaCompiler compiler;
+
+    EXPECT_EQ("(1 + 2)", string(compiler.compile("=1+2")));
+    EXPECT_EQ("(addr{1,1} * 2)", string(compiler.compile("=A1*2")));
+    EXPECT_EQ("str{Hello}", string(compiler.compile("'Hello")));
+    EXPECT_EQ("((1 + 2) + 3)", string(compiler.compile("=1+2+3")));
+}
+
+TEST_F(FormulaTest, compiler_recovers_after_invalid_formula)
+{
+    FormulaCompiler compiler;
+
+    EXPECT_THROW(compiler.compile("=1+"), runtime_error);
+    EXPECT_THROW(compiler.compile("=(1+2"), runtime_error);
+    EXPECT_THROW(compiler.compile("=1 ? 2"), runtime_error);
+
+    // The same compiler must still be usable after each failure
+    EXPECT_EQ("(1 + 2)", string(compiler.compile("=1+2")));
+}
+
+TEST_F(FormulaTest, compilers_can_be_used_in_parallel)
+{
+    const int numThreads = 4;
+    const int numFormulas = 1000;
+
+    vector<int> failures(numThreads, 0);
+    vector<thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.push_back(thread([t, &failures]() {
+            FormulaCompiler compiler;
+            for (int i = 0; i < numFormulas; i++) {
+                stringstream formula, expected;
+                formula << "=A" << (i + 1) << "+" << t;
+                expected << "(addr{1," << (i + 1) << "} + " << t << ")";
+                if (string(compiler.compile(formula.str())) != expected.str()) {
+                    failures[t]++;
+                }
+            }
+        }));
+    }
+
+    for (vector<thread>::iterator itr = threads.begin(); itr != threads.end(); itr++) {
+        itr->join();
+    }
+
+    for (int t = 0; t < numThreads; t++) {
+        EXPECT_EQ(0, failures[t]);
+    }
+}
+
+TEST_F(FormulaTest, ranges_may_be_passed_to_functions)
+{
+    FormulaCompiler compiler;
+
+    EXPECT_EQ("fn{SUM}(range{1,1:2,3})", string(compiler.compile("=SUM(A1:B3)")));
+    EXPECT_EQ("(fn{SUM}(range{1,1:2,3},5,range{3,1:3,1}) + addr{1,1})",
+        string(compiler.compile("=SUM(B3:A1, 5, C1:C1) + A1")));
+
+    // Cells within ranges are not references
+    const Formula formula = compiler.compile("=SUM(B3:A1, A2) + SUM(C1:C10)");
+    ASSERT_EQ(2, formula.getRanges().size());
+    EXPECT_EQ(Range("A1:B3"), formula.getRanges()[0]);
+    EXPECT_EQ(Range("C1:C10"), formula.getRanges()[1]);
+    ASSERT_EQ(1, formula.getReferences().size());
+    EXPECT_EQ(Address("A2"), formula.getReferences()[0]);
+
+    // Ranges have relative shapes, like references
+    EXPECT_EQ(compiler.compile("=SUM(A1:A3)").getShape(Address("B1")),
+        compiler.compile("=SUM(A2:A4)").getShape(Address("B2")));
+
+    // Elsewhere, a range is an array, which has no single value
+    EXPECT_EQ(1, compiler.compile("=A1:B2*2").getRanges().size());
+    EXPECT_EQ("ERROR", compiler.compile("=A1:B2").evaluate(NULL, NULL, NULL, NULL).str());
+    EXPECT_THROW(compiler.compile("=SUM(A1:)"), runtime_error);
+}
+
+TEST_F(FormulaTest, relocated_formulas_keep_the_text_around_references)
+{
+    FormulaCompiler compiler;
+
+    const string source = "= SUM( A1 : B3, \"A3\" )+a4 *  2";
+    const Formula formula = compiler.compile(source);
+    string text;
+    const Formula relocated = formula.relocate(source, moveAddress, moveRange, nullptr, text);
+    EXPECT_EQ("= SUM( A1:B4, \"A3\" )+A5 *  2", text);
+    EXPECT_EQ(string(compiler.compile(text)), string(relocated));
+    ASSERT_EQ(1, relocated.getRanges().size());
+    EXPECT_EQ(Range("A1:B4"), relocated.getRanges()[0]);
+    ASSERT_EQ(1, relocated.getReferences().size());
+    EXPECT_EQ(Address("A5"), relocated.getReferences()[0]);
+
+    // References that do not move are copied exactly as they were written,
+    // and the copy can itself be relocated
+    const string unmoved = "=a1+SUM(A2:B2)";
+    string unchanged;
+    compiler.compile(unmoved).relocate(unmoved, moveAddress, moveRange, nullptr, unchanged);
+    EXPECT_EQ(unmoved, unchanged);
+
+    const string first = text;
+    const Formula twice = relocated.relocate(first, moveAddress, moveRange, nullptr, text);
+    EXPECT_EQ("= SUM( A1:B5, \"A3\" )+#REF! *  2", text);
+    EXPECT_EQ(string(compiler.compile(text)), string(twice));
+}
+
+TEST_F(FormulaTest, deleted_references_are_written_as_ref_errors)
+{
+    FormulaCompiler compiler;
+
+    const string source = "=A5+SUM(C5:D5)+SUM(A2:A5)";
+    string text;
+    const Formula relocated = compiler.compile(source).relocate(source, moveAddress, moveRange, nullptr, text);
+    EXPECT_EQ("=#REF!+SUM(#REF!)+SUM(A2:A6)", text);
+    EXPECT_TRUE(relocated.getReferences().empty());
+    ASSERT_EQ(1, relocated.getRanges().size());
+
+    // #REF! may be compiled on its own, or within a formula, and is an error
+    EXPECT_EQ("(#REF! + 1)", string(compiler.compile("=#REF!+1")));
+    EXPECT_EQ("#REF!", string(compiler.compile("#REF!")));
+    EXPECT_EQ("#REF!", compiler.compile("=#REF!").getShape(Address("A1")));
+}
@@ -0,0 +1,552 @@
+/*
+ * test/functions_test.cpp
+ *
+ * Copyright (c) 2012 Tristan Penman
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * This file is part of Inspect.
+ *
+ * Inspect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <memory>
+#include <stdexcept>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "address.hpp"
+#include "sheet.hpp"
+
+using namespace std;
+
+class FunctionsTest : public testing::Test
+{
+
+};
+
+TEST_F(FunctionsTest, comparisons)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=2<10");
+    sheet.setFormula(Address("A2"), "=\"2\"<\"10\"");
+    sheet.setFormula(Address("A3"), "=1+1=2");
+    sheet.setFormula(Address("A4"), "=\"a\"<>\"a\"");
+    sheet.setFormula(Address("A5"), "=3>=3");
+    sheet.recalculate();
+
+    // Values that are both numbers are compared numerically
+    EXPECT_EQ("TRUE", sheet.getValue(Address("A1")));
+    EXPECT_EQ("TRUE", sheet.getValue(Address("A2")));
+    EXPECT_EQ("TRUE", sheet.getValue(Address("A3")));
+    EXPECT_EQ("FALSE", sheet.getValue(Address("A4")));
+    EXPECT_EQ("TRUE", sheet.getValue(Address("A5")));
+}
+
+TEST_F(FunctionsTest, logical_functions)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=AND(1, \"true\", 2>1)");
+    sheet.setFormula(Address("A2"), "=or(0, \"FALSE\")");
+    sheet.setFormula(Address("A3"), "=NOT(0)");
+    sheet.setFormula(Address("A4"), "=CHOOSE(2, \"a\", \"b\", \"c\")");
+    sheet.setFormula(Address("A5"), "=CHOOSE(4, \"a\", \"b\", \"c\")");
+    sheet.setFormula(Address("A6"), "=IF(\"maybe\", 1, 2)");
+    sheet.setFormula(Address("A7"), "=IF(0, 1)");
+    sheet.recalculate();
+
+    EXPECT_EQ("TRUE", sheet.getValue(Address("A1")));
+    EXPECT_EQ("FALSE", sheet.getValue(Address("A2")));
+    EXPECT_EQ("TRUE", sheet.getValue(Address("A3")));
+    EXPECT_EQ("b", sheet.getValue(Address("A4")));
+    EXPECT_EQ("ERROR", sheet.getValue(Address("A5")));
+    EXPECT_EQ("ERROR", sheet.getValue(Address("A6")));
+    EXPECT_EQ("FALSE", sheet.getValue(Address("A7")));
+
+    sheet.setFormula(Address("A8"), "=UNKNOWN(1)");
+    EXPECT_THROW(sheet.recalculate(), runtime_error);
+}
+
+TEST_F(FunctionsTest, only_arguments_that_are_used_are_evaluated)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=5");
+
+    // C1 refers back to B1, so evaluating both branches would be a cycle
+    sheet.setFormula(Address("B1"), "=IF(A1>1, \"big\", C1)");
+    sheet.setFormula(Address("C1"), "=B1");
+    sheet.setFormula(Address("D1"), "=OR(A1, C1)");
+    sheet.setFormula(Address("E1"), "=AND(0, C1)");
+    sheet.setFormula(Address("F1"), "=CHOOSE(1, A1, C1)");
+    sheet.setProfiling(true);
+    sheet.recalculate();
+
+    EXPECT_EQ("big", sheet.getValue(Address("B1")));
+    EXPECT_EQ("big", sheet.getValue(Address("C1")));
+    EXPECT_EQ("TRUE", sheet.getValue(Address("D1")));
+    EXPECT_EQ("FALSE", sheet.getValue(Address("E1")));
+    EXPECT_EQ("5", sheet.getValue(Address("F1")));
+
+    // Only references that were read are recorded as dependencies
+    const vector<CellProfile> profiles = sheet.getHotCells(10);
+    for (vector<CellProfile>::const_iterator itr = profiles.begin(); itr != profiles.end(); itr++) {
+        if (itr->address == Address("B1")) {
+            EXPECT_EQ(1, itr->fanIn);
+            EXPECT_EQ(1, itr->fanOut);
+        } else if (itr->address == Address("C1")) {
+            EXPECT_EQ(1, itr->fanIn);
+            EXPECT_EQ(0, itr->fanOut);
+        } else if (itr->address == Address("A1")) {
+            EXPECT_EQ(3, itr->fanOut);
+        }
+    }
+
+    // Once the other branch is taken, the cycle is real
+    sheet.setFormula(Address("A1"), "=0");
+    EXPECT_THROW(sheet.recalculate(), runtime_error);
+}
+
+TEST_F(FunctionsTest, sum_of_ranges_and_values)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    sheet.setFormula(Address("A2"), "=2.5");
+    sheet.setFormula(Address("A3"), "'text");
+    sheet.setFormula(Address("B2"), "=A1+A2");
+    sheet.setFormula(Address("C1"), "=SUM(A1:B3)");
+    sheet.setFormula(Address("C2"), "=SUM(A1:A2, 10, B9)");
+    sheet.setFormula(Address("C3"), "=SUM(A1, A3)");
+    sheet.setFormula(Address("C4"), "=SUM(D1:D10)");
+    sheet.recalculate();
+
+    // Text and empty cells within ranges are ignored, but text given as a
+    // value is not
+    EXPECT_EQ("7", sheet.getValue(Address("C1")));
+    EXPECT_EQ("13.5", sheet.getValue(Address("C2")));
+    EXPECT_EQ("ERROR", sheet.getValue(Address("C3")));
+    EXPECT_EQ("0", sheet.getValue(Address("C4")));
+}
+
+TEST_F(FunctionsTest, match_finds_positions_within_a_row_or_column)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=10");
+    sheet.setFormula(Address("A2"), "=20");
+    sheet.setFormula(Address("A3"), "=20");
+    sheet.setFormula(Address("A4"), "=30");
+    sheet.setFormula(Address("A5"), "'pear");
+    sheet.setFormula(Address("B1"), "=MATCH(20, A1:A5, 0)");
+    sheet.setFormula(Address("B2"), "=MATCH(25, A1:A5)");
+    sheet.setFormula(Address("B3"), "=MATCH(20, A1:A5, 1)");
+    sheet.setFormula(Address("B4"), "=MATCH(15, A1:A5, -1)");
+    sheet.setFormula(Address("B5"), "=MATCH(5, A1:A5)");
+    sheet.setFormula(Address("B6"), "=MATCH(\"pear\", A1:A5, 0)");
+    sheet.setFormula(Address("B7"), "=MATCH(\"20.0\", A1:A5, 0)");
+    sheet.setFormula(Address("B8"), "=MATCH(1, A1:B2, 0)");
+    sheet.setFormula(Address("C1"), "=MATCH(\"b\", D1:F1, 0)");
+    sheet.setFormula(Address("D1"), "'a");
+    sheet.setFormula(Address("E1"), "'b");
+    sheet.recalculate();
+
+    // Approximate matches find the last of several equal values
+    EXPECT_EQ("2", sheet.getValue(Address("B1")));
+    EXPECT_EQ("3", sheet.getValue(Address("B2")));
+    EXPECT_EQ("3", sheet.getValue(Address("B3")));
+    EXPECT_EQ("3", sheet.getValue(Address("B4")));
+    EXPECT_EQ("ERROR", sheet.getValue(Address("B5")));
+    EXPECT_EQ("5", sheet.getValue(Address("B6")));
+
+    // Numbers are matched numerically, as they are compared by =
+    EXPECT_EQ("2", sheet.getValue(Address("B7")));
+
+    // Only a single row or column can be searched
+    EXPECT_EQ("ERROR", sheet.getValue(Address("B8")));
+    EXPECT_EQ("2", sheet.getValue(Address("C1")));
+}
+
+TEST_F(FunctionsTest, vlookup_and_xlookup_return_values_from_matching_rows)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    sheet.setFormula(Address("A2"), "=5");
+    sheet.setFormula(Address("A3"), "=10");
+    sheet.setFormula(Address("A4"), "=5");
+    sheet.setFormula(Address("B1"), "'one");
+    sheet.setFormula(Address("B2"), "'five");
+    sheet.setFormula(Address("B3"), "'ten");
+    sheet.setFormula(Address("B4"), "'five again");
+    sheet.setFormula(Address("C1"), "=VLOOKUP(10, A1:B3, 2, \"FALSE\")");
+    sheet.setFormula(Address("C2"), "=VLOOKUP(7, A1:B3, 2)");
+    sheet.setFormula(Address("C3"), "=VLOOKUP(7, A1:B3, 2, 0)");
+    sheet.setFormula(Address("C4"), "=VLOOKUP(10, A1:B3, 3, \"FALSE\")");
+    sheet.setFormula(Address("D1"), "=XLOOKUP(5, A1:A4, B1:B4)");
+    sheet.setFormula(Address("D2"), "=XLOOKUP(5, A1:A4, B1:B4, \"none\", 0, -1)");
+    sheet.setFormula(Address("D3"), "=XLOOKUP(6, A1:A4, B1:B4, \"none\")");
+    sheet.setFormula(Address("D4"), "=XLOOKUP(6, A1:A4, B1:B4, \"none\", 1)");
+    sheet.setFormula(Address("D5"), "=XLOOKUP(6, A1:A4, B1:B4, \"none\", -1)");
+    sheet.setFormula(Address("D6"), "=XLOOKUP(6, A1:A4, B1:B3)");
+    sheet.recalculate();
+
+    EXPECT_EQ("ten", sheet.getValue(Address("C1")));
+    EXPECT_EQ("five", sheet.getValue(Address("C2")));
+    EXPECT_EQ("ERROR", sheet.getValue(Address("C3")));
+    EXPECT_EQ("ERROR", sheet.getValue(Address("C4")));
+    EXPECT_EQ("five", sheet.getValue(Address("D1")));
+    EXPECT_EQ("five again", sheet.getValue(Address("D2")));
+    EXPECT_EQ("none", sheet.getValue(Address("D3")));
+    EXPECT_EQ("ten", sheet.getValue(Address("D4")));
+    EXPECT_EQ("five", sheet.getValue(Address("D5")));
+
+    // Results must be the same length as the range that is searched
+    EXPECT_EQ("ERROR", sheet.getValue(Address("D6")));
+}
+
+TEST_F(FunctionsTest, lookups_follow_changes_to_the_range_they_search)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "'apple");
+    sheet.setFormula(Address("A2"), "'banana");
+    sheet.setFormula(Address("A3"), "=B1");
+    sheet.setFormula(Address("B1"), "'cherry");
+    sheet.setFormula(Address("C1"), "=MATCH(\"cherry\", A1:A4, 0)");
+    sheet.setFormula(Address("C2"), "=MATCH(\"date\", A1:A4, 0)");
+    sheet.setFormula(Address("C3"), "=MATCH(\"banana\", A1:A4, 0)");
+    sheet.recalculate();
+
+    EXPECT_EQ("3", sheet.getValue(Address("C1")));
+    EXPECT_EQ("ERROR", sheet.getValue(Address("C2")));
+    EXPECT_EQ("2", sheet.getValue(Address("C3")));
+
+    // Cells within the range that are set, changed or erased between passes
+    // are seen by the next pass, including cells that are recalculated by it
+    sheet.setFormula(Address("A4"), "'date");
+    sheet.setFormula(Address("B1"), "'banana");
+    sheet.erase(Address("A2"));
+    sheet.recalculate();
+
+    EXPECT_EQ("ERROR", sheet.getValue(Address("C1")));
+    EXPECT_EQ("4", sheet.getValue(Address("C2")));
+    EXPECT_EQ("3", sheet.getValue(Address("C3")));
+}
+
+TEST_F(FunctionsTest, conditional_sums_counts_and_averages)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "'east");
+    sheet.setFormula(Address("A2"), "'west");
+    sheet.setFormula(Address("A3"), "'east");
+    sheet.setFormula(Address("A4"), "'north");
+    sheet.setFormula(Address("B1"), "=10");
+    sheet.setFormula(Address("B2"), "=20");
+    sheet.setFormula(Address("B3"), "=30");
+    sheet.setFormula(Address("B4"), "'n/a");
+    sheet.setFormula(Address("C1"), "=SUMIF(A1:A4, \"east\", B1:B4)");
+    sheet.setFormula(Address("C2"), "=SUMIF(B1:B4, \">15\")");
+    sheet.setFormula(Address("C3"), "=COUNTIF(A1:A4, \"<>east\")");
+    sheet.setFormula(Address("C4"), "=AVERAGEIF(A1:A4, \"*st\", B1:B4)");
+    sheet.setFormula(Address("C5"), "=AVERAGEIF(A1:A4, \"north\", B1:B4)");
+    sheet.setFormula(Address("D1"), "=SUMIFS(B1:B4, A1:A4, \"east\", B1:B4, \">15\")");
+    sheet.setFormula(Address("D2"), "=COUNTIFS(A1:A4, \"east\", B1:B4, \"<=30\")");
+    sheet.setFormula(Address("D3"), "=AVERAGEIFS(B1:B4, A1:A4, \"?est\")");
+    sheet.setFormula(Address("D4"), "=SUMIFS(B1:B4, A1:A3, \"east\")");
+    sheet.recalculate();
+
+    EXPECT_EQ("40", sheet.getValue(Address("C1")));
+    EXPECT_EQ("50", sheet.getValue(Address("C2")));
+    EXPECT_EQ("2", sheet.getValue(Address("C3")));
+    EXPECT_EQ("20", sheet.getValue(Address("C4")));
+    EXPECT_EQ("30", sheet.getValue(Address("D1")));
+    EXPECT_EQ("2", sheet.getValue(Address("D2")));
+    EXPECT_EQ("20", sheet.getValue(Address("D3")));
+
+    // An average of no numbers, and ranges of different sizes, are errors
+    EXPECT_EQ("ERROR", sheet.getValue(Address("C5")));
+    EXPECT_EQ("ERROR", sheet.getValue(Address("D4")));
+}
+
+TEST_F(FunctionsTest, conditional_results_follow_changes)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "'x");
+    sheet.setFormula(Address("A3"), "'x");
+    sheet.setFormula(Address("B1"), "=1");
+    sheet.setFormula(Address("B2"), "=2");
+    sheet.setFormula(Address("B3"), "=E1");
+    sheet.setFormula(Address("E1"), "=4");
+    sheet.setFormula(Address("E2"), "'x");
+    sheet.setFormula(Address("C1"), "=SUMIF(A1:A3, E2, B1:B3)");
+    sheet.setFormula(Address("C2"), "=SUMIF(A1:A3, \"x\", B1:B3)");
+    sheet.recalculate();
+
+    EXPECT_EQ("5", sheet.getValue(Address("C1")));
+    EXPECT_EQ("5", sheet.getValue(Address("C2")));
+
+    // Results are only reused while the ranges and criteria are unchanged,
+    // including values calculated from cells outside of the ranges
+    sheet.setFormula(Address("E1"), "=8");
+    sheet.recalculate();
+    EXPECT_EQ("9", sheet.getValue(Address("C1")));
+
+    sheet.setFormula(Address("A2"), "'x");
+    sheet.recalculate();
+    EXPECT_EQ("11", sheet.getValue(Address("C2")));
+
+    sheet.setFormula(Address("E2"), "'y");
+    sheet.recalculate();
+    EXPECT_EQ("0", sheet.getValue(Address("C1")));
+    EXPECT_EQ("11", sheet.getValue(Address("C2")));
+}
+
+TEST_F(FunctionsTest, matrix_functions_spill_into_neighbouring_cells)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    sheet.setFormula(Address("B1"), "=2");
+    sheet.setFormula(Address("A2"), "=3");
+    sheet.setFormula(Address("B2"), "=4");
+    sheet.setFormula(Address("A3"), "=5");
+    sheet.setFormula(Address("B3"), "=6");
+    sheet.setFormula(Address("D1"), "=MMULT(A1:B3, TRANSPOSE(A1:B1))");
+    sheet.setFormula(Address("F1"), "=TRANSPOSE(A1:B3)");
+    sheet.setFormula(Address("F4"), "=MINVERSE(A1:B2)");
+    sheet.setFormula(Address("J1"), "=MMULT(A1:B3, A1:B3)");
+    sheet.setFormula(Address("J2"), "=SUM(MMULT(A1:B1, A1:B2), 1)");
+    sheet.recalculate();
+
+    EXPECT_EQ("5", sheet.getValue(Address("D1")));
+    EXPECT_EQ("11", sheet.getValue(Address("D2")));
+    EXPECT_EQ("17", sheet.getValue(Address("D3")));
+    EXPECT_EQ("", sheet.getValue(Address("E1")));
+    EXPECT_EQ("", sheet.getValue(Address("D4")));
+    EXPECT_FALSE(sheet.isSet(Address("D2")));
+
+    EXPECT_EQ("1", sheet.getValue(Address("F1")));
+    EXPECT_EQ("3", sheet.getValue(Address("G1")));
+    EXPECT_EQ("5", sheet.getValue(Address("H1")));
+    EXPECT_EQ("6", sheet.getValue(Address("H2")));
+
+    EXPECT_EQ("-2", sheet.getValue(Address("F4")));
+    EXPECT_EQ("1", sheet.getValue(Address("G4")));
+    EXPECT_EQ("1.5", sheet.getValue(Address("F5")));
+    EXPECT_EQ("-0.5", sheet.getValue(Address("G5")));
+
+    // Arrays that do not fit are errors, and a function that is not called
+    // for its whole array returns its first value
+    EXPECT_EQ("ERROR", sheet.getValue(Address("J1")));
+    EXPECT_EQ("8", sheet.getValue(Address("J2")));
+}
+
+TEST_F(FunctionsTest, spilled_values_follow_changes)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    sheet.setFormula(Address("A2"), "=2");
+    sheet.setFormula(Address("A3"), "'x");
+    sheet.setFormula(Address("C1"), "=TRANSPOSE(A1:A3)");
+    sheet.setFormula(Address("D1"), "=7");
+    sheet.recalculate();
+
+    // An array cannot overwrite a cell that has been set
+    EXPECT_EQ("ERROR", sheet.getValue(Address("C1")));
+    EXPECT_EQ("7", sheet.getValue(Address("D1")));
+    EXPECT_EQ("", sheet.getValue(Address("E1")));
+
+    sheet.erase(Address("D1"));
+    sheet.setFormula(Address("A1"), "=5");
+    sheet.recalculate();
+    EXPECT_EQ("5", sheet.getValue(Address("C1")));
+    EXPECT_EQ("2", sheet.getValue(Address("D1")));
+    EXPECT_EQ("x", sheet.getValue(Address("E1")));
+
+    // Arrays move with the cells that hold them, and shrink with their ranges
+    sheet.insertColumns(Address("A1").column, 1);
+    sheet.recalculate();
+    EXPECT_EQ("=TRANSPOSE(B1:B3)", sheet.getFormula(Address("D1")));
+    EXPECT_EQ("5", sheet.getValue(Address("D1")));
+    EXPECT_EQ("2", sheet.getValue(Address("E1")));
+    EXPECT_EQ("x", sheet.getValue(Address("F1")));
+    sheet.setFormula(Address("D1"), "=TRANSPOSE(B1:B2)");
+    sheet.recalculate();
+    EXPECT_EQ("", sheet.getValue(Address("F1")));
+
+    sheet.erase(Address("D1"));
+    EXPECT_EQ("", sheet.getValue(Address("D1")));
+    EXPECT_EQ("", sheet.getValue(Address("F1")));
+}
+
+TEST_F(FunctionsTest, matrix_functions_accept_arrays)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    sheet.setFormula(Address("B1"), "=2");
+    sheet.setFormula(Address("A2"), "=3");
+    sheet.setFormula(Address("B2"), "=4");
+    sheet.setFormula(Address("D1"), "=MMULT(A1:B2*2, TRANSPOSE(A1:B1)) + 1");
+    sheet.setFormula(Address("F1"), "=TRANSPOSE(A1:A2>2)");
+    sheet.recalculate();
+
+    EXPECT_EQ("11", sheet.getValue(Address("D1")));
+    EXPECT_EQ("23", sheet.getValue(Address("D2")));
+    EXPECT_EQ("FALSE", sheet.getValue(Address("F1")));
+    EXPECT_EQ("TRUE", sheet.getValue(Address("G1")));
+}
+
+TEST_F(FunctionsTest, sort_filter_and_unique_spill_their_results)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "'pear");
+    sheet.setFormula(Address("B1"), "=3");
+    sheet.setFormula(Address("A2"), "'apple");
+    sheet.setFormula(Address("B2"), "=1");
+    sheet.setFormula(Address("A3"), "'fig");
+    sheet.setFormula(Address("B3"), "=3");
+    sheet.setFormula(Address("A4"), "'apple");
+    sheet.setFormula(Address("B4"), "=1");
+    sheet.setFormula(Address("D1"), "=SORT(A1:B4)");
+    sheet.setFormula(Address("G1"), "=SORT(A1:B4, 2, -1)");
+    sheet.setFormula(Address("J1"), "=SORTBY(A1:A4, B1:B4, 1, A1:A4, -1)");
+    sheet.setFormula(Address("L1"), "=FILTER(A1:B4, B1:B4>2)");
+    sheet.setFormula(Address("O1"), "=FILTER(A1:A4, B1:B4>5, \"none\")");
+    sheet.setFormula(Address("Q1"), "=UNIQUE(A1:B4)");
+    sheet.setFormula(Address("T1"), "=UNIQUE(A1:A4, 0, 1)");
+    sheet.setFormula(Address("V1"), "=SORT(A1:B4, 3)");
+    sheet.setFormula(Address("X1"), "=FILTER(A1:A4, B1>0)");
+    sheet.setFormula(Address("Y1"), "=SORTBY(A1:A4, 1)");
+    sheet.recalculate();
+
+    EXPECT_EQ("apple", sheet.getValue(Address("D1")));
+    EXPECT_EQ("apple", sheet.getValue(Address("D2")));
+    EXPECT_EQ("fig", sheet.getValue(Address("D3")));
+    EXPECT_EQ("pear", sheet.getValue(Address("D4")));
+    EXPECT_EQ("3", sheet.getValue(Address("E4")));
+
+    // Sorts are stable, so rows with equal keys keep their order
+    EXPECT_EQ("pear", sheet.getValue(Address("G1")));
+    EXPECT_EQ("fig", sheet.getValue(Address("G2")));
+    EXPECT_EQ("apple", sheet.getValue(Address("G3")));
+
+    EXPECT_EQ("apple", sheet.getValue(Address("J1")));
+    EXPECT_EQ("apple", sheet.getValue(Address("J2")));
+    EXPECT_EQ("pear", sheet.getValue(Address("J3")));
+    EXPECT_EQ("fig", sheet.getValue(Address("J4")));
+
+    EXPECT_EQ("pear", sheet.getValue(Address("L1")));
+    EXPECT_EQ("fig", sheet.getValue(Address("L2")));
+    EXPECT_EQ("3", sheet.getValue(Address("M2")));
+    EXPECT_EQ("", sheet.getValue(Address("L3")));
+    EXPECT_EQ("none", sheet.getValue(Address("O1")));
+
+    EXPECT_EQ("pear", sheet.getValue(Address("Q1")));
+    EXPECT_EQ("apple", sheet.getValue(Address("Q2")));
+    EXPECT_EQ("fig", sheet.getValue(Address("Q3")));
+    EXPECT_EQ("", sheet.getValue(Address("Q4")));
+    EXPECT_EQ("pear", sheet.getValue(Address("T1")));
+    EXPECT_EQ("fig", sheet.getValue(Address("T2")));
+    EXPECT_EQ("", sheet.getValue(Address("T3")));
+
+    EXPECT_EQ("ERROR", sheet.getValue(Address("V1")));
+
+    // A single value does not fit a column of several rows
+    EXPECT_EQ("ERROR", sheet.getValue(Address("X1")));
+    EXPECT_EQ("ERROR", sheet.getValue(Address("Y1")));
+
+    // Results follow changes to the cells that they read
+    sheet.setFormula(Address("B3"), "=0");
+    sheet.recalculate();
+    EXPECT_EQ("fig", sheet.getValue(Address("J1")));
+    EXPECT_EQ("", sheet.getValue(Address("L2")));
+}
+
+TEST_F(FunctionsTest, sorted_and_grouped_views_follow_changes)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "'pear");
+    sheet.setFormula(Address("B1"), "=3");
+    sheet.setFormula(Address("A2"), "'apple");
+    sheet.setFormula(Address("B2"), "=1");
+    sheet.setFormula(Address("A3"), "'pear");
+    sheet.setFormula(Address("B3"), "=4");
+    sheet.setFormula(Address("A4"), "'fig");
+    sheet.setFormula(Address("B4"), "=2");
+    sheet.setFormula(Address("D1"), "=SORT(A1:B4, 2)");
+    sheet.setFormula(Address("G1"), "=GROUPBY(A1:A4, B1:B4, \"sum\")");
+    sheet.setFormula(Address("J1"), "=GROUPBY(A1:A4, B1:B4, \"COUNT\")");
+    sheet.setFormula(Address("M1"), "=GROUPBY(A1:A4, B1:B4, \"AVERAGE\")");
+    sheet.setFormula(Address("N1"), "=GROUPBY(A1:B4, B1:B4, \"SUM\")");
+    sheet.setFormula(Address("P1"), "=SUM(H1:H3)");
+    sheet.setFormula(Address("Q1"), "=VLOOKUP(\"pear\", G1:H3, 2, 0)");
+    sheet.recalculate();
+
+    EXPECT_EQ("apple", sheet.getValue(Address("D1")));
+    EXPECT_EQ("fig", sheet.getValue(Address("D2")));
+    EXPECT_EQ("pear", sheet.getValue(Address("D4")));
+    EXPECT_EQ("apple", sheet.getValue(Address("G1")));
+    EXPECT_EQ("1", sheet.getValue(Address("H1")));
+    EXPECT_EQ("pear", sheet.getValue(Address("G3")));
+    EXPECT_EQ("7", sheet.getValue(Address("H3")));
+    EXPECT_EQ("2", sheet.getValue(Address("K3")));
+    EXPECT_EQ("ERROR", sheet.getValue(Address("M1")));
+    EXPECT_EQ("ERROR", sheet.getValue(Address("N1")));
+
+    // Other formulas read the groups as they would any other cells
+    EXPECT_EQ("10", sheet.getValue(Address("P1")));
+    EXPECT_EQ("7", sheet.getValue(Address("Q1")));
+
+    // Views are updated from the cells that change in each pass
+    sheet.setFormula(Address("B2"), "=9");
+    sheet.setFormula(Address("A4"), "'pear");
+    sheet.recalculate();
+    EXPECT_EQ("pear", sheet.getValue(Address("D1")));
+    EXPECT_EQ("apple", sheet.getValue(Address("D4")));
+    EXPECT_EQ("9", sheet.getValue(Address("E4")));
+    EXPECT_EQ("pear", sheet.getValue(Address("G2")));
+    EXPECT_EQ("9", sheet.getValue(Address("H2")));
+    EXPECT_EQ("", sheet.getValue(Address("G3")));
+    EXPECT_EQ("3", sheet.getValue(Address("K2")));
+    EXPECT_EQ("18", sheet.getValue(Address("P1")));
+    EXPECT_EQ("9", sheet.getValue(Address("Q1")));
+}
+
+TEST_F(FunctionsTest, forks_call_functions_on_separate_threads)
+{
+    // Run on its own, the forks make the first calls to any function at the
+    // same time, so both threads look up the same tables of functions
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    sheet.setFormula(Address("A2"), "=2");
+    sheet.setFormula(Address("B1"), "=SUM(A1:A2)");
+    sheet.setFormula(Address("B2"), "=IF(A1>1, 1, 0)");
+    sheet.setFormula(Address("C1"), "=SORT(A1:A2, 1, -1)");
+
+    unique_ptr<Sheet> pFirst = sheet.fork();
+    unique_ptr<Sheet> pSecond = sheet.fork();
+    pSecond->setFormula(Address("A1"), "=5");
+    thread first([&pFirst]() {
+        pFirst->recalculate();
+    });
+    thread second([&pSecond]() {
+        pSecond->recalculate();
+    });
+    first.join();
+    second.join();
+
+    EXPECT_EQ("3", pFirst->getValue(Address("B1")));
+    EXPECT_EQ("0", pFirst->getValue(Address("B2")));
+    EXPECT_EQ("2", pFirst->getValue(Address("C1")));
+    EXPECT_EQ("7", pSecond->getValue(Address("B1")));
+    EXPECT_EQ("1", pSecond->getValue(Address("B2")));
+    EXPECT_EQ("5", pSecond->getValue(Address("C1")));
+}
@@ -0,0 +1,258 @@
+/*
+ * test/journal_test.cpp
+ *
+ * Copyright (c) 2012 Tristan Penman
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * This file is part of Inspect.
+ *
+ * Inspect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "address.hpp"
+#include "journal.hpp"
+#include "sheet.hpp"
+
+using namespace std;
+
+class JournalTest : public testing::Test
+{
+protected:
+    virtual void SetUp()
+    {
+        remove("journal_test.log");
+        remove("journal_test.log.snapshot");
+    }
+
+    virtual void TearDown()
+    {
+        SetUp();
+    }
+};
+
+TEST_F(JournalTest, committed_edits_are_replayed)
+{
+    {
+        Journal journal("journal_test.log");
+        Sheet sheet;
+        sheet.setJournal(&journal);
+        sheet.setFormula(Address("A1"), "=1");
+        sheet.setFormula(Address("A2"), "=A1+1");
+        sheet.setFormula(Address("A3"), "=A2+1");
+        sheet.setFormula(Address("A1"), "=10");
+        sheet.erase(Address("A3"));
+        sheet.erase(Address("B1"));
+        journal.commit();
+
+        EXPECT_EQ(5u, journal.getStats().records);
+        EXPECT_EQ(1u, journal.getStats().syncs);
+    }
+
+    Journal journal("journal_test.log");
+    Sheet sheet;
+    EXPECT_EQ(5u, journal.replay(sheet));
+
+    // Replaying does not recalculate
+    EXPECT_EQ("", sheet.getValue(Address("A2")));
+    sheet.recalculate();
+    EXPECT_EQ("=10", sheet.getFormula(Address("A1")));
+    EXPECT_EQ("11", sheet.getValue(Address("A2")));
+    EXPECT_FALSE(sheet.isSet(Address("A3")));
+}
+
+TEST_F(JournalTest, inserted_and_deleted_rows_and_columns_are_replayed)
+{
+    {
+        Journal journal("journal_test.log");
+        Sheet sheet;
+        sheet.setJournal(&journal);
+        sheet.setFormula(Address("A1"), "=1");
+        sheet.setFormula(Address("A2"), "=A1+1");
+        sheet.setFormula(Address("B2"), "=A2*2");
+        sheet.insertRows(2, 3);
+        sheet.insertColumns(Address("A1").column, 1);
+        sheet.deleteRows(1, 1);
+        sheet.deleteColumns(Address("C1").column, 1);
+        journal.commit();
+
+        EXPECT_EQ(7u, journal.getStats().records);
+    }
+
+    Journal journal("journal_test.log");
+    Sheet sheet;
+    EXPECT_EQ(7u, journal.replay(sheet));
+
+    EXPECT_EQ(1u, sheet.getAddresses().size());
+    EXPECT_EQ("=#REF!+1", sheet.getFormula(Address("B4")));
+}
+
+TEST_F(JournalTest, incomplete_records_are_discarded)
+{
+    {
+        Journal journal("journal_test.log");
+        Sheet sheet;
+        sheet.setJournal(&journal);
+        sheet.setFormula(Address("A1"), "=1");
+        sheet.setFormula(Address("A2"), "=2");
+        journal.commit();
+    }
+
+    // Simulate a crash part way through writing a record
+    {
+        ofstream out("journal_test.log", ios::out | ios::app | ios::binary);
+        out.write("\x20\x00\x00\x00\x01\x02", 6);
+    }
+
+    {
+        Journal journal("journal_test.log");
+        Sheet sheet;
+        EXPECT_EQ(2u, journal.replay(sheet));
+
+        // Records appended after recovery follow the last complete record
+        sheet.setJournal(&journal);
+        sheet.setFormula(Address("A3"), "=3");
+        journal.commit();
+    }
+
+    Journal journal("journal_test.log");
+    Sheet sheet;
+    EXPECT_EQ(3u, journal.replay(sheet));
+    EXPECT_EQ("=3", sheet.getFormula(Address("A3")));
+}
+
+TEST_F(JournalTest, compaction_empties_the_journal)
+{
+    {
+        Journal journal("journal_test.log");
+        Sheet sheet;
+        sheet.setJournal(&journal);
+        for (int i = 0; i < 10; i++) {
+            ostringstream formula;
+            formula << "=" << i;
+            sheet.setFormula(Address("A1"), formula.str());
+        }
+        sheet.setFormula(Address("B1"), "=A1*2");
+        journal.compact(sheet);
+        EXPECT_EQ(1u, journal.getStats().compactions);
+
+        ifstream in("journal_test.log", ios::in | ios::binary | ios::ate);
+        EXPECT_EQ(0, static_cast<int>(in.tellg()));
+
+        sheet.setFormula(Address("C1"), "=B1+1");
+        journal.commit();
+    }
+
+    Journal journal("journal_test.log");
+    Sheet sheet;
+    EXPECT_EQ(3u, journal.replay(sheet));
+    sheet.recalculate();
+    EXPECT_EQ("9", sheet.getValue(Address("A1")));
+    EXPECT_EQ("19", sheet.getValue(Address("C1")));
+}
+
+TEST_F(JournalTest, records_included_in_the_snapshot_are_not_replayed_again)
+{
+    string records;
+    {
+        Journal journal("journal_test.log");
+        Sheet sheet;
+        sheet.setJournal(&journal);
+        sheet.setFormula(Address("A1"), "=1");
+        sheet.setFormula(Address("A2"), "=A1+1");
+        sheet.insertRows(2, 3);
+        journal.commit();
+
+        ifstream in("journal_test.log", ios::in | ios::binary);
+        ostringstream contents;
+        contents << in.rdbuf();
+        records = contents.str();
+
+        journal.compact(sheet);
+    }
+
+    // Simulate a crash after the snapshot was written, but before the
+    // journal was emptied
+    {
+        ofstream out("journal_test.log", ios::out | ios::trunc | ios::binary);
+        out.write(records.data(), streamsize(records.size()));
+    }
+
+    {
+        Journal journal("journal_test.log");
+        Sheet sheet;
+        EXPECT_EQ(2u, journal.replay(sheet));
+        EXPECT_EQ("=A1+1", sheet.getFormula(Address("A5")));
+
+        // Records appended after recovery are replayed after the snapshot
+        sheet.setJournal(&journal);
+        sheet.insertRows(1, 1);
+        journal.commit();
+    }
+
+    Journal journal("journal_test.log");
+    Sheet sheet;
+    EXPECT_EQ(3u, journal.replay(sheet));
+    EXPECT_EQ(2u, sheet.getAddresses().size());
+    EXPECT_EQ("=A2+1", sheet.getFormula(Address("A6")));
+}
+
+TEST_F(JournalTest, concurrent_commits_share_syncs)
+{
+    const int threadCount = 8;
+    const int editCount = 50;
+    {
+        Journal journal("journal_test.log");
+        Sheet sheet;
+        sheet.setJournal(&journal);
+        mutex sheetMutex;
+
+        vector<thread> threads;
+        for (int t = 0; t < threadCount; t++) {
+            threads.push_back(thread([&, t]() {
+                for (int i = 1; i <= editCount; i++) {
+                    {
+                        lock_guard<mutex> lock(sheetMutex);
+                        sheet.setFormula(Address(t + 1, i), "=1");
+                    }
+                    journal.commit();
+                }
+            }));
+        }
+
+        for (vector<thread>::iterator itr = threads.begin(); itr != threads.end(); itr++) {
+            itr->join();
+        }
+
+        EXPECT_EQ(uint64_t(threadCount * editCount), journal.getStats().records);
+        EXPECT_LE(journal.getStats().syncs, journal.getStats().records);
+    }
+
+    Journal journal("journal_test.log");
+    Sheet sheet;
+    EXPECT_EQ(size_t(threadCount * editCount), journal.replay(sheet));
+}
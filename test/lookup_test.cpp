@@ -0,0 +1,296 @@
+/*
+ * test/lookup_test.cpp
+ *
+ * Copyright (c) 2012 Tristan Penman
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * This file is part of Inspect.
+ *
+ * Inspect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <vector>
+
+#include "lookup.hpp"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+class LookupTest : public testing::Test
+{
+protected:
+    static void addCell(vector<RangeCell> & cells, const string & address, const string & value)
+    {
+        const RangeCell cell = {Address(address), Rope(value)};
+        cells.push_back(cell);
+    }
+};
+
+TEST_F(LookupTest, finds_keys_down_the_first_column)
+{
+    vector<RangeCell> cells;
+    addCell(cells, "A1", "3");
+    addCell(cells, "A2", "1");
+    addCell(cells, "A3", "3");
+    addCell(cells, "A5", "x");
+    addCell(cells, "B1", "three");
+    addCell(cells, "B2", "one");
+    addCell(cells, "B3", "3");
+
+    LookupTable table(Range("A1:B5"), false);
+    table.update(cells);
+    EXPECT_TRUE(cells.empty());
+    EXPECT_EQ(5, table.size());
+
+    // Values in other columns are not keys
+    EXPECT_EQ(0, table.find("3", LookupTable::MATCH_EXACT, false));
+    EXPECT_EQ(2, table.find("3.0", LookupTable::MATCH_EXACT, true));
+    EXPECT_EQ(LookupTable::npos, table.find("one", LookupTable::MATCH_EXACT, false));
+    EXPECT_EQ(LookupTable::npos, table.find("", LookupTable::MATCH_EXACT, false));
+
+    // Approximate matches only compare numbers with numbers
+    EXPECT_EQ(1, table.find("2", LookupTable::MATCH_EXACT_OR_SMALLER, false));
+    EXPECT_EQ(0, table.find("2", LookupTable::MATCH_EXACT_OR_LARGER, false));
+    EXPECT_EQ(2, table.find("9", LookupTable::MATCH_EXACT_OR_SMALLER, true));
+    EXPECT_EQ(LookupTable::npos, table.find("9", LookupTable::MATCH_EXACT_OR_LARGER, false));
+    EXPECT_EQ(4, table.find("y", LookupTable::MATCH_EXACT_OR_SMALLER, false));
+
+    EXPECT_EQ("one", table.getValue(1, 1).str());
+    EXPECT_EQ("", table.getValue(3, 1).str());
+    EXPECT_EQ("", table.getValue(0, 2).str());
+}
+
+TEST_F(LookupTest, finds_keys_across_the_first_row)
+{
+    vector<RangeCell> cells;
+    addCell(cells, "A1", "a");
+    addCell(cells, "A2", "1");
+    addCell(cells, "B1", "b");
+    addCell(cells, "B2", "2");
+
+    LookupTable table(Range("A1:C2"), true);
+    table.update(cells);
+    EXPECT_EQ(3, table.size());
+    EXPECT_EQ(1, table.find("b", LookupTable::MATCH_EXACT, false));
+    EXPECT_EQ(LookupTable::npos, table.find("2", LookupTable::MATCH_EXACT, false));
+    EXPECT_EQ("2", table.getValue(1, 1).str());
+}
+
+TEST_F(LookupTest, updates_indexes_for_keys_that_change)
+{
+    vector<RangeCell> cells;
+    for (int row = 1; row <= 100; row++) {
+        const RangeCell cell = {Address(1, row), Rope(to_string(row * 10))};
+        cells.push_back(cell);
+    }
+
+    LookupTable table(Range("A1:A100"), false);
+    table.update(cells);
+    EXPECT_EQ(49, table.find("500", LookupTable::MATCH_EXACT, false));
+    EXPECT_EQ(49, table.find("505", LookupTable::MATCH_EXACT_OR_SMALLER, false));
+
+    // Both indexes have been built, and are patched by the next update
+    for (int row = 1; row <= 100; row++) {
+        const RangeCell cell = {Address(1, row), Rope(to_string(row == 50 ? 5 : row * 10))};
+        if (row != 70) {
+            cells.push_back(cell);
+        }
+    }
+
+    table.update(cells);
+    EXPECT_EQ(LookupTable::npos, table.find("500", LookupTable::MATCH_EXACT, false));
+    EXPECT_EQ(49, table.find("5", LookupTable::MATCH_EXACT, false));
+    EXPECT_EQ(48, table.find("505", LookupTable::MATCH_EXACT_OR_SMALLER, false));
+    EXPECT_EQ(LookupTable::npos, table.find("700", LookupTable::MATCH_EXACT, false));
+    EXPECT_EQ(70, table.find("700", LookupTable::MATCH_EXACT_OR_LARGER, false));
+
+    // Changing many keys discards the sorted index, which is built again
+    for (int row = 1; row <= 100; row++) {
+        const RangeCell cell = {Address(1, row), Rope(to_string(1000 - row))};
+        cells.push_back(cell);
+    }
+
+    table.update(cells);
+    EXPECT_EQ(99, table.find("0", LookupTable::MATCH_EXACT_OR_LARGER, false));
+    EXPECT_EQ(0, table.find("999", LookupTable::MATCH_EXACT, false));
+}
+
+TEST_F(LookupTest, cache_keeps_tables_read_during_a_pass)
+{
+    LookupCache cache;
+    cache.beginPass();
+    EXPECT_EQ(NULL, cache.find(Range("A1:A3"), false));
+
+    vector<RangeCell> cells;
+    addCell(cells, "A1", "x");
+    const LookupTable & table = cache.update(Range("A1:A3"), false, cells);
+    EXPECT_EQ(&table, cache.find(Range("A1:A3"), false));
+    EXPECT_EQ(NULL, cache.find(Range("A1:A3"), true));
+    EXPECT_EQ(NULL, cache.find(Range("A1:A4"), false));
+
+    // Tables must be read again in each pass, but are kept for one pass
+    // after they were last read
+    cache.beginPass();
+    EXPECT_EQ(NULL, cache.find(Range("A1:A3"), false));
+    EXPECT_EQ(1, cache.size());
+    cache.beginPass();
+    EXPECT_EQ(0, cache.size());
+}
+
+TEST_F(LookupTest, scan_holds_numbers_in_address_order)
+{
+    vector<RangeCell> cells;
+    addCell(cells, "A1", "1.5");
+    addCell(cells, "A3", "x");
+    addCell(cells, "B2", "4");
+
+    LookupTable table(Range("A1:B3"), false);
+    EXPECT_TRUE(table.update(cells));
+    const unsigned long version = table.getVersion();
+
+    const LookupTable::Scan & scan = table.getScan();
+    ASSERT_EQ(3, scan.offsets.size());
+    EXPECT_EQ(0, scan.offsets[0]);
+    EXPECT_EQ(2, scan.offsets[1]);
+    EXPECT_EQ(4, scan.offsets[2]);
+    EXPECT_EQ(1.5, scan.numbers[0]);
+    EXPECT_EQ(0, scan.numeric[1]);
+    EXPECT_EQ(4, scan.numbers[2]);
+
+    // The same values do not change the version, while a changed value is
+    // patched into the scan in place
+    addCell(cells, "A1", "1.5");
+    addCell(cells, "A3", "x");
+    addCell(cells, "B2", "4");
+    EXPECT_FALSE(table.update(cells));
+    EXPECT_EQ(version, table.getVersion());
+
+    addCell(cells, "A1", "1.5");
+    addCell(cells, "A3", "7");
+    addCell(cells, "B2", "4");
+    EXPECT_TRUE(table.update(cells));
+    EXPECT_NE(version, table.getVersion());
+    EXPECT_EQ(7, table.getScan().numbers[1]);
+    EXPECT_EQ(1, table.getScan().numeric[1]);
+
+    // Erasing a cell rebuilds the scan
+    addCell(cells, "B2", "4");
+    EXPECT_TRUE(table.update(cells));
+    ASSERT_EQ(1, table.getScan().offsets.size());
+    EXPECT_EQ(4, table.getScan().offsets[0]);
+}
+
+TEST_F(LookupTest, update_keeps_the_cells_that_changed)
+{
+    vector<RangeCell> cells;
+    for (int row = 1; row <= 100; row++) {
+        const RangeCell cell = {Address(1, row), Rope(to_string(row))};
+        cells.push_back(cell);
+    }
+
+    LookupTable table(Range("A1:A101"), false);
+    table.update(cells);
+    const unsigned long version = table.getVersion();
+
+    // Changed, set and erased cells are kept in address order, where erased
+    // cells have empty values
+    for (int row = 1; row <= 101; row++) {
+        const RangeCell cell = {Address(1, row), Rope(to_string(row == 20 ? 0 : row))};
+        if (row != 50) {
+            cells.push_back(cell);
+        }
+    }
+
+    EXPECT_TRUE(table.update(cells));
+    EXPECT_EQ(version, table.getPreviousVersion());
+    const vector<RangeCell> & changes = table.getChanges();
+    ASSERT_EQ(3, changes.size());
+    EXPECT_EQ(Address("A20"), changes[0].address);
+    EXPECT_EQ("0", changes[0].value.str());
+    EXPECT_EQ(Address("A50"), changes[1].address);
+    EXPECT_TRUE(changes[1].value.empty());
+    EXPECT_EQ(Address("A101"), changes[2].address);
+
+    // Changing many cells does not keep the changes
+    for (int row = 1; row <= 100; row++) {
+        const RangeCell cell = {Address(1, row), Rope(to_string(-row))};
+        cells.push_back(cell);
+    }
+
+    EXPECT_TRUE(table.update(cells));
+    EXPECT_EQ(0, table.getPreviousVersion());
+}
+
+TEST_F(LookupTest, criteria_match_numbers_text_and_patterns)
+{
+    vector<RangeCell> cells;
+    addCell(cells, "A1", "10");
+    addCell(cells, "A2", "5");
+    addCell(cells, "A3", "apple");
+    addCell(cells, "A4", "apricot");
+    addCell(cells, "A5", "");
+    addCell(cells, "A6", "a*c");
+
+    LookupTable table(Range("A1:A6"), false);
+    table.update(cells);
+
+    const char * criteria[] = {
+        "10", ">5", "<=5", "<>10", "apple", "=apple", ">b", "ap*", "a?ple", "a~*c", "", "<>", "*"
+    };
+    const char * expected[] = {
+        "100000", "100000", "010000", "011111", "001000", "001000", "000000", "001100", "001000", "000001",
+        "000010", "111101", "001101"
+    };
+
+    vector<unsigned char> mask;
+    for (size_t i = 0; i < sizeof(criteria) / sizeof(criteria[0]); i++) {
+        Criterion(criteria[i]).match(table, mask);
+        string actual;
+        for (size_t j = 0; j < mask.size(); j++) {
+            actual += mask[j] ? '1' : '0';
+        }
+        EXPECT_EQ(expected[i], actual) << "criterion: " << criteria[i];
+    }
+}
+
+TEST_F(LookupTest, cache_reuses_results_until_a_table_changes)
+{
+    LookupCache cache;
+    cache.beginPass();
+
+    vector<RangeCell> cells;
+    addCell(cells, "A1", "1");
+    const LookupTable & table = cache.update(Range("A1:A3"), false, cells);
+    vector<const LookupTable *> tables(1, &table);
+
+    Rope result;
+    EXPECT_FALSE(cache.findResult("SUMIF", tables, result));
+    cache.storeResult("SUMIF", tables, Rope("1"));
+    EXPECT_TRUE(cache.findResult("SUMIF", tables, result));
+    EXPECT_EQ("1", result.str());
+    EXPECT_EQ(&cache.getCriterion(">1"), &cache.getCriterion(">1"));
+
+    // Reading the same values in the next pass keeps the result
+    cache.beginPass();
+    addCell(cells, "A1", "1");
+    cache.update(Range("A1:A3"), false, cells);
+    EXPECT_TRUE(cache.findResult("SUMIF", tables, result));
+
+    cache.beginPass();
+    addCell(cells, "A1", "2");
+    cache.update(Range("A1:A3"), false, cells);
+    EXPECT_FALSE(cache.findResult("SUMIF", tables, result));
+}
@@ -0,0 +1,135 @@
+/*
+ * test/matrix_test.cpp
+ *
+ * Copyright (c) 2012 Tristan Penman
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * This file is part of Inspect.
+ *
+ * Inspect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <cmath>
+#include <vector>
+
+#include "matrix.hpp"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+class MatrixTest : public testing::Test
+{
+protected:
+    /// Matrix of small integers, whose products are exact
+    static Matrix makeMatrix(size_t rows, size_t columns, int seed)
+    {
+        Matrix matrix(rows, columns);
+        for (size_t i = 0; i < matrix.values.size(); i++) {
+            matrix.values[i] = double(int((i * 7 + size_t(seed) * 13) % 11) - 5);
+        }
+
+        return matrix;
+    }
+
+    static Matrix multiplySimply(const Matrix & lhs, const Matrix & rhs)
+    {
+        Matrix product(lhs.rows, rhs.columns);
+        for (size_t i = 0; i < lhs.rows; i++) {
+            for (size_t k = 0; k < lhs.columns; k++) {
+                for (size_t j = 0; j < rhs.columns; j++) {
+                    product.at(i, j) += lhs.at(i, k) * rhs.at(k, j);
+                }
+            }
+        }
+
+        return product;
+    }
+};
+
+TEST_F(MatrixTest, multiplies_matrices_of_any_size)
+{
+    // Sizes that are not multiples of the block size, and sizes large enough
+    // to be divided between threads
+    const size_t sizes[][3] = {{1, 1, 1}, {2, 3, 4}, {70, 130, 300}, {300, 300, 300}};
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        const Matrix lhs = makeMatrix(sizes[i][0], sizes[i][1], 1);
+        const Matrix rhs = makeMatrix(sizes[i][1], sizes[i][2], 2);
+        Matrix product;
+        ASSERT_TRUE(multiplyMatrices(lhs, rhs, product));
+        EXPECT_EQ(sizes[i][0], product.rows);
+        EXPECT_EQ(sizes[i][2], product.columns);
+        EXPECT_EQ(multiplySimply(lhs, rhs).values, product.values);
+    }
+
+    Matrix product;
+    EXPECT_FALSE(multiplyMatrices(makeMatrix(2, 3, 1), makeMatrix(2, 3, 1), product));
+    EXPECT_EQ(0, product.rows);
+}
+
+TEST_F(MatrixTest, transposes_matrices_larger_than_a_tile)
+{
+    const Matrix matrix = makeMatrix(100, 70, 3);
+    Matrix transposed;
+    transposeMatrix(matrix, transposed);
+    ASSERT_EQ(70, transposed.rows);
+    ASSERT_EQ(100, transposed.columns);
+    for (size_t i = 0; i < matrix.rows; i++) {
+        for (size_t j = 0; j < matrix.columns; j++) {
+            EXPECT_EQ(matrix.at(i, j), transposed.at(j, i));
+        }
+    }
+}
+
+TEST_F(MatrixTest, inverts_square_matrices)
+{
+    // The first pivot must be found in another row
+    Matrix matrix(3, 3);
+    const double values[] = {0, 1, 2, 1, 0, 3, 4, -3, 8};
+    matrix.values.assign(values, values + 9);
+    Matrix inverse;
+    ASSERT_TRUE(invertMatrix(matrix, inverse));
+    const double expected[] = {-4.5, 7, -1.5, -2, 4, -1, 1.5, -2, 0.5};
+    for (size_t i = 0; i < 9; i++) {
+        EXPECT_NEAR(expected[i], inverse.values[i], 1e-12);
+    }
+
+    // A larger matrix, which is dominated by its diagonal, times its inverse
+    // is the identity
+    Matrix large = makeMatrix(80, 80, 4);
+    for (size_t i = 0; i < large.rows; i++) {
+        large.at(i, i) += 500;
+    }
+    ASSERT_TRUE(invertMatrix(large, inverse));
+    Matrix identity;
+    ASSERT_TRUE(multiplyMatrices(large, inverse, identity));
+    for (size_t i = 0; i < identity.rows; i++) {
+        for (size_t j = 0; j < identity.columns; j++) {
+            EXPECT_NEAR(i == j ? 1.0 : 0.0, identity.at(i, j), 1e-9);
+        }
+    }
+}
+
+TEST_F(MatrixTest, singular_and_non_square_matrices_have_no_inverse)
+{
+    Matrix singular(2, 2);
+    const double values[] = {1, 2, 3, 6};
+    singular.values.assign(values, values + 4);
+    Matrix inverse;
+    EXPECT_FALSE(invertMatrix(singular, inverse));
+    EXPECT_FALSE(invertMatrix(Matrix(2, 2), inverse));
+    EXPECT_FALSE(invertMatrix(makeMatrix(2, 3, 1), inverse));
+    EXPECT_EQ(0, inverse.rows);
+}
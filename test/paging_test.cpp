@@ -0,0 +1,179 @@
+/*
+ * test/paging_test.cpp
+ *
+ * Copyright (c) 2012 Tristan Penman
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * This file is part of Inspect.
+ *
+ * Inspect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "address.hpp"
+#include "sheet.hpp"
+
+using namespace std;
+
+class PagingTest : public testing::Test
+{
+
+};
+
+namespace
+{
+    /**
+     * Fill a sheet with a column of running totals, followed by a column of
+     * cells that each refer back to the first column.
+     */
+    void fill(Sheet & sheet, unsigned int rows)
+    {
+        sheet.setFormula(Address("A1"), "=1");
+        for (unsigned int row = 2; row <= rows; row++) {
+            ostringstream formula;
+            formula << "=A" << row - 1 << "+1";
+            sheet.setFormula(Address(1, row), formula.str());
+        }
+
+        for (unsigned int row = 1; row <= rows; row++) {
+            ostringstream formula;
+            formula << "=A" << rows - row + 1 << "*2";
+            sheet.setFormula(Address(2, row), formula.str());
+        }
+    }
+}
+
+TEST_F(PagingTest, paged_sheets_match_sheets_in_memory)
+{
+    Sheet expected;
+    fill(expected, 1000);
+    expected.recalculate();
+
+    Sheet sheet;
+    sheet.setPaging("paging_test.dat", 16 * 1024);
+    fill(sheet, 1000);
+    sheet.recalculate();
+
+    for (unsigned int column = 1; column <= 2; column++) {
+        for (unsigned int row = 1; row <= 1000; row++) {
+            const Address address(column, row);
+            EXPECT_EQ(expected.getValue(address), sheet.getValue(address));
+            EXPECT_EQ(expected.getFormula(address), sheet.getFormula(address));
+        }
+    }
+
+    const PagingStats stats = sheet.getPagingStats();
+    EXPECT_GT(stats.misses, 0u);
+    EXPECT_GT(stats.hits, 0u);
+    EXPECT_GT(stats.evictions, 0u);
+    EXPECT_GT(stats.bytesRead, 0u);
+    EXPECT_GT(stats.bytesWritten, 0u);
+    EXPECT_LE(stats.residentBytes, 16u * 1024u);
+    EXPECT_LT(stats.residentBlocks, 1000u / 64u);
+    EXPECT_GT(stats.getHitRate(), 0.0);
+    EXPECT_LT(stats.getHitRate(), 1.0);
+}
+
+TEST_F(PagingTest, edits_to_cells_that_were_paged_out_are_kept)
+{
+    Sheet sheet;
+    fill(sheet, 1000);
+    sheet.recalculate();
+    sheet.setPaging("paging_test.dat", 16 * 1024);
+    ASSERT_EQ("2000", sheet.getValue(Address("B1")));
+
+    // The first cell was paged out when paging was enabled
+    sheet.setFormula(Address("A1"), "=1001");
+    sheet.erase(Address("B1000"));
+    sheet.recalculate();
+
+    EXPECT_EQ("=1001", sheet.getFormula(Address("A1")));
+    EXPECT_EQ("4000", sheet.getValue(Address("B1")));
+    EXPECT_EQ("2004", sheet.getValue(Address("B999")));
+    EXPECT_FALSE(sheet.isSet(Address("B1000")));
+
+    // Recalculating again does not modify any cells
+    const PagingStats before = sheet.getPagingStats();
+    sheet.recalculate();
+    EXPECT_EQ(before.bytesWritten, sheet.getPagingStats().bytesWritten);
+}
+
+TEST_F(PagingTest, paged_sheets_cannot_be_forked)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    EXPECT_EQ(0u, sheet.getPagingStats().misses);
+    EXPECT_EQ(1.0, sheet.getPagingStats().getHitRate());
+
+    sheet.setPaging("paging_test.dat", 1024 * 1024);
+    EXPECT_THROW(sheet.fork(), runtime_error);
+    EXPECT_THROW(sheet.setPaging("paging_test.dat", 1024), runtime_error);
+}
+
+TEST_F(PagingTest, compressed_sheets_match_sheets_in_memory)
+{
+    const char * labels[] = {"'Red", "'Green", "'Blue"};
+    const char * others[] = {"'007", "'-0", "'", "=-5", "'a'b", "=1.5", "=0", "=-0", "'9223372036854775807"};
+    const unsigned int rows = 2000;
+
+    Sheet expected;
+    Sheet sheet;
+    sheet.setCompression(32 * 1024);
+    for (unsigned int row = 1; row <= rows; row++) {
+        ostringstream number;
+        number << "=" << row * 3;
+        ostringstream formula;
+        formula << "=B" << row << "*2";
+
+        const string values[] = {labels[row / 10 % 3], number.str(), formula.str(), others[row % 9]};
+        for (unsigned int column = 1; column <= 4; column++) {
+            expected.setFormula(Address(column, row), values[column - 1]);
+            sheet.setFormula(Address(column, row), values[column - 1]);
+        }
+    }
+
+    expected.recalculate();
+    sheet.recalculate();
+    for (unsigned int column = 1; column <= 4; column++) {
+        for (unsigned int row = 1; row <= rows; row++) {
+            const Address address(column, row);
+            ASSERT_EQ(expected.getValue(address), sheet.getValue(address));
+            ASSERT_EQ(expected.getFormula(address), sheet.getFormula(address));
+        }
+    }
+
+    const PagingStats stats = sheet.getPagingStats();
+    EXPECT_GT(stats.evictions, 0u);
+    EXPECT_GT(stats.compressedBytes, 0u);
+    EXPECT_EQ(0u, stats.bytesRead);
+
+    const vector<ColumnCompression> columns = sheet.getColumnCompression();
+    ASSERT_EQ(4u, columns.size());
+    EXPECT_EQ(1u, columns[0].column);
+    EXPECT_GT(columns[0].dictionarySegments, 0u);
+    EXPECT_GT(columns[0].getRatio(), 4.0);
+    EXPECT_GT(columns[1].deltaSegments, 0u);
+    EXPECT_GT(columns[1].getRatio(), 4.0);
+    EXPECT_GT(columns[2].deltaSegments, 0u);
+    EXPECT_GT(columns[3].cells, 0u);
+}
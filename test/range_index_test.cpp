@@ -0,0 +1,128 @@
+/*
+ * test/range_index_test.cpp
+ *
+ * Copyright (c) 2012 Tristan Penman
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * This file is part of Inspect.
+ *
+ * Inspect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include "range_index.hpp"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+class RangeIndexTest : public testing::Test
+{
+
+};
+
+TEST_F(RangeIndexTest, finds_owners_of_ranges_that_contain_a_cell)
+{
+    RangeIndex index;
+    index.set(1, vector<Range>(1, Range("A1:A1000000")));
+    index.set(2, vector<Range>(1, Range("B2:D4")));
+
+    vector<Range> ranges;
+    ranges.push_back(Range("C3:C3"));
+    ranges.push_back(Range("A10:Z10"));
+    index.set(3, ranges);
+    EXPECT_EQ(4, index.size());
+
+    vector<RangeIndex::Owner> owners;
+    index.findCovering(Address("A500000"), owners);
+    ASSERT_EQ(1, owners.size());
+    EXPECT_EQ(1, owners[0]);
+
+    // Owners are appended in order, once each
+    owners.clear();
+    index.findCovering(Address("C3"), owners);
+    ASSERT_EQ(2, owners.size());
+    EXPECT_EQ(2, owners[0]);
+    EXPECT_EQ(3, owners[1]);
+
+    owners.clear();
+    index.findCovering(Address("A10"), owners);
+    ASSERT_EQ(2, owners.size());
+    EXPECT_EQ(1, owners[0]);
+    EXPECT_EQ(3, owners[1]);
+
+    owners.clear();
+    index.findCovering(Address("E5"), owners);
+    EXPECT_TRUE(owners.empty());
+
+    // Replacing and erasing ranges takes effect on the next query
+    index.set(3, vector<Range>(1, Range("E5:E5")));
+    EXPECT_EQ(3, index.size());
+    index.findCovering(Address("E5"), owners);
+    ASSERT_EQ(1, owners.size());
+    EXPECT_EQ(3, owners[0]);
+
+    EXPECT_TRUE(index.erase(3));
+    EXPECT_FALSE(index.erase(3));
+    EXPECT_TRUE(index.get(3).empty());
+    owners.clear();
+    index.findCovering(Address("E5"), owners);
+    EXPECT_TRUE(owners.empty());
+
+    index.set(2, vector<Range>());
+    EXPECT_EQ(1, index.size());
+}
+
+TEST_F(RangeIndexTest, matches_a_scan_of_every_range)
+{
+    srand(42);
+
+    RangeIndex index;
+    vector<vector<Range> > ranges(500);
+    for (size_t owner = 0; owner < ranges.size(); owner++) {
+        const size_t count = 1 + rand() % 3;
+        for (size_t i = 0; i < count; i++) {
+            // Mostly tall and narrow, as for a column of values
+            const unsigned int column = 1 + rand() % 40;
+            const unsigned int row = 1 + rand() % 400;
+            const unsigned int width = rand() % 4 == 0 ? rand() % 20 : 0;
+            const unsigned int height = rand() % 200;
+            ranges[owner].push_back(Range(Address(column, row), Address(column + width, row + height)));
+        }
+        index.set(owner, ranges[owner]);
+    }
+
+    for (unsigned int column = 1; column <= 64; column++) {
+        for (unsigned int row = 1; row <= 640; row += 3) {
+            const Address address(column, row);
+            vector<RangeIndex::Owner> expected;
+            for (size_t owner = 0; owner < ranges.size(); owner++) {
+                for (vector<Range>::const_iterator itr = ranges[owner].begin(); itr != ranges[owner].end(); itr++) {
+                    if (itr->contains(address)) {
+                        expected.push_back(owner);
+                        break;
+                    }
+                }
+            }
+
+            vector<RangeIndex::Owner> owners;
+            index.findCovering(address, owners);
+            EXPECT_EQ(expected, owners) << address.toString();
+        }
+    }
+}
@@ -0,0 +1,75 @@
+/*
+ * test/range_test.cpp
+ *
+ * Copyright (c) 2012 Tristan Penman
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * This file is part of Inspect.
+ *
+ * Inspect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdexcept>
+
+#include "range.hpp"
+
+#include "gtest/gtest.h"
+
+class RangeTest : public testing::Test
+{
+
+};
+
+TEST_F(RangeTest, constructionFromString)
+{
+    EXPECT_NO_THROW({
+        Range range("A1:C10");
+        EXPECT_EQ(Address(1, 1), range.first);
+        EXPECT_EQ(Address(3, 10), range.last);
+    });
+
+    EXPECT_NO_THROW({
+        // Corners are normalised
+        Range range("C1:A10");
+        EXPECT_EQ(Address(1, 1), range.first);
+        EXPECT_EQ(Address(3, 10), range.last);
+    });
+
+    EXPECT_NO_THROW({
+        // A single address is a range containing one cell
+        Range range("B2");
+        EXPECT_EQ(Address(2, 2), range.first);
+        EXPECT_EQ(Address(2, 2), range.last);
+    });
+
+    EXPECT_THROW(Range("A1:"), std::invalid_argument);
+    EXPECT_THROW(Range(":B2"), std::invalid_argument);
+    EXPECT_THROW(Range("A1:B2:C3"), std::invalid_argument);
+}
+
+TEST_F(RangeTest, contains)
+{
+    const Range range("B2:C3");
+    EXPECT_TRUE(range.contains(Address("B2")));
+    EXPECT_TRUE(range.contains(Address("C3")));
+    EXPECT_FALSE(range.contains(Address("A2")));
+    EXPECT_FALSE(range.contains(Address("C4")));
+}
+
+TEST_F(RangeTest, toString)
+{
+    EXPECT_EQ("A1:C10", Range("A1:C10").toString());
+    EXPECT_EQ("B2:B2", Range("B2").toString());
+}
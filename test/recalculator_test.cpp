@@ -0,0 +1,145 @@
+/*
+ * test/recalculator_test.cpp
+ *
+ * Copyright (c) 2012 Tristan Penman
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * This file is part of Inspect.
+ *
+ * Inspect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <sstream>
+#include <string>
+
+#include "gtest/gtest.h"
+
+#include "address.hpp"
+#include "recalculator.hpp"
+#include "sheet.hpp"
+
+using namespace std;
+
+class RecalculatorTest : public testing::Test
+{
+
+};
+
+namespace
+{
+    void setFormula(Sheet & sheet, const string & address, const string & formula)
+    {
+        sheet.setFormula(Address(address), formula);
+    }
+
+    void getValue(const Sheet & sheet, const string & address, string & value)
+    {
+        value = sheet.getValue(Address(address));
+    }
+
+    void fill(Sheet & sheet, int rows)
+    {
+        for (int row = 1; row <= rows; row++) {
+            stringstream formula;
+            formula << "=" << row << "*2+" << row;
+            sheet.setFormula(Address(1, row), formula.str());
+        }
+    }
+}
+
+TEST_F(RecalculatorTest, cancelled_pass_returns_early)
+{
+    Sheet sheet;
+    fill(sheet, 100);
+
+    RecalcProgress progress;
+    progress.cancelled = true;
+    EXPECT_FALSE(sheet.recalculate(progress));
+    EXPECT_EQ(0, progress.done);
+    EXPECT_EQ(100, progress.total);
+
+    // A later pass is not affected by cells left behind by the cancelled one
+    progress.cancelled = false;
+    EXPECT_TRUE(sheet.recalculate(progress));
+    EXPECT_EQ(100, progress.done);
+    EXPECT_EQ("300", sheet.getValue(Address(1, 100)));
+}
+
+TEST_F(RecalculatorTest, edits_are_recalculated_in_background)
+{
+    using namespace std::placeholders;
+
+    Sheet sheet;
+    Recalculator recalculator(sheet);
+
+    recalculator.edit(bind(setFormula, _1, "A1", "=1+1"));
+    recalculator.edit(bind(setFormula, _1, "A2", "=A1*3"));
+    EXPECT_EQ("", recalculator.wait());
+    EXPECT_TRUE(recalculator.isIdle());
+
+    string value;
+    recalculator.read(bind(getValue, _1, "A2", ref(value)));
+    EXPECT_EQ("6", value);
+
+    size_t done = 0;
+    size_t total = 0;
+    recalculator.getProgress(done, total);
+    EXPECT_EQ(2, done);
+    EXPECT_EQ(2, total);
+}
+
+TEST_F(RecalculatorTest, superseded_passes_are_not_reported)
+{
+    using namespace std::placeholders;
+
+    Sheet sheet;
+    fill(sheet, 20000);
+
+    atomic<int> completions(0);
+    Recalculator recalculator(sheet);
+    recalculator.setCallback([&completions](const string &) { completions++; });
+
+    // Each edit cancels the pass started by the one before it
+    for (int i = 0; i < 20; i++) {
+        stringstream formula;
+        formula << "=" << i;
+        recalculator.edit(bind(setFormula, _1, "B1", formula.str()));
+    }
+
+    EXPECT_EQ("", recalculator.wait());
+    EXPECT_LE(1, completions.load());
+    EXPECT_GE(20, completions.load());
+
+    string value;
+    recalculator.read(bind(getValue, _1, "B1", ref(value)));
+    EXPECT_EQ("19", value);
+}
+
+TEST_F(RecalculatorTest, errors_are_reported)
+{
+    using namespace std::placeholders;
+
+    Sheet sheet;
+    Recalculator recalculator(sheet);
+
+    string reported;
+    recalculator.setCallback([&reported](const string & error) { reported = error; });
+    recalculator.edit(bind(setFormula, _1, "A1", "=A2"));
+    recalculator.edit(bind(setFormula, _1, "A2", "=A1"));
+
+    EXPECT_EQ("Cycle detected.", recalculator.wait());
+    EXPECT_EQ("Cycle detected.", reported);
+}
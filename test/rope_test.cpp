@@ -0,0 +1,177 @@
+/*
+ * test/rope_test.cpp
+ *
+ * Copyright (c) 2012 Tristan Penman
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * This file is part of Inspect.
+ *
+ * Inspect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "address.hpp"
+#include "rope.hpp"
+#include "sheet.hpp"
+
+using namespace std;
+
+class RopeTest : public testing::Test
+{
+
+};
+
+namespace
+{
+    /// Values of various lengths, either side of the inline and head sizes
+    vector<string> getSamples()
+    {
+        vector<string> samples;
+        const size_t lengths[] = {0, 1, 5, 31, 32, 33, 63, 64, 65, 100, 300};
+        for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++) {
+            string value;
+            for (size_t j = 0; j < lengths[i]; j++) {
+                value.push_back(char('a' + (i + j) % 26));
+            }
+            samples.push_back(value);
+        }
+
+        return samples;
+    }
+}
+
+TEST_F(RopeTest, concatenation_matches_strings)
+{
+    const vector<string> samples = getSamples();
+    for (size_t i = 0; i < samples.size(); i++) {
+        for (size_t j = 0; j < samples.size(); j++) {
+            const Rope rope = Rope::concat(Rope(samples[i]), Rope(samples[j]));
+            const string expected = samples[i] + samples[j];
+            EXPECT_EQ(expected.size(), rope.size());
+            EXPECT_EQ(expected, rope.str());
+            EXPECT_EQ(expected.substr(0, Rope::HEAD_SIZE), rope.head());
+
+            // Appending and prepending to an existing concatenation
+            const Rope appended = Rope::concat(rope, Rope(samples[j]));
+            EXPECT_EQ(expected + samples[j], appended.str());
+            const Rope prepended = Rope::concat(Rope(samples[i]), rope);
+            EXPECT_EQ(samples[i] + expected, prepended.str());
+        }
+    }
+}
+
+TEST_F(RopeTest, comparisons_match_strings)
+{
+    const vector<string> samples = getSamples();
+    vector<Rope> ropes;
+    vector<string> strings;
+    for (size_t i = 0; i < samples.size(); i++) {
+        for (size_t j = 0; j < samples.size(); j++) {
+            ropes.push_back(Rope::concat(Rope(samples[i]), Rope(samples[j])));
+            strings.push_back(samples[i] + samples[j]);
+        }
+    }
+
+    for (size_t i = 0; i < ropes.size(); i++) {
+        for (size_t j = 0; j < ropes.size(); j++) {
+            EXPECT_EQ(strings[i] == strings[j], ropes[i] == ropes[j]) << strings[i] << " == " << strings[j];
+            EXPECT_EQ(strings[i] < strings[j], ropes[i] < ropes[j]) << strings[i] << " < " << strings[j];
+        }
+    }
+
+    // Values built from the same parts are equal, however they were split
+    const Rope a = Rope::concat(Rope::concat(Rope(samples[10]), Rope(samples[9])), Rope(samples[10]));
+    const Rope b = Rope::concat(Rope(samples[10]), Rope::concat(Rope(samples[9]), Rope(samples[10])));
+    EXPECT_TRUE(a == b);
+    EXPECT_FALSE(a < b || b < a);
+}
+
+TEST_F(RopeTest, long_chains_are_not_copied)
+{
+    Rope rope("start");
+    for (int i = 0; i < 200000; i++) {
+        rope = Rope::concat(rope, Rope("x"));
+    }
+
+    EXPECT_EQ(200005u, rope.size());
+    const string value = rope.str();
+    EXPECT_EQ("startxxx", value.substr(0, 8));
+    EXPECT_EQ(string(200000, 'x'), value.substr(5));
+
+    // Releasing the chain must not recurse once per piece
+    rope = Rope();
+    EXPECT_TRUE(rope.empty());
+}
+
+TEST_F(RopeTest, sheets_concatenate_across_cells)
+{
+    const unsigned int rows = 5000;
+
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "'row");
+    for (unsigned int row = 2; row <= rows; row++) {
+        ostringstream formula;
+        formula << "=A" << row - 1 << " + \", \" + B" << row;
+        sheet.setFormula(Address(1, row), formula.str());
+        sheet.setFormula(Address(2, row), "'item");
+    }
+
+    sheet.recalculate();
+
+    string expected = "row";
+    for (unsigned int row = 2; row <= rows; row++) {
+        expected += ", item";
+    }
+    EXPECT_EQ(expected, sheet.getValue(Address(1, rows)));
+
+    // Changing the end of the chain only changes the last value
+    sheet.setFormula(Address(2, rows), "'last");
+    sheet.recalculate();
+    EXPECT_EQ(expected.substr(0, expected.size() - 4) + "last", sheet.getValue(Address(1, rows)));
+    EXPECT_EQ(expected.substr(0, expected.size() - 6), sheet.getValue(Address(1, rows - 1)));
+}
+
+TEST_F(RopeTest, long_values_are_read_as_numbers_in_the_same_way)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "'123");
+    sheet.setFormula(Address("A2"), "'abcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyzabcdefghijklmnopqrstuvwxyz");
+    sheet.setFormula(Address("A3"), "'0000000000000000000000000000000000000000");
+    sheet.setFormula(Address("A4"), "'0000000000000000000000000000000000000000000000000000000000000000000");
+
+    // A number followed by text is read as the number
+    sheet.setFormula(Address("B1"), "=A1 + A2");
+    sheet.setFormula(Address("C1"), "=B1 + 1");
+
+    // Digits that continue beyond the first characters are all read
+    sheet.setFormula(Address("B2"), "=A3 + A4 + A1");
+    sheet.setFormula(Address("C2"), "=B2 + 1");
+
+    // Text is not a number
+    sheet.setFormula(Address("B3"), "=A2 + A1");
+    sheet.setFormula(Address("C3"), "=B3 + 1");
+    sheet.recalculate();
+
+    EXPECT_EQ("124", sheet.getValue(Address("C1")));
+    EXPECT_EQ("124", sheet.getValue(Address("C2")));
+    EXPECT_EQ(sheet.getValue(Address("B3")) + "1", sheet.getValue(Address("C3")));
+}
@@ -21,8 +21,12 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <map>
 #include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 
 #include "gtest/gtest.h"
 
@@ -95,3 +99,840 @@ TEST_F(SheetTest, setFormula_and_getFormula_with_addresses)
     string retrievedValue = sheet.getValue(address2);
     EXPECT_EQ(expectedValue, retrievedValue);
 }
+
+TEST_F(SheetTest, profiling_reports_hot_cells)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    sheet.setFormula(Address("A2"), "=A1+1");
+    sheet.setFormula(Address("A3"), "=A1+A2+A1");
+    sheet.setFormula(Address("B1"), "'label");
+
+    // Nothing is recorded until profiling is enabled
+    sheet.recalculate();
+    EXPECT_TRUE(sheet.getHotCells(10).empty());
+
+    sheet.setProfiling(true);
+    EXPECT_TRUE(sheet.isProfiling());
+    sheet.recalculate();
+    sheet.recalculate();
+
+    const vector<CellProfile> profiles = sheet.getHotCells(10);
+    ASSERT_EQ(4, profiles.size());
+
+    map<string, CellProfile> byAddress;
+    for (vector<CellProfile>::const_iterator itr = profiles.begin(); itr != profiles.end(); itr++) {
+        EXPECT_EQ(2, itr->evaluations);
+        EXPECT_LE(itr->exclusiveNanos, itr->inclusiveNanos);
+        byAddress.insert(make_pair(itr->address.toString(), *itr));
+    }
+
+    EXPECT_EQ("=A1+A2+A1", byAddress.at("A3").formula);
+    EXPECT_EQ(2, byAddress.at("A3").fanIn);
+    EXPECT_EQ(0, byAddress.at("A3").fanOut);
+    EXPECT_EQ(0, byAddress.at("A1").fanIn);
+    EXPECT_EQ(2, byAddress.at("A1").fanOut);
+
+    // Results are ordered by exclusive time, and limited to the count requested
+    EXPECT_GE(profiles[0].exclusiveNanos, profiles[1].exclusiveNanos);
+    EXPECT_EQ(1, sheet.getHotCells(1).size());
+
+    sheet.resetProfile();
+    EXPECT_TRUE(sheet.getHotCells(10).empty());
+}
+
+TEST_F(SheetTest, priority_regions_are_recalculated_first)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=5");
+    sheet.setFormula(Address("B1"), "=7");
+    sheet.setFormula(Address("C1"), "=A1*10");
+    sheet.setFormula(Address("C2"), "=B1*10");
+    sheet.addPriorityRegion(Range("C1:D1"));
+
+    map<string, string> published;
+    RecalcProgress progress;
+    progress.onPrioritised = [&sheet, &published]() {
+        const char * addresses[] = { "A1", "B1", "C1", "C2" };
+        for (size_t i = 0; i < 4; i++) {
+            published[addresses[i]] = sheet.getValue(Address(addresses[i]));
+        }
+    };
+
+    EXPECT_TRUE(sheet.recalculate(progress));
+
+    // The region and its precedents were up to date when published...
+    EXPECT_EQ("50", published["C1"]);
+    EXPECT_EQ("5", published["A1"]);
+
+    // ...but the rest of the sheet had not been recalculated yet
+    EXPECT_EQ("", published["B1"]);
+    EXPECT_EQ("", published["C2"]);
+
+    EXPECT_EQ("70", sheet.getValue(Address("C2")));
+    EXPECT_EQ(4, progress.done);
+
+    // Without priority regions, the callback is not used
+    sheet.clearPriorityRegions();
+    published.clear();
+    EXPECT_TRUE(sheet.recalculate(progress));
+    EXPECT_TRUE(published.empty());
+}
+
+TEST_F(SheetTest, references_follow_cells_as_they_are_created_and_erased)
+{
+    Sheet sheet;
+
+    // Reference to a cell that has not been set yet
+    sheet.setFormula(Address("B1"), "=A1+\"!\"");
+    sheet.recalculate();
+    EXPECT_EQ("!", sheet.getValue(Address("B1")));
+
+    sheet.setFormula(Address("A1"), "'first");
+    sheet.recalculate();
+    EXPECT_EQ("first!", sheet.getValue(Address("B1")));
+
+    // Erasing A1 frees its slot, which is then reused by C1; B1 must not
+    // pick up the value of C1 through the reused slot
+    EXPECT_TRUE(sheet.erase(Address("A1")));
+    sheet.setFormula(Address("C1"), "'second");
+    sheet.recalculate();
+    EXPECT_EQ("!", sheet.getValue(Address("B1")));
+    EXPECT_EQ("second", sheet.getValue(Address("C1")));
+
+    sheet.setFormula(Address("A1"), "'third");
+    sheet.recalculate();
+    EXPECT_EQ("third!", sheet.getValue(Address("B1")));
+    EXPECT_FALSE(sheet.erase(Address("D1")));
+}
+
+TEST_F(SheetTest, forks_are_independent_of_their_parent)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=2");
+    sheet.setFormula(Address("A2"), "=A1*10");
+    sheet.setFormula(Address("A3"), "'unchanged");
+    sheet.recalculate();
+
+    unique_ptr<Sheet> pFork = sheet.fork();
+    EXPECT_EQ("20", pFork->getValue(Address("A2")));
+
+    pFork->setFormula(Address("A1"), "=3");
+    pFork->setFormula(Address("B1"), "=A2+1");
+    pFork->recalculate();
+    EXPECT_EQ("=3", pFork->getFormula(Address("A1")));
+    EXPECT_EQ("30", pFork->getValue(Address("A2")));
+    EXPECT_EQ("31", pFork->getValue(Address("B1")));
+    EXPECT_EQ("unchanged", pFork->getValue(Address("A3")));
+
+    // The parent is not affected by changes to the fork, or vice versa
+    EXPECT_EQ("=2", sheet.getFormula(Address("A1")));
+    EXPECT_EQ("20", sheet.getValue(Address("A2")));
+    EXPECT_FALSE(sheet.isSet(Address("B1")));
+
+    EXPECT_TRUE(sheet.erase(Address("A3")));
+    sheet.recalculate();
+    EXPECT_EQ("unchanged", pFork->getValue(Address("A3")));
+
+    // Forks outlive their parents
+    pFork = pFork->fork();
+    EXPECT_EQ("31", pFork->getValue(Address("B1")));
+}
+
+TEST_F(SheetTest, forks_can_be_recalculated_in_parallel)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    for (unsigned int row = 2; row <= 500; row++) {
+        ostringstream formula;
+        formula << "=A" << row - 1 << "+1";
+        sheet.setFormula(Address(1, row), formula.str());
+        sheet.setFormula(Address(2, row), "=B1");
+    }
+    sheet.setFormula(Address("B1"), "'shared");
+    sheet.recalculate();
+
+    const size_t scenarios = 8;
+    vector<unique_ptr<Sheet> > forks;
+    for (size_t i = 0; i < scenarios; i++) {
+        forks.push_back(sheet.fork());
+    }
+
+    vector<thread> threads;
+    for (size_t i = 0; i < scenarios; i++) {
+        Sheet & fork = *forks[i];
+        threads.push_back(thread([&fork, i]() {
+            ostringstream formula;
+            formula << "=" << i * 1000;
+            fork.setFormula(Address("A1"), formula.str());
+            fork.recalculate();
+        }));
+    }
+
+    for (size_t i = 0; i < scenarios; i++) {
+        threads[i].join();
+    }
+
+    for (size_t i = 0; i < scenarios; i++) {
+        ostringstream expected;
+        expected << i * 1000 + 499;
+        EXPECT_EQ(expected.str(), forks[i]->getValue(Address(1, 500)));
+        EXPECT_EQ("shared", forks[i]->getValue(Address(2, 500)));
+    }
+
+    EXPECT_EQ("500", sheet.getValue(Address(1, 500)));
+}
+
+TEST_F(SheetTest, sweep_evaluates_dependents_for_each_input_value)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    sheet.setFormula(Address("B1"), "=10");
+    sheet.setFormula(Address("A2"), "=A1*2+B1");
+    sheet.setFormula(Address("A3"), "=IF(A2>20, \"high\", \"low\")");
+    sheet.setFormula(Address("C1"), "=B1+5");
+
+    vector<vector<string> > values;
+    values.push_back(vector<string>(1, "1"));
+    values.push_back(vector<string>(1, "6"));
+    values.push_back(vector<string>(1, "x"));
+
+    vector<Address> inputs(1, Address("A1"));
+    vector<Address> outputs;
+    outputs.push_back(Address("A2"));
+    outputs.push_back(Address("A3"));
+    outputs.push_back(Address("C1"));
+    outputs.push_back(Address("A1"));
+    outputs.push_back(Address("D9"));
+
+    const vector<vector<string> > results = sheet.sweep(inputs, values, outputs);
+    ASSERT_EQ(3, results.size());
+    ASSERT_EQ(5, results[0].size());
+    EXPECT_EQ("12", results[0][0]);
+    EXPECT_EQ("low", results[0][1]);
+    EXPECT_EQ("15", results[0][2]);
+    EXPECT_EQ("1", results[0][3]);
+    EXPECT_EQ("", results[0][4]);
+    EXPECT_EQ("22", results[1][0]);
+    EXPECT_EQ("high", results[1][1]);
+    EXPECT_EQ("x", results[2][3]);
+
+    // Lanes that are not numbers behave as they would in a recalculation
+    unique_ptr<Sheet> pFork = sheet.fork();
+    pFork->setFormula(Address("A1"), "'x");
+    pFork->recalculate();
+    EXPECT_EQ(pFork->getValue(Address("A2")), results[2][0]);
+    EXPECT_EQ(pFork->getValue(Address("A3")), results[2][1]);
+
+    // The sheet itself is left as it was
+    EXPECT_EQ("12", sheet.getValue(Address("A2")));
+    EXPECT_EQ("=1", sheet.getFormula(Address("A1")));
+
+    EXPECT_THROW(sheet.sweep(vector<Address>(1, Address("Z1")), values, outputs), invalid_argument);
+    values.push_back(vector<string>());
+    EXPECT_THROW(sheet.sweep(inputs, values, outputs), invalid_argument);
+}
+
+TEST_F(SheetTest, sweep_with_several_inputs)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    sheet.setFormula(Address("A2"), "=2");
+    sheet.setFormula(Address("B1"), "=A1*A2");
+    sheet.setFormula(Address("B2"), "=B1+A1");
+
+    vector<Address> inputs;
+    inputs.push_back(Address("A1"));
+    inputs.push_back(Address("A2"));
+
+    vector<vector<string> > values;
+    for (int i = 0; i < 100; i++) {
+        ostringstream a;
+        ostringstream b;
+        a << i;
+        b << i + 1;
+        vector<string> lane;
+        lane.push_back(a.str());
+        lane.push_back(b.str());
+        values.push_back(lane);
+    }
+
+    const vector<vector<string> > results = sheet.sweep(inputs, values, vector<Address>(1, Address("B2")));
+    ASSERT_EQ(100, results.size());
+    for (int i = 0; i < 100; i++) {
+        ostringstream expected;
+        expected << i * (i + 1) + i;
+        EXPECT_EQ(expected.str(), results[i][0]);
+    }
+}
+
+TEST_F(SheetTest, filled_down_runs_match_cell_by_cell_evaluation)
+{
+    // Formulas in consecutive rows form a run; the same formulas in every
+    // other row do not
+    Sheet filled;
+    Sheet spaced;
+    for (unsigned int i = 1; i <= 100; i++) {
+        ostringstream a;
+        ostringstream b;
+        a << "=" << i << ".25";
+        b << "=" << i * 7;
+        if (i == 50) {
+            a.str("'text");
+        }
+
+        filled.setFormula(Address(1, i), a.str());
+        filled.setFormula(Address(2, i), b.str());
+        spaced.setFormula(Address(1, i * 2), a.str());
+        spaced.setFormula(Address(2, i * 2), b.str());
+
+        ostringstream formula;
+        formula << "=A" << i << "*B" << i << "/3+0.1234567";
+        filled.setFormula(Address(3, i), formula.str());
+        formula.str("");
+        formula << "=A" << i * 2 << "*B" << i * 2 << "/3+0.1234567";
+        spaced.setFormula(Address(3, i * 2), formula.str());
+    }
+
+    filled.recalculate();
+    spaced.recalculate();
+
+    for (unsigned int i = 1; i <= 100; i++) {
+        EXPECT_EQ(spaced.getValue(Address(3, i * 2)), filled.getValue(Address(3, i)));
+    }
+
+    EXPECT_EQ("ERROR0.123457", filled.getValue(Address(3, 50)));
+
+    // Changing a precedent is picked up by the next pass
+    filled.setFormula(Address(2, 10), "=0");
+    filled.recalculate();
+    EXPECT_EQ("0.123457", filled.getValue(Address(3, 10)));
+}
+
+TEST_F(SheetTest, runs_that_refer_to_themselves_are_evaluated_in_order)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("C1"), "=1");
+    for (unsigned int row = 2; row <= 40; row++) {
+        ostringstream formula;
+        formula << "=C" << row - 1 << "+1";
+        sheet.setFormula(Address(3, row), formula.str());
+    }
+
+    sheet.recalculate();
+    EXPECT_EQ("40", sheet.getValue(Address(3, 40)));
+}
+
+TEST_F(SheetTest, evaluation_plan_is_kept_until_cells_are_created_or_erased)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=2");
+    for (unsigned int row = 1; row <= 20; row++) {
+        ostringstream formula;
+        formula << "=A1*" << row;
+        sheet.setFormula(Address(2, row), formula.str());
+    }
+
+    RecalcProgress progress;
+    EXPECT_TRUE(sheet.recalculate(progress));
+    EXPECT_FALSE(progress.planned);
+    EXPECT_EQ("40", sheet.getValue(Address("B20")));
+
+    // Changing formulas keeps the plan
+    sheet.setFormula(Address("A1"), "=3");
+    EXPECT_TRUE(sheet.recalculate(progress));
+    EXPECT_TRUE(progress.planned);
+    EXPECT_EQ(21, progress.done);
+    EXPECT_EQ("60", sheet.getValue(Address("B20")));
+
+    // Creating a cell discards it, and the next pass records a new one
+    sheet.setFormula(Address("C1"), "=B20+1");
+    EXPECT_TRUE(sheet.recalculate(progress));
+    EXPECT_FALSE(progress.planned);
+    EXPECT_EQ("61", sheet.getValue(Address("C1")));
+
+    EXPECT_TRUE(sheet.recalculate(progress));
+    EXPECT_TRUE(progress.planned);
+
+    EXPECT_TRUE(sheet.erase(Address("C1")));
+    EXPECT_TRUE(sheet.recalculate(progress));
+    EXPECT_FALSE(progress.planned);
+}
+
+TEST_F(SheetTest, planned_passes_follow_changes_to_dependencies)
+{
+    Sheet planned;
+    Sheet fresh;
+    for (unsigned int row = 1; row <= 20; row++) {
+        ostringstream a, b;
+        a << "=" << row;
+        b << "=A" << row << "*2";
+        planned.setFormula(Address(1, row), a.str());
+        planned.setFormula(Address(2, row), b.str());
+    }
+
+    planned.setFormula(Address("C1"), "=1");
+    planned.setFormula(Address("C2"), "=C1+1");
+    planned.recalculate();
+
+    // A cell in the middle of a run that was evaluated as a batch changes
+    // shape, and comes to depend on a cell that was later in the plan
+    planned.setFormula(Address("B10"), "=C2+B9");
+
+    // C1 now depends on a cell that was later in the plan
+    planned.setFormula(Address("C1"), "=B20+1");
+
+    RecalcProgress progress;
+    EXPECT_TRUE(planned.recalculate(progress));
+    EXPECT_TRUE(progress.planned);
+
+    const vector<Address> addresses = planned.getAddresses();
+    for (vector<Address>::const_iterator itr = addresses.begin(); itr != addresses.end(); itr++) {
+        fresh.setFormula(*itr, planned.getFormula(*itr));
+    }
+
+    fresh.recalculate();
+    for (vector<Address>::const_iterator itr = addresses.begin(); itr != addresses.end(); itr++) {
+        EXPECT_EQ(fresh.getValue(*itr), planned.getValue(*itr)) << itr->column << "," << itr->row;
+    }
+
+    EXPECT_EQ("42", planned.getValue(Address("C2")));
+    EXPECT_EQ("60", planned.getValue(Address("B10")));
+
+    // Following the plan that was recorded by that pass gives the same values
+    EXPECT_TRUE(planned.recalculate(progress));
+    EXPECT_TRUE(progress.planned);
+    EXPECT_EQ("42", planned.getValue(Address("C2")));
+    EXPECT_EQ("60", planned.getValue(Address("B10")));
+
+    // A cycle introduced by changing a formula is still detected
+    planned.setFormula(Address("A20"), "=C2");
+    EXPECT_THROW(planned.recalculate(), std::runtime_error);
+}
+
+TEST_F(SheetTest, cells_within_ranges_are_evaluated_before_they_are_read)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=SUM(B1:B3)");
+    sheet.setFormula(Address("B1"), "=B2*2");
+    sheet.setFormula(Address("B2"), "=B3+1");
+    sheet.setFormula(Address("B3"), "=4");
+    sheet.recalculate();
+
+    EXPECT_EQ("19", sheet.getValue(Address("A1")));
+
+    // A range that contains its own cell is a cycle
+    sheet.setFormula(Address("B3"), "=SUM(A1:A2)");
+    EXPECT_THROW(sheet.recalculate(), std::runtime_error);
+
+    sheet.setFormula(Address("B3"), "=SUM(C1:C2)");
+    sheet.recalculate();
+    EXPECT_EQ("3", sheet.getValue(Address("A1")));
+}
+
+TEST_F(SheetTest, sweep_reaches_cells_that_read_an_input_through_a_range)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    sheet.setFormula(Address("A2"), "=2");
+    sheet.setFormula(Address("A3"), "=3");
+    sheet.setFormula(Address("B1"), "=SUM(A1:A3)");
+    sheet.setFormula(Address("C1"), "=B1*10");
+    sheet.setFormula(Address("D1"), "=SUM(A2:A3)");
+    sheet.recalculate();
+
+    vector<vector<string> > values;
+    values.push_back(vector<string>(1, "5"));
+    values.push_back(vector<string>(1, "x"));
+
+    vector<Address> outputs;
+    outputs.push_back(Address("B1"));
+    outputs.push_back(Address("C1"));
+    outputs.push_back(Address("D1"));
+
+    const vector<vector<string> > results = sheet.sweep(vector<Address>(1, Address("A1")), values, outputs);
+    ASSERT_EQ(2, results.size());
+    EXPECT_EQ("10", results[0][0]);
+    EXPECT_EQ("100", results[0][1]);
+    EXPECT_EQ("5", results[0][2]);
+    EXPECT_EQ("5", results[1][0]);
+    EXPECT_EQ("50", results[1][1]);
+
+    // Erasing a cell removes its ranges, so a cell created later in its slot
+    // is not taken to read them
+    EXPECT_TRUE(sheet.erase(Address("B1")));
+    sheet.setFormula(Address("E1"), "=7");
+    sheet.setFormula(Address("C1"), "=E1*10");
+    sheet.recalculate();
+
+    const vector<vector<string> > after = sheet.sweep(vector<Address>(1, Address("A1")), values, outputs);
+    EXPECT_EQ("", after[0][0]);
+    EXPECT_EQ("70", after[0][1]);
+}
+
+TEST_F(SheetTest, precedents_and_dependents_are_traced_from_formulas)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    sheet.setFormula(Address("A2"), "=2");
+    sheet.setFormula(Address("A3"), "'text");
+    sheet.setFormula(Address("B1"), "=A1+A2+A1");
+    sheet.setFormula(Address("B2"), "=IF(B1>0, 1, A3)");
+    sheet.setFormula(Address("C1"), "=SUM(A1:A3, B9)");
+    sheet.setFormula(Address("D1"), "=B2*C1");
+
+    // Cells need not have been recalculated to be traced
+    vector<Address> direct;
+    direct.push_back(Address("A3"));
+    direct.push_back(Address("B1"));
+    EXPECT_EQ(direct, sheet.getPrecedents(Range("B2"), false));
+
+    // References that were not read are included, and references to cells
+    // that are not set are not
+    sheet.recalculate();
+    EXPECT_EQ(direct, sheet.getPrecedents(Range("B2"), false));
+
+    const vector<Address> all = sheet.getPrecedents(Range("D1"), true);
+    ASSERT_EQ(6, all.size());
+    EXPECT_EQ(Address("A1"), all[0]);
+    EXPECT_EQ(Address("C1"), all[5]);
+
+    vector<Address> dependents;
+    dependents.push_back(Address("B1"));
+    dependents.push_back(Address("C1"));
+    EXPECT_EQ(dependents, sheet.getDependents(Range("A1"), false));
+
+    dependents.push_back(Address("B2"));
+    dependents.push_back(Address("D1"));
+    sort(dependents.begin(), dependents.end());
+    EXPECT_EQ(dependents, sheet.getDependents(Range("A1:A2"), true));
+    EXPECT_TRUE(sheet.getDependents(Range("D1"), true).empty());
+
+    // Cells within the range are included if they depend on each other
+    dependents.clear();
+    dependents.push_back(Address("B2"));
+    dependents.push_back(Address("D1"));
+    EXPECT_EQ(dependents, sheet.getDependents(Range("B1:B2"), false));
+
+    EXPECT_TRUE(sheet.dependsOn(Address("D1"), Address("A2")));
+    EXPECT_TRUE(sheet.dependsOn(Address("C1"), Address("A3")));
+    EXPECT_FALSE(sheet.dependsOn(Address("A2"), Address("D1")));
+    EXPECT_FALSE(sheet.dependsOn(Address("C1"), Address("B1")));
+    EXPECT_FALSE(sheet.dependsOn(Address("D1"), Address("D1")));
+    EXPECT_FALSE(sheet.dependsOn(Address("D1"), Address("Z9")));
+}
+
+TEST_F(SheetTest, tracing_follows_edits)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    sheet.setFormula(Address("A2"), "=A1+1");
+    sheet.setFormula(Address("A3"), "=A2+1");
+    sheet.setFormula(Address("B1"), "=5");
+    EXPECT_TRUE(sheet.dependsOn(Address("A3"), Address("A1")));
+
+    // Edits that keep the same references keep the graph
+    sheet.setFormula(Address("A2"), "=A1+2");
+    sheet.setFormula(Address("A1"), "=3");
+    EXPECT_TRUE(sheet.dependsOn(Address("A3"), Address("A1")));
+    EXPECT_EQ(2, sheet.getDependents(Range("A1"), true).size());
+
+    // Edits that change references, including ranges, are followed
+    sheet.setFormula(Address("A2"), "=B1");
+    EXPECT_FALSE(sheet.dependsOn(Address("A3"), Address("A1")));
+    EXPECT_TRUE(sheet.dependsOn(Address("A3"), Address("B1")));
+
+    sheet.setFormula(Address("B1"), "=SUM(A1:A1)");
+    EXPECT_TRUE(sheet.dependsOn(Address("A3"), Address("A1")));
+    EXPECT_EQ(vector<Address>(1, Address("A1")), sheet.getPrecedents(Range("B1"), false));
+
+    // As are cells that are created and erased
+    sheet.setFormula(Address("C1"), "=A3");
+    EXPECT_TRUE(sheet.dependsOn(Address("C1"), Address("A1")));
+    EXPECT_TRUE(sheet.erase(Address("A2")));
+    EXPECT_FALSE(sheet.dependsOn(Address("C1"), Address("A1")));
+    EXPECT_TRUE(sheet.getPrecedents(Range("A3"), false).empty());
+
+    // A cycle is traced without looping, and cells within it depend on
+    // themselves
+    sheet.setFormula(Address("A1"), "=C1");
+    sheet.setFormula(Address("A2"), "=A1");
+    EXPECT_TRUE(sheet.dependsOn(Address("A1"), Address("A1")));
+    EXPECT_TRUE(sheet.dependsOn(Address("B1"), Address("C1")));
+    const vector<Address> cycle = sheet.getPrecedents(Range("C1"), true);
+    ASSERT_EQ(4, cycle.size());
+    EXPECT_EQ(Address("C1"), cycle[3]);
+}
+
+TEST_F(SheetTest, inserting_rows_moves_cells_and_rewrites_references)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    sheet.setFormula(Address("A2"), "=2");
+    sheet.setFormula(Address("A3"), "=A1 + A2");
+    sheet.setFormula(Address("B1"), "=SUM(A1:A3) + A3 + C9");
+    sheet.setFormula(Address("B2"), "=A1 * 10");
+    sheet.recalculate();
+    EXPECT_TRUE(sheet.dependsOn(Address("B1"), Address("A2")));
+
+    sheet.insertRows(2, 2);
+
+    // Cells from the insertion point down move, and references follow them,
+    // including references to cells that have not been set
+    EXPECT_FALSE(sheet.isSet(Address("A2")));
+    EXPECT_EQ("=2", sheet.getFormula(Address("A4")));
+    EXPECT_EQ("=A1 + A4", sheet.getFormula(Address("A5")));
+    EXPECT_EQ("=SUM(A1:A5) + A5 + C11", sheet.getFormula(Address("B1")));
+    EXPECT_EQ("=A1 * 10", sheet.getFormula(Address("B4")));
+
+    sheet.recalculate();
+    EXPECT_EQ("3", sheet.getValue(Address("A5")));
+    EXPECT_EQ("9", sheet.getValue(Address("B1")));
+    EXPECT_EQ("10", sheet.getValue(Address("B4")));
+
+    // Tracing follows the cells to their new addresses
+    EXPECT_TRUE(sheet.dependsOn(Address("B1"), Address("A4")));
+    EXPECT_EQ(vector<Address>(1, Address("B1")), sheet.getDependents(Range("A5"), false));
+
+    // Cells that are set afterwards are found by ranges that grew
+    sheet.setFormula(Address("A2"), "=100");
+    sheet.setFormula(Address("C11"), "=1000");
+    sheet.recalculate();
+    EXPECT_EQ("1109", sheet.getValue(Address("B1")));
+}
+
+TEST_F(SheetTest, deleting_rows_replaces_references_to_deleted_cells)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    sheet.setFormula(Address("A2"), "=2");
+    sheet.setFormula(Address("A3"), "=3");
+    sheet.setFormula(Address("A4"), "=4");
+    sheet.setFormula(Address("B1"), "=SUM(A1:A4)");
+    sheet.setFormula(Address("B4"), "=A4 - A1");
+    sheet.setFormula(Address("B5"), "=A2 + 1");
+    sheet.setFormula(Address("B6"), "=SUM(A2:A3)");
+    sheet.recalculate();
+
+    sheet.deleteRows(2, 2);
+
+    // Ranges shrink, unless every row is deleted
+    EXPECT_EQ("=SUM(A1:A2)", sheet.getFormula(Address("B1")));
+    EXPECT_EQ("=A2 - A1", sheet.getFormula(Address("B2")));
+    EXPECT_EQ("=#REF! + 1", sheet.getFormula(Address("B3")));
+    EXPECT_EQ("=SUM(#REF!)", sheet.getFormula(Address("B4")));
+    EXPECT_FALSE(sheet.isSet(Address("A3")));
+    EXPECT_FALSE(sheet.isSet(Address("B5")));
+
+    sheet.recalculate();
+    EXPECT_EQ("5", sheet.getValue(Address("B1")));
+    EXPECT_EQ("3", sheet.getValue(Address("B2")));
+    EXPECT_EQ("ERROR", sheet.getValue(Address("B4")));
+
+    // References to deleted cells are gone from the graph
+    EXPECT_EQ(2, sheet.getPrecedents(Range("B1:B4"), false).size());
+    EXPECT_FALSE(sheet.dependsOn(Address("B3"), Address("A2")));
+
+    sheet.setFormula(Address("C1"), "=B2");
+    sheet.deleteRows(2, 1);
+    EXPECT_EQ("=#REF!", sheet.getFormula(Address("C1")));
+    EXPECT_EQ("=SUM(A1:A1)", sheet.getFormula(Address("B1")));
+}
+
+TEST_F(SheetTest, inserting_and_deleting_columns_rewrites_references)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    sheet.setFormula(Address("B1"), "=2");
+    sheet.setFormula(Address("C1"), "=A1+B1");
+    sheet.setFormula(Address("A2"), "=SUM(A1:C1)");
+    sheet.setFormula(Address("A3"), "'B1");
+
+    sheet.insertColumns(Address("B1").column, 1);
+    EXPECT_EQ("=2", sheet.getFormula(Address("C1")));
+    EXPECT_EQ("=A1+C1", sheet.getFormula(Address("D1")));
+    EXPECT_EQ("=SUM(A1:D1)", sheet.getFormula(Address("A2")));
+    EXPECT_EQ("'B1", sheet.getFormula(Address("A3")));
+
+    sheet.deleteColumns(Address("A1").column, 1);
+    EXPECT_EQ("=#REF!+B1", sheet.getFormula(Address("C1")));
+    EXPECT_FALSE(sheet.isSet(Address("A2")));
+
+    sheet.recalculate();
+    EXPECT_EQ("2", sheet.getValue(Address("B1")));
+    EXPECT_EQ(2u, sheet.getAddresses().size());
+}
+
+TEST_F(SheetTest, forks_are_independent_of_inserted_rows)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    sheet.setFormula(Address("A2"), "=A1+1");
+    sheet.recalculate();
+
+    unique_ptr<Sheet> pFork = sheet.fork();
+    pFork->insertRows(1, 1);
+    pFork->recalculate();
+
+    EXPECT_EQ("=A2+1", pFork->getFormula(Address("A3")));
+    EXPECT_EQ("2", pFork->getValue(Address("A3")));
+    EXPECT_EQ("=A1+1", sheet.getFormula(Address("A2")));
+    EXPECT_EQ("2", sheet.getValue(Address("A2")));
+    EXPECT_FALSE(sheet.isSet(Address("A3")));
+}
+
+TEST_F(SheetTest, array_formulas_spill_into_neighbouring_cells)
+{
+    Sheet sheet;
+    for (unsigned int row = 1; row <= 5; row++) {
+        stringstream formula;
+        formula << "=" << row;
+        sheet.setFormula(Address(1, row), formula.str());
+    }
+    sheet.setFormula(Address("D1"), "=10");
+    sheet.setFormula(Address("E1"), "=20");
+    sheet.setFormula(Address("F1"), "=30");
+
+    sheet.setFormula(Address("B1"), "=A1:A5*2");
+    sheet.setFormula(Address("H1"), "=A1:A3+D1:F1");
+    sheet.setFormula(Address("H5"), "=A1:A3>A2");
+    sheet.setFormula(Address("J5"), "=A1:A3-A1:A2");
+    sheet.recalculate();
+
+    EXPECT_EQ("2", sheet.getValue(Address("B1")));
+    EXPECT_EQ("6", sheet.getValue(Address("B3")));
+    EXPECT_EQ("10", sheet.getValue(Address("B5")));
+    EXPECT_EQ("", sheet.getValue(Address("B6")));
+    EXPECT_FALSE(sheet.isSet(Address("B5")));
+
+    // Operands with a single row or column are repeated to match the other
+    EXPECT_EQ("11", sheet.getValue(Address("H1")));
+    EXPECT_EQ("21", sheet.getValue(Address("I1")));
+    EXPECT_EQ("33", sheet.getValue(Address("J3")));
+
+    EXPECT_EQ("FALSE", sheet.getValue(Address("H5")));
+    EXPECT_EQ("TRUE", sheet.getValue(Address("H7")));
+    EXPECT_EQ("0", sheet.getValue(Address("J6")));
+    EXPECT_EQ("ERROR", sheet.getValue(Address("J7")));
+
+    sheet.setFormula(Address("A3"), "=-3");
+    sheet.recalculate();
+    EXPECT_EQ("-6", sheet.getValue(Address("B3")));
+    EXPECT_EQ("27", sheet.getValue(Address("J3")));
+}
+
+TEST_F(SheetTest, formulas_read_spilled_cells)
+{
+    Sheet sheet;
+    for (unsigned int row = 1; row <= 10; row++) {
+        stringstream value;
+        value << "=" << row;
+        sheet.setFormula(Address(1, row), value.str());
+
+        // A run of cells filled down, which read the array one cell each
+        stringstream reader;
+        reader << "=C" << row << "+100";
+        sheet.setFormula(Address(5, row), reader.str());
+    }
+
+    // Cells that read the array are recalculated after it, wherever they are
+    sheet.setFormula(Address("A20"), "=C3");
+    sheet.setFormula(Address("C1"), "=A1:A10*10");
+    sheet.setFormula(Address("F1"), "=SUM(C1:C10)");
+    sheet.setFormula(Address("F2"), "=SUM(C2:C4)");
+    sheet.setFormula(Address("F3"), "=COUNTIF(C1:C10, \">50\")");
+    sheet.recalculate();
+
+    EXPECT_EQ("30", sheet.getValue(Address("A20")));
+    EXPECT_EQ("110", sheet.getValue(Address("E1")));
+    EXPECT_EQ("200", sheet.getValue(Address("E10")));
+    EXPECT_EQ("550", sheet.getValue(Address("F1")));
+    EXPECT_EQ("90", sheet.getValue(Address("F2")));
+    EXPECT_EQ("5", sheet.getValue(Address("F3")));
+
+    sheet.setFormula(Address("A3"), "=0");
+    sheet.recalculate();
+    EXPECT_EQ("0", sheet.getValue(Address("A20")));
+    EXPECT_EQ("100", sheet.getValue(Address("E3")));
+    EXPECT_EQ("520", sheet.getValue(Address("F1")));
+    EXPECT_EQ("60", sheet.getValue(Address("F2")));
+
+    // Cells beyond a shrinking array are no longer spilled into
+    sheet.setFormula(Address("C1"), "=A1:A5*10");
+    sheet.recalculate();
+    EXPECT_EQ("", sheet.getValue(Address("C6")));
+    EXPECT_EQ("100", sheet.getValue(Address("E6")));
+    EXPECT_EQ("120", sheet.getValue(Address("F1")));
+
+    // An array cannot read the cells it spills into
+    sheet.setFormula(Address("C1"), "=A1:A5+C3");
+    EXPECT_THROW(sheet.recalculate(), runtime_error);
+}
+
+TEST_F(SheetTest, arrays_can_be_replaced_by_formulas_that_read_their_old_areas)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    sheet.setFormula(Address("A2"), "=2");
+    sheet.setFormula(Address("A3"), "=3");
+    sheet.setFormula(Address("C1"), "=A1:A3*10");
+    sheet.recalculate();
+    EXPECT_EQ("20", sheet.getValue(Address("C2")));
+
+    // The cell no longer holds an array, so the cell it reads is empty
+    sheet.setFormula(Address("C1"), "=C2+1");
+    sheet.recalculate();
+    EXPECT_EQ("1", sheet.getValue(Address("C1")));
+    EXPECT_EQ("", sheet.getValue(Address("C2")));
+    sheet.recalculate();
+    EXPECT_EQ("1", sheet.getValue(Address("C1")));
+
+    // An array that shrinks may read a cell that it no longer spills into
+    sheet.setFormula(Address("C1"), "=A1:A3*10");
+    sheet.recalculate();
+    sheet.setFormula(Address("C1"), "=A1:A2*10+SUM(C3)");
+    sheet.recalculate();
+    EXPECT_EQ("10", sheet.getValue(Address("C1")));
+    EXPECT_EQ("20", sheet.getValue(Address("C2")));
+    EXPECT_EQ("", sheet.getValue(Address("C3")));
+}
+
+TEST_F(SheetTest, arrays_cannot_spill_over_other_cells)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    sheet.setFormula(Address("A2"), "=2");
+    sheet.setFormula(Address("A3"), "=3");
+    sheet.setFormula(Address("D1"), "=A1:A3");
+    sheet.setFormula(Address("F1"), "=D2");
+    sheet.recalculate();
+    EXPECT_EQ("2", sheet.getValue(Address("F1")));
+
+    // A cell that has been set blocks the array, until it is erased
+    sheet.setFormula(Address("D3"), "'text");
+    sheet.recalculate();
+    EXPECT_EQ("ERROR", sheet.getValue(Address("D1")));
+    EXPECT_EQ("", sheet.getValue(Address("D2")));
+    EXPECT_EQ("text", sheet.getValue(Address("D3")));
+    EXPECT_EQ("", sheet.getValue(Address("F1")));
+
+    sheet.erase(Address("D3"));
+    sheet.recalculate();
+    EXPECT_EQ("1", sheet.getValue(Address("D1")));
+    EXPECT_EQ("3", sheet.getValue(Address("D3")));
+    EXPECT_EQ("2", sheet.getValue(Address("F1")));
+
+    // So does an array that spilled first, until it no longer overlaps
+    sheet.setFormula(Address("C3"), "=TRANSPOSE(A1:A3)");
+    sheet.recalculate();
+    EXPECT_EQ("ERROR", sheet.getValue(Address("C3")));
+    EXPECT_EQ("3", sheet.getValue(Address("D3")));
+    EXPECT_EQ("", sheet.getValue(Address("E3")));
+
+    sheet.setFormula(Address("D1"), "=A1:A2");
+    sheet.recalculate();
+    EXPECT_EQ("1", sheet.getValue(Address("C3")));
+    EXPECT_EQ("2", sheet.getValue(Address("D3")));
+    EXPECT_EQ("3", sheet.getValue(Address("E3")));
+    EXPECT_EQ("2", sheet.getValue(Address("F1")));
+}
@@ -0,0 +1,163 @@
+/*
+ * test/strings_test.cpp
+ *
+ * Copyright (c) 2012 Tristan Penman
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * This file is part of Inspect.
+ *
+ * Inspect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+#include "address.hpp"
+#include "sheet.hpp"
+#include "strings.hpp"
+
+using namespace std;
+
+class StringsTest : public testing::Test
+{
+
+};
+
+TEST_F(StringsTest, equal_strings_share_storage)
+{
+    StringPool pool;
+    const InternedString a = pool.intern("SUM");
+    const InternedString b = pool.intern(string("SUMIF").substr(0, 3));
+    const InternedString c = pool.intern("IF");
+
+    EXPECT_TRUE(a == b);
+    EXPECT_EQ(&a.str(), &b.str());
+    EXPECT_TRUE(a != c);
+    EXPECT_EQ("SUM", a.str());
+    EXPECT_EQ("IF", c.str());
+
+    EXPECT_TRUE(pool.intern("").empty());
+    EXPECT_TRUE(pool.intern("") == InternedString());
+    EXPECT_EQ("", InternedString().str());
+
+    const StringPoolStats stats = pool.getStats();
+    EXPECT_EQ(2u, stats.strings);
+    EXPECT_EQ(3u, stats.handles);
+    EXPECT_EQ(5u, stats.uniqueBytes);
+    EXPECT_EQ(3u, stats.getBytesSaved());
+}
+
+TEST_F(StringsTest, strings_are_removed_once_unreferenced)
+{
+    StringPool pool;
+    InternedString a = pool.intern("label");
+    {
+        const InternedString b = a;
+        const InternedString c = pool.intern("other");
+        EXPECT_EQ(2u, pool.getStats().strings);
+        EXPECT_EQ(3u, pool.getStats().handles);
+    }
+
+    EXPECT_EQ(1u, pool.getStats().strings);
+    a = InternedString();
+    EXPECT_EQ(0u, pool.getStats().strings);
+
+    // A string that has been removed is added again as a new entry
+    EXPECT_EQ("label", pool.intern("label").str());
+}
+
+TEST_F(StringsTest, handles_outlive_their_pool)
+{
+    InternedString a;
+    {
+        StringPool pool;
+        a = pool.intern("kept");
+    }
+
+    const InternedString b = a;
+    EXPECT_EQ("kept", b.str());
+    EXPECT_TRUE(a == b);
+}
+
+TEST_F(StringsTest, concurrent_interning_gives_one_copy)
+{
+    StringPool pool;
+    vector<vector<InternedString> > results(4);
+    vector<thread> threads;
+    for (size_t t = 0; t < results.size(); t++) {
+        threads.push_back(thread([&pool, &results, t]() {
+            for (int i = 0; i < 1000; i++) {
+                ostringstream s;
+                s << "label" << i % 100;
+                results[t].push_back(pool.intern(s.str()));
+                if (i % 3 == 0) {
+                    // Drop some handles, so that strings are removed and added again
+                    results[t].pop_back();
+                }
+            }
+        }));
+    }
+
+    for (vector<thread>::iterator itr = threads.begin(); itr != threads.end(); itr++) {
+        itr->join();
+    }
+
+    for (size_t t = 1; t < results.size(); t++) {
+        ASSERT_EQ(results[0].size(), results[t].size());
+        for (size_t i = 0; i < results[t].size(); i++) {
+            EXPECT_TRUE(results[0][i] == results[t][i]);
+        }
+    }
+
+    EXPECT_EQ(100u, pool.getStats().strings);
+}
+
+TEST_F(StringsTest, sheets_intern_formulas_and_literals)
+{
+    const string formula = "=IF(A1>0, \"positive\", \"negative\")";
+
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+    for (unsigned int row = 1; row <= 100; row++) {
+        sheet.setFormula(Address(2, row), formula);
+    }
+
+    sheet.recalculate();
+    EXPECT_EQ("positive", sheet.getValue(Address("B100")));
+
+    const StringPoolStats stats = sheet.getStringStats();
+    EXPECT_GE(stats.getBytesSaved(), 99 * (formula.size() + string("positive").size()));
+    EXPECT_LT(stats.strings, 10u);
+
+    // Forks share the pool of the sheet that they were forked from
+    unique_ptr<Sheet> pFork = sheet.fork();
+    pFork->setFormula(Address(2, 1), formula);
+    EXPECT_EQ(stats.strings, sheet.getStringStats().strings);
+
+    for (unsigned int row = 1; row <= 100; row++) {
+        sheet.erase(Address(2, row));
+        pFork->erase(Address(2, row));
+    }
+
+    sheet.erase(Address("A1"));
+    pFork->erase(Address("A1"));
+    EXPECT_EQ(0u, sheet.getStringStats().strings);
+}
@@ -0,0 +1,160 @@
+/*
+ * test/trace_test.cpp
+ *
+ * Copyright (c) 2012 Tristan Penman
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * This file is part of Inspect.
+ *
+ * Inspect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "gtest/gtest.h"
+
+#include "address.hpp"
+#include "sheet.hpp"
+#include "trace.hpp"
+
+using namespace std;
+
+class TraceTest : public testing::Test
+{
+protected:
+    virtual void TearDown()
+    {
+        Trace::stop();
+    }
+};
+
+TEST_F(TraceTest, disabled_by_default)
+{
+    EXPECT_FALSE(Trace::isEnabled());
+}
+
+TEST_F(TraceTest, records_parse_and_eval_spans_per_cell)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=B2*2");
+    sheet.setFormula(Address("B2"), "=1+1");
+
+    Trace::start();
+    sheet.recalculate();
+    Trace::stop();
+
+    stringstream ss;
+    // One recalculate span, plus a parse and eval span for each cell
+    EXPECT_EQ(5, Trace::write(ss));
+
+    const string json = ss.str();
+    EXPECT_EQ(0, json.find("{\"displayTimeUnit\":\"ns\",\"traceEvents\":["));
+    EXPECT_NE(string::npos, json.find("\"name\":\"parse B2\""));
+    EXPECT_NE(string::npos, json.find("\"name\":\"eval A1\""));
+    EXPECT_NE(string::npos, json.find("\"cat\":\"recalculate\""));
+
+    // A1 is evaluated first, and pulls in B2 from within its own eval span
+    EXPECT_NE(string::npos, json.find("\"cell\":\"B2\",\"depth\":2"));
+}
+
+TEST_F(TraceTest, nothing_recorded_after_stop)
+{
+    Sheet sheet;
+    sheet.setFormula(Address("A1"), "=1");
+
+    Trace::start();
+    Trace::stop();
+    sheet.recalculate();
+
+    stringstream ss;
+    EXPECT_EQ(0, Trace::write(ss));
+}
+
+TEST_F(TraceTest, ring_keeps_most_recent_events)
+{
+    Trace::start(4);
+    for (int i = 0; i < 10; i++) {
+        TraceSpan span("test");
+    }
+
+    stringstream ss;
+    EXPECT_EQ(4, Trace::write(ss));
+}
+
+TEST_F(TraceTest, threads_record_into_separate_rings)
+{
+    Trace::start();
+
+    thread other([]() {
+        TraceSpan span("other");
+    });
+    other.join();
+
+    {
+        TraceSpan span("main");
+    }
+
+    stringstream ss;
+    EXPECT_EQ(2, Trace::write(ss));
+
+    const string json = ss.str();
+    const size_t other_tid = json.find("\"tid\":", json.find("\"cat\":\"other\""));
+    const size_t main_tid = json.find("\"tid\":", json.find("\"cat\":\"main\""));
+    EXPECT_NE(json.substr(other_tid, 8), json.substr(main_tid, 8));
+}
+
+TEST_F(TraceTest, restarting_keeps_rings_that_threads_are_writing_to)
+{
+    Trace::start(16);
+
+    atomic<bool> running(true);
+    thread other([&running]() {
+        while (running.load()) {
+            TraceSpan outer("outer");
+            TraceSpan inner("inner");
+        }
+    });
+
+    // Each restart discards the rings while the other thread records spans
+    for (int i = 0; i < 1000; i++) {
+        Trace::start(16);
+    }
+
+    running.store(false);
+    other.join();
+
+    stringstream ss;
+    EXPECT_GE(16u, Trace::write(ss));
+}
+
+TEST_F(TraceTest, long_traces_keep_nanosecond_times)
+{
+    TraceEvent event;
+    event.category = "eval";
+    event.column = 0;
+    event.row = 0;
+    event.start = 1234567891234ull;
+    event.duration = 5;
+    event.depth = 0;
+
+    stringstream ss;
+    Trace::writeEvent(ss, event, 1);
+    const string json = ss.str();
+    EXPECT_NE(string::npos, json.find("\"ts\":1234567891.234,"));
+    EXPECT_NE(string::npos, json.find("\"dur\":0.005,"));
+}
@@ -0,0 +1,224 @@
+/*
+ * test/views_test.cpp
+ *
+ * Copyright (c) 2012 Tristan Penman
+ *
+ * ----------------------------------------------------------------------------
+ *
+ * This file is part of Inspect.
+ *
+ * Inspect is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published
+ * by the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "arrays.hpp"
+#include "ast.hpp"
+#include "lookup.hpp"
+#include "views.hpp"
+
+#include "gtest/gtest.h"
+
+using namespace std;
+
+class ViewsTest : public testing::Test
+{
+protected:
+    typedef map<Address, string> Cells;
+
+    /// Update a table from every cell that has been set
+    static void updateTable(LookupTable & table, const Cells & values)
+    {
+        vector<RangeCell> cells;
+        for (Cells::const_iterator itr = values.begin(); itr != values.end(); itr++) {
+            const RangeCell cell = {itr->first, Rope(itr->second)};
+            cells.push_back(cell);
+        }
+
+        table.update(cells);
+    }
+
+    static vector<string> getStrings(const Array & array)
+    {
+        vector<string> values;
+        for (size_t i = 0; i < array.values.size(); i++) {
+            values.push_back(array.values.getString(i).str());
+        }
+
+        return values;
+    }
+};
+
+TEST_F(ViewsTest, sorted_view_matches_a_full_sort_after_each_change)
+{
+    Cells cells;
+    unsigned seed = 7;
+    for (unsigned int row = 1; row <= 200; row++) {
+        seed = seed * 1103515245 + 12345;
+        cells[Address(1, row)] = to_string((seed >> 16) % 40);
+        cells[Address(2, row)] = to_string(row);
+    }
+
+    LookupTable table(Range("A1:B200"), false);
+    const vector<const LookupTable *> tables(1, &table);
+    SortedView view(0, true);
+    for (int pass = 0; pass < 60; pass++) {
+        // A few keys change in most passes, including to text and to empty,
+        // while every key changes in some, so the view is read again
+        const unsigned int changes = pass % 10 == 9 ? 200 : pass % 3 + 1;
+        for (unsigned int i = 0; i < changes; i++) {
+            seed = seed * 1103515245 + 12345;
+            const Address address(1, (seed >> 16) % 200 + 1);
+            const unsigned value = (seed >> 8) % 40;
+            if (value == 0) {
+                cells.erase(address);
+            } else if (value == 1) {
+                cells[address] = "x";
+            } else {
+                cells[address] = to_string(value);
+            }
+        }
+
+        updateTable(table, cells);
+        Array result;
+        view.update(tables, result);
+
+        Array array;
+        table.getArray(array);
+        vector<SortKey> keys(1);
+        readSortKey(array, 0, false, true, keys.front());
+        vector<size_t> order;
+        sortRows(keys, array.rows, 1, order);
+        Array expected;
+        selectRows(array, false, order, expected);
+
+        ASSERT_EQ(expected.rows, result.rows);
+        ASSERT_EQ(getStrings(expected), getStrings(result)) << "pass " << pass;
+    }
+}
+
+TEST_F(ViewsTest, grouped_view_keeps_totals_for_each_key)
+{
+    Cells keys;
+    Cells values;
+    keys[Address("A1")] = "b";
+    values[Address("B1")] = "3";
+    keys[Address("A2")] = "a";
+    values[Address("B2")] = "4";
+    keys[Address("A3")] = "b";
+    values[Address("B3")] = "-1";
+    keys[Address("A4")] = "2";
+    values[Address("B4")] = "x";
+    values[Address("B5")] = "100";
+
+    LookupTable keyTable(Range("A1:A5"), false);
+    LookupTable valueTable(Range("B1:B5"), false);
+    vector<const LookupTable *> tables;
+    tables.push_back(&keyTable);
+    tables.push_back(&valueTable);
+
+    GroupedView sum(GroupedView::FUNCTION_SUM);
+    GroupedView count(GroupedView::FUNCTION_COUNT);
+    GroupedView min(GroupedView::FUNCTION_MIN);
+    GroupedView max(GroupedView::FUNCTION_MAX);
+    Array result;
+
+    // Numbers come first, and rows without keys are left out
+    updateTable(keyTable, keys);
+    updateTable(valueTable, values);
+    sum.update(tables, result);
+    const char * const sums[] = {"2", "0", "a", "4", "b", "2"};
+    EXPECT_EQ(vector<string>(sums, sums + 6), getStrings(result));
+    count.update(tables, result);
+    const char * const counts[] = {"2", "1", "a", "1", "b", "2"};
+    EXPECT_EQ(vector<string>(counts, counts + 6), getStrings(result));
+    min.update(tables, result);
+    EXPECT_EQ("-1", result.values.getString(5).str());
+    max.update(tables, result);
+    EXPECT_EQ("3", result.values.getString(5).str());
+
+    // Moving the only row of a group removes the group
+    keys[Address("A2")] = "b";
+    values[Address("B3")] = "7";
+    updateTable(keyTable, keys);
+    updateTable(valueTable, values);
+    EXPECT_NE(0, keyTable.getPreviousVersion());
+    EXPECT_NE(0, valueTable.getPreviousVersion());
+    sum.update(tables, result);
+    const char * const movedSums[] = {"2", "0", "b", "14"};
+    EXPECT_EQ(vector<string>(movedSums, movedSums + 4), getStrings(result));
+
+    // A key that is set joins its row to a group
+    keys[Address("A5")] = "c";
+    updateTable(keyTable, keys);
+    EXPECT_NE(0, keyTable.getPreviousVersion());
+    sum.update(tables, result);
+    const char * const newSums[] = {"2", "0", "b", "14", "c", "100"};
+    EXPECT_EQ(vector<string>(newSums, newSums + 6), getStrings(result));
+    count.update(tables, result);
+    EXPECT_EQ("3", result.values.getString(3).str());
+    min.update(tables, result);
+    EXPECT_EQ("3", result.values.getString(3).str());
+    max.update(tables, result);
+    EXPECT_EQ("7", result.values.getString(3).str());
+
+    // A view that missed an update reads every cell again
+    values[Address("B1")] = "5";
+    updateTable(valueTable, values);
+    values[Address("B1")] = "6";
+    updateTable(valueTable, values);
+    sum.update(tables, result);
+    EXPECT_EQ("17", result.values.getString(3).str());
+    keys.clear();
+    updateTable(keyTable, keys);
+    sum.update(tables, result);
+    EXPECT_EQ(0, result.rows);
+}
+
+TEST_F(ViewsTest, grouped_sums_match_sums_added_up_afresh)
+{
+    Cells keys;
+    Cells values;
+    for (unsigned int row = 1; row <= 20; row++) {
+        keys[Address(1, row)] = "a";
+        values[Address(2, row)] = row == 1 ? "1e20" : row % 2 ? "0.1" : "1";
+    }
+
+    LookupTable keyTable(Range("A1:A20"), false);
+    LookupTable valueTable(Range("B1:B20"), false);
+    vector<const LookupTable *> tables;
+    tables.push_back(&keyTable);
+    tables.push_back(&valueTable);
+    updateTable(keyTable, keys);
+    updateTable(valueTable, values);
+
+    GroupedView sum(GroupedView::FUNCTION_SUM);
+    Array result;
+    sum.update(tables, result);
+    EXPECT_EQ("1e+20", result.values.getString(1).str());
+
+    // Taking away a large number leaves the small numbers it absorbed
+    values[Address("B1")] = "0";
+    updateTable(valueTable, values);
+    EXPECT_NE(0, valueTable.getPreviousVersion());
+    sum.update(tables, result);
+
+    GroupedView fresh(GroupedView::FUNCTION_SUM);
+    Array expected;
+    fresh.update(tables, expected);
+    EXPECT_EQ(getStrings(expected), getStrings(result));
+    EXPECT_EQ("10.9", result.values.getString(1).str());
+}